@@ -35,6 +35,11 @@ then
   export ENABLE_LUA="ON"
 fi
 
+if [ -z "${ENABLE_ZLIB+x}" ]
+then
+  export ENABLE_ZLIB="ON"
+fi
+
 #save startpath
 STARTPATH=$(pwd)
 
@@ -352,7 +357,7 @@ buildrelease() {
   export INSTALL_PREFIX="${MYMPD_INSTALL_PREFIX:-/usr}"
   cmake -DCMAKE_INSTALL_PREFIX:PATH="$INSTALL_PREFIX" -DCMAKE_BUILD_TYPE=RELEASE \
   	-DENABLE_SSL="$ENABLE_SSL" -DENABLE_LIBID3TAG="$ENABLE_LIBID3TAG" \
-  	-DENABLE_FLAC="$ENABLE_FLAC" -DENABLE_LUA="$ENABLE_LUA" ..
+  	-DENABLE_FLAC="$ENABLE_FLAC" -DENABLE_LUA="$ENABLE_LUA" -DENABLE_ZLIB="$ENABLE_ZLIB" ..
   make
 }
 
@@ -416,7 +421,7 @@ builddebug() {
   cd debug || exit 1
   cmake -DCMAKE_INSTALL_PREFIX:PATH=/usr -DCMAKE_BUILD_TYPE=DEBUG -DMEMCHECK="$MEMCHECK" \
   	-DENABLE_SSL="$ENABLE_SSL" -DENABLE_LIBID3TAG="$ENABLE_LIBID3TAG" -DENABLE_FLAC="$ENABLE_FLAC" \
-  	-DENABLE_LUA="$ENABLE_LUA" -DCMAKE_EXPORT_COMPILE_COMMANDS=ON ..
+  	-DENABLE_LUA="$ENABLE_LUA" -DENABLE_ZLIB="$ENABLE_ZLIB" -DCMAKE_EXPORT_COMPILE_COMMANDS=ON ..
   make VERBOSE=1
   echo "Linking compilation database"
   sed -e 's/\\t/ /g' -e 's/-Wformat-overflow=2//g' -e 's/-fsanitize=bounds-strict//g' -e 's/-static-libasan//g' compile_commands.json > ../src/compile_commands.json
@@ -732,26 +737,26 @@ installdeps() {
     apt-get update
     apt-get install -y --no-install-recommends \
 	gcc cmake perl libssl-dev libid3tag0-dev libflac-dev \
-	build-essential liblua5.3-dev pkg-config libpcre3-dev
+	build-essential liblua5.3-dev pkg-config libpcre3-dev zlib1g-dev
   elif [ -f /etc/arch-release ]
   then
     #arch
-    pacman -S gcc cmake perl openssl libid3tag flac lua pkgconf pcre
+    pacman -S gcc cmake perl openssl libid3tag flac lua pkgconf pcre zlib
   elif [ -f /etc/alpine-release ]
   then
     #alpine
     apk add cmake perl openssl-dev libid3tag-dev flac-dev lua5.3-dev \
-    	alpine-sdk linux-headers pkgconf pcre-dev
+    	alpine-sdk linux-headers pkgconf pcre-dev zlib-dev
   elif [ -f /etc/SuSE-release ]
   then
     #suse
     zypper install gcc cmake pkgconfig perl openssl-devel libid3tag-devel flac-devel \
-	lua-devel unzip pcre-devel
+	lua-devel unzip pcre-devel zlib-devel
   elif [ -f /etc/redhat-release ]
   then  
     #fedora 	
     yum install gcc cmake pkgconfig perl openssl-devel libid3tag-devel flac-devel \
-	lua-devel unzip pcre-devel
+	lua-devel unzip pcre-devel zlib-devel
   else 
     echo "Unsupported distribution detected."
     echo "You should manually install:"
@@ -763,6 +768,7 @@ installdeps() {
     echo "  - libid3tag (devel)"
     echo "  - lua53 (devel)"
     echo "  - libpcre3 (devel)"
+    echo "  - zlib (devel)"
   fi
 }
 
@@ -1157,6 +1163,7 @@ case "$ACTION" in
 	  echo "  - ENABLE_LIBID3TAG=\"ON\""
 	  echo "  - ENABLE_FLAC=\"ON\""
 	  echo "  - ENABLE_LUA=\"ON\""
+	  echo "  - ENABLE_ZLIB=\"ON\""
 	  echo "  - MANPAGES=\"ON\""
 	  echo ""
 	;;
@@ -20,6 +20,7 @@ BuildRequires:  pkgconfig
 BuildRequires:  openssl-devel
 BuildRequires:  libid3tag-devel
 BuildRequires:	flac-devel
+BuildRequires:	zlib-devel
 BuildRequires:  lua-devel
 BuildRequires:  pcre-devel
 BuildRoot:      %{_tmppath}/%{name}-%{version}-build
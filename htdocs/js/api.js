@@ -4,16 +4,38 @@
 // https://github.com/jcorporation/mympd
 
 var ignoreMessages = ['No current song', 'No lyrics found'];
+//cached responses with an etag, key: method and params
+var apiCache = {};
+var apiCacheSize = 30;
 
-function sendAPI(method, params, callback, onerror) {
+function sendAPI(method, params, callback, onerror, noCache) {
     let request = {"jsonrpc": "2.0", "id": 0, "method": method, "params": params};
+    let cacheKey = method + JSON.stringify(params);
     let ajaxRequest=new XMLHttpRequest();
     ajaxRequest.open('POST', subdir + '/api', true);
     ajaxRequest.setRequestHeader('Content-type', 'application/json');
+    let etag = null;
+    if (apiCache[cacheKey] !== undefined && noCache !== true) {
+        etag = apiCache[cacheKey].etag;
+        ajaxRequest.setRequestHeader('If-None-Match', etag);
+    }
     ajaxRequest.onreadystatechange = function() {
         if (ajaxRequest.readyState === 4) {
             if (ajaxRequest.responseText !== '') {
                 let obj = JSON.parse(ajaxRequest.responseText);
+                if (obj.result && obj.result.notModified === true) {
+                    if (apiCache[cacheKey] === undefined || apiCache[cacheKey].etag !== etag) {
+                        //the cached response was evicted or replaced while the request was pending
+                        logDebug('Cached response for ' + method + ' is gone, fetching it again');
+                        sendAPI(method, params, callback, onerror, true);
+                        return;
+                    }
+                    logDebug('Using cached response for ' + method);
+                    obj = JSON.parse(apiCache[cacheKey].response);
+                }
+                else {
+                    cacheApiResponse(cacheKey, ajaxRequest);
+                }
                 if (obj.error) {
                     showNotification(t(obj.error.message, obj.error.data), '', '', 'danger');
                     logError(JSON.stringify(obj.error));
@@ -61,6 +83,19 @@ function sendAPI(method, params, callback, onerror) {
     logDebug('Send API request: ' + method);
 }
 
+function cacheApiResponse(cacheKey, ajaxRequest) {
+    const etag = ajaxRequest.getResponseHeader('ETag');
+    if (etag === null) {
+        delete apiCache[cacheKey];
+        return;
+    }
+    const keys = Object.keys(apiCache);
+    if (keys.length >= apiCacheSize && apiCache[cacheKey] === undefined) {
+        delete apiCache[keys[0]];
+    }
+    apiCache[cacheKey] = {"etag": etag, "response": ajaxRequest.responseText};
+}
+
 function webSocketConnect() {
     if (socket !== null && socket.readyState === WebSocket.OPEN) {
         logInfo('Socket already connected');
@@ -128,6 +163,12 @@ function webSocketConnect() {
                     appRoute();
                     sendAPI("MPD_API_PLAYER_STATE", {}, parseState, true);
                     break;
+                case 'resync':
+                    //notifications were dropped, reload all
+                    getSettings(true);
+                    appRoute();
+                    sendAPI("MPD_API_PLAYER_STATE", {}, parseState);
+                    break;
                 case 'update_state':
                     obj.result = obj.params;
                     parseState(obj);
@@ -144,17 +185,31 @@ function webSocketConnect() {
                     getSettings(true);
                     break;
                 case 'update_queue':
-                    if (app.current.app === 'Queue') {
+                    if (queueChanged(obj.params) === true && app.current.app === 'Queue') {
                         getQueue();
                     }
                     obj.result = obj.params;
                     parseUpdateQueue(obj);
                     break;
                 case 'update_options':
-                    getSettings();
+                    if (obj.params.mpdConnected !== undefined) {
+                        //notify includes the mpd settings
+                        obj.result = obj.params;
+                        parseUpdateOptions(obj);
+                    }
+                    else {
+                        getSettings();
+                    }
                     break;
                 case 'update_outputs':
-                    sendAPI("MPD_API_PLAYER_OUTPUT_LIST", {}, parseOutputs);
+                    if (obj.params.data !== undefined) {
+                        //notify includes the outputs
+                        obj.result = obj.params;
+                        parseOutputs(obj);
+                    }
+                    else {
+                        sendAPI("MPD_API_PLAYER_OUTPUT_LIST", {}, parseOutputs);
+                    }
                     break;
                 case 'update_started':
                     updateDBstarted(false);
@@ -186,6 +241,9 @@ function webSocketConnect() {
                         sendAPI("MPD_API_JUKEBOX_LIST", {"offset": app.current.offset, "limit": app.current.limit, "cols": settings.colsQueueJukebox}, parseJukeboxList);
                     }
                     break;
+                case 'update_coverprefetch':
+                    parseCoverprefetch(obj);
+                    break;
                 case 'error':
                     if (document.getElementById('alertMpdState').classList.contains('hide')) {
                         showNotification(t(obj.params.message), '', '', 'danger');
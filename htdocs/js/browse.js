@@ -3,6 +3,16 @@
 // myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
 // https://github.com/jcorporation/mympd
 
+var albumartBatch = [];
+var albumartBatchTimer = null;
+//covers of batch responses are kept as object urls and in the cache storage,
+//browsers do not cache POST responses
+var albumartObjectUrls = new Map();
+const albumartObjectUrlsMax = 500;
+const albumartCacheName = 'mympd-albumart';
+//same lifetime as the cache header of single /albumart responses
+const albumartCacheMaxAge = 604800;
+
 function initBrowse() {
     document.getElementById('BrowseDatabaseListList').addEventListener('click', function(event) {
         if (app.current.tag === 'Album') {
@@ -532,6 +542,8 @@ function parseDatabase(obj) {
     if (cols.length === 0) {
         cardContainer.innerHTML = '';
     }
+    //pending batch entries of replaced cards are obsolete
+    albumartBatch = [];
     for (let i = 0; i < nrItems; i++) {
         let col = document.createElement('div');
         col.classList.add('col', 'px-0', 'flex-grow-0');
@@ -614,12 +626,139 @@ function setGridImage(changes, observer) {
             const uri = getAttDec(change.target.firstChild, 'data-picture');
             const body = change.target.firstChild.getElementsByClassName('card-body')[0];
             if (body) {
-                body.style.backgroundImage = 'url("' + uri + '"), url("' + subdir + '/assets/coverimage-loading.svg")';
+                const albumartPrefix = subdir + '/albumart/';
+                if (uri.indexOf(albumartPrefix) === 0) {
+                    setCachedAlbumart(body, uri.substring(albumartPrefix.length));
+                }
+                else {
+                    body.style.backgroundImage = 'url("' + uri + '"), url("' + subdir + '/assets/coverimage-loading.svg")';
+                }
             }
         }
     });
 }
 
+function setCachedAlbumart(el, uri) {
+    const objectUrl = albumartObjectUrls.get(uri);
+    if (objectUrl !== undefined) {
+        //move to the end of the eviction order
+        albumartObjectUrls.delete(uri);
+        albumartObjectUrls.set(uri, objectUrl);
+        el.style.backgroundImage = 'url("' + objectUrl + '")';
+        return;
+    }
+    if ('caches' in window === false) {
+        queueAlbumartBatch(el, uri);
+        return;
+    }
+    caches.open(albumartCacheName).then(function(cache) {
+        return cache.match(subdir + '/albumart/' + uri);
+    }).then(function(response) {
+        if (response && Date.now() - Date.parse(response.headers.get('Date')) < albumartCacheMaxAge * 1000) {
+            return response.blob();
+        }
+        return null;
+    }).then(function(blob) {
+        if (blob !== null) {
+            el.style.backgroundImage = 'url("' + addAlbumartObjectUrl(uri, blob) + '")';
+        }
+        else {
+            queueAlbumartBatch(el, uri);
+        }
+    }).catch(function() {
+        queueAlbumartBatch(el, uri);
+    });
+}
+
+function queueAlbumartBatch(el, uri) {
+    //album covers are fetched in batches
+    albumartBatch.push({"el": el, "uri": uri});
+    if (albumartBatchTimer === null) {
+        albumartBatchTimer = setTimeout(getAlbumartBatch, 10);
+    }
+}
+
+function addAlbumartObjectUrl(uri, blob) {
+    const oldUrl = albumartObjectUrls.get(uri);
+    if (oldUrl !== undefined) {
+        URL.revokeObjectURL(oldUrl);
+        albumartObjectUrls.delete(uri);
+    }
+    const objectUrl = URL.createObjectURL(blob);
+    albumartObjectUrls.set(uri, objectUrl);
+    if (albumartObjectUrls.size > albumartObjectUrlsMax) {
+        //maps are iterated in insertion order, the first entry is the least recently used
+        const oldest = albumartObjectUrls.keys().next().value;
+        URL.revokeObjectURL(albumartObjectUrls.get(oldest));
+        albumartObjectUrls.delete(oldest);
+    }
+    return objectUrl;
+}
+
+function storeAlbumart(uri, blob) {
+    if ('caches' in window === false) {
+        return;
+    }
+    caches.open(albumartCacheName).then(function(cache) {
+        return cache.put(subdir + '/albumart/' + uri, new Response(blob, {"headers": {
+            "Content-Type": blob.type,
+            "Date": new Date().toUTCString()
+        }}));
+    }).catch(function(error) {
+        logDebug('Can not store cover in cache: ' + error);
+    });
+}
+
+function getAlbumartBatch() {
+    //the server accepts 100 uris per request
+    const batch = albumartBatch.splice(0, 100);
+    albumartBatchTimer = albumartBatch.length > 0 ? setTimeout(getAlbumartBatch, 10) : null;
+    if (batch.length === 0) {
+        return;
+    }
+    let uris = [];
+    for (let i = 0; i < batch.length; i++) {
+        uris.push(batch[i].uri);
+    }
+    let ajaxRequest = new XMLHttpRequest();
+    ajaxRequest.open('POST', subdir + '/albumart-batch', true);
+    ajaxRequest.setRequestHeader('Content-type', 'application/json');
+    ajaxRequest.responseType = 'arraybuffer';
+    ajaxRequest.onreadystatechange = function() {
+        if (ajaxRequest.readyState !== 4) {
+            return;
+        }
+        const buffer = ajaxRequest.status === 200 ? ajaxRequest.response : null;
+        const view = buffer !== null ? new DataView(buffer) : null;
+        const decoder = new TextDecoder();
+        let pos = 0;
+        for (let i = 0; i < batch.length; i++) {
+            let objectUrl = '';
+            if (view !== null && pos + 4 <= buffer.byteLength) {
+                const mimeLen = view.getUint32(pos);
+                const mimeType = decoder.decode(new Uint8Array(buffer, pos + 4, mimeLen));
+                pos += 4 + mimeLen;
+                const len = view.getUint32(pos);
+                pos += 4;
+                if (len > 0) {
+                    const blob = new Blob([new Uint8Array(buffer, pos, len)], {type: mimeType});
+                    objectUrl = addAlbumartObjectUrl(batch[i].uri, blob);
+                    storeAlbumart(batch[i].uri, blob);
+                    pos += len;
+                }
+            }
+            if (objectUrl !== '') {
+                batch[i].el.style.backgroundImage = 'url("' + objectUrl + '")';
+            }
+            else {
+                //cover is not available locally, fallback to single request
+                batch[i].el.style.backgroundImage = 'url("' + subdir + '/albumart/' + batch[i].uri + '"), url("' + subdir + '/assets/coverimage-loading.svg")';
+            }
+        }
+    };
+    ajaxRequest.send(JSON.stringify({"uris": uris}));
+}
+
 function addPlayButton(parentEl) {
     const div = document.createElement('div');
     div.classList.add('align-self-end', 'album-grid-mouseover', 'mi', 'rounded-circle', 'clickable');
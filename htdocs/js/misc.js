@@ -98,6 +98,18 @@ function cropCovercache() {
     sendAPI("MYMPD_API_COVERCACHE_CROP", {});
 }
 
+//eslint-disable-next-line no-unused-vars
+function toggleCoverprefetch() {
+    sendAPI(coverprefetchRunning === true ? "MPDWORKER_API_COVERPREFETCH_STOP" : "MPDWORKER_API_COVERPREFETCH_START", {});
+}
+
+function parseCoverprefetch(obj) {
+    coverprefetchRunning = obj.params.running;
+    document.getElementById('btnCoverprefetch').textContent = t(coverprefetchRunning === true ? 'Stop' : 'Start');
+    document.getElementById('coverprefetchState').textContent = obj.params.total > 0 ?
+        t('%{pos} of %{total} albums, %{fetched} covers fetched', obj.params) : '';
+}
+
 //eslint-disable-next-line no-unused-vars
 function updateDB(uri, showModal) {
     sendAPI("MPD_API_DATABASE_UPDATE", {"uri": uri});
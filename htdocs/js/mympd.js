@@ -14,6 +14,8 @@ var lastState;
 var currentSong = {};
 var playstate = '';
 var settingsLock = false;
+var lastQueueLength = -1;
+var coverprefetchRunning = false;
 var settingsParsed = false;
 var settingsNew = {};
 var settings = {};
@@ -79,6 +79,18 @@ function initQueue() {
     });
 }
 
+//checks if the displayed page is affected by the changes in the update_queue notify
+function queueChanged(params) {
+    let changed = true;
+    if (params.changedFrom !== undefined && params.changedFrom > -1 && app.current.search.length < 2 &&
+        params.queueLength === lastQueueLength)
+    {
+        changed = params.changedFrom < app.current.offset + app.current.limit;
+    }
+    lastQueueLength = params.queueLength;
+    return changed;
+}
+
 function parseUpdateQueue(obj) {
     //Set playstate
     if (obj.result.state === 1) {
@@ -227,6 +227,18 @@ function joinSettings(obj) {
     btnWaiting(document.getElementById('btnApplySettings'), false);
 }
 
+function parseUpdateOptions(obj) {
+    if (settingsLock === true) {
+        //settings are fetched, the response includes this changes
+        return;
+    }
+    for (let key in obj.result) {
+        settings[key] = obj.result[key];
+    }
+    parseSettings();
+    toggleUI();
+}
+
 function parseUrlhandlers(obj) {
     let storagePlugins = '';
     for (let i = 0; i < obj.result.data.length; i++) {
@@ -452,11 +464,18 @@ function parseSettings() {
     }
     if (settings.readonly === true) {
         disableEl('btnBookmarks');
-        document.getElementsByClassName('groupClearCovercache')[0].classList.add('hide');
     }
     else {
         enableEl('btnBookmarks');
-        document.getElementsByClassName('groupClearCovercache')[0].classList.remove('hide');
+    }
+    const covercacheEls = document.getElementsByClassName('groupClearCovercache');
+    for (let i = 0; i < covercacheEls.length; i++) {
+        if (settings.readonly === true) {
+            covercacheEls[i].classList.add('hide');
+        }
+        else {
+            covercacheEls[i].classList.remove('hide');
+        }
     }
     
     let timerActions = '<optgroup data-value="player" label="' + t('Playback') + '">' +
@@ -23,6 +23,7 @@ var ignoreRequests = new RegExp('(' + [
   subdir + '/ca.crt',
   subdir + '/ws',
   subdir + '/tagpics/(.*)',
+  subdir + '/albumart-batch',
   subdir + '/albumart/(.*)',
   subdir + '/browse/(.*)'].join('(/?)|\\') + ')$');
 
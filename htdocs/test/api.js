@@ -38,6 +38,9 @@ var cmds = [
     {"jsonrpc":"2.0","id":0,"method":"MPD_API_PLAYLIST_SORT", "params":{"uri":"","tag":""}},
     {"jsonrpc":"2.0","id":0,"method":"MPDWORKER_API_SMARTPLS_UPDATE_ALL", "params":{"force":false}},
     {"jsonrpc":"2.0","id":0,"method":"MPDWORKER_API_SMARTPLS_UPDATE", "params":{"playlist":""}},
+    {"jsonrpc":"2.0","id":0,"method":"MPDWORKER_API_SMARTPLS_STATUS", "params":{}},
+    {"jsonrpc":"2.0","id":0,"method":"MPDWORKER_API_COVERPREFETCH_START", "params":{}},
+    {"jsonrpc":"2.0","id":0,"method":"MPDWORKER_API_COVERPREFETCH_STOP", "params":{}},
     {"jsonrpc":"2.0","id":0,"method":"MPD_API_SMARTPLS_SAVE","params":{"type":"","playlist":"","timerange":0,"sort":""}},
     {"jsonrpc":"2.0","id":0,"method":"MPD_API_SMARTPLS_GET","params":{"playlist":""}},
     {"jsonrpc":"2.0","id":0,"method":"MPD_API_DATABASE_SEARCH_ADV","params":{"offset":0,"limit":100,"expression":"(any contains '"+""+"')","sort":"", "sortdesc":false,"plist":"","cols":[""],"replace":false}},
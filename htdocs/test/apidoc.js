@@ -157,6 +157,12 @@ desc['MPDWORKER_API_SMARTPLS_UPDATE'] = 'Updates the smart playlists.' +
     '<ul>' +
     '<li>playlist: playlist to update</li>' +
     '</ul>';
+desc['MPDWORKER_API_SMARTPLS_STATUS'] = 'Lists the update state of the smart playlists: ' +
+    'dependencies, dirty flag, priority, time and cost in ms of the last build and number of entries.';
+desc['MPDWORKER_API_COVERPREFETCH_START'] = 'Starts or resumes fetching the covers of all albums into the covercache. ' +
+    'The job runs in the background and pauses while other requests are queued, ' +
+    'the progress is sent with the update_coverprefetch notification.';
+desc['MPDWORKER_API_COVERPREFETCH_STOP'] = 'Stops the cover prefetch job, it resumes after the last fetched album.';
 
 let tbody = document.getElementsByTagName('tbody')[0];
 for (let i = 0; i < cmds.length; i++) {
@@ -32,8 +32,83 @@ bool is_public_api_method(enum mympd_cmd_ids cmd_id) {
         case MYMPD_API_SCRIPT_POST_EXECUTE:
         case MYMPD_API_STATE_SAVE:
         case MPD_API_STATE_SAVE:
+        case MPD_API_BATCH:
             return false;
         default:
             return true;
     }
 }
+
+//methods with binary transfers, they are handled by the mpd_binary thread
+bool is_mpd_binary_api_method(enum mympd_cmd_ids cmd_id) {
+    switch(cmd_id) {
+        case MPD_API_ALBUMART:
+        case MPD_API_DATABASE_FINGERPRINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_coalesce_api_method(enum mympd_cmd_ids cmd_id) {
+    switch(cmd_id) {
+        case MPD_API_PLAYER_STATE:
+        case MPD_API_PLAYER_CURRENT_SONG:
+        case MPD_API_PLAYER_OUTPUT_LIST:
+        case MPD_API_PLAYER_VOLUME_GET:
+        case MPD_API_QUEUE_LIST:
+        case MPD_API_QUEUE_LAST_PLAYED:
+        case MPD_API_JUKEBOX_LIST:
+        case MPD_API_SETTINGS_GET:
+        case MPD_API_DATABASE_STATS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//bitmask of the generations the response depends on, 0 if it can not be cached
+unsigned get_api_generations(enum mympd_cmd_ids cmd_id) {
+    switch(cmd_id) {
+        case MPD_API_DATABASE_TAG_LIST:
+        case MPD_API_DATABASE_TAG_ALBUM_TITLE_LIST:
+        case MPD_API_DATABASE_GET_ALBUMS:
+            //MPD_API_DATABASE_STATS is not cacheable, playtime and uptime change constantly
+            return 1 << GENERATION_DATABASE;
+        case MPD_API_DATABASE_FILESYSTEM_LIST:
+        case MPD_API_PLAYLIST_LIST:
+        case MPD_API_PLAYLIST_CONTENT_LIST:
+            return (1 << GENERATION_DATABASE) | (1 << GENERATION_PLAYLISTS);
+        case MPD_API_QUEUE_LIST:
+            return (1 << GENERATION_DATABASE) | (1 << GENERATION_QUEUE);
+        case MPD_API_SETTINGS_GET:
+        case MYMPD_API_SETTINGS_GET:
+            return 1 << GENERATION_SETTINGS;
+        default:
+            return 0;
+    }
+}
+
+bool is_mpd_client_pool_api_method(enum mympd_cmd_ids cmd_id) {
+    switch(cmd_id) {
+        case MPD_API_DATABASE_FILESYSTEM_LIST:
+        case MPD_API_DATABASE_TAG_LIST:
+        case MPD_API_DATABASE_TAG_ALBUM_TITLE_LIST:
+        case MPD_API_DATABASE_SEARCH:
+        case MPD_API_DATABASE_SEARCH_ADV:
+        case MPD_API_PLAYLIST_LIST:
+        case MPD_API_PLAYLIST_CONTENT_LIST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//methods that can be sent in a batch, they are handled by the mpd_client thread
+bool is_batch_api_method(enum mympd_cmd_ids cmd_id) {
+    const char * mympd_cmd_strs[] = { MYMPD_CMDS(GEN_STR) };
+    if (is_public_api_method(cmd_id) == false || is_mpd_binary_api_method(cmd_id) == true) {
+        return false;
+    }
+    return strncmp(mympd_cmd_strs[cmd_id], "MPD_API_", 8) == 0 ? true : false;
+}
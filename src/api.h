@@ -42,7 +42,10 @@
     X(MPD_API_PLAYLIST_SORT) \
     X(MPDWORKER_API_SMARTPLS_UPDATE_ALL) \
     X(MPDWORKER_API_SMARTPLS_UPDATE) \
+    X(MPDWORKER_API_SMARTPLS_STATUS) \
     X(MPDWORKER_API_CACHES_CREATE) \
+    X(MPDWORKER_API_COVERPREFETCH_START) \
+    X(MPDWORKER_API_COVERPREFETCH_STOP) \
     X(MPD_API_STICKERCACHE_CREATED) \
     X(MPD_API_ALBUMCACHE_CREATED) \
     X(MPD_API_SMARTPLS_SAVE) \
@@ -97,6 +100,7 @@
     X(MPD_API_JUKEBOX_LIST) \
     X(MPD_API_JUKEBOX_RM) \
     X(MPD_API_STATE_SAVE) \
+    X(MPD_API_BATCH) \
     X(MPD_API_LYRICS_UNSYNCED_GET) \
     X(MPD_API_LYRICS_SYNCED_GET) \
     X(MPD_API_LYRICS_GET) \
@@ -141,7 +145,21 @@ enum mympd_cmd_ids {
     MYMPD_CMDS(GEN_ENUM)
 };
 
+//generation counters for cacheable api responses
+enum api_generations {
+    GENERATION_DATABASE = 0,
+    GENERATION_QUEUE,
+    GENERATION_PLAYLISTS,
+    GENERATION_SETTINGS,
+    GENERATION_MAX
+};
+
 //global functions
 enum mympd_cmd_ids get_cmd_id(const char *cmd);
 bool is_public_api_method(enum mympd_cmd_ids cmd_id);
+bool is_mpd_binary_api_method(enum mympd_cmd_ids cmd_id);
+bool is_mpd_client_pool_api_method(enum mympd_cmd_ids cmd_id);
+bool is_coalesce_api_method(enum mympd_cmd_ids cmd_id);
+bool is_batch_api_method(enum mympd_cmd_ids cmd_id);
+unsigned get_api_generations(enum mympd_cmd_ids cmd_id);
 #endif
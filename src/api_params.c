@@ -0,0 +1,327 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "../dist/src/frozen/frozen.h"
+#include "api_params.h"
+
+//The body of an api request is walked once. The members of the top-level
+//object and of the params object are saved in a table, the handlers read
+//them with typed accessors instead of scanning the body again.
+
+struct t_api_params_walk {
+    t_api_params *params;
+    unsigned tokens;
+    //names of objects and arrays that are not finished
+    struct json_token pending_top;
+    struct json_token pending_params;
+};
+
+struct t_api_params_batch_walk {
+    struct json_token *elements;
+    int max;
+    int count;
+    unsigned tokens;
+};
+
+//private definitions
+static void api_params_batch_cb(void *callback_data, const char *name, size_t name_len, const char *path,
+                                const struct json_token *token);
+static void api_params_walk_cb(void *callback_data, const char *name, size_t name_len, const char *path,
+                               const struct json_token *token);
+static void api_params_add(t_api_params *params, const struct json_token *key, const struct json_token *value,
+                           bool in_params);
+static unsigned api_params_depth(const char *path);
+static bool api_params_check_depth(const char *data, int len);
+static const struct json_token *api_params_find(t_api_params *params, const char *key, bool in_params);
+static bool api_params_token_long(const struct json_token *token, long *value);
+
+//public functions
+
+//returns a table with valid == false if the body is not a valid json object
+t_api_params *api_params_parse(const char *data, int len) {
+    t_api_params *params = (t_api_params *)malloc(sizeof(t_api_params));
+    assert(params);
+    params->valid = false;
+    params->count = 0;
+    params->capacity = 0;
+    params->entries = NULL;
+    struct t_api_params_walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.params = params;
+    //skip leading whitespace, the body must be an object
+    int i = 0;
+    while (i < len && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n')) {
+        i++;
+    }
+    if (i == len || data[i] != '{') {
+        return params;
+    }
+    //the json parser is recursive
+    if (api_params_check_depth(data, len) == false) {
+        return params;
+    }
+    int rc = json_walk(data, len, api_params_walk_cb, &walk);
+    if (rc > 0 && walk.tokens <= API_PARAMS_MAX_TOKENS) {
+        params->valid = true;
+    }
+    else {
+        params->count = 0;
+    }
+    return params;
+}
+
+void api_params_free(t_api_params *params) {
+    if (params == NULL) {
+        return;
+    }
+    free(params->entries);
+    free(params);
+}
+
+bool api_params_validate(const char *data, int len) {
+    t_api_params *params = api_params_parse(data, len);
+    bool valid = params->valid;
+    api_params_free(params);
+    return valid;
+}
+
+//splits a json-rpc batch into its elements,
+//returns -1 if the body is not an array or has more than max elements
+int api_params_batch(const char *data, int len, struct json_token *elements, int max) {
+    int i = 0;
+    while (i < len && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n')) {
+        i++;
+    }
+    if (i == len || data[i] != '[' || api_params_check_depth(data, len) == false) {
+        return -1;
+    }
+    struct t_api_params_batch_walk walk = {elements, max, 0, 0};
+    int rc = json_walk(data, len, api_params_batch_cb, &walk);
+    if (rc <= 0 || walk.count > max || walk.tokens > API_PARAMS_MAX_TOKENS) {
+        return -1;
+    }
+    return walk.count;
+}
+
+//member of the top-level object
+const struct json_token *api_params_member(t_api_params *params, const char *key) {
+    return api_params_find(params, key, false);
+}
+
+bool api_params_member_long(t_api_params *params, const char *key, long *value) {
+    return api_params_token_long(api_params_find(params, key, false), value);
+}
+
+//member of the params object
+const struct json_token *api_param_token(t_api_params *params, const char *key) {
+    return api_params_find(params, key, true);
+}
+
+//value is malloced like the %Q conversion of json_scanf
+bool api_param_string(t_api_params *params, const char *key, char **value) {
+    const struct json_token *token = api_params_find(params, key, true);
+    if (token == NULL || token->type != JSON_TYPE_STRING) {
+        return false;
+    }
+    char *buf = (char *)malloc(token->len + 1);
+    assert(buf);
+    int len = json_unescape(token->ptr, token->len, buf, token->len);
+    if (len < 0) {
+        free(buf);
+        return false;
+    }
+    buf[len] = '\0';
+    if (*value != NULL) {
+        free(*value);
+    }
+    *value = buf;
+    return true;
+}
+
+bool api_param_long(t_api_params *params, const char *key, long *value) {
+    return api_params_token_long(api_params_find(params, key, true), value);
+}
+
+bool api_param_uint(t_api_params *params, const char *key, unsigned *value) {
+    long v;
+    if (api_param_long(params, key, &v) == false || v < 0 || v > UINT_MAX) {
+        return false;
+    }
+    *value = (unsigned)v;
+    return true;
+}
+
+bool api_param_bool(t_api_params *params, const char *key, bool *value) {
+    const struct json_token *token = api_params_find(params, key, true);
+    if (token == NULL || (token->type != JSON_TYPE_TRUE && token->type != JSON_TYPE_FALSE)) {
+        return false;
+    }
+    *value = token->type == JSON_TYPE_TRUE ? true : false;
+    return true;
+}
+
+//iterates the members of the params object, pos must be 0 for the first call
+bool api_params_next(t_api_params *params, unsigned *pos, struct json_token *key, struct json_token *value) {
+    while (*pos < params->count) {
+        struct t_api_param *entry = &params->entries[*pos];
+        (*pos)++;
+        if (entry->in_params == true) {
+            *key = entry->key;
+            *value = entry->value;
+            return true;
+        }
+    }
+    return false;
+}
+
+//private functions
+static void api_params_walk_cb(void *callback_data, const char *name, size_t name_len, const char *path,
+                               const struct json_token *token)
+{
+    struct t_api_params_walk *walk = (struct t_api_params_walk *)callback_data;
+    walk->tokens++;
+    if (walk->tokens > API_PARAMS_MAX_TOKENS) {
+        return;
+    }
+    unsigned depth = api_params_depth(path);
+    bool in_params = false;
+    struct json_token *pending = NULL;
+    if (depth == 1) {
+        pending = &walk->pending_top;
+    }
+    else if (depth == 2 && strncmp(path, ".params.", 8) == 0) {
+        pending = &walk->pending_params;
+        in_params = true;
+    }
+    else {
+        return;
+    }
+    if (token->type == JSON_TYPE_OBJECT_START || token->type == JSON_TYPE_ARRAY_START) {
+        //the value is reported with the end event
+        pending->ptr = name;
+        pending->len = name_len;
+        return;
+    }
+    struct json_token key = {name, name_len, JSON_TYPE_STRING};
+    if (token->type == JSON_TYPE_OBJECT_END || token->type == JSON_TYPE_ARRAY_END) {
+        key = *pending;
+    }
+    if (key.ptr == NULL) {
+        return;
+    }
+    api_params_add(walk->params, &key, token, in_params);
+}
+
+static void api_params_batch_cb(void *callback_data, const char *name, size_t name_len, const char *path,
+                                const struct json_token *token)
+{
+    struct t_api_params_batch_walk *walk = (struct t_api_params_batch_walk *)callback_data;
+    walk->tokens++;
+    //elements of the top-level array, objects and arrays are reported with the end event
+    if (api_params_depth(path) != 1 || token->type == JSON_TYPE_OBJECT_START || token->type == JSON_TYPE_ARRAY_START) {
+        return;
+    }
+    if (walk->count < walk->max) {
+        walk->elements[walk->count] = *token;
+    }
+    walk->count++;
+    (void) name;
+    (void) name_len;
+}
+
+static void api_params_add(t_api_params *params, const struct json_token *key, const struct json_token *value,
+                           bool in_params)
+{
+    if (params->count == params->capacity) {
+        params->capacity = params->capacity == 0 ? 8 : params->capacity * 2;
+        params->entries = (struct t_api_param *)realloc(params->entries, params->capacity * sizeof(struct t_api_param));
+        assert(params->entries);
+    }
+    struct t_api_param *entry = &params->entries[params->count++];
+    entry->key = *key;
+    entry->value = *value;
+    entry->in_params = in_params;
+}
+
+//number of path elements, e.g. 2 for .params.cols and 3 for .params.cols[0]
+static unsigned api_params_depth(const char *path) {
+    unsigned depth = 0;
+    for (const char *p = path; *p != '\0'; p++) {
+        if (*p == '.' || *p == '[') {
+            depth++;
+        }
+    }
+    return depth;
+}
+
+//nesting depth of objects and arrays outside of strings
+static bool api_params_check_depth(const char *data, int len) {
+    unsigned depth = 0;
+    bool in_string = false;
+    for (int i = 0; i < len; i++) {
+        if (in_string == true) {
+            if (data[i] == '\\') {
+                i++;
+            }
+            else if (data[i] == '"') {
+                in_string = false;
+            }
+        }
+        else if (data[i] == '"') {
+            in_string = true;
+        }
+        else if (data[i] == '{' || data[i] == '[') {
+            if (++depth > API_PARAMS_MAX_DEPTH) {
+                return false;
+            }
+        }
+        else if (data[i] == '}' || data[i] == ']') {
+            if (depth > 0) {
+                depth--;
+            }
+        }
+    }
+    return true;
+}
+
+static const struct json_token *api_params_find(t_api_params *params, const char *key, bool in_params) {
+    if (params == NULL || params->valid == false) {
+        return NULL;
+    }
+    size_t key_len = strlen(key);
+    for (unsigned i = 0; i < params->count; i++) {
+        struct t_api_param *entry = &params->entries[i];
+        if (entry->in_params == in_params && (size_t)entry->key.len == key_len &&
+            strncmp(entry->key.ptr, key, key_len) == 0)
+        {
+            return &entry->value;
+        }
+    }
+    return NULL;
+}
+
+static bool api_params_token_long(const struct json_token *token, long *value) {
+    if (token == NULL || token->type != JSON_TYPE_NUMBER || token->len > 20) {
+        return false;
+    }
+    //tokens are not null terminated
+    char buf[21];
+    memcpy(buf, token->ptr, token->len);
+    buf[token->len] = '\0';
+    char *end = NULL;
+    long v = strtol(buf, &end, 10);
+    if (end == buf || *end != '\0') {
+        return false;
+    }
+    *value = v;
+    return true;
+}
@@ -0,0 +1,43 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __API_PARAMS_H__
+#define __API_PARAMS_H__
+
+//limits for untrusted request bodies
+#define API_PARAMS_MAX_DEPTH 16
+#define API_PARAMS_MAX_TOKENS 4096
+#define API_BATCH_MAX_REQUESTS 32
+#define API_BATCH_MAX_SIZE 16384
+
+struct t_api_param {
+    struct json_token key;
+    struct json_token value;
+    bool in_params; //member of the params object or top-level member
+};
+
+//members of the request body and of its params object,
+//the tokens point into the parsed string
+typedef struct t_api_params {
+    bool valid;
+    unsigned count;
+    unsigned capacity;
+    struct t_api_param *entries;
+} t_api_params;
+
+t_api_params *api_params_parse(const char *data, int len);
+void api_params_free(t_api_params *params);
+bool api_params_validate(const char *data, int len);
+int api_params_batch(const char *data, int len, struct json_token *elements, int max);
+const struct json_token *api_params_member(t_api_params *params, const char *key);
+bool api_params_member_long(t_api_params *params, const char *key, long *value);
+const struct json_token *api_param_token(t_api_params *params, const char *key);
+bool api_param_string(t_api_params *params, const char *key, char **value);
+bool api_param_long(t_api_params *params, const char *key, long *value);
+bool api_param_uint(t_api_params *params, const char *key, unsigned *value);
+bool api_param_bool(t_api_params *params, const char *key, bool *value);
+bool api_params_next(t_api_params *params, unsigned *pos, struct json_token *key, struct json_token *value);
+#endif
@@ -116,6 +116,24 @@ static int mympd_inihandler(void *user, const char *section, const char *name, c
     else if (MATCH("mympd", "stickercache")) {
         p_config->sticker_cache = strtobool(value);
     }
+    else if (MATCH("mympd", "cacheconnections")) {
+        p_config->cache_connections = strtoumax(value, &crap, 10);
+        if (p_config->cache_connections < 1) {
+            LOG_WARN("Setting cacheconnections to minimal value 1");
+            p_config->cache_connections = 1;
+        }
+        else if (p_config->cache_connections > 8) {
+            LOG_WARN("Setting cacheconnections to maximal value 8");
+            p_config->cache_connections = 8;
+        }
+    }
+    else if (MATCH("mympd", "readconnections")) {
+        p_config->read_connections = strtoumax(value, &crap, 10);
+        if (p_config->read_connections > 8) {
+            LOG_WARN("Setting readconnections to maximal value 8");
+            p_config->read_connections = 8;
+        }
+    }
     else if (MATCH("mympd", "smartpls")) {
         p_config->smartpls =  strtobool(value);
     }
@@ -159,6 +177,12 @@ static int mympd_inihandler(void *user, const char *section, const char *name, c
     else if (MATCH("mympd", "covercache")) {
         p_config->covercache = strtobool(value);
     }
+    else if (MATCH("mympd", "covercachemaxsize")) {
+        p_config->covercache_max_size = strtoumax(value, &crap, 10);
+    }
+    else if (MATCH("mympd", "covermemcache")) {
+        p_config->covermemcache = strtoumax(value, &crap, 10);
+    }
     else if (MATCH("mympd", "syscmds")) {
         p_config->syscmds = strtobool(value);
     }
@@ -372,7 +396,7 @@ static void mympd_get_env(struct t_config *config) {
         "WEBSERVER_SSLSAN", "WEBSERVER_REDIRECT", 
       #endif
         "MYMPD_LOGLEVEL", "MYMPD_USER", "MYMPD_VARLIBDIR", "MYMPD_MIXRAMP", "MYMPD_STICKERS", 
-        "MYMPD_STICKERCACHE", "MYMPD_TAGLIST", "MYMPD_GENERATE_PLS_TAGS",
+        "MYMPD_STICKERCACHE", "MYMPD_CACHECONNECTIONS", "MYMPD_READCONNECTIONS", "MYMPD_TAGLIST", "MYMPD_GENERATE_PLS_TAGS",
         "MYMPD_SMARTPLSSORT", "MYMPD_SMARTPLSPREFIX", "MYMPD_SMARTPLSINTERVAL",
         "MYMPD_SEARCHTAGLIST", "MYMPD_BROWSETAGLIST", "MYMPD_SMARTPLS", "MYMPD_SYSCMDS", 
         "MYMPD_PAGINATION", "MYMPD_LASTPLAYEDCOUNT", "MYMPD_LOVE", "MYMPD_LOVECHANNEL", "MYMPD_LOVEMESSAGE",
@@ -384,7 +408,7 @@ static void mympd_get_env(struct t_config *config) {
         "MYMPD_COLSBROWSEDATABASE", "MYMPD_COLSBROWSEPLAYLISTDETAIL",
         "MYMPD_COLSBROWSEFILESYSTEM", "MYMPD_COLSPLAYBACK", "MYMPD_COLSQUEUELASTPLAYED",
         "MYMPD_LOCALPLAYER", "MYMPD_STREAMPORT", "MYMPD_HOME", "MYMPOD_COLSQUEUEJUKEBOX",
-        "MYMPD_STREAMURL", "MYMPD_VOLUMESTEP", "MYMPD_COVERCACHEKEEPDAYS", "MYMPD_COVERCACHE",
+        "MYMPD_STREAMURL", "MYMPD_VOLUMESTEP", "MYMPD_COVERCACHEKEEPDAYS", "MYMPD_COVERCACHE", "MYMPD_COVERCACHEMAXSIZE", "MYMPD_COVERMEMCACHE",
         "MYMPD_COVERCACHEAVOID", "MYMPD_LYRICS", "MYMPD_PARTITIONS", "MYMPD_FOOTERSTOP",
         "MYMPD_VOLUMEMIN", "MYMPD_VOLUMEMAX", "MYMPD_VORBISUSLT", "MYMPD_VORBISSYLT",
         "MYMPD_USLTEXT", "MYMPD_SYLTEXT",
@@ -529,11 +553,15 @@ void mympd_config_defaults(t_config *config) {
     config->webdav = false;
     config->covercache_keep_days = 7;
     config->covercache = true;
+    config->covercache_max_size = 100;
+    config->covermemcache = 16384;
     config->theme = sdsnew("theme-dark");
     config->highlight_color = sdsnew("#28a745");
     config->custom_placeholder_images = false;
     config->timer = true;
     config->sticker_cache = true;
+    config->cache_connections = 2;
+    config->read_connections = 2;
     config->booklet_name = sdsnew("booklet.pdf");
     config->mounts = true;
     config->lyrics = true;
@@ -633,6 +661,8 @@ bool mympd_dump_config(void) {
         "varlibdir = %s\n"
         "stickers = %s\n"
         "stickercache = %s\n"
+        "cacheconnections = %u\n"
+        "readconnections = %u\n"
         "smartpls = %s\n"
         "smartplssort = %s\n"
         "smartplsprefix = %s\n"
@@ -646,6 +676,8 @@ bool mympd_dump_config(void) {
         "volumestep = %d\n"
         "covercachekeepdays = %d\n"
         "covercache = %s\n"
+        "covercachemaxsize = %u\n"
+        "covermemcache = %u\n"
         "syscmds = %s\n"
     #ifdef ENABLE_LUA
         "scripting = %s\n"
@@ -699,6 +731,8 @@ bool mympd_dump_config(void) {
         p_config->varlibdir,
         (p_config->stickers == true ? "true" : "false"),
         (p_config->sticker_cache == true ? "true" : "false"),
+        p_config->cache_connections,
+        p_config->read_connections,
         (p_config->smartpls == true ? "true" : "false"),
         p_config->smartpls_sort,
         p_config->smartpls_prefix,
@@ -712,6 +746,8 @@ bool mympd_dump_config(void) {
         p_config->volume_step,
         p_config->covercache_keep_days,
         (p_config->covercache == true ? "true" : "false"),
+        p_config->covercache_max_size,
+        p_config->covermemcache,
         (p_config->syscmds == true ? "true" : "false"),
     #ifdef ENABLE_LUA
         (p_config->scripting == true ? "true" : "false"),
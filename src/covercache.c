@@ -0,0 +1,860 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include "../dist/src/sds/sds.h"
+#include "../dist/src/rax/rax.h"
+#include "../dist/src/mongoose/mongoose.h"
+#include "sds_extras.h"
+#include "list.h"
+#include "config_defs.h"
+#include "log.h"
+#include "utility.h"
+#include "covercache.h"
+
+//Layout of the covercache directory
+//  objects/ab/cd/<sha1 of image>.<ext>: one file per distinct image
+//  index/ab/cd/<sha1 of key>: contains the object name of the image for a song
+//The key is the song uri flattened with uri_to_filename, the name of the files
+//in the old flat layout, which allows migrating existing caches.
+//
+//The objects are tracked in an in-memory lru index, which is updated on write
+//and hit and drives the eviction. Each entry knows the index files pointing to
+//its object, they are removed with the object. The lru index is saved on a clean
+//shutdown and rebuilt by a full scan after a crash.
+
+struct t_covercache_entry {
+    sds name;
+    sds keys; //hashes of the keys pointing to the object, separated by spaces
+    size_t size;
+    time_t atime;
+    struct t_covercache_entry *prev;
+    struct t_covercache_entry *next;
+};
+
+struct t_covercache_index {
+    rax *entries;
+    struct t_covercache_entry *head; //most recently used
+    struct t_covercache_entry *tail; //least recently used
+    size_t size;
+};
+
+struct t_covercache_writer {
+    sds key;
+    sds ext;
+    sds tmp_file;
+    FILE *fp;
+    cs_sha1_ctx sha1_ctx;
+    size_t size;
+    bool error;
+};
+
+struct t_covercache_scan_entry {
+    sds name;
+    size_t size;
+    time_t atime;
+};
+
+//the covercache is written by the web_server and mpd_client threads and cropped by the mympd_api thread
+static pthread_mutex_t covercache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct t_covercache_index covercache_index = {NULL, NULL, NULL, 0};
+
+//privat definitions
+static void covercache_lock(void);
+static void covercache_unlock(void);
+static struct t_covercache_entry *covercache_index_touch(const char *name, size_t size, time_t atime, bool append);
+static void covercache_entry_add_key(struct t_covercache_entry *entry, const char *key_hash);
+static void covercache_entry_remove_keys(t_config *config, struct t_covercache_entry *entry);
+static void covercache_index_remove(t_config *config, struct t_covercache_entry *entry);
+static void covercache_index_evict(t_config *config);
+static void covercache_index_free(void);
+static bool covercache_index_load(t_config *config);
+static bool covercache_index_save(t_config *config);
+static void covercache_index_scan(t_config *config);
+static void covercache_scan_dir(sds dirpath, int level, struct t_covercache_scan_entry **entries, size_t *count, size_t *alloced);
+static void covercache_prune_index_files(t_config *config, sds dirpath, int level);
+static int covercache_scan_entry_cmp(const void *a, const void *b);
+static sds covercache_shard_path(sds buffer, t_config *config, const char *type, const char *name);
+static bool covercache_create_shard(sds path);
+static bool covercache_write_atomic(sds path, const char *data, size_t len);
+static struct t_covercache_writer *covercache_writer_create(t_config *config, sds key, sds ext);
+static bool covercache_write_key(t_config *config, const char *key, const char *mime_type, sds binary);
+static bool covercache_link_key(t_config *config, struct t_covercache_writer *writer, const char *object_name);
+static bool covercache_migrate(t_config *config);
+
+//public functions
+bool write_covercache_file(t_config *config, const char *uri, const char *mime_type, sds binary) {
+    sds key = sdsnew(uri);
+    uri_to_filename(key);
+    bool rc = covercache_write_key(config, key, mime_type, binary);
+    if (rc == true) {
+        LOG_DEBUG("Write covercache file for uri \"%s\"", uri);
+    }
+    sdsfree(key);
+    return rc;
+}
+
+//returns the absolute path of the cached image for uri in filename, filename is empty if there is none
+sds find_covercache_file(t_config *config, const char *uri, sds filename) {
+    filename = sdscrop(filename);
+    sds key = sdsnew(uri);
+    uri_to_filename(key);
+    sds key_hash = calc_sha1(sdsempty(), key, sdslen(key));
+    sdsfree(key);
+    sds index_file = covercache_shard_path(sdsempty(), config, "index", key_hash);
+    FILE *fp = fopen(index_file, "r");
+    if (fp == NULL) {
+        sdsfree(index_file);
+        sdsfree(key_hash);
+        return filename;
+    }
+    char object_name[64];
+    bool valid = false;
+    if (fgets(object_name, sizeof(object_name), fp) != NULL) {
+        //object names are 40 hex chars and an extension
+        size_t len = strlen(object_name);
+        valid = len > 41 && object_name[40] == '.';
+        for (size_t i = 0; i < len && valid == true; i++) {
+            if (isalnum((unsigned char)object_name[i]) == 0 && i != 40) {
+                valid = false;
+            }
+        }
+    }
+    fclose(fp);
+    if (valid == true) {
+        filename = covercache_shard_path(filename, config, "objects", object_name);
+        struct stat status;
+        if (stat(filename, &status) == 0) {
+            covercache_lock();
+            struct t_covercache_entry *entry = covercache_index_touch(object_name, (size_t)status.st_size, time(NULL), false);
+            if (entry != NULL) {
+                //an index saved by an older version has no keys
+                covercache_entry_add_key(entry, key_hash);
+            }
+            covercache_unlock();
+        }
+        else {
+            filename = sdscrop(filename);
+            valid = false;
+        }
+    }
+    if (valid == false) {
+        //remove dangling index entry
+        LOG_DEBUG("Removing invalid covercache index file \"%s\"", index_file);
+        if (unlink(index_file) != 0) {
+            LOG_ERROR("Error removing file \"%s\": %s", index_file, strerror(errno));
+        }
+    }
+    sdsfree(index_file);
+    sdsfree(key_hash);
+    return filename;
+}
+
+//starts writing an image that is received in chunks, returns NULL on error
+struct t_covercache_writer *covercache_writer_new(t_config *config, const char *uri, const char *mime_type) {
+    sds ext = get_ext_by_mime_type(mime_type);
+    if (sdslen(ext) == 0) {
+        LOG_WARN("Unknown image type for covercache uri \"%s\"", uri);
+        sdsfree(ext);
+        return NULL;
+    }
+    sds key = sdsnew(uri);
+    uri_to_filename(key);
+    return covercache_writer_create(config, key, ext);
+}
+
+bool covercache_writer_append(struct t_covercache_writer *writer, const char *data, size_t len) {
+    if (writer->error == true) {
+        return false;
+    }
+    if (fwrite(data, 1, len, writer->fp) != len) {
+        LOG_ERROR("Error writing file \"%s\"", writer->tmp_file);
+        writer->error = true;
+        return false;
+    }
+    cs_sha1_update(&writer->sha1_ctx, (const unsigned char *)data, (uint32_t)len);
+    writer->size += len;
+    return true;
+}
+
+//moves the written image into place and frees the writer
+bool covercache_writer_finish(t_config *config, struct t_covercache_writer *writer) {
+    if (fclose(writer->fp) != 0) {
+        writer->error = true;
+    }
+    writer->fp = NULL;
+    if (writer->error == true || writer->size == 0) {
+        covercache_writer_abort(writer);
+        return false;
+    }
+    unsigned char digest[20];
+    char hex[41];
+    cs_sha1_final(digest, &writer->sha1_ctx);
+    cs_to_hex(hex, digest, sizeof(digest));
+    sds object_name = sdscatfmt(sdsempty(), "%s.%s", hex, writer->ext);
+    bool rc = covercache_link_key(config, writer, object_name);
+    if (rc == true) {
+        LOG_DEBUG("Write covercache file for key \"%s\" (%u bytes)", writer->key, writer->size);
+    }
+    sdsfree(object_name);
+    sdsfree(writer->key);
+    sdsfree(writer->ext);
+    sdsfree(writer->tmp_file);
+    free(writer);
+    return rc;
+}
+
+//discards the written chunks and frees the writer
+void covercache_writer_abort(struct t_covercache_writer *writer) {
+    if (writer->fp != NULL) {
+        fclose(writer->fp);
+    }
+    if (unlink(writer->tmp_file) != 0) {
+        LOG_ERROR("Error removing file \"%s\": %s", writer->tmp_file, strerror(errno));
+    }
+    sdsfree(writer->key);
+    sdsfree(writer->ext);
+    sdsfree(writer->tmp_file);
+    free(writer);
+}
+
+//creates the directory layout and migrates the old flat covercache
+bool init_covercache(t_config *config) {
+    sds dirname = sdscatfmt(sdsempty(), "%s/covercache/objects", config->varlibdir);
+    int testdir_rc = testdir("Covercache objects dir", dirname, true);
+    if (testdir_rc < 2) {
+        dirname = sdscrop(dirname);
+        dirname = sdscatfmt(dirname, "%s/covercache/index", config->varlibdir);
+        testdir_rc = testdir("Covercache index dir", dirname, true);
+    }
+    sdsfree(dirname);
+    if (testdir_rc > 1) {
+        return false;
+    }
+    bool rc = covercache_migrate(config);
+    covercache_lock();
+    covercache_index.entries = raxNew();
+    if (covercache_index_load(config) == false) {
+        covercache_index_scan(config);
+    }
+    //the budget could be lowered since last run
+    covercache_index_evict(config);
+    covercache_unlock();
+    return rc;
+}
+
+//saves and frees the lru index
+void free_covercache(t_config *config) {
+    covercache_lock();
+    if (covercache_index.entries != NULL) {
+        covercache_index_save(config);
+        covercache_index_free();
+    }
+    covercache_unlock();
+}
+
+//removes objects not used since expire and the index files pointing to them,
+//returns -1 if the index is not loaded
+int expire_covercache(t_config *config, time_t expire) {
+    int num_deleted = -1;
+    covercache_lock();
+    if (covercache_index.entries != NULL) {
+        num_deleted = 0;
+        while (covercache_index.tail != NULL && covercache_index.tail->atime < expire) {
+            covercache_index_remove(config, covercache_index.tail);
+            num_deleted++;
+        }
+    }
+    covercache_unlock();
+    return num_deleted;
+}
+
+//empties the lru index after the covercache directory was cleared
+void reset_covercache_index(void) {
+    covercache_lock();
+    if (covercache_index.entries != NULL) {
+        covercache_index_free();
+        covercache_index.entries = raxNew();
+    }
+    covercache_unlock();
+}
+
+sds covercache_stats(sds buffer) {
+    covercache_lock();
+    buffer = sdscat(buffer, "\"covercache\":{");
+    buffer = tojson_long(buffer, "entries", (covercache_index.entries != NULL ? (long long)raxSize(covercache_index.entries) : 0), true);
+    buffer = tojson_long(buffer, "size", (long long)covercache_index.size, false);
+    buffer = sdscat(buffer, "}");
+    covercache_unlock();
+    return buffer;
+}
+
+//privat functions
+static void covercache_lock(void) {
+    int rc = pthread_mutex_lock(&covercache_mutex);
+    if (rc != 0) {
+        LOG_ERROR("Error in pthread_mutex_lock: %d", rc);
+    }
+}
+
+static void covercache_unlock(void) {
+    int rc = pthread_mutex_unlock(&covercache_mutex);
+    if (rc != 0) {
+        LOG_ERROR("Error in pthread_mutex_unlock: %d", rc);
+    }
+}
+
+//adds or refreshes an object in the lru index, the lock must be held
+static struct t_covercache_entry *covercache_index_touch(const char *name, size_t size, time_t atime, bool append) {
+    if (covercache_index.entries == NULL) {
+        return NULL;
+    }
+    struct t_covercache_entry *entry = NULL;
+    void *data = raxFind(covercache_index.entries, (unsigned char *)name, strlen(name));
+    if (data != raxNotFound) {
+        entry = (struct t_covercache_entry *)data;
+        //unlink
+        if (entry->prev != NULL) {
+            entry->prev->next = entry->next;
+        }
+        else {
+            covercache_index.head = entry->next;
+        }
+        if (entry->next != NULL) {
+            entry->next->prev = entry->prev;
+        }
+        else {
+            covercache_index.tail = entry->prev;
+        }
+        covercache_index.size -= entry->size;
+    }
+    else {
+        entry = (struct t_covercache_entry *)malloc(sizeof(struct t_covercache_entry));
+        assert(entry);
+        entry->name = sdsnew(name);
+        entry->keys = sdsempty();
+        raxInsert(covercache_index.entries, (unsigned char *)entry->name, sdslen(entry->name), entry, NULL);
+    }
+    entry->size = size;
+    entry->atime = atime;
+    covercache_index.size += size;
+    if (append == true) {
+        entry->next = NULL;
+        entry->prev = covercache_index.tail;
+        if (covercache_index.tail != NULL) {
+            covercache_index.tail->next = entry;
+        }
+        covercache_index.tail = entry;
+        if (covercache_index.head == NULL) {
+            covercache_index.head = entry;
+        }
+    }
+    else {
+        entry->prev = NULL;
+        entry->next = covercache_index.head;
+        if (covercache_index.head != NULL) {
+            covercache_index.head->prev = entry;
+        }
+        covercache_index.head = entry;
+        if (covercache_index.tail == NULL) {
+            covercache_index.tail = entry;
+        }
+    }
+    return entry;
+}
+
+//remembers an index file pointing to the object, the lock must be held
+static void covercache_entry_add_key(struct t_covercache_entry *entry, const char *key_hash) {
+    //all hashes have the same length
+    if (strstr(entry->keys, key_hash) != NULL) {
+        return;
+    }
+    if (sdslen(entry->keys) > 0) {
+        entry->keys = sdscatlen(entry->keys, " ", 1);
+    }
+    entry->keys = sdscat(entry->keys, key_hash);
+}
+
+//removes the index files that still point to the object, the lock must be held
+static void covercache_entry_remove_keys(t_config *config, struct t_covercache_entry *entry) {
+    int count = 0;
+    sds *key_hashes = sdssplitlen(entry->keys, (ssize_t)sdslen(entry->keys), " ", 1, &count);
+    for (int i = 0; i < count; i++) {
+        if (sdslen(key_hashes[i]) != 40) {
+            continue;
+        }
+        sds index_file = covercache_shard_path(sdsempty(), config, "index", key_hashes[i]);
+        FILE *fp = fopen(index_file, "r");
+        if (fp != NULL) {
+            //the key could point to another object now
+            char object_name[64];
+            bool current = fgets(object_name, sizeof(object_name), fp) != NULL && strcmp(object_name, entry->name) == 0;
+            fclose(fp);
+            if (current == true && unlink(index_file) != 0) {
+                LOG_ERROR("Error removing file \"%s\": %s", index_file, strerror(errno));
+            }
+        }
+        sdsfree(index_file);
+    }
+    sdsfreesplitres(key_hashes, count);
+}
+
+//removes an object from the lru index and the disk, the lock must be held
+static void covercache_index_remove(t_config *config, struct t_covercache_entry *entry) {
+    sds object_file = covercache_shard_path(sdsempty(), config, "objects", entry->name);
+    LOG_DEBUG("Evicting covercache file \"%s\"", object_file);
+    if (unlink(object_file) != 0 && errno != ENOENT) {
+        LOG_ERROR("Error removing file \"%s\": %s", object_file, strerror(errno));
+    }
+    sdsfree(object_file);
+    covercache_entry_remove_keys(config, entry);
+    raxRemove(covercache_index.entries, (unsigned char *)entry->name, sdslen(entry->name), NULL);
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    }
+    else {
+        covercache_index.head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    }
+    else {
+        covercache_index.tail = entry->prev;
+    }
+    covercache_index.size -= entry->size;
+    sdsfree(entry->name);
+    sdsfree(entry->keys);
+    free(entry);
+}
+
+//evicts least recently used objects until the covercache fits in its budget, the lock must be held
+static void covercache_index_evict(t_config *config) {
+    if (config->covercache_max_size == 0) {
+        return;
+    }
+    size_t max_size = (size_t)config->covercache_max_size * 1024 * 1024;
+    //never evict the most recently used object
+    while (covercache_index.size > max_size && covercache_index.tail != covercache_index.head) {
+        covercache_index_remove(config, covercache_index.tail);
+    }
+}
+
+static void covercache_index_free(void) {
+    struct t_covercache_entry *current = covercache_index.head;
+    while (current != NULL) {
+        struct t_covercache_entry *next = current->next;
+        sdsfree(current->name);
+        sdsfree(current->keys);
+        free(current);
+        current = next;
+    }
+    raxFree(covercache_index.entries);
+    covercache_index.entries = NULL;
+    covercache_index.head = NULL;
+    covercache_index.tail = NULL;
+    covercache_index.size = 0;
+}
+
+//loads the index saved on shutdown and removes the file,
+//a missing file means that myMPD was not stopped cleanly
+static bool covercache_index_load(t_config *config) {
+    sds index_file = sdscatfmt(sdsempty(), "%s/covercache/lru.index", config->varlibdir);
+    FILE *fp = fopen(index_file, "r");
+    if (fp == NULL) {
+        LOG_DEBUG("No saved covercache index found");
+        sdsfree(index_file);
+        return false;
+    }
+    char *line = NULL;
+    size_t n = 0;
+    while (getline(&line, &n, fp) > 0) {
+        long long atime;
+        unsigned long long size;
+        char name[64];
+        int keys_pos = 0;
+        if (sscanf(line, "%lld %llu %63s%n", &atime, &size, name, &keys_pos) == 3) {
+            struct t_covercache_entry *entry = covercache_index_touch(name, (size_t)size, (time_t)atime, true);
+            //the keys follow the name
+            entry->keys = sdscat(entry->keys, line + keys_pos);
+            sdstrim(entry->keys, " \n");
+        }
+    }
+    FREE_PTR(line);
+    fclose(fp);
+    if (unlink(index_file) != 0) {
+        LOG_ERROR("Error removing file \"%s\": %s", index_file, strerror(errno));
+    }
+    LOG_INFO("Loaded covercache index with %llu entries", (unsigned long long)raxSize(covercache_index.entries));
+    sdsfree(index_file);
+    return true;
+}
+
+static bool covercache_index_save(t_config *config) {
+    sds index_file = sdscatfmt(sdsempty(), "%s/covercache/lru.index", config->varlibdir);
+    sds buffer = sdsempty();
+    for (struct t_covercache_entry *current = covercache_index.head; current != NULL; current = current->next) {
+        buffer = sdscatprintf(buffer, "%lld %llu %s", (long long)current->atime, (unsigned long long)current->size, current->name);
+        if (sdslen(current->keys) > 0) {
+            buffer = sdscatfmt(buffer, " %s", current->keys);
+        }
+        buffer = sdscatlen(buffer, "\n", 1);
+    }
+    bool rc = covercache_write_atomic(index_file, buffer, sdslen(buffer));
+    sdsfree(buffer);
+    sdsfree(index_file);
+    return rc;
+}
+
+//recovery: rebuilds the lru index from the object files and removes stale files
+static void covercache_index_scan(t_config *config) {
+    LOG_INFO("Rebuilding covercache index");
+    struct t_covercache_scan_entry *entries = NULL;
+    size_t count = 0;
+    size_t alloced = 0;
+    sds dirpath = sdscatfmt(sdsempty(), "%s/covercache/objects", config->varlibdir);
+    covercache_scan_dir(dirpath, 0, &entries, &count, &alloced);
+    //newest first
+    if (count > 0) {
+        qsort(entries, count, sizeof(struct t_covercache_scan_entry), covercache_scan_entry_cmp);
+    }
+    for (size_t i = 0; i < count; i++) {
+        covercache_index_touch(entries[i].name, entries[i].size, entries[i].atime, true);
+        sdsfree(entries[i].name);
+    }
+    FREE_PTR(entries);
+    dirpath = sdscrop(dirpath);
+    dirpath = sdscatfmt(dirpath, "%s/covercache/index", config->varlibdir);
+    covercache_prune_index_files(config, dirpath, 0);
+    sdsfree(dirpath);
+    LOG_INFO("Covercache index rebuilt with %llu entries", (unsigned long long)raxSize(covercache_index.entries));
+}
+
+static void covercache_scan_dir(sds dirpath, int level, struct t_covercache_scan_entry **entries, size_t *count, size_t *alloced) {
+    DIR *dir = opendir(dirpath);
+    if (dir == NULL) {
+        LOG_ERROR("Error opening directory %s: %s", dirpath, strerror(errno));
+        return;
+    }
+    struct dirent *next_file;
+    while ((next_file = readdir(dir)) != NULL) {
+        if (next_file->d_name[0] == '.') {
+            continue;
+        }
+        sds filepath = sdscatfmt(sdsempty(), "%s/%s", dirpath, next_file->d_name);
+        struct stat status;
+        if (stat(filepath, &status) == 0) {
+            if (S_ISDIR(status.st_mode)) {
+                if (level < 2) {
+                    covercache_scan_dir(filepath, level + 1, entries, count, alloced);
+                }
+            }
+            else if (strchr(next_file->d_name, '.') != strrchr(next_file->d_name, '.')) {
+                //leftover temporary file
+                if (unlink(filepath) != 0) {
+                    LOG_ERROR("Error removing file \"%s\": %s", filepath, strerror(errno));
+                }
+            }
+            else {
+                if (*count == *alloced) {
+                    *alloced = *alloced == 0 ? 1024 : *alloced * 2;
+                    *entries = (struct t_covercache_scan_entry *)realloc(*entries, *alloced * sizeof(struct t_covercache_scan_entry));
+                    assert(*entries);
+                }
+                (*entries)[*count].name = sdsnew(next_file->d_name);
+                (*entries)[*count].size = (size_t)status.st_size;
+                (*entries)[*count].atime = status.st_atime > status.st_mtime ? status.st_atime : status.st_mtime;
+                (*count)++;
+            }
+        }
+        sdsfree(filepath);
+    }
+    closedir(dir);
+}
+
+//removes index files pointing to missing objects and adds the others to the
+//keys of their objects, the lock must be held
+static void covercache_prune_index_files(t_config *config, sds dirpath, int level) {
+    DIR *dir = opendir(dirpath);
+    if (dir == NULL) {
+        LOG_ERROR("Error opening directory %s: %s", dirpath, strerror(errno));
+        return;
+    }
+    struct dirent *next_file;
+    while ((next_file = readdir(dir)) != NULL) {
+        if (next_file->d_name[0] == '.') {
+            continue;
+        }
+        sds filepath = sdscatfmt(sdsempty(), "%s/%s", dirpath, next_file->d_name);
+        if (level < 2) {
+            covercache_prune_index_files(config, filepath, level + 1);
+            sdsfree(filepath);
+            continue;
+        }
+        bool valid = false;
+        FILE *fp = fopen(filepath, "r");
+        if (fp != NULL) {
+            char object_name[64];
+            void *data = raxNotFound;
+            if (fgets(object_name, sizeof(object_name), fp) != NULL) {
+                data = raxFind(covercache_index.entries, (unsigned char *)object_name, strlen(object_name));
+            }
+            if (data != raxNotFound && strlen(next_file->d_name) == 40) {
+                covercache_entry_add_key((struct t_covercache_entry *)data, next_file->d_name);
+                valid = true;
+            }
+            fclose(fp);
+        }
+        if (valid == false && unlink(filepath) != 0) {
+            LOG_ERROR("Error removing file \"%s\": %s", filepath, strerror(errno));
+        }
+        sdsfree(filepath);
+    }
+    closedir(dir);
+}
+
+static int covercache_scan_entry_cmp(const void *a, const void *b) {
+    const struct t_covercache_scan_entry *e1 = (const struct t_covercache_scan_entry *)a;
+    const struct t_covercache_scan_entry *e2 = (const struct t_covercache_scan_entry *)b;
+    if (e1->atime > e2->atime) {
+        return -1;
+    }
+    if (e1->atime < e2->atime) {
+        return 1;
+    }
+    return 0;
+}
+
+static sds covercache_shard_path(sds buffer, t_config *config, const char *type, const char *name) {
+    buffer = sdscatfmt(buffer, "%s/covercache/%s/", config->varlibdir, type);
+    buffer = sdscatlen(buffer, name, 2);
+    buffer = sdscatlen(buffer, "/", 1);
+    buffer = sdscatlen(buffer, name + 2, 2);
+    buffer = sdscatfmt(buffer, "/%s", name);
+    return buffer;
+}
+
+//creates the two shard directories for the file path
+static bool covercache_create_shard(sds path) {
+    sds dirname = sdsdup(path);
+    //strip filename
+    char *p = strrchr(dirname, '/');
+    if (p == NULL) {
+        sdsfree(dirname);
+        return false;
+    }
+    sdsrange(dirname, 0, p - dirname - 1);
+    p = strrchr(dirname, '/');
+    if (p == NULL) {
+        sdsfree(dirname);
+        return false;
+    }
+    sds first_level = sdsnewlen(dirname, (size_t)(p - dirname));
+    bool rc = true;
+    if (mkdir(first_level, 0700) != 0 && errno != EEXIST) {
+        LOG_ERROR("Creating directory \"%s\" failed: %s", first_level, strerror(errno));
+        rc = false;
+    }
+    else if (mkdir(dirname, 0700) != 0 && errno != EEXIST) {
+        LOG_ERROR("Creating directory \"%s\" failed: %s", dirname, strerror(errno));
+        rc = false;
+    }
+    sdsfree(first_level);
+    sdsfree(dirname);
+    return rc;
+}
+
+static bool covercache_write_atomic(sds path, const char *data, size_t len) {
+    sds tmp_file = sdscatfmt(sdsempty(), "%s.XXXXXX", path);
+    int fd = mkstemp(tmp_file);
+    if (fd < 0 && errno == ENOENT && covercache_create_shard(path) == true) {
+        //mkstemp modified the template
+        tmp_file = sdscrop(tmp_file);
+        tmp_file = sdscatfmt(tmp_file, "%s.XXXXXX", path);
+        fd = mkstemp(tmp_file);
+    }
+    if (fd < 0) {
+        LOG_ERROR("Can not open file \"%s\" for write: %s", tmp_file, strerror(errno));
+        sdsfree(tmp_file);
+        return false;
+    }
+    FILE *fp = fdopen(fd, "w");
+    size_t written = fwrite(data, 1, len, fp);
+    fclose(fp);
+    bool rc = true;
+    if (written != len) {
+        LOG_ERROR("Error writing file \"%s\"", tmp_file);
+        rc = false;
+    }
+    else if (rename(tmp_file, path) == -1) {
+        LOG_ERROR("Rename file from \"%s\" to \"%s\" failed: %s", tmp_file, path, strerror(errno));
+        rc = false;
+    }
+    if (rc == false && unlink(tmp_file) != 0) {
+        LOG_ERROR("Error removing file \"%s\": %s", tmp_file, strerror(errno));
+    }
+    sdsfree(tmp_file);
+    return rc;
+}
+
+static bool covercache_write_key(t_config *config, const char *key, const char *mime_type, sds binary) {
+    sds ext = get_ext_by_mime_type(mime_type);
+    if (sdslen(ext) == 0) {
+        sds magic_mime_type = get_mime_type_by_magic_stream(binary);
+        sdsfree(ext);
+        ext = get_ext_by_mime_type(magic_mime_type);
+        sdsfree(magic_mime_type);
+        if (sdslen(ext) == 0) {
+            LOG_WARN("Unknown image type for covercache key \"%s\"", key);
+            sdsfree(ext);
+            return false;
+        }
+    }
+    struct t_covercache_writer *writer = covercache_writer_create(config, sdsnew(key), ext);
+    if (writer == NULL) {
+        return false;
+    }
+    covercache_writer_append(writer, binary, sdslen(binary));
+    return covercache_writer_finish(config, writer);
+}
+
+//the object name is known after the last chunk, the temporary file is removed by the recovery scan,
+//takes ownership of key and ext
+static struct t_covercache_writer *covercache_writer_create(t_config *config, sds key, sds ext) {
+    sds tmp_file = sdscatfmt(sdsempty(), "%s/covercache/objects/stream.tmp.XXXXXX", config->varlibdir);
+    int fd = mkstemp(tmp_file);
+    if (fd < 0) {
+        LOG_ERROR("Can not open file \"%s\" for write: %s", tmp_file, strerror(errno));
+        sdsfree(tmp_file);
+        sdsfree(key);
+        sdsfree(ext);
+        return NULL;
+    }
+    struct t_covercache_writer *writer = (struct t_covercache_writer *)malloc(sizeof(struct t_covercache_writer));
+    assert(writer);
+    writer->key = key;
+    writer->ext = ext;
+    writer->tmp_file = tmp_file;
+    writer->fp = fdopen(fd, "w");
+    cs_sha1_init(&writer->sha1_ctx);
+    writer->size = 0;
+    writer->error = false;
+    return writer;
+}
+
+//moves the written object into place, adds it to the lru index and points the index file
+//of the key to it, all under the lock to not race with the eviction of the object
+static bool covercache_link_key(t_config *config, struct t_covercache_writer *writer, const char *object_name) {
+    sds key_hash = calc_sha1(sdsempty(), writer->key, sdslen(writer->key));
+    sds object_file = covercache_shard_path(sdsempty(), config, "objects", object_name);
+    bool rc = true;
+    covercache_lock();
+    if (access(object_file, F_OK) == 0) { /* Flawfinder: ignore */
+        //keep a shared image as long as it is written
+        if (utimes(object_file, NULL) != 0) {
+            LOG_ERROR("Error touching file \"%s\": %s", object_file, strerror(errno));
+        }
+        if (unlink(writer->tmp_file) != 0) {
+            LOG_ERROR("Error removing file \"%s\": %s", writer->tmp_file, strerror(errno));
+        }
+    }
+    else if (rename(writer->tmp_file, object_file) == -1 &&
+             (errno != ENOENT || covercache_create_shard(object_file) == false || rename(writer->tmp_file, object_file) == -1))
+    {
+        LOG_ERROR("Rename file from \"%s\" to \"%s\" failed: %s", writer->tmp_file, object_file, strerror(errno));
+        if (unlink(writer->tmp_file) != 0) {
+            LOG_ERROR("Error removing file \"%s\": %s", writer->tmp_file, strerror(errno));
+        }
+        rc = false;
+    }
+    if (rc == true) {
+        sds index_file = covercache_shard_path(sdsempty(), config, "index", key_hash);
+        rc = covercache_write_atomic(index_file, object_name, strlen(object_name));
+        sdsfree(index_file);
+    }
+    if (rc == true) {
+        struct t_covercache_entry *entry = covercache_index_touch(object_name, writer->size, time(NULL), false);
+        if (entry != NULL) {
+            covercache_entry_add_key(entry, key_hash);
+        }
+        covercache_index_evict(config);
+    }
+    covercache_unlock();
+    sdsfree(object_file);
+    sdsfree(key_hash);
+    return rc;
+}
+
+//moves the files of the old flat layout into the sharded layout
+static bool covercache_migrate(t_config *config) {
+    sds covercache = sdscatfmt(sdsempty(), "%s/covercache", config->varlibdir);
+    DIR *covercache_dir = opendir(covercache);
+    if (covercache_dir == NULL) {
+        LOG_ERROR("Error opening directory %s: %s", covercache, strerror(errno));
+        sdsfree(covercache);
+        return false;
+    }
+    int num_migrated = 0;
+    struct dirent *next_file;
+    sds filepath = sdsempty();
+    while ((next_file = readdir(covercache_dir)) != NULL) {
+        //keep the saved lru index
+        if (next_file->d_name[0] == '.' || strcmp(next_file->d_name, "lru.index") == 0) {
+            continue;
+        }
+        filepath = sdscrop(filepath);
+        filepath = sdscatfmt(filepath, "%s/%s", covercache, next_file->d_name);
+        struct stat status;
+        if (stat(filepath, &status) != 0 || !S_ISREG(status.st_mode)) {
+            continue;
+        }
+        FILE *fp = fopen(filepath, "r");
+        if (fp == NULL) {
+            LOG_ERROR("Can not open file \"%s\": %s", filepath, strerror(errno));
+            continue;
+        }
+        sds binary = sdsnewlen(NULL, (size_t)status.st_size);
+        size_t bytes_read = fread(binary, 1, (size_t)status.st_size, fp);
+        fclose(fp);
+        if (bytes_read == (size_t)status.st_size) {
+            sds mime_type = get_mime_type_by_ext(next_file->d_name);
+            sds key = sdsnew(next_file->d_name);
+            strip_extension(key);
+            sdsupdatelen(key);
+            if (covercache_write_key(config, key, mime_type, binary) == true) {
+                num_migrated++;
+            }
+            sdsfree(key);
+            sdsfree(mime_type);
+        }
+        sdsfree(binary);
+        //the old files are only a cache, remove them also if migration failed
+        if (unlink(filepath) != 0) {
+            LOG_ERROR("Error removing file \"%s\": %s", filepath, strerror(errno));
+        }
+    }
+    closedir(covercache_dir);
+    if (num_migrated > 0) {
+        LOG_INFO("Migrated %d files to the new covercache layout", num_migrated);
+    }
+    sdsfree(filepath);
+    sdsfree(covercache);
+    return true;
+}
@@ -0,0 +1,20 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __COVERCACHE_H__
+#define __COVERCACHE_H__
+bool write_covercache_file(t_config *config, const char *uri, const char *mime_type, sds binary);
+sds find_covercache_file(t_config *config, const char *uri, sds filename);
+struct t_covercache_writer *covercache_writer_new(t_config *config, const char *uri, const char *mime_type);
+bool covercache_writer_append(struct t_covercache_writer *writer, const char *data, size_t len);
+bool covercache_writer_finish(t_config *config, struct t_covercache_writer *writer);
+void covercache_writer_abort(struct t_covercache_writer *writer);
+bool init_covercache(t_config *config);
+void free_covercache(t_config *config);
+int expire_covercache(t_config *config, time_t expire);
+void reset_covercache_index(void);
+sds covercache_stats(sds buffer);
+#endif
@@ -7,24 +7,53 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include <mpd/client.h>
 
 #include "../dist/src/sds/sds.h"
 #include "../dist/src/mongoose/mongoose.h"
+#include "../dist/src/frozen/frozen.h"
 #include "list.h"
 #include "tiny_queue.h"
 #include "lua_mympd_state.h"
 #include "api.h"
+#include "log.h"
 #include "global.h"
+#include "api_params.h"
 
 sig_atomic_t s_signal_received;
 tiny_queue_t *web_server_queue;
 tiny_queue_t *mpd_client_queue;
 tiny_queue_t *mympd_api_queue;
 tiny_queue_t *mpd_worker_queue;
+tiny_queue_t *mpd_binary_queue;
+tiny_queue_t *mpd_client_pool_queue;
 tiny_queue_t *mympd_script_queue;
 
+//generation counters, incremented after the data has changed
+static unsigned long api_generation[GENERATION_MAX];
+static pthread_mutex_t api_generation_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//size of a response chunk
+#define RESPONSE_CHUNK_SIZE 65536
+//max chunks of a response in the web server queue and send buffers
+#define RESPONSE_CHUNK_MAX 64
+
+//request of the api handler in this thread, NULL if it can not be chunked
+static _Thread_local t_work_request *chunk_request;
+static _Thread_local unsigned chunk_count;
+//the client is too slow, the rest of the response is discarded
+static _Thread_local bool chunk_aborted;
+//the handler replaced the buffer with an error object
+static _Thread_local bool chunk_error;
+//chunks not yet sent by the web server, key: conn_id, value_i: chunks
+static struct list chunks_inflight;
+static pthread_mutex_t chunk_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 t_work_result *create_result(t_work_request *request) {
     t_work_result *response = create_result_new(request->conn_id, request->id, request->cmd_id, request->method);
     return response;
@@ -40,6 +69,7 @@ t_work_result *create_result_new(int conn_id, long request_id, int cmd_id, const
     response->data = sdsempty();
     response->binary = sdsempty();
     response->extra = NULL;
+    response->chunk = RESPONSE_COMPLETE;
     return response;
 }
 
@@ -51,18 +81,38 @@ t_work_request *create_request(int conn_id, long request_id, int cmd_id, const c
     request->id = request_id;
     request->method = sdsnew(method);
     request->data = sdsnew(data);
+    request->params = NULL;
     request->extra = NULL;
     return request;
 }
 
 void free_request(t_work_request *request) {
     if (request != NULL) {
+        if (request->cmd_id == MPD_API_BATCH && request->extra != NULL) {
+            //the elements of a batch are requests
+            struct list *batch = (struct list *)request->extra;
+            for (struct list_node *current = batch->head; current != NULL; current = current->next) {
+                free_request((t_work_request *)current->user_data);
+            }
+            list_free_keep_user_data(batch);
+            free(batch);
+        }
+        api_params_free(request->params);
         sdsfree(request->data);
         sdsfree(request->method);
         free(request);
     }
 }
 
+//requests from the web server are parsed on arrival,
+//internal requests on first access
+t_api_params *request_params(t_work_request *request) {
+    if (request->params == NULL) {
+        request->params = api_params_parse(request->data, sdslen(request->data));
+    }
+    return request->params;
+}
+
 void free_result(t_work_result *result) {
     if (result != NULL) {
         sdsfree(result->data);
@@ -95,7 +145,8 @@ int expire_request_queue(tiny_queue_t *queue, time_t age) {
     t_work_request *request = NULL;
     int i = 0;
     while ((request = tiny_queue_expire(queue, age)) != NULL) {
-        if (request->extra != NULL) {
+        //batches are freed by free_request
+        if (request->extra != NULL && request->cmd_id != MPD_API_BATCH) {
             if (strcmp(request->method, "MYMPD_API_SCRIPT_INIT") == 0) {
                 free_lua_mympd_state(request->extra);
             }
@@ -109,3 +160,117 @@ int expire_request_queue(tiny_queue_t *queue, time_t age) {
     }
     return i;
 }
+
+void api_generation_bump(enum api_generations generation) {
+    pthread_mutex_lock(&api_generation_mutex);
+    api_generation[generation]++;
+    pthread_mutex_unlock(&api_generation_mutex);
+}
+
+void api_generation_bump_all(void) {
+    pthread_mutex_lock(&api_generation_mutex);
+    for (unsigned i = 0; i < GENERATION_MAX; i++) {
+        api_generation[i]++;
+    }
+    pthread_mutex_unlock(&api_generation_mutex);
+}
+
+//the sum of monotonic counters changes with each increment of one of them
+unsigned long api_generation_get(unsigned generations) {
+    unsigned long sum = 0;
+    pthread_mutex_lock(&api_generation_mutex);
+    for (unsigned i = 0; i < GENERATION_MAX; i++) {
+        if (generations & (1 << i)) {
+            sum += api_generation[i];
+        }
+    }
+    pthread_mutex_unlock(&api_generation_mutex);
+    return sum;
+}
+
+//only responses for http connections are chunked
+void response_chunk_begin(t_work_request *request) {
+    chunk_request = request->conn_id > 0 ? request : NULL;
+    chunk_count = 0;
+    chunk_aborted = false;
+    chunk_error = false;
+}
+
+//pushes the buffer to the web server if it is large enough,
+//the handler thread never waits for the web server, the response is
+//aborted if the client does not keep up
+sds response_chunk(sds buffer) {
+    if (chunk_request == NULL || sdslen(buffer) < RESPONSE_CHUNK_SIZE) {
+        return buffer;
+    }
+    if (chunk_aborted == false) {
+        char key[12];
+        snprintf(key, sizeof(key), "%d", chunk_request->conn_id);
+        pthread_mutex_lock(&chunk_mutex);
+        struct list_node *node = list_get_node(&chunks_inflight, key);
+        if (node == NULL) {
+            list_push(&chunks_inflight, key, 1, NULL, NULL);
+        }
+        else if (node->value_i < RESPONSE_CHUNK_MAX) {
+            node->value_i++;
+        }
+        else {
+            chunk_aborted = true;
+        }
+        pthread_mutex_unlock(&chunk_mutex);
+        if (chunk_aborted == true) {
+            LOG_WARN("Client of connection %d does not keep up, aborting the response", chunk_request->conn_id);
+        }
+    }
+    if (chunk_aborted == true) {
+        //the handler only drains the mpd connection
+        sdsclear(buffer);
+        return buffer;
+    }
+    t_work_result *response = create_result(chunk_request);
+    response->data = sdscatsds(response->data, buffer);
+    response->chunk = RESPONSE_CHUNK;
+    tiny_queue_push(web_server_queue, response, 0);
+    chunk_count++;
+    sdsclear(buffer);
+    return buffer;
+}
+
+void response_chunk_end(t_work_result *response) {
+    if (chunk_aborted == true) {
+        response->chunk = RESPONSE_ABORT;
+    }
+    else if (chunk_count > 0) {
+        //the already sent part of the list can not be completed with an error object
+        response->chunk = chunk_error == true ? RESPONSE_ABORT : RESPONSE_LAST_CHUNK;
+    }
+    chunk_request = NULL;
+    chunk_count = 0;
+    chunk_aborted = false;
+    chunk_error = false;
+}
+
+//called by handlers that replace a possibly chunked buffer with an error object
+void response_chunk_abort(void) {
+    chunk_error = true;
+}
+
+//called by the web server for chunks that are sent or discarded
+void response_chunk_release(int conn_id, unsigned count) {
+    char key[12];
+    snprintf(key, sizeof(key), "%d", conn_id);
+    pthread_mutex_lock(&chunk_mutex);
+    unsigned i = 0;
+    for (struct list_node *current = chunks_inflight.head; current != NULL; current = current->next, i++) {
+        if (strcmp(current->key, key) == 0) {
+            if ((unsigned long)current->value_i > count) {
+                current->value_i -= count;
+            }
+            else {
+                list_shift(&chunks_inflight, i);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&chunk_mutex);
+}
@@ -15,6 +15,8 @@ extern tiny_queue_t *web_server_queue;
 extern tiny_queue_t *mpd_client_queue;
 extern tiny_queue_t *mympd_api_queue;
 extern tiny_queue_t *mpd_worker_queue;
+extern tiny_queue_t *mpd_binary_queue;
+extern tiny_queue_t *mpd_client_pool_queue;
 extern tiny_queue_t *mympd_script_queue;
 
 typedef struct t_work_request {
@@ -23,9 +25,18 @@ typedef struct t_work_request {
     sds method; //the jsonrpc method
     enum mympd_cmd_ids cmd_id;
     sds data;
+    struct t_api_params *params; //parsed data, use request_params()
     void *extra;
 } t_work_request;
 
+//api responses can be sent in chunks
+enum response_chunk_types {
+    RESPONSE_COMPLETE = 0,
+    RESPONSE_CHUNK,
+    RESPONSE_LAST_CHUNK,
+    RESPONSE_ABORT //closes the connection, the response can not be completed
+};
+
 typedef struct t_work_result {
     int conn_id; // needed to identify the connection where to send the reply
     long id; //the jsonrpc id
@@ -34,6 +45,7 @@ typedef struct t_work_result {
     sds data;
     sds binary;
     void *extra;
+    enum response_chunk_types chunk;
 } t_work_result;
 
 t_work_result *create_result(t_work_request *request);
@@ -42,6 +54,15 @@ t_work_request *create_request(int conn_id, long request_id, int cmd_id, const c
 int expire_request_queue(tiny_queue_t *queue, time_t age);
 int expire_result_queue(tiny_queue_t *queue, time_t age);
 void free_request(t_work_request *request);
+struct t_api_params *request_params(t_work_request *request);
 void free_result(t_work_result *result);
+void api_generation_bump(enum api_generations generation);
+void api_generation_bump_all(void);
+unsigned long api_generation_get(unsigned generations);
+void response_chunk_begin(t_work_request *request);
+sds response_chunk(sds buffer);
+void response_chunk_end(t_work_result *response);
+void response_chunk_abort(void);
+void response_chunk_release(int conn_id, unsigned count);
 
 #endif
@@ -26,6 +26,8 @@
 
 #include "../dist/src/sds/sds.h"
 #include "../dist/src/mongoose/mongoose.h"
+#include "../dist/src/rax/rax.h"
+#include "../dist/src/frozen/frozen.h"
 
 #include "sds_extras.h"
 #include "log.h"
@@ -38,7 +40,14 @@
 #include "global.h"
 #include "mpd_client.h"
 #include "mpd_worker.h"
+#include "mpd_binary.h"
 #include "web_server/web_server_utility.h"
+#include "web_server/web_server_albumart_cache.h"
+#include "web_server/web_server_coverlookup.h"
+#include "web_server/web_server_connections.h"
+#include "web_server/web_server_coalesce.h"
+#include "web_server/web_server_etag.h"
+#include "web_server/web_server_chunked.h"
 #include "web_server.h"
 #include "mympd_api.h"
 #ifdef ENABLE_SSL
@@ -46,6 +55,7 @@
 #endif
 #include "handle_options.h"
 #include "maintenance.h"
+#include "covercache.h"
 #include "random.h"
 
 _Thread_local sds thread_logname;
@@ -289,7 +299,7 @@ static bool check_dirs(t_config *config) {
         testdirname = sdscrop(testdirname);
         testdirname = sdscatfmt(testdirname, "%s/covercache", config->varlibdir);
         testdir_rc = testdir("Covercache dir", testdirname, true);
-        if (testdir_rc > 1) {
+        if (testdir_rc > 1 || init_covercache(config) == false) {
             sdsfree(testdirname);
             return false;
         }
@@ -316,6 +326,7 @@ int main(int argc, char **argv) {
     bool init_thread_webserver = false;
     bool init_thread_mpdclient = false;
     bool init_thread_mpdworker = false;
+    bool init_thread_mpdbinary = false;
     bool init_thread_mympdapi = false;
     int rc = EXIT_FAILURE;
     #ifdef DEBUG
@@ -336,6 +347,7 @@ int main(int argc, char **argv) {
     
     mpd_client_queue = tiny_queue_create();
     mpd_worker_queue = tiny_queue_create();
+    mpd_binary_queue = tiny_queue_create();
     mympd_api_queue = tiny_queue_create();
     web_server_queue = tiny_queue_create();
     mympd_script_queue = tiny_queue_create();
@@ -465,9 +477,15 @@ int main(int argc, char **argv) {
         }
     }
 
+    //queue for the read-only mpd connections, created only if enabled
+    if (config->read_connections > 0) {
+        mpd_client_pool_queue = tiny_queue_create();
+    }
+
     //Create working threads
     pthread_t mpd_client_thread;
     pthread_t mpd_worker_thread;
+    pthread_t mpd_binary_thread;
     pthread_t web_server_thread;
     pthread_t mympd_api_thread;
     //mympd api
@@ -490,6 +508,15 @@ int main(int argc, char **argv) {
         LOG_ERROR("Can't create mympd_worker thread");
         s_signal_received = SIGTERM;
     }
+    LOG_INFO("Starting mpd binary thread");
+    if (pthread_create(&mpd_binary_thread, NULL, mpd_binary_loop, config) == 0) {
+        pthread_setname_np(mpd_binary_thread, "mympd_mpdbinary");
+        init_thread_mpdbinary = true;
+    }
+    else {
+        LOG_ERROR("Can't create mympd_mpdbinary thread");
+        s_signal_received = SIGTERM;
+    }
     LOG_INFO("Starting mpd client thread");
     if (pthread_create(&mpd_client_thread, NULL, mpd_client_loop, config) == 0) {
         pthread_setname_np(mpd_client_thread, "mympd_mpdclient");
@@ -524,6 +551,10 @@ int main(int argc, char **argv) {
         pthread_join(mpd_worker_thread, NULL);
         LOG_INFO("Stopping mpd worker thread");
     }
+    if (init_thread_mpdbinary == true) {
+        pthread_join(mpd_binary_thread, NULL);
+        LOG_INFO("Stopping mpd binary thread");
+    }
     if (init_thread_webserver == true) {
         pthread_join(web_server_thread, NULL);
         LOG_INFO("Stopping web server thread");
@@ -556,11 +587,24 @@ int main(int argc, char **argv) {
     tiny_queue_free(mpd_worker_queue);
     LOG_DEBUG("Expired %d entries", expired);
 
+    LOG_DEBUG("Expiring mpd_binary_queue: %u", tiny_queue_length(mpd_binary_queue, 10));
+    expired = expire_request_queue(mpd_binary_queue, 0);
+    tiny_queue_free(mpd_binary_queue);
+    LOG_DEBUG("Expired %d entries", expired);
+
+    if (mpd_client_pool_queue != NULL) {
+        LOG_DEBUG("Expiring mpd_client_pool_queue: %u", tiny_queue_length(mpd_client_pool_queue, 10));
+        expired = expire_request_queue(mpd_client_pool_queue, 0);
+        tiny_queue_free(mpd_client_pool_queue);
+        LOG_DEBUG("Expired %d entries", expired);
+    }
+
     LOG_DEBUG("Expiring mympd_script_queue: %u", tiny_queue_length(mympd_script_queue, 10));
     expired = expire_result_queue(mympd_script_queue, 0);
     tiny_queue_free(mympd_script_queue);
     LOG_DEBUG("Expired %d entries", expired);
 
+    free_covercache(config);
     mympd_free_config(config);
     sdsfree(configfile);
     sdsfree(option);
@@ -570,6 +614,12 @@ int main(int argc, char **argv) {
         sdsfree(mg_user_data->playlist_directory);
         sdsfreesplitres(mg_user_data->coverimage_names, mg_user_data->coverimage_names_len);
         sdsfree(mg_user_data->rewrite_patterns);
+        albumart_cache_free(mg_user_data->albumart_cache);
+        coverlookup_cache_free(mg_user_data->coverlookup_cache);
+        connection_index_free(mg_user_data->connection_index);
+        request_coalesce_free(mg_user_data->request_coalesce);
+        etag_index_free(mg_user_data->etag_index);
+        chunked_index_free(mg_user_data->chunked_index);
     }
     FREE_PTR(mg_user_data);
     if (rc == EXIT_SUCCESS) {
@@ -23,10 +23,14 @@
 #include "log.h"
 #include "list.h"
 #include "config_defs.h"
+#include "covercache.h"
 #include "maintenance.h"
 
+//privat definitions
+static int clear_covercache_dir(sds dirpath, time_t expire, int level);
+
+//public functions
 int clear_covercache(t_config *config, int keepdays) {
-    int num_deleted = 0;
     if (config->covercache == false) {
         LOG_WARN("Covercache is disabled");
         return 0;
@@ -35,37 +39,67 @@ int clear_covercache(t_config *config, int keepdays) {
         keepdays = config->covercache_keep_days;
     }
     time_t now = time(NULL) - keepdays * 24 * 60 * 60;
-    
+    if (keepdays > 0) {
+        //use the lru index of the running instance
+        int num_deleted = expire_covercache(config, now);
+        if (num_deleted >= 0) {
+            LOG_INFO("Deleted %d files from covercache", num_deleted);
+            return num_deleted;
+        }
+    }
+    //full scan to clear the covercache or without loaded index
     sds covercache = sdscatfmt(sdsempty(), "%s/covercache", config->varlibdir);
     LOG_INFO("Cleaning covercache %s", covercache);
     LOG_DEBUG("Remove files older than %ld sec", now);
-    DIR *covercache_dir = opendir(covercache);
-    if (covercache_dir != NULL) {
-        struct dirent *next_file;
-        while ( (next_file = readdir(covercache_dir)) != NULL ) {
-            if (strncmp(next_file->d_name, ".", 1) != 0) {
-                sds filepath = sdscatfmt(sdsempty(), "%s/%s", covercache, next_file->d_name);
-                struct stat status;
-                if (stat(filepath, &status) == 0) {
-                    if (status.st_mtime < now) {
-                        LOG_DEBUG("Deleting %s: %ld", filepath, status.st_mtime);
-                        if (unlink(filepath) != 0) {
-                            LOG_ERROR("Error removing file \"%s\": %s", filepath, strerror(errno));
-                        }
-                        else {
-                            num_deleted++;
-                        }
+    //objects are touched on each write, an object is always newer than its index files
+    sds dirpath = sdscatfmt(sdsempty(), "%s/index", covercache);
+    int num_deleted = clear_covercache_dir(dirpath, now, 0);
+    dirpath = sdscrop(dirpath);
+    dirpath = sdscatfmt(dirpath, "%s/objects", covercache);
+    num_deleted += clear_covercache_dir(dirpath, now, 0);
+    sdsfree(dirpath);
+    if (keepdays == 0) {
+        reset_covercache_index();
+    }
+    LOG_INFO("Deleted %d files from covercache", num_deleted);
+    sdsfree(covercache);
+    return num_deleted;
+}
+
+//privat functions
+
+//walks the two shard levels below dirpath
+static int clear_covercache_dir(sds dirpath, time_t expire, int level) {
+    int num_deleted = 0;
+    DIR *covercache_dir = opendir(dirpath);
+    if (covercache_dir == NULL) {
+        LOG_ERROR("Error opening directory %s: %s", dirpath, strerror(errno));
+        return 0;
+    }
+    struct dirent *next_file;
+    while ( (next_file = readdir(covercache_dir)) != NULL ) {
+        if (strncmp(next_file->d_name, ".", 1) != 0) {
+            sds filepath = sdscatfmt(sdsempty(), "%s/%s", dirpath, next_file->d_name);
+            struct stat status;
+            if (stat(filepath, &status) == 0) {
+                if (S_ISDIR(status.st_mode)) {
+                    if (level < 2) {
+                        num_deleted += clear_covercache_dir(filepath, expire, level + 1);
+                    }
+                }
+                else if (status.st_mtime < expire) {
+                    LOG_DEBUG("Deleting %s: %ld", filepath, status.st_mtime);
+                    if (unlink(filepath) != 0) {
+                        LOG_ERROR("Error removing file \"%s\": %s", filepath, strerror(errno));
+                    }
+                    else {
+                        num_deleted++;
                     }
                 }
-                sdsfree(filepath);
             }
+            sdsfree(filepath);
         }
-        closedir(covercache_dir);
-    }
-    else {
-        LOG_ERROR("Error opening directory %s: %s", covercache, strerror(errno));
     }
-    LOG_INFO("Deleted %d files from covercache", num_deleted);
-    sdsfree(covercache);
+    closedir(covercache_dir);
     return num_deleted;
 }
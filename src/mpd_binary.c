@@ -0,0 +1,222 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <signal.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <mpd/client.h>
+
+#include "../dist/src/sds/sds.h"
+#include "sds_extras.h"
+#include "log.h"
+#include "list.h"
+#include "config_defs.h"
+#include "tiny_queue.h"
+#include "api.h"
+#include "global.h"
+#include "utility.h"
+#include "mpd_shared/mpd_shared_typedefs.h"
+#include "mpd_shared.h"
+#include "mpd_binary/mpd_binary_utility.h"
+#include "mpd_binary/mpd_binary_api.h"
+#include "mpd_binary.h"
+
+//The mpd_binary thread has its own mpd connection for the binary transfers
+//(albumart, readpicture and getfingerprint). Large transfers do not block
+//the mpd_client connection and the interactive requests.
+
+//private definitions
+static void mpd_binary_idle(t_config *config, t_mpd_binary_state *mpd_binary_state);
+static void mpd_binary_respond_disconnected(t_work_request *request);
+
+//public functions
+void *mpd_binary_loop(void *arg_config) {
+    thread_logname = sdsreplace(thread_logname, "mpdbinary");
+    t_config *config = (t_config *) arg_config;
+    //State of mpd connection
+    t_mpd_binary_state *mpd_binary_state = (t_mpd_binary_state *)malloc(sizeof(t_mpd_binary_state));
+    assert(mpd_binary_state);
+    default_mpd_binary_state(mpd_binary_state);
+
+    //wait for initial settings
+    while (s_signal_received == 0) {
+        t_work_request *request = tiny_queue_shift(mpd_binary_queue, 50, 0);
+        if (request != NULL) {
+            if (request->cmd_id == MYMPD_API_SETTINGS_SET) {
+                LOG_DEBUG("Got initial settings from mympd_api");
+                mpd_binary_api(config, mpd_binary_state, request);
+                break;
+            }
+            LOG_DEBUG("MPD binary not initialized, discarding message");
+            mpd_binary_respond_disconnected(request);
+        }
+    }
+
+    LOG_INFO("Starting mpd_binary");
+    //On startup connect instantly
+    mpd_binary_state->mpd_state->conn_state = MPD_DISCONNECTED;
+    while (s_signal_received == 0) {
+        mpd_binary_idle(config, mpd_binary_state);
+    }
+    //Cleanup
+    mpd_shared_mpd_disconnect(mpd_binary_state->mpd_state);
+    free_mpd_binary_state(mpd_binary_state);
+    sdsfree(thread_logname);
+    return NULL;
+}
+
+//private functions
+static void mpd_binary_idle(t_config *config, t_mpd_binary_state *mpd_binary_state) {
+    unsigned mpd_binary_queue_length = 0;
+    struct pollfd fds[1];
+    int pollrc;
+    //idle only keeps the connection open, the events are not used
+    enum mpd_idle set_idle_mask = MPD_IDLE_DATABASE;
+    
+    switch (mpd_binary_state->mpd_state->conn_state) {
+        case MPD_WAIT: {
+            mpd_binary_queue_length = tiny_queue_length(mpd_binary_queue, 50);
+            if (mpd_binary_queue_length > 0) {
+                //Handle request
+                LOG_DEBUG("Handle request (mpd disconnected)");
+                t_work_request *request = tiny_queue_shift(mpd_binary_queue, 50, 0);
+                if (request != NULL) {
+                    if (request->cmd_id == MYMPD_API_SETTINGS_SET) {
+                        //allow to change mpd host
+                        mpd_binary_api(config, mpd_binary_state, request);
+                        mpd_binary_state->mpd_state->conn_state = MPD_DISCONNECTED;
+                    }
+                    else {
+                        //other requests not allowed
+                        mpd_binary_respond_disconnected(request);
+                    }
+                }
+            }
+
+            time_t now = time(NULL);
+            if (now > mpd_binary_state->mpd_state->reconnect_time) {
+                mpd_binary_state->mpd_state->conn_state = MPD_DISCONNECTED;
+            }
+            if (now < mpd_binary_state->mpd_state->reconnect_time) {
+                //pause 100ms to prevent high cpu usage
+                my_usleep(100000);
+            }
+            break;
+        }
+        case MPD_DISCONNECTED:
+            /* Try to connect */
+            if (strncmp(mpd_binary_state->mpd_state->mpd_host, "/", 1) == 0) {
+                LOG_INFO("MPD binary connecting to socket %s", mpd_binary_state->mpd_state->mpd_host);
+            }
+            else {
+                LOG_INFO("MPD binary connecting to %s:%d", mpd_binary_state->mpd_state->mpd_host, mpd_binary_state->mpd_state->mpd_port);
+            }
+            mpd_binary_state->mpd_state->conn = mpd_connection_new(mpd_binary_state->mpd_state->mpd_host, mpd_binary_state->mpd_state->mpd_port, mpd_binary_state->mpd_state->timeout);
+            if (mpd_binary_state->mpd_state->conn == NULL) {
+                LOG_ERROR("MPD binary connection to failed: out-of-memory");
+                mpd_binary_state->mpd_state->conn_state = MPD_FAILURE;
+                return;
+            }
+
+            if (mpd_connection_get_error(mpd_binary_state->mpd_state->conn) != MPD_ERROR_SUCCESS) {
+                LOG_ERROR("MPD binary connection: %s", mpd_connection_get_error_message(mpd_binary_state->mpd_state->conn));
+                mpd_binary_state->mpd_state->conn_state = MPD_FAILURE;
+                return;
+            }
+
+            if (sdslen(mpd_binary_state->mpd_state->mpd_pass) > 0 && !mpd_run_password(mpd_binary_state->mpd_state->conn, mpd_binary_state->mpd_state->mpd_pass)) {
+                LOG_ERROR("MPD binary connection: %s", mpd_connection_get_error_message(mpd_binary_state->mpd_state->conn));
+                mpd_binary_state->mpd_state->conn_state = MPD_FAILURE;
+                return;
+            }
+
+            LOG_INFO("MPD binary connected");
+            mpd_connection_set_timeout(mpd_binary_state->mpd_state->conn, mpd_binary_state->mpd_state->timeout);
+            mpd_binary_state->mpd_state->conn_state = MPD_CONNECTED;
+            mpd_binary_state->mpd_state->reconnect_interval = 0;
+            mpd_binary_state->mpd_state->reconnect_time = 0;
+            
+            mpd_binary_features(mpd_binary_state);
+            
+            if (!mpd_send_idle_mask(mpd_binary_state->mpd_state->conn, set_idle_mask)) {
+                LOG_ERROR("MPD binary entering idle mode failed");
+                mpd_binary_state->mpd_state->conn_state = MPD_FAILURE;
+            }
+            break;
+
+        case MPD_FAILURE:
+            LOG_ERROR("MPD binary connection failed");
+            // fall through
+        case MPD_DISCONNECT:
+        case MPD_RECONNECT:
+            if (mpd_binary_state->mpd_state->conn != NULL) {
+                mpd_connection_free(mpd_binary_state->mpd_state->conn);
+            }
+            mpd_binary_state->mpd_state->conn = NULL;
+            mpd_binary_state->mpd_state->conn_state = MPD_WAIT;
+            if (mpd_binary_state->mpd_state->reconnect_interval <= 20) {
+                mpd_binary_state->mpd_state->reconnect_interval += 2;
+            }
+            mpd_binary_state->mpd_state->reconnect_time = time(NULL) + mpd_binary_state->mpd_state->reconnect_interval;
+            LOG_VERBOSE("MPD binary waiting %u seconds before reconnection", mpd_binary_state->mpd_state->reconnect_interval);
+            break;
+
+        case MPD_CONNECTED:
+            fds[0].fd = mpd_connection_get_fd(mpd_binary_state->mpd_state->conn);
+            fds[0].events = POLLIN;
+            pollrc = poll(fds, 1, 50);
+
+            mpd_binary_queue_length = tiny_queue_length(mpd_binary_queue, 50);
+            if (pollrc > 0 || mpd_binary_queue_length > 0) {
+                LOG_DEBUG("Leaving mpd binary idle mode");
+                if (!mpd_send_noidle(mpd_binary_state->mpd_state->conn)) {
+                    check_error_and_recover(mpd_binary_state->mpd_state, NULL, NULL, 0);
+                    mpd_binary_state->mpd_state->conn_state = MPD_FAILURE;
+                    break;
+                }
+                //discard idle events
+                mpd_recv_idle(mpd_binary_state->mpd_state->conn, false);
+                if (mpd_binary_queue_length > 0) {
+                    //Handle request
+                    LOG_DEBUG("MPD binary handle request");
+                    t_work_request *request = tiny_queue_shift(mpd_binary_queue, 50, 0);
+                    if (request != NULL) {
+                        mpd_binary_api(config, mpd_binary_state, request);
+                    }
+                }
+                if (mpd_binary_state->mpd_state->conn_state == MPD_CONNECTED) {
+                    LOG_DEBUG("Entering mpd binary idle mode");
+                    if (!mpd_send_idle_mask(mpd_binary_state->mpd_state->conn, set_idle_mask)) {
+                        check_error_and_recover(mpd_binary_state->mpd_state, NULL, NULL, 0);
+                        mpd_binary_state->mpd_state->conn_state = MPD_FAILURE;
+                    }
+                }
+            }
+            break;
+        default:
+            LOG_ERROR("Invalid mpd binary connection state");
+    }
+}
+
+static void mpd_binary_respond_disconnected(t_work_request *request) {
+    if (request->conn_id == -2 || request->conn_id > -1) {
+        t_work_result *response = create_result(request);
+        response->data = jsonrpc_respond_message(response->data, request->method, request->id, "MPD disconnected", true);
+        if (request->conn_id == -2) {
+            tiny_queue_push(mympd_script_queue, response, request->id);
+        }
+        else {
+            tiny_queue_push(web_server_queue, response, 0);
+        }
+    }
+    free_request(request);
+}
@@ -0,0 +1,133 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../sds_extras.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../api.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "../api_params.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared.h"
+#include "mpd_binary_utility.h"
+#include "mpd_binary_cover.h"
+#include "mpd_binary_fingerprint.h"
+#include "mpd_binary_api.h"
+
+//private definitions
+static void mpd_binary_api_settings_set(t_mpd_binary_state *mpd_binary_state, struct json_token *key, 
+                                        struct json_token *val, bool *mpd_host_changed);
+
+//public functions
+void mpd_binary_api(t_config *config, t_mpd_binary_state *mpd_binary_state, void *arg_request) {
+    t_work_request *request = (t_work_request*) arg_request;
+    int je;
+    char *p_charbuf1 = NULL;
+
+    LOG_VERBOSE("MPD BINARY API request (%d)(%ld) %s: %s", request->conn_id, request->id, request->method, request->data);
+    //create response struct
+    t_work_result *response = create_result(request);
+    
+    switch(request->cmd_id) {
+        case MYMPD_API_SETTINGS_SET: {
+            t_api_params *params = request_params(request);
+            unsigned pos = 0;
+            struct json_token key;
+            struct json_token val;
+            bool mpd_host_changed = false;
+            while (api_params_next(params, &pos, &key, &val) == true) {
+                mpd_binary_api_settings_set(mpd_binary_state, &key, &val, &mpd_host_changed);
+            }
+            if (mpd_host_changed == true) {
+                //reconnect with new settings
+                mpd_binary_state->mpd_state->conn_state = MPD_DISCONNECT;
+            }
+            response->data = jsonrpc_respond_ok(response->data, request->method, request->id);
+            break;
+        }
+        case MPD_API_ALBUMART:
+            je = json_scanf(request->data, sdslen(request->data), "{params: {uri: %Q}}", &p_charbuf1);
+            if (je == 1) {
+                response->data = mpd_binary_getcover(config, mpd_binary_state, response->data, request->method, request->id, request->conn_id, p_charbuf1, &response->binary);
+            }
+            break;
+        case MPD_API_DATABASE_FINGERPRINT:
+            if (mpd_binary_state->feat_fingerprint == true) {
+                je = json_scanf(request->data, sdslen(request->data), "{params: { uri: %Q}}", &p_charbuf1);
+                if (je == 1 && strlen(p_charbuf1) > 0) {
+                    response->data = mpd_binary_put_fingerprint(mpd_binary_state, response->data, request->method, request->id, p_charbuf1);
+                }
+            }
+            else {
+                response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Fingerprint command not supported", true);
+            }
+            break;
+        default:
+            response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Unknown request", true);
+            LOG_ERROR("Unknown API request: %.*s", sdslen(request->data), request->data);
+    }
+    FREE_PTR(p_charbuf1);
+
+    if (sdslen(response->data) == 0) {
+        response->data = jsonrpc_start_phrase(response->data, request->method, request->id, "No response for method %{method}", true);
+        response->data = tojson_char(response->data, "method", request->method, false);
+        response->data = jsonrpc_end_phrase(response->data);
+        LOG_ERROR("No response for cmd_id %u", request->cmd_id);
+    }
+    if (request->conn_id == -2) {
+        LOG_DEBUG("Push response to mympd_script_queue for thread %ld: %s", request->id, response->data);
+        tiny_queue_push(mympd_script_queue, response, request->id);
+    }
+    else if (request->conn_id > -1) {
+        LOG_DEBUG("Push response to web_server_queue for connection %lu: %s", request->conn_id, response->data);
+        tiny_queue_push(web_server_queue, response, 0);
+    }
+    else {
+        free_result(response);
+    }
+    free_request(request);
+}
+
+//private functions
+static void mpd_binary_api_settings_set(t_mpd_binary_state *mpd_binary_state, struct json_token *key, 
+                                        struct json_token *val, bool *mpd_host_changed)
+{
+    char *crap;
+    LOG_DEBUG("Parse setting \"%.*s\" with value \"%.*s\"", key->len, key->ptr, val->len, val->ptr);
+    if (strncmp(key->ptr, "mpdPass", key->len) == 0) {
+        if (strncmp(val->ptr, "dontsetpassword", val->len) != 0) {
+            *mpd_host_changed = true;
+            mpd_binary_state->mpd_state->mpd_pass = sdsreplacelen(mpd_binary_state->mpd_state->mpd_pass, val->ptr, val->len);
+        }
+    }
+    else if (strncmp(key->ptr, "mpdHost", key->len) == 0) {
+        if (strncmp(val->ptr, mpd_binary_state->mpd_state->mpd_host, val->len) != 0) {
+            *mpd_host_changed = true;
+            mpd_binary_state->mpd_state->mpd_host = sdsreplacelen(mpd_binary_state->mpd_state->mpd_host, val->ptr, val->len);
+        }
+    }
+    else if (strncmp(key->ptr, "mpdPort", key->len) == 0) {
+        sds settingvalue = sdscatlen(sdsempty(), val->ptr, val->len);
+        int mpd_port = strtoimax(settingvalue, &crap, 10);
+        if (mpd_binary_state->mpd_state->mpd_port != mpd_port) {
+            *mpd_host_changed = true;
+            mpd_binary_state->mpd_state->mpd_port = mpd_port;
+        }
+        sdsfree(settingvalue);
+    }
+}
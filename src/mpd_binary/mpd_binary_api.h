@@ -0,0 +1,10 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __MPD_BINARY_API_H__
+#define __MPD_BINARY_API_H__
+void mpd_binary_api(t_config *config, t_mpd_binary_state *mpd_binary_state, void *arg_request);
+#endif
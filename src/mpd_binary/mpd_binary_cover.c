@@ -0,0 +1,128 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <inttypes.h>
+
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../log.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "../covercache.h"
+#include "mpd_binary_utility.h"
+#include "mpd_binary_cover.h"
+
+//images larger than one chunk are streamed, each chunk is pushed to the web server as it arrives
+//max chunks waiting in the web_server_queue
+#define COVER_QUEUE_LIMIT 16
+
+//privat definitions
+static sds mpd_binary_cover_result(sds buffer, sds method, long request_id, const char *mime_type, const char *uri,
+                                   unsigned offset, unsigned size);
+
+//public functions
+sds mpd_binary_getcover(t_config *config, t_mpd_binary_state *mpd_binary_state, sds buffer, sds method, long request_id,
+                        int conn_id, const char *uri, sds *binary)
+{
+    unsigned size = 0;
+    sds chunk = sdsempty();
+    int recv_len = -1;
+    bool readpicture = false;
+    if (mpd_binary_state->feat_mpd_albumart == true) {
+        LOG_DEBUG("Try mpd command albumart for \"%s\"", uri);
+        recv_len = mpd_shared_read_cover_chunk(mpd_binary_state->mpd_state->conn, false, uri, 0, &chunk, &size);
+    }
+    if (recv_len <= 0 && mpd_binary_state->feat_mpd_readpicture == true) {
+        LOG_DEBUG("Try mpd command readpicture for \"%s\"", uri);
+        readpicture = true;
+        sdsclear(chunk);
+        recv_len = mpd_shared_read_cover_chunk(mpd_binary_state->mpd_state->conn, true, uri, 0, &chunk, &size);
+    }
+    if (recv_len <= 0) {
+        LOG_DEBUG("No albumart found by mpd for uri \"%s\"", uri);
+        sdsfree(chunk);
+        buffer = jsonrpc_respond_message(buffer, method, request_id, "No albumart found by mpd", true);
+        return buffer;
+    }
+    LOG_DEBUG("Albumart found by mpd for uri \"%s\" (%u bytes)", uri, size);
+    sds mime_type = get_mime_type_by_magic_stream(chunk);
+    struct t_covercache_writer *writer = config->covercache == true ? covercache_writer_new(config, uri, mime_type) : NULL;
+    unsigned offset = 0;
+    while (true) {
+        if (writer != NULL) {
+            covercache_writer_append(writer, chunk, sdslen(chunk));
+        }
+        if (offset + (unsigned)recv_len >= size) {
+            //last chunk
+            break;
+        }
+        if (conn_id > -1) {
+            t_work_result *response = create_result_new(conn_id, request_id, MPD_API_ALBUMART, method);
+            response->data = mpd_binary_cover_result(response->data, method, request_id, mime_type, uri, offset, size);
+            sdsfree(response->binary);
+            response->binary = chunk;
+            chunk = sdsempty();
+            //do not queue the whole image if the web server is slower than mpd
+            while (tiny_queue_length(web_server_queue, 0) > COVER_QUEUE_LIMIT && s_signal_received == 0) {
+                my_usleep(1000);
+            }
+            tiny_queue_push(web_server_queue, response, 0);
+        }
+        else {
+            sdsclear(chunk);
+        }
+        offset += (unsigned)recv_len;
+        recv_len = mpd_shared_read_cover_chunk(mpd_binary_state->mpd_state->conn, readpicture, uri, offset, &chunk, &size);
+        if (recv_len <= 0) {
+            //the web server has already sent the header, it closes the connection
+            LOG_ERROR("Reading albumart for uri \"%s\" failed at offset %u", uri, offset);
+            if (writer != NULL) {
+                covercache_writer_abort(writer);
+            }
+            sdsfree(chunk);
+            sdsfree(mime_type);
+            buffer = jsonrpc_respond_message(buffer, method, request_id, "Reading albumart from mpd failed", true);
+            return buffer;
+        }
+    }
+    buffer = mpd_binary_cover_result(buffer, method, request_id, mime_type, uri, offset, size);
+    sdsfree(*binary);
+    *binary = chunk;
+    if (writer != NULL) {
+        covercache_writer_finish(config, writer);
+    }
+    sdsfree(mime_type);
+    return buffer;
+}
+
+//privat functions
+
+static sds mpd_binary_cover_result(sds buffer, sds method, long request_id, const char *mime_type, const char *uri,
+                                   unsigned offset, unsigned size)
+{
+    buffer = jsonrpc_start_result(buffer, method, request_id);
+    buffer = sdscat(buffer, ",");
+    buffer = tojson_char(buffer, "mime_type", mime_type, true);
+    buffer = tojson_char(buffer, "uri", uri, true);
+    buffer = tojson_long(buffer, "offset", offset, true);
+    buffer = tojson_long(buffer, "size", size, false);
+    buffer = jsonrpc_end_result(buffer);
+    return buffer;
+}
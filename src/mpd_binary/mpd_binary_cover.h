@@ -0,0 +1,11 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __MPD_BINARY_COVER_H__
+#define __MPD_BINARY_COVER_H__
+sds mpd_binary_getcover(t_config *config, t_mpd_binary_state *mpd_binary_state, sds buffer, sds method, long request_id,
+                        int conn_id, const char *uri, sds *binary);
+#endif
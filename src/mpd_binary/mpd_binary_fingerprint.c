@@ -0,0 +1,48 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <signal.h>
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../sds_extras.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../api.h"
+#include "../log.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared.h"
+#include "mpd_binary_utility.h"
+#include "mpd_binary_fingerprint.h"
+
+//public functions
+sds mpd_binary_put_fingerprint(t_mpd_binary_state *mpd_binary_state, sds buffer, sds method, long request_id,
+                               const char *uri)
+{
+    if (validate_songuri(uri) == false) {
+        buffer = jsonrpc_respond_message(buffer, method, request_id, "Invalid URI", true);
+        return buffer;
+    }
+    
+    char fp_buffer[8192];
+    const char *fingerprint = mpd_run_getfingerprint_chromaprint(mpd_binary_state->mpd_state->conn, uri, fp_buffer, sizeof(fp_buffer));
+    if (fingerprint == NULL) {
+        check_error_and_recover2(mpd_binary_state->mpd_state, &buffer, method, request_id, false);
+        return buffer;
+    }
+    
+    buffer = jsonrpc_start_result(buffer, method, request_id);
+    buffer = sdscat(buffer, ",");
+    buffer = tojson_char(buffer, "fingerprint", fingerprint, false);
+    buffer = jsonrpc_end_result(buffer);
+    
+    mpd_response_finish(mpd_binary_state->mpd_state->conn);
+    check_error_and_recover2(mpd_binary_state->mpd_state, &buffer, method, request_id, false);
+    
+    return buffer;
+}
@@ -0,0 +1,68 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../sds_extras.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../tiny_queue.h"
+#include "../api.h"
+#include "../global.h"
+#include "../utility.h"
+#include "../log.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared.h"
+#include "mpd_binary_utility.h"
+
+//public functions
+void default_mpd_binary_state(t_mpd_binary_state *mpd_binary_state) {
+    mpd_binary_state->feat_mpd_albumart = false;
+    mpd_binary_state->feat_mpd_readpicture = false;
+    mpd_binary_state->feat_fingerprint = false;
+    //mpd state
+    mpd_binary_state->mpd_state = (t_mpd_state *)malloc(sizeof(t_mpd_state));
+    assert(mpd_binary_state->mpd_state);
+    mpd_shared_default_mpd_state(mpd_binary_state->mpd_state);
+}
+
+void free_mpd_binary_state(t_mpd_binary_state *mpd_binary_state) {
+    //mpd state
+    mpd_shared_free_mpd_state(mpd_binary_state->mpd_state);
+    free(mpd_binary_state);
+}
+
+void mpd_binary_features(t_mpd_binary_state *mpd_binary_state) {
+    mpd_binary_state->feat_mpd_albumart = false;
+    mpd_binary_state->feat_mpd_readpicture = false;
+    mpd_binary_state->feat_fingerprint = false;
+
+    if (mpd_send_allowed_commands(mpd_binary_state->mpd_state->conn) == true) {
+        struct mpd_pair *pair;
+        while ((pair = mpd_recv_command_pair(mpd_binary_state->mpd_state->conn)) != NULL) {
+            if (strcmp(pair->value, "albumart") == 0) {
+                mpd_binary_state->feat_mpd_albumart = true;
+            }
+            else if (strcmp(pair->value, "readpicture") == 0) {
+                mpd_binary_state->feat_mpd_readpicture = true;
+            }
+            else if (strcmp(pair->value, "getfingerprint") == 0) {
+                mpd_binary_state->feat_fingerprint = true;
+            }
+            mpd_return_pair(mpd_binary_state->mpd_state->conn, pair);
+        }
+    }
+    else {
+        LOG_ERROR("Error in response to command: mpd_send_allowed_commands");
+    }
+    mpd_response_finish(mpd_binary_state->mpd_state->conn);
+    check_error_and_recover2(mpd_binary_state->mpd_state, NULL, NULL, 0, false);
+}
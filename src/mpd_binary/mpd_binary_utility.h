@@ -0,0 +1,21 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __MPD_BINARY_UTILITY_H__
+#define __MPD_BINARY_UTILITY_H__
+
+typedef struct t_mpd_binary_state {
+    bool feat_mpd_albumart;
+    bool feat_mpd_readpicture;
+    bool feat_fingerprint;
+    //mpd state
+    struct t_mpd_state *mpd_state;
+} t_mpd_binary_state;
+
+void free_mpd_binary_state(t_mpd_binary_state *mpd_binary_state);
+void default_mpd_binary_state(t_mpd_binary_state *mpd_binary_state);
+void mpd_binary_features(t_mpd_binary_state *mpd_binary_state);
+#endif
@@ -16,6 +16,7 @@
 #include <mpd/client.h>
 
 #include "../dist/src/sds/sds.h"
+#include "../dist/src/frozen/frozen.h"
 #include "sds_extras.h"
 #include "log.h"
 #include "list.h"
@@ -38,10 +39,12 @@
 #include "mpd_client/mpd_client_state.h"
 #include "mpd_client/mpd_client_features.h"
 #include "mpd_client/mpd_client_queue.h"
+#include "mpd_client/mpd_client_settings.h"
 #include "mpd_client/mpd_client_features.h"
 #include "mpd_client/mpd_client_sticker.h"
 #include "mpd_client/mpd_client_timer.h"
 #include "mpd_client/mpd_client_trigger.h"
+#include "mpd_client/mpd_client_pool.h"
 #include "mpd_client.h"
 
 //private definitions
@@ -79,6 +82,7 @@ void *mpd_client_loop(void *arg_config) {
     }
 
     LOG_INFO("Starting mpd_client");
+    mpd_client_pool_start(config);
     trigger_execute(mpd_client_state, TRIGGER_MYMPD_START);
     //On startup connect instantly
     mpd_client_state->mpd_state->conn_state = MPD_DISCONNECTED;
@@ -87,10 +91,14 @@ void *mpd_client_loop(void *arg_config) {
     }
     trigger_execute(mpd_client_state, TRIGGER_MYMPD_STOP);
     //Cleanup
+    mpd_client_pool_stop();
     mpd_shared_mpd_disconnect(mpd_client_state->mpd_state);
     mpd_client_last_played_list_save(config, mpd_client_state);
     triggerfile_save(config, mpd_client_state);
+    sticker_cache_lock();
+    sticker_cache_publish(NULL);
     sticker_cache_free(&mpd_client_state->sticker_cache);
+    sticker_cache_unlock();
     album_cache_free(&mpd_client_state->album_cache);
     free_trigerlist_arguments(mpd_client_state);
     free_mpd_client_state(mpd_client_state);
@@ -115,12 +123,15 @@ static void mpd_client_parse_idle(t_config *config, t_mpd_client_state *mpd_clie
                     buffer = jsonrpc_notify(buffer, "update_database");
                     //update database caches
                     caches_init(config, mpd_client_state);
+                    api_generation_bump(GENERATION_DATABASE);
                     //smart playlist updates are triggered in the mpd worker thread
                     break;
                 case MPD_IDLE_STORED_PLAYLIST:
                     buffer = jsonrpc_notify(buffer, "update_stored_playlist");
+                    api_generation_bump(GENERATION_PLAYLISTS);
                     break;
                 case MPD_IDLE_QUEUE:
+                    api_generation_bump(GENERATION_QUEUE);
                     buffer = mpd_client_get_queue_state(mpd_client_state, buffer);
                     //jukebox enabled
                     if (mpd_client_state->jukebox_mode != JUKEBOX_OFF && mpd_client_state->queue_length < mpd_client_state->jukebox_queue_length) {
@@ -160,11 +171,13 @@ static void mpd_client_parse_idle(t_config *config, t_mpd_client_state *mpd_clie
                     buffer = mpd_client_put_volume(mpd_client_state, buffer, NULL, 0);
                     break;
                 case MPD_IDLE_OUTPUT:
-                    buffer = jsonrpc_notify(buffer, "update_outputs");
+                    //send the outputs with the notify, the clients must not fetch them
+                    buffer = mpd_client_put_outputs(mpd_client_state, buffer, NULL, 0);
                     break;
                 case MPD_IDLE_OPTIONS:
                     mpd_client_get_queue_state(mpd_client_state, NULL);
-                    buffer = jsonrpc_notify(buffer, "update_options");
+                    api_generation_bump(GENERATION_SETTINGS);
+                    buffer = mpd_client_put_settings(mpd_client_state, buffer, NULL, 0);
                     break;
                 case MPD_IDLE_UPDATE:
                     buffer = mpd_client_get_updatedb_state(mpd_client_state, buffer);
@@ -174,7 +187,7 @@ static void mpd_client_parse_idle(t_config *config, t_mpd_client_state *mpd_clie
                         bool old_love = mpd_client_state->feat_love;
                         mpd_client_feature_love(mpd_client_state);
                         if (old_love != mpd_client_state->feat_love) {
-                            buffer = jsonrpc_notify(buffer, "update_options");
+                            buffer = mpd_client_put_settings(mpd_client_state, buffer, NULL, 0);
                         }
                     }
                     break;
@@ -289,6 +302,7 @@ static void mpd_client_idle(t_config *config, t_mpd_client_state *mpd_client_sta
             reset_t_tags(&mpd_client_state->mpd_state->mpd_tag_types);
             //get mpd features
             mpd_client_mpd_features(config, mpd_client_state);
+            api_generation_bump_all();
             //set binarylimit
             mpd_client_set_binarylimit(config, mpd_client_state);
             //update sticker and album cache
@@ -311,6 +325,7 @@ static void mpd_client_idle(t_config *config, t_mpd_client_state *mpd_client_sta
             buffer = jsonrpc_notify(buffer, "mpd_disconnected");
             ws_notify(buffer);
             trigger_execute(mpd_client_state, TRIGGER_MYMPD_DISCONNECTED);
+            api_generation_bump_all();
             // fall through
         case MPD_DISCONNECT:
         case MPD_RECONNECT:
@@ -24,6 +24,7 @@
 #include "../log.h"
 #include "../tiny_queue.h"
 #include "../global.h"
+#include "../api_params.h"
 #include "../mpd_shared/mpd_shared_search.h"
 #include "../mpd_shared/mpd_shared_playlists.h"
 #include "../mpd_shared.h"
@@ -32,7 +33,6 @@
 #include "../lua_mympd_state.h"
 #include "mpd_client_utility.h"
 #include "mpd_client_browse.h"
-#include "mpd_client_cover.h" 
 #include "mpd_client_features.h"
 #include "mpd_client_jukebox.h"
 #include "mpd_client_playlists.h"
@@ -46,10 +46,40 @@
 #include "mpd_client_partitions.h"
 #include "mpd_client_trigger.h"
 #include "mpd_client_lyrics.h"
+#include "mpd_client_batch.h"
 #include "mpd_client_api.h"
 
+//private definitions
+static bool params_to_tags(t_api_params *params, const char *key, t_tags *tags);
+
+//public functions
 void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void *arg_request) {
     t_work_request *request = (t_work_request*) arg_request;
+    t_work_result *response = NULL;
+    if (request->cmd_id == MPD_API_BATCH) {
+        response = mpd_client_batch(config, mpd_client_state, request);
+    }
+    else {
+        //large lists are sent in chunks
+        response_chunk_begin(request);
+        response = mpd_client_api_response(config, mpd_client_state, request);
+    }
+    if (request->conn_id == -2) {
+        LOG_DEBUG("Push response to mympd_script_queue for thread %ld: %s", request->id, response->data);
+        tiny_queue_push(mympd_script_queue, response, request->id);
+    }
+    else if (request->conn_id > -1) {
+        LOG_DEBUG("Push response to web_server_queue for connection %lu: %s", request->conn_id, response->data);
+        tiny_queue_push(web_server_queue, response, 0);
+    }
+    else {
+        free_result(response);
+    }
+    free_request(request);
+}
+
+//executes the request and returns the response
+t_work_result *mpd_client_api_response(t_config *config, t_mpd_client_state *mpd_client_state, t_work_request *request) {
     unsigned int uint_buf1;
     unsigned int uint_buf2;
     int je;
@@ -238,9 +268,16 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
             }
             break;
         case MPD_API_STICKERCACHE_CREATED:
+            sticker_cache_lock();
             sticker_cache_free(&mpd_client_state->sticker_cache);
             if (request->extra != NULL) {
                 mpd_client_state->sticker_cache = (rax *) request->extra;
+                //apply not yet written sticker changes
+                mpd_client_sticker_queue_to_cache(mpd_client_state);
+            }
+            sticker_cache_publish(mpd_client_state->sticker_cache);
+            sticker_cache_unlock();
+            if (request->extra != NULL) {
                 response->data = jsonrpc_respond_ok(response->data, request->method, request->id);
                 LOG_VERBOSE("Sticker cache was replaced");
             }
@@ -254,6 +291,7 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
             album_cache_free(&mpd_client_state->album_cache);
             if (request->extra != NULL) {
                 mpd_client_state->album_cache = (rax *) request->extra;
+                api_generation_bump(GENERATION_DATABASE);
                 response->data = jsonrpc_respond_ok(response->data, request->method, request->id);
                 LOG_VERBOSE("Album cache was replaced");
             }
@@ -308,7 +346,8 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
             response->data = mpd_client_put_state(config, mpd_client_state, response->data, request->method, request->id);
             break;
         case MYMPD_API_SETTINGS_SET: {
-            void *h = NULL;
+            t_api_params *params = request_params(request);
+            unsigned pos = 0;
             struct json_token key;
             struct json_token val;
             rc = true;
@@ -316,7 +355,7 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
             bool jukebox_changed = false;
             bool check_mpd_error = false;
             sds notify_buffer = sdsempty();
-            while ((h = json_next_key(request->data, sdslen(request->data), h, ".params", &key, &val)) != NULL) {
+            while (api_params_next(params, &pos, &key, &val) == true) {
                 rc = mpd_api_settings_set(config, mpd_client_state, &key, &val, &mpd_host_changed, &jukebox_changed, &check_mpd_error);
                 if ((check_mpd_error == true && check_error_and_recover2(mpd_client_state->mpd_state, &notify_buffer, request->method, request->id, true) == false)
                     || rc == false)
@@ -558,8 +597,11 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_QUEUE_LIST: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset: %u, limit: %u, cols: %M}}", &uint_buf1, &uint_buf2, json_to_tags, tagcols);
-            if (je == 3) {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true)
+            {
                 response->data = mpd_client_put_queue(mpd_client_state, response->data, request->method, request->id, uint_buf1, uint_buf2, tagcols);
             }
             free(tagcols);
@@ -568,8 +610,11 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_QUEUE_LAST_PLAYED: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset: %u, limit: %u, cols: %M}}", &uint_buf1, &uint_buf2, json_to_tags, tagcols);
-            if (je == 3) {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true)
+            {
                 response->data = mpd_client_put_last_played_songs(config, mpd_client_state, response->data, request->method, request->id, uint_buf1, uint_buf2, tagcols);
             }
             free(tagcols);
@@ -588,36 +633,32 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
                 response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Invalid API request", true);
             }
             break;
-        case MPD_API_DATABASE_FINGERPRINT:
-            if (mpd_client_state->feat_fingerprint == true) {
-                je = json_scanf(request->data, sdslen(request->data), "{params: { uri: %Q}}", &p_charbuf1);
-                if (je == 1 && strlen(p_charbuf1) > 0) {
-                    response->data = mpd_client_put_fingerprint(mpd_client_state, response->data, request->method, request->id, p_charbuf1);
-                }
-            }
-            else {
-                response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Fingerprint command not supported", true);
-            }
-            break;
-
         case MPD_API_PLAYLIST_RENAME:
             je = json_scanf(request->data, sdslen(request->data), "{params: {from: %Q, to: %Q}}", &p_charbuf1, &p_charbuf2);
             if (je == 2) {
                 response->data = mpd_client_playlist_rename(config, mpd_client_state, response->data, request->method, request->id, p_charbuf1, p_charbuf2);
             }
             break;            
-        case MPD_API_PLAYLIST_LIST:
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset: %u, limit: %u, searchstr: %Q}}", &uint_buf1, &uint_buf2, &p_charbuf1);
-            if (je == 3) {
+        case MPD_API_PLAYLIST_LIST: {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                api_param_string(params, "searchstr", &p_charbuf1) == true)
+            {
                 response->data = mpd_client_put_playlists(config, mpd_client_state, response->data, request->method, request->id, uint_buf1, uint_buf2, p_charbuf1);
             }
             break;
+        }
         case MPD_API_PLAYLIST_CONTENT_LIST: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {uri: %Q, offset: %u, limit: %u searchstr: %Q, cols: %M}}", 
-                &p_charbuf1, &uint_buf1, &uint_buf2, &p_charbuf2, json_to_tags, tagcols);
-            if (je == 5) {
+            t_api_params *params = request_params(request);
+            if (api_param_string(params, "uri", &p_charbuf1) == true &&
+                api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                api_param_string(params, "searchstr", &p_charbuf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true)
+            {
                 response->data = mpd_client_put_playlist_list(config, mpd_client_state, response->data, request->method, request->id, p_charbuf1, uint_buf1, uint_buf2, p_charbuf2, tagcols);
             }
             free(tagcols);
@@ -673,9 +714,13 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_DATABASE_FILESYSTEM_LIST: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset:%u, limit:%u, searchstr:%Q, path:%Q, cols: %M}}", 
-                &uint_buf1, &uint_buf2, &p_charbuf1, &p_charbuf2, json_to_tags, tagcols);
-            if (je == 5) {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                api_param_string(params, "searchstr", &p_charbuf1) == true &&
+                api_param_string(params, "path", &p_charbuf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true)
+            {
                 response->data = mpd_client_put_filesystem(config, mpd_client_state, response->data, request->method, request->id, p_charbuf2, uint_buf1, uint_buf2, p_charbuf1, tagcols);
             }
             free(tagcols);
@@ -755,9 +800,13 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_QUEUE_SEARCH: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset: %u, limit: %u, filter: %Q, searchstr: %Q, cols: %M}}", 
-                &uint_buf1, &uint_buf2, &p_charbuf1, &p_charbuf2, json_to_tags, tagcols);
-            if (je == 5) {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                api_param_string(params, "filter", &p_charbuf1) == true &&
+                api_param_string(params, "searchstr", &p_charbuf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true)
+            {
                 response->data = mpd_client_search_queue(mpd_client_state, response->data, request->method, request->id, p_charbuf1, uint_buf1, uint_buf2, p_charbuf2, tagcols);
             }
             free(tagcols);
@@ -766,9 +815,15 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_DATABASE_SEARCH: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {searchstr:%Q, filter:%Q, plist:%Q, offset:%u, limit:%u, cols: %M, replace:%B}}", 
-                &p_charbuf1, &p_charbuf2, &p_charbuf3, &uint_buf1, &uint_buf2, json_to_tags, tagcols, &bool_buf1);
-            if (je == 7) {
+            t_api_params *params = request_params(request);
+            if (api_param_string(params, "searchstr", &p_charbuf1) == true &&
+                api_param_string(params, "filter", &p_charbuf2) == true &&
+                api_param_string(params, "plist", &p_charbuf3) == true &&
+                api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true &&
+                api_param_bool(params, "replace", &bool_buf1) == true)
+            {
                 if (bool_buf1 == true) {
                     rc = mpd_run_clear(mpd_client_state->mpd_state->conn);
                     if (rc == false) {
@@ -785,9 +840,16 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_DATABASE_SEARCH_ADV: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {expression:%Q, sort:%Q, sortdesc:%B, plist:%Q, offset:%u, limit:%u, cols: %M, replace:%B}}", 
-                &p_charbuf1, &p_charbuf2, &bool_buf1, &p_charbuf3, &uint_buf1, &uint_buf2, json_to_tags, tagcols, &bool_buf2);
-            if (je == 8) {
+            t_api_params *params = request_params(request);
+            if (api_param_string(params, "expression", &p_charbuf1) == true &&
+                api_param_string(params, "sort", &p_charbuf2) == true &&
+                api_param_bool(params, "sortdesc", &bool_buf1) == true &&
+                api_param_string(params, "plist", &p_charbuf3) == true &&
+                api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                params_to_tags(params, "cols", tagcols) == true &&
+                api_param_bool(params, "replace", &bool_buf2) == true)
+            {
                 if (bool_buf2 == true) {
                     rc = mpd_run_clear(mpd_client_state->mpd_state->conn);
                     if (rc == false) {
@@ -817,34 +879,44 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
         case MPD_API_DATABASE_STATS:
             response->data = mpd_client_put_stats(config, mpd_client_state, response->data, request->method, request->id);
             break;
-        case MPD_API_ALBUMART:
-            je = json_scanf(request->data, sdslen(request->data), "{params: {uri: %Q}}", &p_charbuf1);
-            if (je == 1) {
-                response->data = mpd_client_getcover(config, mpd_client_state, response->data, request->method, request->id, p_charbuf1, &response->binary);
-            }
-            break;
-        case MPD_API_DATABASE_GET_ALBUMS:
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset: %u, limit: %u, searchstr: %Q, filter: %Q, sort: %Q, sortdesc: %B}}", 
-                &uint_buf1, &uint_buf2, &p_charbuf1, &p_charbuf2, &p_charbuf3, &bool_buf1);
-            if (je == 6) {
+        case MPD_API_DATABASE_GET_ALBUMS: {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                api_param_string(params, "searchstr", &p_charbuf1) == true &&
+                api_param_string(params, "filter", &p_charbuf2) == true &&
+                api_param_string(params, "sort", &p_charbuf3) == true &&
+                api_param_bool(params, "sortdesc", &bool_buf1) == true)
+            {
                 response->data = mpd_client_put_firstsong_in_albums(mpd_client_state, response->data, request->method, request->id, 
                     p_charbuf1, p_charbuf2, p_charbuf3, bool_buf1, uint_buf1, uint_buf2);
             }
             break;
-        case MPD_API_DATABASE_TAG_LIST:
-            je = json_scanf(request->data, sdslen(request->data), "{params: {offset: %u, limit: %u, searchstr: %Q, filter: %Q, sort: %Q, sortdesc: %B, tag: %Q}}", 
-                &uint_buf1, &uint_buf2, &p_charbuf1, &p_charbuf2, &p_charbuf3, &bool_buf1, &p_charbuf4);
-            if (je == 7) {
+        }
+        case MPD_API_DATABASE_TAG_LIST: {
+            t_api_params *params = request_params(request);
+            if (api_param_uint(params, "offset", &uint_buf1) == true &&
+                api_param_uint(params, "limit", &uint_buf2) == true &&
+                api_param_string(params, "searchstr", &p_charbuf1) == true &&
+                api_param_string(params, "filter", &p_charbuf2) == true &&
+                api_param_string(params, "sort", &p_charbuf3) == true &&
+                api_param_bool(params, "sortdesc", &bool_buf1) == true &&
+                api_param_string(params, "tag", &p_charbuf4) == true)
+            {
                 response->data = mpd_client_put_db_tag2(config, mpd_client_state, response->data, request->method, request->id,
                     p_charbuf1, p_charbuf2, p_charbuf3, bool_buf1, uint_buf1, uint_buf2, p_charbuf4);
             }
             break;
+        }
         case MPD_API_DATABASE_TAG_ALBUM_TITLE_LIST: {
             t_tags *tagcols = (t_tags *)malloc(sizeof(t_tags));
             assert(tagcols);
-            je = json_scanf(request->data, sdslen(request->data), "{params: {album: %Q, searchstr: %Q, tag: %Q, cols: %M}}", 
-                &p_charbuf1, &p_charbuf2, &p_charbuf3, json_to_tags, tagcols);
-            if (je == 4) {
+            t_api_params *params = request_params(request);
+            if (api_param_string(params, "album", &p_charbuf1) == true &&
+                api_param_string(params, "searchstr", &p_charbuf2) == true &&
+                api_param_string(params, "tag", &p_charbuf3) == true &&
+                params_to_tags(params, "cols", tagcols) == true)
+            {
                 response->data = mpd_client_put_songs_in_album(mpd_client_state, response->data, request->method, request->id, p_charbuf1, p_charbuf2, p_charbuf3, tagcols);
             }
             free(tagcols);
@@ -925,22 +997,29 @@ void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void
     MEASURE_PRINT(request->method)
     #endif
 
-    if (sdslen(response->data) == 0) {
+    //cached settings responses are outdated
+    if (request->cmd_id == MYMPD_API_SETTINGS_SET) {
+        api_generation_bump(GENERATION_SETTINGS);
+    }
+
+    response_chunk_end(response);
+    if (sdslen(response->data) == 0 && response->chunk == RESPONSE_COMPLETE) {
         response->data = jsonrpc_start_phrase(response->data, request->method, request->id, "No response for method %{method}", true);
         response->data = tojson_char(response->data, "method", request->method, false);
         response->data = jsonrpc_end_phrase(response->data);
         LOG_ERROR("No response for cmd_id %u", request->cmd_id);
     }
-    if (request->conn_id == -2) {
-        LOG_DEBUG("Push response to mympd_script_queue for thread %ld: %s", request->id, response->data);
-        tiny_queue_push(mympd_script_queue, response, request->id);
-    }
-    else if (request->conn_id > -1) {
-        LOG_DEBUG("Push response to web_server_queue for connection %lu: %s", request->conn_id, response->data);
-        tiny_queue_push(web_server_queue, response, 0);
-    }
-    else {
-        free_result(response);
+    return response;
+}
+
+//private functions
+
+//reads an array of tag names from the request params
+static bool params_to_tags(t_api_params *params, const char *key, t_tags *tags) {
+    const struct json_token *token = api_param_token(params, key);
+    if (token == NULL || token->type != JSON_TYPE_ARRAY_END) {
+        return false;
     }
-    free_request(request);
+    json_to_tags(token->ptr, token->len, tags);
+    return true;
 }
@@ -7,4 +7,5 @@
 #ifndef __MPD_CLIENT_API_H__
 #define __MPD_CLIENT_API_H__
 void mpd_client_api(t_config *config, t_mpd_client_state *mpd_client_state, void *arg_request);
+t_work_result *mpd_client_api_response(t_config *config, t_mpd_client_state *mpd_client_state, t_work_request *request);
 #endif
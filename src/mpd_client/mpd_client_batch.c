@@ -0,0 +1,173 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../api_params.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared.h"
+#include "mpd_client_utility.h"
+#include "mpd_client_api.h"
+#include "mpd_client_batch.h"
+
+//The requests of a json-rpc batch are executed in one idle cycle.
+//Consecutive requests that map to one mpd command are sent in one
+//command list, all other requests are executed one by one. If a command
+//of the list fails, the following commands of the list are not executed.
+
+//private definitions
+static struct list_node *mpd_client_batch_command_list(t_mpd_client_state *mpd_client_state, struct list_node *first);
+static bool mpd_client_batch_send(struct mpd_connection *conn, t_work_request *request, bool send);
+
+//public functions
+t_work_result *mpd_client_batch(t_config *config, t_mpd_client_state *mpd_client_state, t_work_request *request) {
+    struct list *batch = (struct list *)request->extra;
+    LOG_VERBOSE("MPD CLIENT API batch request (%d) with %u requests", request->conn_id, batch->length);
+    struct list_node *current = batch->head;
+    while (current != NULL) {
+        t_work_request *element = (t_work_request *)current->user_data;
+        if (element == NULL) {
+            //invalid request, the web server has set the error response
+            current = current->next;
+        }
+        else if (mpd_client_batch_send(mpd_client_state->mpd_state->conn, element, false) == true) {
+            current = mpd_client_batch_command_list(mpd_client_state, current);
+        }
+        else {
+            t_work_result *response = mpd_client_api_response(config, mpd_client_state, element);
+            current->value_p = sdscatsds(current->value_p, response->data);
+            free_result(response);
+            current = current->next;
+        }
+    }
+    t_work_result *response = create_result(request);
+    response->data = sdscatlen(response->data, "[", 1);
+    for (current = batch->head; current != NULL; current = current->next) {
+        if (current != batch->head) {
+            response->data = sdscatlen(response->data, ",", 1);
+        }
+        response->data = sdscatsds(response->data, current->value_p);
+    }
+    response->data = sdscatlen(response->data, "]", 1);
+    return response;
+}
+
+//private functions
+
+//sends the requests from first up to the next request that can not be
+//sent in a command list, returns this request
+static struct list_node *mpd_client_batch_command_list(t_mpd_client_state *mpd_client_state, struct list_node *first) {
+    struct mpd_connection *conn = mpd_client_state->mpd_state->conn;
+    struct list_node *last = first;
+    unsigned count = 0;
+    while (last != NULL && last->user_data != NULL && 
+           mpd_client_batch_send(conn, (t_work_request *)last->user_data, false) == true)
+    {
+        last = last->next;
+        count++;
+    }
+    LOG_DEBUG("Sending %u commands in a command list", count);
+    bool rc = mpd_command_list_begin(conn, true);
+    for (struct list_node *current = first; rc == true && current != last; current = current->next) {
+        rc = mpd_client_batch_send(conn, (t_work_request *)current->user_data, true);
+    }
+    if (rc == true) {
+        rc = mpd_command_list_end(conn);
+    }
+    bool failed = false;
+    for (struct list_node *current = first; current != last; current = current->next) {
+        t_work_request *request = (t_work_request *)current->user_data;
+        if (failed == true) {
+            current->value_p = jsonrpc_respond_message(current->value_p, request->method, request->id, "Not executed, a previous command failed", true);
+        }
+        else if (rc == true && mpd_response_next(conn) == true) {
+            current->value_p = jsonrpc_respond_ok(current->value_p, request->method, request->id);
+        }
+        else {
+            //the error of the failed command, it discards the rest of the response
+            current->value_p = respond_with_mpd_error_or_ok(mpd_client_state->mpd_state, current->value_p, request->method, request->id, false, "mpd_command_list_end");
+            failed = true;
+        }
+    }
+    if (failed == false) {
+        mpd_response_finish(conn);
+        check_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0);
+    }
+    return last;
+}
+
+//returns false if the request can not be sent in a command list,
+//the command is only sent if send is true
+static bool mpd_client_batch_send(struct mpd_connection *conn, t_work_request *request, bool send) {
+    t_api_params *params = request_params(request);
+    unsigned uint_buf1;
+    unsigned uint_buf2;
+    char *p_charbuf1 = NULL;
+    bool rc = false;
+    switch(request->cmd_id) {
+        case MPD_API_PLAYER_PLAY:
+            rc = send == false || mpd_send_play(conn) == true;
+            break;
+        case MPD_API_PLAYER_PAUSE:
+            rc = send == false || mpd_send_toggle_pause(conn) == true;
+            break;
+        case MPD_API_PLAYER_STOP:
+            rc = send == false || mpd_send_stop(conn) == true;
+            break;
+        case MPD_API_PLAYER_NEXT:
+            rc = send == false || mpd_send_next(conn) == true;
+            break;
+        case MPD_API_PLAYER_PREV:
+            rc = send == false || mpd_send_previous(conn) == true;
+            break;
+        case MPD_API_PLAYER_PLAY_TRACK:
+            rc = api_param_uint(params, "track", &uint_buf1) == true &&
+                (send == false || mpd_send_play_id(conn, uint_buf1) == true);
+            break;
+        case MPD_API_QUEUE_CLEAR:
+            rc = send == false || mpd_send_clear(conn) == true;
+            break;
+        case MPD_API_QUEUE_SHUFFLE:
+            rc = send == false || mpd_send_shuffle(conn) == true;
+            break;
+        case MPD_API_QUEUE_RM_TRACK:
+            rc = api_param_uint(params, "track", &uint_buf1) == true &&
+                (send == false || mpd_send_delete_id(conn, uint_buf1) == true);
+            break;
+        case MPD_API_QUEUE_RM_RANGE:
+            rc = api_param_uint(params, "start", &uint_buf1) == true &&
+                api_param_uint(params, "end", &uint_buf2) == true &&
+                (send == false || mpd_send_delete_range(conn, uint_buf1, uint_buf2) == true);
+            break;
+        case MPD_API_QUEUE_ADD_TRACK:
+            rc = api_param_string(params, "uri", &p_charbuf1) == true && strlen(p_charbuf1) > 0 &&
+                (send == false || mpd_send_add(conn, p_charbuf1) == true);
+            break;
+        case MPD_API_QUEUE_ADD_PLAYLIST:
+            rc = api_param_string(params, "plist", &p_charbuf1) == true &&
+                (send == false || mpd_send_load(conn, p_charbuf1) == true);
+            break;
+        default:
+            rc = false;
+    }
+    FREE_PTR(p_charbuf1);
+    return rc;
+}
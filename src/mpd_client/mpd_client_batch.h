@@ -0,0 +1,10 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __MPD_CLIENT_BATCH_H__
+#define __MPD_CLIENT_BATCH_H__
+t_work_result *mpd_client_batch(t_config *config, t_mpd_client_state *mpd_client_state, t_work_request *request);
+#endif
@@ -35,7 +35,6 @@
 #include "../mpd_shared.h"
 #include "../mpd_shared/mpd_shared_tags.h"
 #include "mpd_client_utility.h"
-#include "mpd_client_cover.h"
 #include "mpd_client_sticker.h"
 #include "mpd_client_browse.h"
 
@@ -45,32 +44,6 @@ static pcre *_compile_regex(const char *regex_str);
 static bool _cmp_regex(pcre *re_compiled, const char *value);
 
 //public functions
-sds mpd_client_put_fingerprint(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id,
-                               const char *uri)
-{
-    if (validate_songuri(uri) == false) {
-        buffer = jsonrpc_respond_message(buffer, method, request_id, "Invalid URI", true);
-        return buffer;
-    }
-    
-    char fp_buffer[8192];
-    const char *fingerprint = mpd_run_getfingerprint_chromaprint(mpd_client_state->mpd_state->conn, uri, fp_buffer, sizeof(fp_buffer));
-    if (fingerprint == NULL) {
-        check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false);
-        return buffer;
-    }
-    
-    buffer = jsonrpc_start_result(buffer, method, request_id);
-    buffer = sdscat(buffer, ",");
-    buffer = tojson_char(buffer, "fingerprint", fingerprint, false);
-    buffer = jsonrpc_end_result(buffer);
-    
-    mpd_response_finish(mpd_client_state->mpd_state->conn);
-    check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false);
-    
-    return buffer;
-}
-
 sds mpd_client_put_songdetails(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id, 
                                const char *uri)
 {
@@ -6,8 +6,6 @@
 
 #ifndef __BROWSE_H__
 #define __BROWSE_H__
-sds mpd_client_put_fingerprint(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id,
-                               const char *uri);
 sds mpd_client_put_songdetails(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id, 
                                const char *uri);
 sds mpd_client_put_filesystem(t_config *config, t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id, 
@@ -26,6 +26,7 @@
 #include "../mpd_shared.h"
 #include "mpd_client_utility.h"
 #include "mpd_client_state.h"
+#include "mpd_client_pool.h"
 #include "mpd_client_features.h"
 
 //private definitions
@@ -39,6 +40,7 @@ void mpd_client_mpd_features(t_config *config, t_mpd_client_state *mpd_client_st
     LOG_INFO("MPD protocoll version: %u.%u.%u", mpd_client_state->protocol[0], mpd_client_state->protocol[1], mpd_client_state->protocol[2]);
 
     // Defaults
+    mpd_client_state->queue_notify_version = 0;
     mpd_client_state->feat_sticker = false;
     mpd_client_state->feat_playlists = false;
     mpd_client_state->mpd_state->feat_tags = false;
@@ -105,6 +107,8 @@ void mpd_client_mpd_features(t_config *config, t_mpd_client_state *mpd_client_st
     web_server_response->data = sdsreplace(web_server_response->data, data);
     sdsfree(data);
     tiny_queue_push(web_server_queue, web_server_response, 0);
+    //update the read-only connections
+    mpd_client_pool_publish(mpd_client_state);
 }
 
 void mpd_client_feature_love(t_mpd_client_state *mpd_client_state) {
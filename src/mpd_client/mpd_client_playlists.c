@@ -143,6 +143,7 @@ sds mpd_client_put_playlist_list(t_config *config, t_mpd_client_state *mpd_clien
                 buffer = tojson_long(buffer, "Pos", entity_count, true);
                 buffer = put_song_tags(buffer, mpd_client_state->mpd_state, tagcols, song);
                 buffer = sdscat(buffer, "}");
+                buffer = response_chunk(buffer);
             }
             else {
                 entity_count--;
@@ -153,6 +154,7 @@ sds mpd_client_put_playlist_list(t_config *config, t_mpd_client_state *mpd_clien
     sdsfree(entityName);
     mpd_response_finish(mpd_client_state->mpd_state->conn);
     if (check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false) == false) {
+        response_chunk_abort();
         return buffer;
     }
     
@@ -0,0 +1,334 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../sds_extras.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../api.h"
+#include "../api_params.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared/mpd_shared_tags.h"
+#include "../mpd_shared.h"
+#include "mpd_client_utility.h"
+#include "mpd_client_api.h"
+#include "mpd_client_pool.h"
+
+//Read-only requests (browse, search and stored playlists) are handled by a
+//pool of mpd connections, one thread per connection. The threads share the
+//mpd_client_pool_queue. Each thread works on its own copy of the mpd_client
+//state, mpd_client publishes a new copy after the feature detection.
+//Requests that change something stay ordered on the mpd_client connection.
+
+#define MPD_CLIENT_POOL_MAX 8
+
+//privat definitions
+struct t_mpd_client_pool_stats {
+    bool connected;
+    unsigned long requests;
+    unsigned long forwarded;
+    unsigned long latency_sum; //ms
+    unsigned long latency_max; //ms
+};
+
+static struct t_mpd_client_pool {
+    t_config *config;
+    unsigned size;
+    pthread_t threads[MPD_CLIENT_POOL_MAX];
+    bool started[MPD_CLIENT_POOL_MAX];
+    struct t_mpd_client_pool_stats stats[MPD_CLIENT_POOL_MAX];
+    //copy of the mpd_client state, generation 0 means not yet published
+    t_mpd_client_state *published;
+    unsigned long generation;
+} pool;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *mpd_client_pool_loop(void *arg);
+static void mpd_client_pool_idle(t_mpd_client_state *mpd_client_state, unsigned idx, unsigned long generation);
+static unsigned long mpd_client_pool_sync(t_mpd_client_state *mpd_client_state, unsigned long generation);
+static void mpd_client_pool_copy_state(t_mpd_client_state *dst, t_mpd_client_state *src);
+static bool mpd_client_pool_readonly(t_work_request *request);
+static void mpd_client_pool_forward(t_work_request *request, unsigned idx);
+static void mpd_client_pool_lock(void);
+static void mpd_client_pool_unlock(void);
+
+//public functions
+void mpd_client_pool_start(t_config *config) {
+    pool.config = config;
+    pool.size = mpd_client_pool_queue != NULL ? config->read_connections : 0;
+    pool.generation = 0;
+    pool.published = (t_mpd_client_state *)malloc(sizeof(t_mpd_client_state));
+    assert(pool.published);
+    default_mpd_client_state(pool.published);
+    for (unsigned i = 0; i < pool.size; i++) {
+        memset(&pool.stats[i], 0, sizeof(struct t_mpd_client_pool_stats));
+        pool.started[i] = pthread_create(&pool.threads[i], NULL, mpd_client_pool_loop, (void *)(intptr_t)i) == 0 ? true : false;
+        if (pool.started[i] == true) {
+            sds name = sdscatfmt(sdsempty(), "mympd_mpdpool%u", i);
+            pthread_setname_np(pool.threads[i], name);
+            sdsfree(name);
+        }
+        else {
+            LOG_ERROR("Can't create mpd pool thread %u", i);
+        }
+    }
+    LOG_INFO("Started %u read-only mpd connections", pool.size);
+}
+
+void mpd_client_pool_stop(void) {
+    for (unsigned i = 0; i < pool.size; i++) {
+        if (pool.started[i] == true) {
+            pthread_join(pool.threads[i], NULL);
+        }
+    }
+    free_mpd_client_state(pool.published);
+    pool.published = NULL;
+}
+
+//called by mpd_client after the feature detection
+void mpd_client_pool_publish(t_mpd_client_state *mpd_client_state) {
+    if (pool.size == 0) {
+        return;
+    }
+    mpd_client_pool_lock();
+    mpd_client_pool_copy_state(pool.published, mpd_client_state);
+    pool.generation++;
+    mpd_client_pool_unlock();
+}
+
+sds mpd_client_pool_stats(sds buffer) {
+    buffer = sdscat(buffer, "\"readpool\":{");
+    buffer = tojson_long(buffer, "connections", pool.size, true);
+    buffer = tojson_long(buffer, "queue", (mpd_client_pool_queue != NULL ? tiny_queue_length(mpd_client_pool_queue, 0) : 0), true);
+    buffer = sdscat(buffer, "\"stats\":[");
+    mpd_client_pool_lock();
+    for (unsigned i = 0; i < pool.size; i++) {
+        if (i > 0) {
+            buffer = sdscat(buffer, ",");
+        }
+        buffer = sdscat(buffer, "{");
+        buffer = tojson_bool(buffer, "connected", pool.stats[i].connected, true);
+        buffer = tojson_long(buffer, "requests", pool.stats[i].requests, true);
+        buffer = tojson_long(buffer, "forwarded", pool.stats[i].forwarded, true);
+        buffer = tojson_long(buffer, "latencyAvg", (pool.stats[i].requests > 0 ? pool.stats[i].latency_sum / pool.stats[i].requests : 0), true);
+        buffer = tojson_long(buffer, "latencyMax", pool.stats[i].latency_max, false);
+        buffer = sdscat(buffer, "}");
+    }
+    mpd_client_pool_unlock();
+    buffer = sdscat(buffer, "]}");
+    return buffer;
+}
+
+//privat functions
+static void *mpd_client_pool_loop(void *arg) {
+    unsigned idx = (unsigned)(intptr_t)arg;
+    thread_logname = sdscatfmt(sdsempty(), "mpdpool%u", idx);
+    t_mpd_client_state *mpd_client_state = (t_mpd_client_state *)malloc(sizeof(t_mpd_client_state));
+    assert(mpd_client_state);
+    default_mpd_client_state(mpd_client_state);
+    mpd_client_state->mpd_state->conn_state = MPD_DISCONNECTED;
+    unsigned long generation = 0;
+    while (s_signal_received == 0) {
+        generation = mpd_client_pool_sync(mpd_client_state, generation);
+        mpd_client_pool_idle(mpd_client_state, idx, generation);
+    }
+    mpd_shared_mpd_disconnect(mpd_client_state->mpd_state);
+    free_mpd_client_state(mpd_client_state);
+    sdsfree(thread_logname);
+    return NULL;
+}
+
+static void mpd_client_pool_idle(t_mpd_client_state *mpd_client_state, unsigned idx, unsigned long generation) {
+    t_mpd_state *mpd_state = mpd_client_state->mpd_state;
+    if (generation == 0 || mpd_state->conn_state != MPD_CONNECTED) {
+        if (generation > 0 && mpd_state->conn_state == MPD_DISCONNECTED) {
+            if (mpd_shared_mpd_connect(mpd_state) == true) {
+                LOG_INFO("MPD pool connection %u connected", idx);
+                mpd_state->reconnect_interval = 0;
+                if (mpd_send_idle_mask(mpd_state->conn, MPD_IDLE_DATABASE) == false) {
+                    mpd_state->conn_state = MPD_FAILURE;
+                }
+            }
+        }
+        else if (generation > 0 && mpd_state->conn_state != MPD_WAIT) {
+            //MPD_FAILURE, MPD_DISCONNECT or MPD_RECONNECT
+            if (mpd_state->conn != NULL) {
+                mpd_connection_free(mpd_state->conn);
+                mpd_state->conn = NULL;
+            }
+            mpd_state->conn_state = MPD_WAIT;
+            if (mpd_state->reconnect_interval <= 20) {
+                mpd_state->reconnect_interval += 2;
+            }
+            mpd_state->reconnect_time = time(NULL) + mpd_state->reconnect_interval;
+        }
+        else if (mpd_state->conn_state == MPD_WAIT && time(NULL) > mpd_state->reconnect_time) {
+            mpd_state->conn_state = MPD_DISCONNECTED;
+        }
+        mpd_client_pool_lock();
+        pool.stats[idx].connected = mpd_state->conn_state == MPD_CONNECTED ? true : false;
+        mpd_client_pool_unlock();
+        //the pool is not ready, mpd_client handles the requests
+        if (mpd_state->conn_state != MPD_CONNECTED && tiny_queue_length(mpd_client_pool_queue, 50) > 0) {
+            t_work_request *request = tiny_queue_shift(mpd_client_pool_queue, 50, 0);
+            if (request != NULL) {
+                mpd_client_pool_forward(request, idx);
+            }
+        }
+        return;
+    }
+
+    struct pollfd fds[1];
+    fds[0].fd = mpd_connection_get_fd(mpd_state->conn);
+    fds[0].events = POLLIN;
+    int pollrc = poll(fds, 1, 50);
+    unsigned queue_length = tiny_queue_length(mpd_client_pool_queue, 0);
+    if (pollrc == 0 && queue_length == 0) {
+        return;
+    }
+    if (mpd_send_noidle(mpd_state->conn) == false) {
+        check_error_and_recover(mpd_state, NULL, NULL, 0);
+        mpd_state->conn_state = MPD_FAILURE;
+        return;
+    }
+    //discard idle events, the connection is only in idle mode to keep it open
+    mpd_recv_idle(mpd_state->conn, false);
+    if (queue_length > 0) {
+        t_work_request *request = tiny_queue_shift(mpd_client_pool_queue, 50, 0);
+        if (request != NULL) {
+            if (mpd_client_pool_readonly(request) == true) {
+                struct timespec start;
+                struct timespec end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                mpd_client_api(pool.config, mpd_client_state, request);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                unsigned long latency = (unsigned long)((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
+                mpd_client_pool_lock();
+                pool.stats[idx].requests++;
+                pool.stats[idx].latency_sum += latency;
+                if (latency > pool.stats[idx].latency_max) {
+                    pool.stats[idx].latency_max = latency;
+                }
+                mpd_client_pool_unlock();
+            }
+            else {
+                mpd_client_pool_forward(request, idx);
+            }
+        }
+    }
+    if (mpd_state->conn_state == MPD_CONNECTED && mpd_send_idle_mask(mpd_state->conn, MPD_IDLE_DATABASE) == false) {
+        check_error_and_recover(mpd_state, NULL, NULL, 0);
+        mpd_state->conn_state = MPD_FAILURE;
+    }
+}
+
+//copies the published state, reconnects if the mpd host has changed
+static unsigned long mpd_client_pool_sync(t_mpd_client_state *mpd_client_state, unsigned long generation) {
+    mpd_client_pool_lock();
+    if (pool.generation == generation) {
+        mpd_client_pool_unlock();
+        return generation;
+    }
+    bool host_changed = strcmp(mpd_client_state->mpd_state->mpd_host, pool.published->mpd_state->mpd_host) != 0 ||
+        strcmp(mpd_client_state->mpd_state->mpd_pass, pool.published->mpd_state->mpd_pass) != 0 ||
+        mpd_client_state->mpd_state->mpd_port != pool.published->mpd_state->mpd_port;
+    mpd_client_pool_copy_state(mpd_client_state, pool.published);
+    generation = pool.generation;
+    mpd_client_pool_unlock();
+    if (mpd_client_state->mpd_state->conn_state == MPD_CONNECTED) {
+        if (host_changed == true) {
+            mpd_client_state->mpd_state->conn_state = MPD_DISCONNECT;
+        }
+        else if (mpd_send_noidle(mpd_client_state->mpd_state->conn) == true) {
+            //enable the new tags
+            mpd_recv_idle(mpd_client_state->mpd_state->conn, false);
+            if (mpd_client_state->mpd_state->feat_tags == true) {
+                enable_mpd_tags(mpd_client_state->mpd_state, mpd_client_state->mpd_state->mympd_tag_types);
+            }
+            if (mpd_send_idle_mask(mpd_client_state->mpd_state->conn, MPD_IDLE_DATABASE) == false) {
+                mpd_client_state->mpd_state->conn_state = MPD_FAILURE;
+            }
+        }
+        else {
+            mpd_client_state->mpd_state->conn_state = MPD_FAILURE;
+        }
+    }
+    return generation;
+}
+
+//copies the settings and features used by the read-only requests
+static void mpd_client_pool_copy_state(t_mpd_client_state *dst, t_mpd_client_state *src) {
+    mpd_shared_copy_mpd_state(dst->mpd_state, src->mpd_state);
+    dst->feat_sticker = src->feat_sticker;
+    dst->feat_playlists = src->feat_playlists;
+    dst->feat_library = src->feat_library;
+    dst->feat_smartpls = src->feat_smartpls;
+    dst->coverimage = src->coverimage;
+    dst->coverimage_name = sdsreplace(dst->coverimage_name, src->coverimage_name);
+    dst->music_directory_value = sdsreplace(dst->music_directory_value, src->music_directory_value);
+    dst->booklet_name = sdsreplace(dst->booklet_name, src->booklet_name);
+    dst->searchtaglist = sdsreplace(dst->searchtaglist, src->searchtaglist);
+    dst->browsetaglist = sdsreplace(dst->browsetaglist, src->browsetaglist);
+    dst->search_tag_types = src->search_tag_types;
+    dst->browse_tag_types = src->browse_tag_types;
+}
+
+//searches can add the result to the queue or a playlist
+static bool mpd_client_pool_readonly(t_work_request *request) {
+    if (request->cmd_id != MPD_API_DATABASE_SEARCH && request->cmd_id != MPD_API_DATABASE_SEARCH_ADV) {
+        return true;
+    }
+    //requests from the web server are already parsed
+    t_api_params *params = request_params(request);
+    char *plist = NULL;
+    bool replace = false;
+    api_param_string(params, "plist", &plist);
+    api_param_bool(params, "replace", &replace);
+    bool rc = (plist == NULL || plist[0] == '\0') && replace == false;
+    FREE_PTR(plist);
+    return rc;
+}
+
+static void mpd_client_pool_forward(t_work_request *request, unsigned idx) {
+    LOG_DEBUG("Forwarding request %s to mpd_client", request->method);
+    mpd_client_pool_lock();
+    pool.stats[idx].forwarded++;
+    mpd_client_pool_unlock();
+    tiny_queue_push(mpd_client_queue, request, 0);
+}
+
+static void mpd_client_pool_lock(void) {
+    int rc = pthread_mutex_lock(&pool_mutex);
+    if (rc != 0) {
+        LOG_ERROR("Error in pthread_mutex_lock: %d", rc);
+    }
+}
+
+static void mpd_client_pool_unlock(void) {
+    int rc = pthread_mutex_unlock(&pool_mutex);
+    if (rc != 0) {
+        LOG_ERROR("Error in pthread_mutex_unlock: %d", rc);
+    }
+}
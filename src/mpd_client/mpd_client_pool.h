@@ -0,0 +1,13 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __MPD_CLIENT_POOL_H__
+#define __MPD_CLIENT_POOL_H__
+void mpd_client_pool_start(t_config *config);
+void mpd_client_pool_stop(void);
+void mpd_client_pool_publish(t_mpd_client_state *mpd_client_state);
+sds mpd_client_pool_stats(sds buffer);
+#endif
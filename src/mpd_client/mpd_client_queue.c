@@ -8,6 +8,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <signal.h>
+#include <pthread.h>
 #include <mpd/client.h>
 
 #include "../../dist/src/sds/sds.h"
@@ -17,12 +19,18 @@
 #include "../list.h"
 #include "config_defs.h"
 #include "../utility.h"
+#include "../tiny_queue.h"
+#include "../global.h"
 #include "../mpd_shared/mpd_shared_typedefs.h"
 #include "../mpd_shared/mpd_shared_tags.h"
 #include "../mpd_shared.h"
 #include "mpd_client_utility.h"
 #include "mpd_client_queue.h"
 
+//private definitions
+static long _mpd_client_get_queue_changed_from(t_mpd_client_state *mpd_client_state, unsigned version);
+
+//public functions
 bool mpd_client_queue_prio_set_highest(t_mpd_client_state *mpd_client_state, const unsigned trackid) {
     //default prio is 10
     unsigned priority = 10;
@@ -105,20 +113,39 @@ sds mpd_client_get_queue_state(t_mpd_client_state *mpd_client_state, sds buffer)
         return buffer;
     }
 
+    //lowest changed position since the last queue version, -1 if unknown
+    long changed_from = -1;
+    if (buffer != NULL) {
+        unsigned new_length = mpd_status_get_queue_length(status);
+        if (mpd_client_state->queue_notify_version > 0) {
+            changed_from = _mpd_client_get_queue_changed_from(mpd_client_state, mpd_client_state->queue_notify_version);
+        }
+        if (changed_from > -1) {
+            //removed songs at the end are not reported by plchanges
+            unsigned min_length = mpd_client_state->queue_notify_length < new_length ? mpd_client_state->queue_notify_length : new_length;
+            if ((long)min_length < changed_from) {
+                changed_from = min_length;
+            }
+        }
+        mpd_client_state->queue_notify_version = mpd_status_get_queue_version(status);
+        mpd_client_state->queue_notify_length = new_length;
+    }
+
     mpd_client_state->queue_version = mpd_status_get_queue_version(status);
     mpd_client_state->queue_length = mpd_status_get_queue_length(status);
     mpd_client_state->crossfade = mpd_status_get_crossfade(status);
     mpd_client_state->mpd_state->state = mpd_status_get_state(status);
 
     if (buffer != NULL) {
-        buffer = mpd_client_put_queue_state(status, buffer);
+        buffer = mpd_client_put_queue_state(status, buffer, changed_from);
     }
     mpd_status_free(status);
     return buffer;
 }
 
-sds mpd_client_put_queue_state(struct mpd_status *status, sds buffer) {
+sds mpd_client_put_queue_state(struct mpd_status *status, sds buffer, long changed_from) {
     buffer = jsonrpc_start_notify(buffer, "update_queue");
+    buffer = tojson_long(buffer, "changedFrom", changed_from, true);
     buffer = tojson_long(buffer, "state", mpd_status_get_state(status), true);
     buffer = tojson_long(buffer, "queueLength", mpd_status_get_queue_length(status), true);
     buffer = tojson_long(buffer, "queueVersion", mpd_status_get_queue_version(status), true);
@@ -167,6 +194,7 @@ sds mpd_client_put_queue(t_mpd_client_state *mpd_client_state, sds buffer, sds m
         buffer = put_song_tags(buffer, mpd_client_state->mpd_state, tagcols, song);
         buffer = sdscat(buffer, "}");
         mpd_song_free(song);
+        buffer = response_chunk(buffer);
     }
 
     buffer = sdscat(buffer, "],");
@@ -183,6 +211,7 @@ sds mpd_client_put_queue(t_mpd_client_state *mpd_client_state, sds buffer, sds m
 
     mpd_response_finish(mpd_client_state->mpd_state->conn);
     if (check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false) == false) {
+        response_chunk_abort();
         return buffer;
     }
     
@@ -294,3 +323,24 @@ sds mpd_client_search_queue(t_mpd_client_state *mpd_client_state, sds buffer, sd
     
     return buffer;
 }
+
+//private functions
+static long _mpd_client_get_queue_changed_from(t_mpd_client_state *mpd_client_state, unsigned version) {
+    long changed_from = LONG_MAX;
+    if (mpd_send_queue_changes_brief(mpd_client_state->mpd_state->conn, version) == false) {
+        check_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0);
+        return -1;
+    }
+    unsigned position;
+    unsigned id;
+    while (mpd_recv_queue_change_brief(mpd_client_state->mpd_state->conn, &position, &id) == true) {
+        if ((long)position < changed_from) {
+            changed_from = position;
+        }
+    }
+    mpd_response_finish(mpd_client_state->mpd_state->conn);
+    if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false) == false) {
+        return -1;
+    }
+    return changed_from;
+}
@@ -7,7 +7,7 @@
 #ifndef __MPD_CLIENT_QUEUE_H__
 #define __MPD_CLIENT_QUEUE_H__
 sds mpd_client_get_queue_state(t_mpd_client_state *mpd_client_state, sds buffer);
-sds mpd_client_put_queue_state(struct mpd_status *status, sds buffer);
+sds mpd_client_put_queue_state(struct mpd_status *status, sds buffer, long changed_from);
 sds mpd_client_put_queue(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id,
                          unsigned int offset, unsigned int limit, const t_tags *tagcols);
 sds mpd_client_crop_queue(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id, bool or_clear);
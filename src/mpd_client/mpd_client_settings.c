@@ -229,23 +229,39 @@ bool mpd_api_settings_set(t_config *config, t_mpd_client_state *mpd_client_state
 }
 
 sds mpd_client_put_settings(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id) {
+    //method NULL creates the update_options notify, on error the bare notify is sent
     struct mpd_status *status = mpd_run_status(mpd_client_state->mpd_state->conn);
     if (status == NULL) {
+        if (method == NULL) {
+            check_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0);
+            return jsonrpc_notify(buffer, "update_options");
+        }
         buffer = check_error_and_recover(mpd_client_state->mpd_state, buffer, method, request_id);
         return buffer;
     }
 
     enum mpd_replay_gain_mode replay_gain_mode = mpd_run_replay_gain_status(mpd_client_state->mpd_state->conn);
     if (replay_gain_mode == MPD_REPLAY_UNKNOWN) {
-        if (check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false) == false) {
+        if (method == NULL) {
+            if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false) == false) {
+                mpd_status_free(status);
+                return jsonrpc_notify(buffer, "update_options");
+            }
+        }
+        else if (check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false) == false) {
             mpd_status_free(status);
             return buffer;
         }
     }
     const char *replaygain = mpd_lookup_replay_gain_mode(replay_gain_mode);
     
-    buffer = jsonrpc_start_result(buffer, method, request_id);
-    buffer = sdscat(buffer, ",");
+    if (method == NULL) {
+        buffer = jsonrpc_start_notify(buffer, "update_options");
+    }
+    else {
+        buffer = jsonrpc_start_result(buffer, method, request_id);
+        buffer = sdscat(buffer, ",");
+    }
     buffer = tojson_long(buffer, "repeat", mpd_status_get_repeat(status), true);
     if (mpd_client_state->feat_single_oneshot == true) {
         buffer = tojson_long(buffer, "single", mpd_status_get_single_state(status), true);
@@ -294,7 +310,12 @@ sds mpd_client_put_settings(t_mpd_client_state *mpd_client_state, sds buffer, sd
     buffer = print_trigger_list(buffer);
     buffer = sdscat(buffer, "}");
     
-    buffer = jsonrpc_end_result(buffer);
+    if (method == NULL) {
+        buffer = jsonrpc_end_notify(buffer);
+    }
+    else {
+        buffer = jsonrpc_end_result(buffer);
+    }
     
     return buffer;
 }
@@ -26,8 +26,6 @@
 #include "../mpd_shared/mpd_shared_tags.h"
 #include "../mpd_shared.h"
 #include "mpd_client_utility.h"
-#include "mpd_client_cover.h"
-#include "mpd_client_api.h"
 #include "mpd_client_sticker.h"
 #include "mpd_client_state.h"
 
@@ -271,12 +269,21 @@ sds mpd_client_put_current_song(t_mpd_client_state *mpd_client_state, sds buffer
 //private functions
 static sds _mpd_client_put_outputs(t_mpd_client_state *mpd_client_state, sds buffer, sds method, long request_id) {
     bool rc = mpd_send_outputs(mpd_client_state->mpd_state->conn);
-    if (check_rc_error_and_recover(mpd_client_state->mpd_state, &buffer, method, request_id, false, rc, "mpd_send_outputs") == false) {
-        return buffer;
+    if (method == NULL) {
+        //send the bare notify on error, the clients fetch the outputs
+        if (check_rc_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_send_outputs") == false) {
+            return jsonrpc_notify(buffer, "update_outputs");
+        }
+        buffer = jsonrpc_start_notify(buffer, "update_outputs");
+        buffer = sdscat(buffer, "\"data\":[");
+    }
+    else {
+        if (check_rc_error_and_recover(mpd_client_state->mpd_state, &buffer, method, request_id, false, rc, "mpd_send_outputs") == false) {
+            return buffer;
+        }
+        buffer = jsonrpc_start_result(buffer, method, request_id);
+        buffer = sdscat(buffer, ",\"data\":[");
     }
-
-    buffer = jsonrpc_start_result(buffer, method, request_id);
-    buffer = sdscat(buffer, ",\"data\":[");
     int nr = 0;
     struct mpd_output *output;
     while ((output = mpd_recv_output(mpd_client_state->mpd_state->conn)) != NULL) {
@@ -301,13 +308,23 @@ static sds _mpd_client_put_outputs(t_mpd_client_state *mpd_client_state, sds buf
         mpd_output_free(output);
     }
     mpd_response_finish(mpd_client_state->mpd_state->conn);
-    if (check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false) == false) {
+    if (method == NULL) {
+        if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false) == false) {
+            return jsonrpc_notify(buffer, "update_outputs");
+        }
+    }
+    else if (check_error_and_recover2(mpd_client_state->mpd_state, &buffer, method, request_id, false) == false) {
         return buffer;
     }
 
     buffer = sdscat(buffer, "],");
     buffer = tojson_long(buffer, "numOutputs", nr, false);
-    buffer = jsonrpc_end_result(buffer);
+    if (method == NULL) {
+        buffer = jsonrpc_end_notify(buffer);
+    }
+    else {
+        buffer = jsonrpc_end_result(buffer);
+    }
     
     return buffer;
 }
@@ -26,33 +26,104 @@
 #include "../mpd_shared/mpd_shared_typedefs.h"
 #include "../mpd_shared/mpd_shared_tags.h"
 #include "../mpd_shared.h"
+#include "../mpd_shared/mpd_shared_sticker.h"
 #include "mpd_client_utility.h"
 #include "mpd_client_sticker.h"
 
 //privat definitions
-static bool _mpd_client_count_song_uri(t_mpd_client_state *mpd_client_state, const char *uri, const char *name, const long value);
-static bool _mpd_client_set_sticker(t_mpd_client_state *mpd_client_state, const char *uri, const char *name, const long value);
+//pending sticker changes for one song, coalesced until the next flush
+struct t_sticker_update {
+    unsigned play_count_inc;
+    unsigned skip_count_inc;
+    long last_played;
+    long last_skipped;
+    long like;
+    //current values from mpd, only needed for increments of uncached songs
+    t_sticker current;
+    bool current_valid;
+};
+
+static struct t_sticker_update *_mpd_client_sticker_update(t_mpd_client_state *mpd_client_state, const char *uri);
+static void _mpd_client_sticker_apply(t_sticker *sticker, const struct t_sticker_update *update);
+static unsigned _mpd_client_sticker_add(unsigned value, unsigned inc);
+static void _mpd_client_sticker_recv(t_mpd_client_state *mpd_client_state, t_sticker *sticker);
+static void _mpd_client_sticker_fetch_current(t_mpd_client_state *mpd_client_state);
+static void _mpd_client_sticker_set_list(t_mpd_client_state *mpd_client_state, struct list *set_list);
 
 //public functions
 bool mpd_client_sticker_inc_play_count(t_mpd_client_state *mpd_client_state, const char *uri) {
-    return list_push(&mpd_client_state->sticker_queue, uri, 1, "playCount", NULL);
+    struct t_sticker_update *update = _mpd_client_sticker_update(mpd_client_state, uri);
+    if (update == NULL) {
+        return false;
+    }
+    update->play_count_inc++;
+    sticker_cache_lock();
+    t_sticker *sticker = get_sticker_from_cache(mpd_client_state, uri);
+    if (sticker != NULL) {
+        sticker->playCount = _mpd_client_sticker_add(sticker->playCount, 1);
+    }
+    sticker_cache_unlock();
+    return true;
 }
 
 bool mpd_client_sticker_inc_skip_count(t_mpd_client_state *mpd_client_state, const char *uri) {
-    return list_push(&mpd_client_state->sticker_queue, uri, 1, "skipCount", NULL);
+    struct t_sticker_update *update = _mpd_client_sticker_update(mpd_client_state, uri);
+    if (update == NULL) {
+        return false;
+    }
+    update->skip_count_inc++;
+    sticker_cache_lock();
+    t_sticker *sticker = get_sticker_from_cache(mpd_client_state, uri);
+    if (sticker != NULL) {
+        sticker->skipCount = _mpd_client_sticker_add(sticker->skipCount, 1);
+    }
+    sticker_cache_unlock();
+    return true;
 }
 
 bool mpd_client_sticker_like(t_mpd_client_state *mpd_client_state, const char *uri, int value) {
-    return list_push(&mpd_client_state->sticker_queue, uri, value, "like", NULL);
+    struct t_sticker_update *update = _mpd_client_sticker_update(mpd_client_state, uri);
+    if (update == NULL) {
+        return false;
+    }
+    update->like = value;
+    sticker_cache_lock();
+    t_sticker *sticker = get_sticker_from_cache(mpd_client_state, uri);
+    if (sticker != NULL) {
+        sticker->like = value;
+    }
+    sticker_cache_unlock();
+    return true;
 }
 
 bool mpd_client_sticker_last_played(t_mpd_client_state *mpd_client_state, const char *uri) {
-    return list_push(&mpd_client_state->sticker_queue, uri, mpd_client_state->song_start_time, "lastPlayed", NULL);
+    struct t_sticker_update *update = _mpd_client_sticker_update(mpd_client_state, uri);
+    if (update == NULL) {
+        return false;
+    }
+    update->last_played = mpd_client_state->song_start_time;
+    sticker_cache_lock();
+    t_sticker *sticker = get_sticker_from_cache(mpd_client_state, uri);
+    if (sticker != NULL) {
+        sticker->lastPlayed = update->last_played;
+    }
+    sticker_cache_unlock();
+    return true;
 }
 
 bool mpd_client_sticker_last_skipped(t_mpd_client_state *mpd_client_state, const char *uri) {
-    time_t now = time(NULL);
-    return list_push(&mpd_client_state->sticker_queue, uri, now, "lastSkipped", NULL);
+    struct t_sticker_update *update = _mpd_client_sticker_update(mpd_client_state, uri);
+    if (update == NULL) {
+        return false;
+    }
+    update->last_skipped = time(NULL);
+    sticker_cache_lock();
+    t_sticker *sticker = get_sticker_from_cache(mpd_client_state, uri);
+    if (sticker != NULL) {
+        sticker->lastSkipped = update->last_skipped;
+    }
+    sticker_cache_unlock();
+    return true;
 }
 
 bool mpd_client_sticker_dequeue(t_mpd_client_state *mpd_client_state) {
@@ -62,25 +133,77 @@ bool mpd_client_sticker_dequeue(t_mpd_client_state *mpd_client_state) {
         LOG_VERBOSE("Delay setting stickers, sticker_cache is building");
         return false;
     }
-    
+    if (mpd_client_state->sticker_queue.length == 0) {
+        return true;
+    }
+    //increments for songs that are not in the sticker cache needs the current values
+    _mpd_client_sticker_fetch_current(mpd_client_state);
+
+    struct list set_list;
+    list_init(&set_list);
     struct list_node *current = mpd_client_state->sticker_queue.head;
     while (current != NULL) {
-        LOG_DEBUG("Setting %s = %ld for %s", current->value_p, current->value_i, current->key);
-        if (strcmp(current->value_p, "playCount") == 0 || strcmp(current->value_p, "skipCount") == 0) {
-            _mpd_client_count_song_uri(mpd_client_state, current->key, current->value_p, current->value_i);
+        struct t_sticker_update *update = (struct t_sticker_update *)current->user_data;
+        t_sticker *sticker = get_sticker_from_cache(mpd_client_state, current->key);
+        if (update->play_count_inc > 0 || update->skip_count_inc > 0) {
+            if (sticker != NULL) {
+                //increments are already applied to the cache
+                if (update->play_count_inc > 0) {
+                    list_push(&set_list, current->key, sticker->playCount, "playCount", NULL);
+                }
+                if (update->skip_count_inc > 0) {
+                    list_push(&set_list, current->key, sticker->skipCount, "skipCount", NULL);
+                }
+            }
+            else if (update->current_valid == true) {
+                if (update->play_count_inc > 0) {
+                    list_push(&set_list, current->key, _mpd_client_sticker_add(update->current.playCount, update->play_count_inc), "playCount", NULL);
+                }
+                if (update->skip_count_inc > 0) {
+                    list_push(&set_list, current->key, _mpd_client_sticker_add(update->current.skipCount, update->skip_count_inc), "skipCount", NULL);
+                }
+            }
+            else {
+                LOG_ERROR("Can not get stickers for \"%s\", discarding count updates", current->key);
+            }
         }
-        else if (strcmp(current->value_p, "like") == 0 || strcmp(current->value_p, "lastPlayed") == 0 || 
-                 strcmp(current->value_p, "lastSkipped") == 0) 
-        {
-            _mpd_client_set_sticker(mpd_client_state, current->key, current->value_p, current->value_i);
+        if (update->like > -1) {
+            list_push(&set_list, current->key, update->like, "like", NULL);
+        }
+        if (update->last_played > 0) {
+            list_push(&set_list, current->key, update->last_played, "lastPlayed", NULL);
         }
-        list_shift(&mpd_client_state->sticker_queue, 0);
-        current = mpd_client_state->sticker_queue.head;
+        if (update->last_skipped > 0) {
+            list_push(&set_list, current->key, update->last_skipped, "lastSkipped", NULL);
+        }
+        current = current->next;
     }
+    LOG_VERBOSE("Writing %u stickers for %u songs", set_list.length, mpd_client_state->sticker_queue.length);
+    list_free(&mpd_client_state->sticker_queue);
+    _mpd_client_sticker_set_list(mpd_client_state, &set_list);
+    list_free(&set_list);
     return true;
 }
 
+void mpd_client_sticker_queue_to_cache(t_mpd_client_state *mpd_client_state) {
+    if (mpd_client_state->sticker_cache == NULL) {
+        return;
+    }
+    //caller must hold the sticker cache lock
+    struct list_node *current = mpd_client_state->sticker_queue.head;
+    while (current != NULL) {
+        t_sticker *sticker = get_sticker_from_cache(mpd_client_state, current->key);
+        if (sticker != NULL) {
+            _mpd_client_sticker_apply(sticker, (struct t_sticker_update *)current->user_data);
+        }
+        current = current->next;
+    }
+}
+
 struct t_sticker *get_sticker_from_cache(t_mpd_client_state *mpd_client_state, const char *uri) {
+    if (mpd_client_state->sticker_cache == NULL) {
+        return NULL;
+    }
     void *data = raxFind(mpd_client_state->sticker_cache, (unsigned char*)uri, strlen(uri));
     if (data == raxNotFound) {
         return NULL;
@@ -90,8 +213,6 @@ struct t_sticker *get_sticker_from_cache(t_mpd_client_state *mpd_client_state, c
 }
 
 bool mpd_client_get_sticker(t_mpd_client_state *mpd_client_state, const char *uri, t_sticker *sticker) {
-    struct mpd_pair *pair;
-    char *crap = NULL;
     sticker->playCount = 0;
     sticker->skipCount = 0;
     sticker->lastPlayed = 0;
@@ -102,11 +223,78 @@ bool mpd_client_get_sticker(t_mpd_client_state *mpd_client_state, const char *ur
         return false;
     }
 
+    //the sticker cache includes all pending changes
+    t_sticker *cached = get_sticker_from_cache(mpd_client_state, uri);
+    if (cached != NULL) {
+        memcpy(sticker, cached, sizeof(t_sticker));
+        return true;
+    }
+
     bool rc = mpd_send_sticker_list(mpd_client_state->mpd_state->conn, "song", uri);
     if (check_rc_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_send_sticker_list") == false) {
         return false;
     }
+    _mpd_client_sticker_recv(mpd_client_state, sticker);
+    mpd_response_finish(mpd_client_state->mpd_state->conn);
+    if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false) == false) {
+        return false;
+    }
+
+    //overlay not yet written changes
+    struct list_node *pending = list_get_node(&mpd_client_state->sticker_queue, uri);
+    if (pending != NULL) {
+        _mpd_client_sticker_apply(sticker, (struct t_sticker_update *)pending->user_data);
+    }
+    return true;
+}
+
+//private functions
+static struct t_sticker_update *_mpd_client_sticker_update(t_mpd_client_state *mpd_client_state, const char *uri) {
+    if (uri == NULL || is_streamuri(uri) == true) {
+        LOG_ERROR("Failed to queue sticker update, invalid song uri: %s", uri);
+        return NULL;
+    }
+    struct list_node *node = list_get_node(&mpd_client_state->sticker_queue, uri);
+    if (node != NULL) {
+        return (struct t_sticker_update *)node->user_data;
+    }
+    struct t_sticker_update *update = (struct t_sticker_update *)malloc(sizeof(struct t_sticker_update));
+    assert(update);
+    update->play_count_inc = 0;
+    update->skip_count_inc = 0;
+    update->last_played = 0;
+    update->last_skipped = 0;
+    update->like = -1;
+    update->current_valid = false;
+    list_push(&mpd_client_state->sticker_queue, uri, 0, NULL, update);
+    return update;
+}
+
+static void _mpd_client_sticker_apply(t_sticker *sticker, const struct t_sticker_update *update) {
+    sticker->playCount = _mpd_client_sticker_add(sticker->playCount, update->play_count_inc);
+    sticker->skipCount = _mpd_client_sticker_add(sticker->skipCount, update->skip_count_inc);
+    if (update->like > -1) {
+        sticker->like = update->like;
+    }
+    if (update->last_played > 0) {
+        sticker->lastPlayed = update->last_played;
+    }
+    if (update->last_skipped > 0) {
+        sticker->lastSkipped = update->last_skipped;
+    }
+}
+
+static unsigned _mpd_client_sticker_add(unsigned value, unsigned inc) {
+    value += inc;
+    if (value > INT_MAX / 2) {
+        value = INT_MAX / 2;
+    }
+    return value;
+}
 
+static void _mpd_client_sticker_recv(t_mpd_client_state *mpd_client_state, t_sticker *sticker) {
+    struct mpd_pair *pair;
+    char *crap = NULL;
     while ((pair = mpd_recv_sticker(mpd_client_state->mpd_state->conn)) != NULL) {
         if (strcmp(pair->name, "playCount") == 0) {
             sticker->playCount = strtoimax(pair->value, &crap, 10);
@@ -125,101 +313,114 @@ bool mpd_client_get_sticker(t_mpd_client_state *mpd_client_state, const char *ur
         }
         mpd_return_sticker(mpd_client_state->mpd_state->conn, pair);
     }
-    mpd_response_finish(mpd_client_state->mpd_state->conn);
-    if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false) == false) {
-        return false;
-    }
-
-    return true;
 }
 
-//private functions
-static bool _mpd_client_count_song_uri(t_mpd_client_state *mpd_client_state, const char *uri, const char *name, const long value) {
-    if (uri == NULL || strstr(uri, "://") != NULL) {
-        return false;
+static void _mpd_client_sticker_fetch_current(t_mpd_client_state *mpd_client_state) {
+    struct mpd_connection *conn = mpd_client_state->mpd_state->conn;
+    unsigned count = 0;
+    struct list_node *current = mpd_client_state->sticker_queue.head;
+    while (current != NULL) {
+        struct t_sticker_update *update = (struct t_sticker_update *)current->user_data;
+        if ((update->play_count_inc > 0 || update->skip_count_inc > 0) && get_sticker_from_cache(mpd_client_state, current->key) == NULL) {
+            count++;
+        }
+        current = current->next;
     }
-    unsigned old_value = 0;
-    t_sticker *sticker = NULL;
-    if (mpd_client_state->sticker_cache != NULL) {
-        sticker = get_sticker_from_cache(mpd_client_state, uri);
-        if (sticker != NULL) {
-            if (strcmp(name, "playCount") == 0) {
-                old_value = sticker->playCount;
-            }
-            else if (strcmp(name, "skipCount") == 0) {
-                old_value = sticker->skipCount;
+    if (count == 0) {
+        return;
+    }
+    //get all needed stickers in one command list
+    bool rc = mpd_command_list_begin(conn, true);
+    current = mpd_client_state->sticker_queue.head;
+    while (rc == true && current != NULL) {
+        struct t_sticker_update *update = (struct t_sticker_update *)current->user_data;
+        if ((update->play_count_inc > 0 || update->skip_count_inc > 0) && get_sticker_from_cache(mpd_client_state, current->key) == NULL) {
+            rc = mpd_send_sticker_list(conn, "song", current->key);
+            if (rc == false) {
+                LOG_ERROR("Error adding command to command list mpd_send_sticker_list");
             }
         }
+        current = current->next;
     }
-    else {
-        struct mpd_pair *pair;
-        char *crap = NULL;
-        bool rc = mpd_send_sticker_list(mpd_client_state->mpd_state->conn, "song", uri);
-        if (check_rc_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_send_sticker_list") == false) {
-            return false;
-        }
-        while ((pair = mpd_recv_sticker(mpd_client_state->mpd_state->conn)) != NULL) {
-            if (strcmp(pair->name, name) == 0) {
-                old_value = strtoimax(pair->value, &crap, 10);
+    if (rc == true) {
+        rc = mpd_command_list_end(conn);
+    }
+    current = mpd_client_state->sticker_queue.head;
+    while (rc == true && current != NULL) {
+        struct t_sticker_update *update = (struct t_sticker_update *)current->user_data;
+        if ((update->play_count_inc > 0 || update->skip_count_inc > 0) && get_sticker_from_cache(mpd_client_state, current->key) == NULL) {
+            update->current.playCount = 0;
+            update->current.skipCount = 0;
+            _mpd_client_sticker_recv(mpd_client_state, &update->current);
+            if (mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
+                break;
             }
-            mpd_return_sticker(mpd_client_state->mpd_state->conn, pair);
-        }
-        mpd_response_finish(mpd_client_state->mpd_state->conn);
-        if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, true) == false) {
-            return false;
+            update->current_valid = true;
+            mpd_response_next(conn);
         }
+        current = current->next;
     }
+    mpd_response_finish(conn);
+    check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false);
 
-    old_value += value;
-    if (old_value > INT_MAX / 2) {
-        old_value = INT_MAX / 2;
-    }
-
-    sds value_str = sdsfromlonglong(old_value);
-    LOG_VERBOSE("Setting sticker: \"%s\" -> %s: %s", uri, name, value_str);
-    bool rc = mpd_run_sticker_set(mpd_client_state->mpd_state->conn, "song", uri, name, value_str);
-    sdsfree(value_str);
-    if (rc == false) {
-        check_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0);
-    }
-    else {
-        if (sticker != NULL) {
-            if (strcmp(name, "playCount") == 0) {
-                sticker->playCount = old_value;
-            }
-            else if (strcmp(name, "skipCount") == 0) {
-                sticker->skipCount = old_value;
+    //an error aborts the command list, e.g. for a removed song, get the remaining stickers one by one
+    current = mpd_client_state->sticker_queue.head;
+    while (current != NULL) {
+        struct t_sticker_update *update = (struct t_sticker_update *)current->user_data;
+        if ((update->play_count_inc > 0 || update->skip_count_inc > 0) && update->current_valid == false &&
+            get_sticker_from_cache(mpd_client_state, current->key) == NULL)
+        {
+            update->current_valid = mpd_client_get_sticker(mpd_client_state, current->key, &update->current);
+            if (update->current_valid == true) {
+                //mpd_client_get_sticker overlays the pending changes, remove them
+                update->current.playCount -= update->play_count_inc;
+                update->current.skipCount -= update->skip_count_inc;
             }
-        }    
+        }
+        current = current->next;
     }
-    return rc;
 }
 
-static bool _mpd_client_set_sticker(t_mpd_client_state *mpd_client_state, const char *uri, const char *name, const long value) {
-    if (uri == NULL || strstr(uri, "://") != NULL) {
-        LOG_ERROR("Failed to set sticker %s to %d, invalid song uri: %s", name, value, uri);
-        return false;
-    }
-    sds value_str = sdsfromlonglong(value);
-    LOG_VERBOSE("Setting sticker: \"%s\" -> %s: %s", uri, name, value_str);
-    bool rc = mpd_run_sticker_set(mpd_client_state->mpd_state->conn, "song", uri, name, value_str);
-    sdsfree(value_str);
-    if (check_rc_error_and_recover(mpd_client_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_run_sticker_set") == false) {
-        return false;
-    }
-    if (mpd_client_state->sticker_cache != NULL) {
-        t_sticker *sticker = get_sticker_from_cache(mpd_client_state, uri);
-        if (sticker != NULL) {
-            if (strcmp(name, "like") == 0) {
-                sticker->like = value;
-            }
-            else if (strcmp(name, "lastPlayed") == 0) {
-                sticker->lastPlayed = value;
+static void _mpd_client_sticker_set_list(t_mpd_client_state *mpd_client_state, struct list *set_list) {
+    struct mpd_connection *conn = mpd_client_state->mpd_state->conn;
+    unsigned start = 0;
+    while (start < set_list->length) {
+        if (mpd_command_list_begin(conn, false) == false) {
+            check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false);
+            return;
+        }
+        unsigned i = 0;
+        struct list_node *current = set_list->head;
+        while (current != NULL) {
+            if (i >= start) {
+                sds value_str = sdsfromlonglong(current->value_i);
+                LOG_VERBOSE("Setting sticker: \"%s\" -> %s: %s", current->key, current->value_p, value_str);
+                bool rc = mpd_send_sticker_set(conn, "song", current->key, current->value_p, value_str);
+                sdsfree(value_str);
+                if (rc == false) {
+                    LOG_ERROR("Error adding command to command list mpd_send_sticker_set");
+                    break;
+                }
             }
-            else if (strcmp(name, "lastSkipped") == 0) {
-                sticker->lastSkipped = value;
+            i++;
+            current = current->next;
+        }
+        if (mpd_command_list_end(conn)) {
+            mpd_response_finish(conn);
+        }
+        if (mpd_connection_get_error(conn) == MPD_ERROR_SERVER) {
+            //the command list stops at the failed command, continue with the next one
+            unsigned location = mpd_connection_get_server_error_location(conn);
+            LOG_ERROR("Setting sticker %u failed", start + location);
+            if (check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false) == false &&
+                mpd_client_state->mpd_state->conn_state == MPD_FAILURE)
+            {
+                return;
             }
+            start += location + 1;
+            continue;
         }
+        check_error_and_recover2(mpd_client_state->mpd_state, NULL, NULL, 0, false);
+        return;
     }
-    return true;
 }
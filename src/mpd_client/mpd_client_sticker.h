@@ -12,6 +12,7 @@ bool mpd_client_sticker_like(t_mpd_client_state *mpd_client_state, const char *u
 bool mpd_client_sticker_last_played(t_mpd_client_state *mpd_client_state, const char *uri);
 bool mpd_client_sticker_last_skipped(t_mpd_client_state *mpd_client_state, const char *uri);
 bool mpd_client_sticker_dequeue(t_mpd_client_state *mpd_client_state);
+void mpd_client_sticker_queue_to_cache(t_mpd_client_state *mpd_client_state);
 struct t_sticker *get_sticker_from_cache(t_mpd_client_state *mpd_client_state, const char *uri);
 bool mpd_client_get_sticker(t_mpd_client_state *mpd_client_state, const char *uri, t_sticker *sticker);
 #endif
@@ -123,6 +123,8 @@ void default_mpd_client_state(t_mpd_client_state *mpd_client_state) {
     mpd_client_state->last_song_uri = sdsempty();
     mpd_client_state->queue_version = 0;
     mpd_client_state->queue_length = 0;
+    mpd_client_state->queue_notify_version = 0;
+    mpd_client_state->queue_notify_length = 0;
     mpd_client_state->last_last_played_id = -1;
     mpd_client_state->song_end_time = 0;
     mpd_client_state->song_start_time = 0;
@@ -40,6 +40,9 @@ typedef struct t_mpd_client_state {
     sds last_song_uri;
     unsigned queue_version;
     unsigned queue_length;
+    //queue version and length of the last update_queue notify
+    unsigned queue_notify_version;
+    unsigned queue_notify_length;
     int last_last_played_id;
     int last_skipped_id;
     time_t song_end_time;
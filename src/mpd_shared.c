@@ -29,6 +29,7 @@
 
 //mpd state
 void mpd_shared_default_mpd_state(t_mpd_state *mpd_state) {
+    mpd_state->conn = NULL;
     mpd_state->conn_state = MPD_DISCONNECTED;
     mpd_state->reconnect_time = 0;
     mpd_state->reconnect_interval = 0;
@@ -49,10 +50,49 @@ void mpd_shared_free_mpd_state(t_mpd_state *mpd_state) {
     free(mpd_state);
 }
 
+void mpd_shared_copy_mpd_state(t_mpd_state *dst, t_mpd_state *src) {
+    dst->mpd_host = sdsreplace(dst->mpd_host, src->mpd_host);
+    dst->mpd_port = src->mpd_port;
+    dst->mpd_pass = sdsreplace(dst->mpd_pass, src->mpd_pass);
+    dst->timeout = src->timeout;
+    dst->taglist = sdsreplace(dst->taglist, src->taglist);
+    dst->mympd_tag_types = src->mympd_tag_types;
+    dst->mpd_tag_types = src->mpd_tag_types;
+    dst->feat_mpd_searchwindow = src->feat_mpd_searchwindow;
+    dst->feat_tags = src->feat_tags;
+    dst->feat_advsearch = src->feat_advsearch;
+}
+
+bool mpd_shared_mpd_connect(t_mpd_state *mpd_state) {
+    mpd_state->conn = mpd_connection_new(mpd_state->mpd_host, mpd_state->mpd_port, mpd_state->timeout);
+    if (mpd_state->conn == NULL) {
+        LOG_ERROR("MPD connection failed: out-of-memory");
+        mpd_state->conn_state = MPD_FAILURE;
+        return false;
+    }
+    if (mpd_connection_get_error(mpd_state->conn) != MPD_ERROR_SUCCESS) {
+        LOG_ERROR("MPD connection: %s", mpd_connection_get_error_message(mpd_state->conn));
+        mpd_state->conn_state = MPD_FAILURE;
+        return false;
+    }
+    if (sdslen(mpd_state->mpd_pass) > 0 && !mpd_run_password(mpd_state->conn, mpd_state->mpd_pass)) {
+        LOG_ERROR("MPD connection: %s", mpd_connection_get_error_message(mpd_state->conn));
+        mpd_state->conn_state = MPD_FAILURE;
+        return false;
+    }
+    mpd_connection_set_timeout(mpd_state->conn, mpd_state->timeout);
+    mpd_state->conn_state = MPD_CONNECTED;
+    if (mpd_state->feat_tags == true) {
+        enable_mpd_tags(mpd_state, mpd_state->mympd_tag_types);
+    }
+    return true;
+}
+
 void mpd_shared_mpd_disconnect(t_mpd_state *mpd_state) {
     mpd_state->conn_state = MPD_DISCONNECT;
     if (mpd_state->conn != NULL) {
         mpd_connection_free(mpd_state->conn);
+        mpd_state->conn = NULL;
     }
 }
 
@@ -139,3 +179,40 @@ sds respond_with_mpd_error_or_ok(t_mpd_state *mpd_state, sds buffer, sds method,
     }
     return jsonrpc_respond_ok(buffer, method, request_id);
 }
+
+//reads one chunk of the albumart or readpicture response into chunk,
+//unlike mpd_run_albumart it returns the total size of the image
+int mpd_shared_read_cover_chunk(struct mpd_connection *conn, bool readpicture, const char *uri, unsigned offset,
+                                sds *chunk, unsigned *size)
+{
+    bool rc = readpicture == true ? mpd_send_readpicture(conn, uri, offset) : mpd_send_albumart(conn, uri, offset);
+    int recv_len = -1;
+    if (rc == true) {
+        struct mpd_pair *pair;
+        while ((pair = mpd_recv_pair(conn)) != NULL) {
+            if (strcmp(pair->name, "size") == 0) {
+                *size = (unsigned)strtoumax(pair->value, NULL, 10);
+            }
+            else if (strcmp(pair->name, "binary") == 0) {
+                size_t len = strtoumax(pair->value, NULL, 10);
+                mpd_return_pair(conn, pair);
+                *chunk = sdsMakeRoomFor(*chunk, len);
+                if (mpd_recv_binary(conn, *chunk + sdslen(*chunk), len) == true) {
+                    sdsIncrLen(*chunk, (ssize_t)len);
+                    recv_len = (int)len;
+                }
+                break;
+            }
+            mpd_return_pair(conn, pair);
+        }
+        if (mpd_response_finish(conn) == false) {
+            recv_len = -1;
+        }
+    }
+    if (recv_len == -1) {
+        //silently clear the error if no albumart is found
+        mpd_connection_clear_error(conn);
+        mpd_response_finish(conn);
+    }
+    return recv_len;
+}
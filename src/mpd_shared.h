@@ -9,6 +9,8 @@
 
 void mpd_shared_free_mpd_state(t_mpd_state *mpd_state);
 void mpd_shared_default_mpd_state(t_mpd_state *mpd_state);
+void mpd_shared_copy_mpd_state(t_mpd_state *dst, t_mpd_state *src);
+bool mpd_shared_mpd_connect(t_mpd_state *mpd_state);
 void mpd_shared_mpd_disconnect(t_mpd_state *mpd_state);
 bool check_rc_error_and_recover(t_mpd_state *mpd_state, sds *buffer,
                                 sds method, long request_id, bool notify, bool rc, const char *command);
@@ -17,4 +19,6 @@ sds check_error_and_recover(t_mpd_state *mpd_state, sds buffer, sds method, long
 sds check_error_and_recover_notify(t_mpd_state *mpd_state, sds buffer);
 sds respond_with_command_error(sds buffer, sds method, long request_id, const char *command);
 sds respond_with_mpd_error_or_ok(t_mpd_state *mpd_state, sds buffer, sds method, long request_id, bool rc, const char *command);
+int mpd_shared_read_cover_chunk(struct mpd_connection *conn, bool readpicture, const char *uri, unsigned offset,
+                                sds *chunk, unsigned *size);
 #endif
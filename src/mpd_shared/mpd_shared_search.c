@@ -9,6 +9,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <signal.h>
+#include <pthread.h>
 #include <mpd/client.h>
 
 #include "../../dist/src/sds/sds.h"
@@ -18,6 +20,8 @@
 #include "../list.h"
 #include "config_defs.h"
 #include "../utility.h"
+#include "../tiny_queue.h"
+#include "../global.h"
 #include "mpd_shared_typedefs.h"
 #include "../mpd_shared.h"
 #include "mpd_shared_tags.h"
@@ -171,6 +175,7 @@ static sds _mpd_shared_search(t_mpd_state *mpd_state, sds buffer, sds method, lo
                 buffer = tojson_char(buffer, "Type", "song", true);
                 buffer = put_song_tags(buffer, mpd_state, tagcols, song);
                 buffer = sdscat(buffer, "}");
+                buffer = response_chunk(buffer);
             }
             mpd_song_free(song);
         }
@@ -206,6 +211,7 @@ static sds _mpd_shared_search(t_mpd_state *mpd_state, sds buffer, sds method, lo
     
     mpd_response_finish(mpd_state->conn);
     if (check_error_and_recover2(mpd_state, &buffer, method, request_id, false) == false) {
+       response_chunk_abort();
        return buffer;
     }
     return buffer;
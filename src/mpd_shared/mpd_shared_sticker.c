@@ -11,6 +11,7 @@
 #include <limits.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 #include <mpd/client.h>
 
 #include "../../dist/src/rax/rax.h"
@@ -25,6 +26,11 @@
 #include "../mpd_shared.h"
 #include "mpd_shared_sticker.h"
 
+//the sticker cache is owned by the mpd_client thread,
+//the mpd_worker thread reads it to update sticker based smart playlists
+static pthread_mutex_t sticker_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rax *sticker_cache_shared = NULL;
+
 bool mpd_shared_get_sticker(t_mpd_state *mpd_state, const char *uri, t_sticker *sticker) {
     struct mpd_pair *pair;
     char *crap = NULL;
@@ -84,3 +90,27 @@ void sticker_cache_free(rax **sticker_cache) {
     raxFree(*sticker_cache);
     *sticker_cache = NULL;
 }
+
+void sticker_cache_lock(void) {
+    int rc = pthread_mutex_lock(&sticker_cache_mutex);
+    if (rc != 0) {
+        LOG_ERROR("Error in pthread_mutex_lock: %d", rc);
+    }
+}
+
+void sticker_cache_unlock(void) {
+    int rc = pthread_mutex_unlock(&sticker_cache_mutex);
+    if (rc != 0) {
+        LOG_ERROR("Error in pthread_mutex_unlock: %d", rc);
+    }
+}
+
+//caller must hold the sticker cache lock
+void sticker_cache_publish(rax *sticker_cache) {
+    sticker_cache_shared = sticker_cache;
+}
+
+//caller must hold the sticker cache lock
+rax *sticker_cache_get_shared(void) {
+    return sticker_cache_shared;
+}
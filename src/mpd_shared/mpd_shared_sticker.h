@@ -11,4 +11,8 @@
 
 bool mpd_shared_get_sticker(t_mpd_state *mpd_state, const char *uri, t_sticker *sticker);
 void sticker_cache_free(rax **sticker_cache);
+void sticker_cache_lock(void);
+void sticker_cache_unlock(void);
+void sticker_cache_publish(rax *sticker_cache);
+rax *sticker_cache_get_shared(void);
 #endif
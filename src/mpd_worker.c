@@ -30,6 +30,7 @@
 #include "mpd_worker/mpd_worker_utility.h"
 #include "mpd_worker/mpd_worker_api.h"
 #include "mpd_worker/mpd_worker_smartpls.h"
+#include "mpd_worker/mpd_worker_coverprefetch.h"
 #include "mpd_worker.h"
 
 //private definitions
@@ -76,7 +77,7 @@ static void mpd_worker_idle(t_config *config, t_mpd_worker_state *mpd_worker_sta
     unsigned mpd_worker_queue_length = 0;
     struct pollfd fds[1];
     int pollrc;
-    enum mpd_idle set_idle_mask = MPD_IDLE_DATABASE;
+    enum mpd_idle set_idle_mask = MPD_IDLE_DATABASE | MPD_IDLE_STICKER;
     
     switch (mpd_worker_state->mpd_state->conn_state) {
         case MPD_WAIT: {
@@ -143,7 +144,11 @@ static void mpd_worker_idle(t_config *config, t_mpd_worker_state *mpd_worker_sta
             mpd_worker_state->mpd_state->reconnect_time = 0;
             
             mpd_worker_features(mpd_worker_state);
-            
+            //changes while disconnected are not announced by idle events
+            mpd_worker_state->db_generation++;
+            mpd_worker_state->sticker_generation++;
+            mpd_worker_smartpls_update_all(config, mpd_worker_state, false, true);
+
             if (!mpd_send_idle_mask(mpd_worker_state->mpd_state->conn, set_idle_mask)) {
                 LOG_ERROR("MPD worker entering idle mode failed");
                 mpd_worker_state->mpd_state->conn_state = MPD_FAILURE;
@@ -173,7 +178,12 @@ static void mpd_worker_idle(t_config *config, t_mpd_worker_state *mpd_worker_sta
             pollrc = poll(fds, 1, 50);
 
             mpd_worker_queue_length = tiny_queue_length(mpd_worker_queue, 50);
-            if (pollrc > 0 || mpd_worker_queue_length > 0) {
+            //rebuild dirty smart playlists one by one if nothing else is to do
+            bool smartpls_dirty = pollrc == 0 && mpd_worker_queue_length == 0 ? mpd_worker_smartpls_dirty(mpd_worker_state) : false;
+            //prefetch covers in the background with the lowest priority
+            bool coverprefetch = pollrc == 0 && mpd_worker_queue_length == 0 && smartpls_dirty == false ?
+                mpd_worker_coverprefetch_pending(config, mpd_worker_state) : false;
+            if (pollrc > 0 || mpd_worker_queue_length > 0 || smartpls_dirty == true || coverprefetch == true) {
                 LOG_DEBUG("Leaving mpd worker idle mode");
                 if (!mpd_send_noidle(mpd_worker_state->mpd_state->conn)) {
                     check_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0);
@@ -188,7 +198,9 @@ static void mpd_worker_idle(t_config *config, t_mpd_worker_state *mpd_worker_sta
 
                 }
                 else {
-                    mpd_response_finish(mpd_worker_state->mpd_state->conn);
+                    //the noidle response can include events, they are needed for the smart playlist scheduler
+                    enum mpd_idle idle_bitmask = mpd_recv_idle(mpd_worker_state->mpd_state->conn, false);
+                    mpd_worker_parse_idle(config, mpd_worker_state, idle_bitmask);
                 }
                 if (mpd_worker_queue_length > 0) {
                     //Handle request
@@ -198,6 +210,12 @@ static void mpd_worker_idle(t_config *config, t_mpd_worker_state *mpd_worker_sta
                         mpd_worker_api(config, mpd_worker_state, request);
                     }
                 }
+                else if (smartpls_dirty == true) {
+                    mpd_worker_smartpls_update_next(config, mpd_worker_state);
+                }
+                else if (coverprefetch == true) {
+                    mpd_worker_coverprefetch_next(config, mpd_worker_state);
+                }
                 LOG_DEBUG("Entering mpd worker idle mode");
                 if (!mpd_send_idle_mask(mpd_worker_state->mpd_state->conn, set_idle_mask)) {
                     check_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0);
@@ -221,9 +239,14 @@ static void mpd_worker_parse_idle(t_config *config, t_mpd_worker_state *mpd_work
             LOG_VERBOSE("MPD idle event: %s", idle_name);
             switch(idle_event) {
                 case MPD_IDLE_DATABASE:
-                    mpd_worker_smartpls_update_all(config, mpd_worker_state, false);
+                    mpd_worker_state->db_generation++;
+                    mpd_worker_smartpls_update_all(config, mpd_worker_state, false, false);
                     //sticker cache and album cache updates are triggered from mpd_client
                     break;
+                case MPD_IDLE_STICKER:
+                    mpd_worker_state->sticker_generation++;
+                    mpd_worker_smartpls_update_all(config, mpd_worker_state, false, false);
+                    break;
                 default: {
                     //other idle events not used
                 }
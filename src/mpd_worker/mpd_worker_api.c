@@ -22,11 +22,13 @@
 #include "../log.h"
 #include "../tiny_queue.h"
 #include "../global.h"
+#include "../api_params.h"
 #include "../mpd_shared/mpd_shared_typedefs.h"
 #include "../mpd_shared.h"
 #include "mpd_worker_utility.h"
 #include "mpd_worker_smartpls.h"
 #include "mpd_worker_cache.h"
+#include "mpd_worker_coverprefetch.h"
 #include "mpd_worker_api.h"
 
 //private definitions
@@ -52,14 +54,15 @@ void mpd_worker_api(t_config *config, t_mpd_worker_state *mpd_worker_state, void
     
     switch(request->cmd_id) {
         case MYMPD_API_SETTINGS_SET: {
-            void *h = NULL;
+            t_api_params *params = request_params(request);
+            unsigned pos = 0;
             struct json_token key;
             struct json_token val;
             rc = true;
             bool mpd_host_changed = false;
             bool check_mpd_error = false;
             sds notify_buffer = sdsempty();
-            while ((h = json_next_key(request->data, sdslen(request->data), h, ".params", &key, &val)) != NULL) {
+            while (api_params_next(params, &pos, &key, &val) == true) {
                 rc = mpd_worker_api_settings_set(mpd_worker_state, &key, &val, &mpd_host_changed, &check_mpd_error);
                 if ((check_mpd_error == true && check_error_and_recover2(mpd_worker_state->mpd_state, &notify_buffer, request->method, request->id, true) == false)
                     || rc == false)
@@ -101,9 +104,15 @@ void mpd_worker_api(t_config *config, t_mpd_worker_state *mpd_worker_state, void
                     free_result(response);
                 }
                 free_request(request);
-                rc = mpd_worker_smartpls_update_all(config, mpd_worker_state, bool_buf1);
+                //marks the smart playlists for update, they are rebuild in the background
+                rc = mpd_worker_smartpls_update_all(config, mpd_worker_state, bool_buf1, true);
                 if (rc == true) {
-                    send_jsonrpc_notify_info("Smart playlists updated");
+                    if (mpd_worker_smartpls_dirty(mpd_worker_state) == true) {
+                        mpd_worker_state->smartpls_notify = true;
+                    }
+                    else {
+                        send_jsonrpc_notify_info("Smart playlists updated");
+                    }
                 }
                 else {
                     send_jsonrpc_notify_error("Smart playlists update failed");
@@ -127,15 +136,31 @@ void mpd_worker_api(t_config *config, t_mpd_worker_state *mpd_worker_state, void
                 }
             }
             break;
+        case MPDWORKER_API_SMARTPLS_STATUS:
+            response->data = mpd_worker_smartpls_status(mpd_worker_state, response->data, request->method, request->id);
+            break;
         case MPDWORKER_API_CACHES_CREATE:
             je = json_scanf(request->data, sdslen(request->data), "{params: {featTags: %B, featSticker: %B}}", &bool_buf1, &bool_buf2);
             if (je == 2) {
-                mpd_worker_cache_init(mpd_worker_state, bool_buf1, bool_buf2);
+                mpd_worker_cache_init(mpd_worker_state, bool_buf1, bool_buf2, config->cache_connections);
             }
             async = true;
             free_request(request);
             free_result(response);
             break;
+        case MPDWORKER_API_COVERPREFETCH_START:
+            rc = mpd_worker_coverprefetch_start(config, mpd_worker_state);
+            if (rc == true) {
+                response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Cover prefetch started", false);
+            }
+            else {
+                response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Cover prefetch needs the covercache and the album cache", true);
+            }
+            break;
+        case MPDWORKER_API_COVERPREFETCH_STOP:
+            mpd_worker_coverprefetch_stop(config, mpd_worker_state);
+            response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Cover prefetch stopped", false);
+            break;
         default:
             response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Unknown request", true);
             LOG_ERROR("Unknown API request: %.*s", sdslen(request->data), request->data);
@@ -214,6 +239,8 @@ static bool mpd_worker_api_settings_set(t_mpd_worker_state *mpd_worker_state, st
     }
     else if (strncmp(key->ptr, "generatePlsTags", key->len) == 0) {
         mpd_worker_state->generate_pls_tags = sdsreplacelen(mpd_worker_state->generate_pls_tags, settingvalue, sdslen(settingvalue));
+        //check for new smart playlists per tag on next update
+        mpd_worker_state->smartpls_per_tag_generation = 0;
     }
     else if (strncmp(key->ptr, "taglist", key->len) == 0) {
         mpd_worker_state->mpd_state->taglist = sdsreplacelen(mpd_worker_state->mpd_state->taglist, settingvalue, sdslen(settingvalue));
@@ -12,6 +12,7 @@
 #include <time.h>
 #include <assert.h>
 #include <signal.h>
+#include <pthread.h>
 #include <mpd/client.h>
 
 #include "../../dist/src/sds/sds.h"
@@ -28,13 +29,33 @@
 #include "../mpd_shared.h"
 #include "../mpd_shared/mpd_shared_sticker.h"
 #include "mpd_worker_utility.h"
+#include "mpd_worker_coverprefetch.h"
 #include "mpd_worker_cache.h"
 
 //privat definitions
-static bool _cache_init(t_mpd_worker_state *mpd_worker_state, rax *album_cache, rax *sticker_cache, bool feat_tags, bool feat_sticker);
+struct t_cache_thread_arg {
+    t_mpd_state *mpd_state;
+    unsigned offset;
+    unsigned step;
+    bool feat_tags;
+    bool feat_sticker;
+    rax *album_cache;
+    rax *album_pos; //album key -> database position of the cached song
+    rax *sticker_cache;
+    unsigned album_count;
+    unsigned song_count;
+    bool rc;
+};
+
+static bool _cache_init(t_mpd_worker_state *mpd_worker_state, rax *album_cache, rax *sticker_cache, bool feat_tags, bool feat_sticker, unsigned connections);
+static void *_cache_thread(void *arg);
+static bool _cache_fetch(struct t_cache_thread_arg *arg);
+static unsigned _cache_merge(rax *dst, rax **src);
+static unsigned _cache_merge_albums(rax *dst, rax *dst_pos, rax **src, rax **src_pos);
+static long _elapsed_ms(const struct timespec *start);
 
 //public functions
-bool mpd_worker_cache_init(t_mpd_worker_state *mpd_worker_state, bool feat_tags, bool feat_sticker) {
+bool mpd_worker_cache_init(t_mpd_worker_state *mpd_worker_state, bool feat_tags, bool feat_sticker, unsigned connections) {
     rax *album_cache = NULL;
     if (feat_tags == true) {
         album_cache = raxNew();
@@ -46,7 +67,7 @@ bool mpd_worker_cache_init(t_mpd_worker_state *mpd_worker_state, bool feat_tags,
     
     bool rc = true;
     if (feat_tags == true || feat_sticker == true) {
-        rc =_cache_init(mpd_worker_state, album_cache, sticker_cache, feat_tags, feat_sticker);
+        rc =_cache_init(mpd_worker_state, album_cache, sticker_cache, feat_tags, feat_sticker, connections);
     }
 
     //push album cache building response to mpd_client thread
@@ -54,6 +75,7 @@ bool mpd_worker_cache_init(t_mpd_worker_state *mpd_worker_state, bool feat_tags,
         t_work_request *request = create_request(-1, 0, MPD_API_ALBUMCACHE_CREATED, "MPD_API_ALBUMCACHE_CREATED", "");
         request->data = sdscat(request->data, "{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"MPD_API_ALBUMCACHE_CREATED\",\"params\":{}}");
         if (rc == true) {
+            mpd_worker_coverprefetch_albums(mpd_worker_state, album_cache);
             request->extra = (void *) album_cache;
         }
         else {
@@ -84,65 +106,182 @@ bool mpd_worker_cache_init(t_mpd_worker_state *mpd_worker_state, bool feat_tags,
 }
 
 //private functions
-static bool _cache_init(t_mpd_worker_state *mpd_worker_state, rax *album_cache, rax *sticker_cache, bool feat_tags, bool feat_sticker) {
-    LOG_VERBOSE("Creating caches");
-    unsigned start = 0;
-    unsigned end = start + 1000;
-    unsigned i = 0;   
-    unsigned album_count = 0;
-    unsigned song_count = 0;
+static bool _cache_init(t_mpd_worker_state *mpd_worker_state, rax *album_cache, rax *sticker_cache, bool feat_tags, bool feat_sticker, unsigned connections) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (connections < 1) {
+        connections = 1;
+    }
+    LOG_VERBOSE("Creating caches with %u connection(s)", connections);
+    struct t_cache_thread_arg *args = (struct t_cache_thread_arg *)malloc(connections * sizeof(struct t_cache_thread_arg));
+    assert(args);
+    //the first window set is fetched over the worker connection, each further set over an own connection
+    for (unsigned i = 0; i < connections; i++) {
+        args[i].offset = i;
+        args[i].step = connections;
+        args[i].feat_tags = feat_tags;
+        args[i].feat_sticker = feat_sticker;
+        args[i].album_count = 0;
+        args[i].song_count = 0;
+        args[i].rc = false;
+        args[i].album_pos = feat_tags == true ? raxNew() : NULL;
+        if (i == 0) {
+            args[i].mpd_state = mpd_worker_state->mpd_state;
+            args[i].album_cache = album_cache;
+            args[i].sticker_cache = sticker_cache;
+            continue;
+        }
+        args[i].mpd_state = (t_mpd_state *)malloc(sizeof(t_mpd_state));
+        assert(args[i].mpd_state);
+        mpd_shared_default_mpd_state(args[i].mpd_state);
+        mpd_shared_copy_mpd_state(args[i].mpd_state, mpd_worker_state->mpd_state);
+        args[i].album_cache = feat_tags == true ? raxNew() : NULL;
+        args[i].sticker_cache = feat_sticker == true ? raxNew() : NULL;
+        if (mpd_shared_mpd_connect(args[i].mpd_state) == false) {
+            //fall back to the connections opened so far
+            LOG_WARN("Can not open cache connection %u, using %u connection(s)", i + 1, i);
+            mpd_shared_mpd_disconnect(args[i].mpd_state);
+            mpd_shared_free_mpd_state(args[i].mpd_state);
+            album_cache_free(&args[i].album_cache);
+            sticker_cache_free(&args[i].sticker_cache);
+            if (args[i].album_pos != NULL) {
+                raxFree(args[i].album_pos);
+            }
+            connections = i;
+            for (unsigned j = 0; j < connections; j++) {
+                args[j].step = connections;
+            }
+            break;
+        }
+    }
+
+    pthread_t *threads = (pthread_t *)malloc(connections * sizeof(pthread_t));
+    assert(threads);
+    bool *started = (bool *)malloc(connections * sizeof(bool));
+    assert(started);
+    for (unsigned i = 1; i < connections; i++) {
+        started[i] = pthread_create(&threads[i], NULL, _cache_thread, &args[i]) == 0 ? true : false;
+        if (started[i] == false) {
+            LOG_ERROR("Can not create cache thread %u", i);
+        }
+    }
+    _cache_fetch(&args[0]);
+    bool rc = args[0].rc;
+    for (unsigned i = 1; i < connections; i++) {
+        if (started[i] == true) {
+            pthread_join(threads[i], NULL);
+        }
+        if (started[i] == false || args[i].rc == false) {
+            rc = false;
+        }
+    }
+    FREE_PTR(threads);
+    FREE_PTR(started);
+
+    //merge the results of the other connections
+    unsigned album_count = args[0].album_count;
+    unsigned song_count = args[0].song_count;
+    for (unsigned i = 1; i < connections; i++) {
+        if (rc == true) {
+            if (feat_tags == true) {
+                album_count += _cache_merge_albums(album_cache, args[0].album_pos, &args[i].album_cache, &args[i].album_pos);
+            }
+            if (feat_sticker == true) {
+                song_count += _cache_merge(sticker_cache, &args[i].sticker_cache);
+            }
+        }
+        album_cache_free(&args[i].album_cache);
+        sticker_cache_free(&args[i].sticker_cache);
+        if (args[i].album_pos != NULL) {
+            raxFree(args[i].album_pos);
+        }
+        mpd_shared_mpd_disconnect(args[i].mpd_state);
+        mpd_shared_free_mpd_state(args[i].mpd_state);
+    }
+    if (args[0].album_pos != NULL) {
+        raxFree(args[0].album_pos);
+    }
+    FREE_PTR(args);
+
+    if (rc == false) {
+        LOG_ERROR("Cache update failed");
+        return false;
+    }
+    LOG_VERBOSE("Added %u albums to album cache", album_count);
+    LOG_VERBOSE("Added %u songs to sticker cache", song_count);
+    LOG_INFO("Caches updated successfully with %u connection(s) in %ld ms", connections, _elapsed_ms(&start));
+    return true;
+}
+
+static void *_cache_thread(void *arg) {
+    struct t_cache_thread_arg *cache_arg = (struct t_cache_thread_arg *) arg;
+    thread_logname = sdscatfmt(sdsempty(), "cache%u", cache_arg->offset);
+    _cache_fetch(cache_arg);
+    sdsfree(thread_logname);
+    return NULL;
+}
+
+//fetches every step-th window of 1000 songs, starting with the offset-th window
+static bool _cache_fetch(struct t_cache_thread_arg *arg) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    t_mpd_state *mpd_state = arg->mpd_state;
+    unsigned window = arg->offset;
+    unsigned i;
     //get first song from each album
     do {
-        bool rc = mpd_search_db_songs(mpd_worker_state->mpd_state->conn, false);
-        if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_db_songs") == false) {
-            LOG_ERROR("Cache update failed");
-            mpd_search_cancel(mpd_worker_state->mpd_state->conn);
+        unsigned window_start = window * 1000;
+        unsigned window_end = window_start + 1000;
+        i = 0;
+        bool rc = mpd_search_db_songs(mpd_state->conn, false);
+        if (check_rc_error_and_recover(mpd_state, NULL, NULL, 0, false, rc, "mpd_search_db_songs") == false) {
+            mpd_search_cancel(mpd_state->conn);
             return false;
         }
-        rc = mpd_search_add_uri_constraint(mpd_worker_state->mpd_state->conn, MPD_OPERATOR_DEFAULT, "");
-        if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_add_uri_constraint") == false) {
-            LOG_ERROR("Cache update failed");
-            mpd_search_cancel(mpd_worker_state->mpd_state->conn);
+        rc = mpd_search_add_uri_constraint(mpd_state->conn, MPD_OPERATOR_DEFAULT, "");
+        if (check_rc_error_and_recover(mpd_state, NULL, NULL, 0, false, rc, "mpd_search_add_uri_constraint") == false) {
+            mpd_search_cancel(mpd_state->conn);
             return false;
         }
-        rc = mpd_search_add_window(mpd_worker_state->mpd_state->conn, start, end);
-        if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_add_window") == false) {
-            LOG_ERROR("Cache update failed");
-            mpd_search_cancel(mpd_worker_state->mpd_state->conn);
+        rc = mpd_search_add_window(mpd_state->conn, window_start, window_end);
+        if (check_rc_error_and_recover(mpd_state, NULL, NULL, 0, false, rc, "mpd_search_add_window") == false) {
+            mpd_search_cancel(mpd_state->conn);
             return false;
         }
-        rc = mpd_search_commit(mpd_worker_state->mpd_state->conn);
-        if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_commit") == false) {
-            LOG_ERROR("Cache update failed");
+        rc = mpd_search_commit(mpd_state->conn);
+        if (check_rc_error_and_recover(mpd_state, NULL, NULL, 0, false, rc, "mpd_search_commit") == false) {
             return false;
         }
         struct mpd_song *song;
         sds album = sdsempty();
         sds artist = sdsempty();
         sds key = sdsempty();
-        while ((song = mpd_recv_song(mpd_worker_state->mpd_state->conn)) != NULL) {
+        while ((song = mpd_recv_song(mpd_state->conn)) != NULL) {
             //sticker cache
-            if (feat_sticker == true) {
+            if (arg->feat_sticker == true) {
                 const char *uri = mpd_song_get_uri(song);
                 t_sticker *sticker = (t_sticker *) malloc(sizeof(t_sticker));
                 assert(sticker);
-                raxInsert(sticker_cache, (unsigned char*)uri, strlen(uri), (void *)sticker, NULL);
-                song_count++;
+                raxInsert(arg->sticker_cache, (unsigned char*)uri, strlen(uri), (void *)sticker, NULL);
+                arg->song_count++;
             }
 
             //album cache
-            if (feat_tags == true) {
+            if (arg->feat_tags == true) {
                 album = mpd_shared_get_tags(song, MPD_TAG_ALBUM, album);
                 artist = mpd_shared_get_tags(song, MPD_TAG_ALBUM_ARTIST, artist);
                 if (strcmp(album, "-") > 0 && strcmp(artist, "-") > 0) {
                     sdsclear(key);
                     key = sdscatfmt(key, "%s::%s", album, artist);
-                    if (raxTryInsert(album_cache, (unsigned char*)key, sdslen(key), (void *)song, NULL) == 0) {
+                    //windows are fetched in ascending order, the first song of an album has the lowest position
+                    if (raxTryInsert(arg->album_cache, (unsigned char*)key, sdslen(key), (void *)song, NULL) == 0) {
                         //discard song data if key exists
                         mpd_song_free(song);
                     }
                     else {
-                        album_count++;
+                        uintptr_t pos = window_start + i;
+                        raxInsert(arg->album_pos, (unsigned char*)key, sdslen(key), (void *)pos, NULL);
+                        arg->album_count++;
                     }
                 }
                 else {
@@ -150,34 +289,97 @@ static bool _cache_init(t_mpd_worker_state *mpd_worker_state, rax *album_cache,
                     mpd_song_free(song);
                 }
             }
+            else {
+                mpd_song_free(song);
+            }
             i++;
         }
         sdsfree(album);
         sdsfree(artist);
         sdsfree(key);
-        mpd_response_finish(mpd_worker_state->mpd_state->conn);
-        if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
-            LOG_ERROR("Cache update failed");
-            return false;        
-        }
-        start = end;
-        end = end + 1000;
-    } while (i >= start);
+        mpd_response_finish(mpd_state->conn);
+        if (check_error_and_recover2(mpd_state, NULL, NULL, 0, false) == false) {
+            return false;
+        }
+        window += arg->step;
+    } while (i == 1000);
     //get sticker values
-    if (feat_sticker == true) {
+    if (arg->feat_sticker == true) {
         raxIterator iter;
-        raxStart(&iter, sticker_cache);
+        raxStart(&iter, arg->sticker_cache);
         raxSeek(&iter, "^", NULL, 0);
         sds uri = sdsempty();
         while (raxNext(&iter)) {
             uri = sdsreplacelen(uri, (char *)iter.key, iter.key_len);
-            mpd_shared_get_sticker(mpd_worker_state->mpd_state, uri, (t_sticker *)iter.data);
+            mpd_shared_get_sticker(mpd_state, uri, (t_sticker *)iter.data);
         }
         sdsfree(uri);
         raxStop(&iter);
     }
-    LOG_VERBOSE("Added %u albums to album cache", album_count);
-    LOG_VERBOSE("Added %u songs to sticker cache", song_count);
-    LOG_VERBOSE("Cache updated successfully");
+    LOG_VERBOSE("Fetched %u songs and %u albums in %ld ms", arg->song_count, arg->album_count, _elapsed_ms(&start));
+    arg->rc = true;
     return true;
 }
+
+//moves all entries from src to dst, returns the number of new keys in dst
+static unsigned _cache_merge(rax *dst, rax **src) {
+    unsigned count = 0;
+    raxIterator iter;
+    raxStart(&iter, *src);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        if (raxTryInsert(dst, iter.key, iter.key_len, iter.data, NULL) == 0) {
+            //key already exists, discard data
+            free(iter.data);
+        }
+        else {
+            count++;
+        }
+    }
+    raxStop(&iter);
+    //the data is now owned by dst or freed
+    raxFree(*src);
+    *src = NULL;
+    return count;
+}
+
+//moves all albums from src to dst, an album keeps the song with the lowest database position
+//like a cache build over one connection, returns the number of new keys in dst
+static unsigned _cache_merge_albums(rax *dst, rax *dst_pos, rax **src, rax **src_pos) {
+    unsigned count = 0;
+    raxIterator iter;
+    raxStart(&iter, *src);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        void *pos = raxFind(*src_pos, iter.key, iter.key_len);
+        void *old_pos = raxFind(dst_pos, iter.key, iter.key_len);
+        if (old_pos == raxNotFound) {
+            raxInsert(dst, iter.key, iter.key_len, iter.data, NULL);
+            raxInsert(dst_pos, iter.key, iter.key_len, pos, NULL);
+            count++;
+        }
+        else if ((uintptr_t)pos < (uintptr_t)old_pos) {
+            //replace the song from a later window
+            void *old_song = NULL;
+            raxInsert(dst, iter.key, iter.key_len, iter.data, &old_song);
+            raxInsert(dst_pos, iter.key, iter.key_len, pos, NULL);
+            mpd_song_free((struct mpd_song *)old_song);
+        }
+        else {
+            mpd_song_free((struct mpd_song *)iter.data);
+        }
+    }
+    raxStop(&iter);
+    //the songs are now owned by dst or freed
+    raxFree(*src);
+    *src = NULL;
+    raxFree(*src_pos);
+    *src_pos = NULL;
+    return count;
+}
+
+static long _elapsed_ms(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000 + (end.tv_nsec - start->tv_nsec) / 1000000;
+}
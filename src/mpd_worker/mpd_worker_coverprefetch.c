@@ -0,0 +1,259 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <mpd/client.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/rax/rax.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "../covercache.h"
+#include "../mpd_shared/mpd_shared_typedefs.h"
+#include "../mpd_shared.h"
+#include "mpd_worker_utility.h"
+#include "mpd_worker_coverprefetch.h"
+
+//The cover prefetch job fills the covercache with the covers of all albums
+//from the album cache. It fetches one album per step, with a pause between
+//the steps, and only if no other requests are queued. The uri of the last
+//fetched album is saved periodically and on stop, a stopped job resumes
+//after it. Albums fetched after the last save are skipped as cached.
+
+//minimum time between two fetches in ms
+#define COVERPREFETCH_INTERVAL 200
+//save the position and send a progress notification each n albums
+#define COVERPREFETCH_NOTIFY 50
+
+//private definitions
+static bool mpd_worker_coverprefetch_fetch(t_config *config, t_mpd_worker_state *mpd_worker_state, const char *uri);
+static void mpd_worker_coverprefetch_seek(t_mpd_worker_state *mpd_worker_state, const char *uri);
+static void mpd_worker_coverprefetch_notify(t_mpd_worker_state *mpd_worker_state);
+static sds mpd_worker_coverprefetch_state_read(t_config *config, sds uri);
+static void mpd_worker_coverprefetch_state_write(t_config *config, const char *uri);
+
+//public functions
+
+//remembers the first song of each album, called after the album cache is built
+void mpd_worker_coverprefetch_albums(t_mpd_worker_state *mpd_worker_state, rax *album_cache) {
+    sds last_uri = mpd_worker_state->coverprefetch_node != NULL ? sdsdup(mpd_worker_state->coverprefetch_node->key) : NULL;
+    list_free(&mpd_worker_state->coverprefetch_uris);
+    raxIterator iter;
+    raxStart(&iter, album_cache);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        const struct mpd_song *song = (const struct mpd_song *)iter.data;
+        list_push(&mpd_worker_state->coverprefetch_uris, mpd_song_get_uri(song), 0, NULL, NULL);
+    }
+    raxStop(&iter);
+    //keep the position of a running job
+    mpd_worker_coverprefetch_seek(mpd_worker_state, last_uri);
+    if (last_uri != NULL) {
+        sdsfree(last_uri);
+    }
+    LOG_DEBUG("Cover prefetch list has %u albums", mpd_worker_state->coverprefetch_uris.length);
+}
+
+bool mpd_worker_coverprefetch_start(t_config *config, t_mpd_worker_state *mpd_worker_state) {
+    if (config->covercache == false || mpd_worker_state->coverprefetch_uris.length == 0) {
+        return false;
+    }
+    if (mpd_worker_state->coverprefetch_running == true) {
+        return true;
+    }
+    //resume after the last fetched album
+    sds last_uri = mpd_worker_coverprefetch_state_read(config, sdsempty());
+    mpd_worker_coverprefetch_seek(mpd_worker_state, last_uri);
+    sdsfree(last_uri);
+    LOG_INFO("Starting cover prefetch at album %u of %u", mpd_worker_state->coverprefetch_pos, mpd_worker_state->coverprefetch_uris.length);
+    mpd_worker_state->coverprefetch_fetched = 0;
+    mpd_worker_state->coverprefetch_running = true;
+    mpd_worker_coverprefetch_notify(mpd_worker_state);
+    return true;
+}
+
+void mpd_worker_coverprefetch_stop(t_config *config, t_mpd_worker_state *mpd_worker_state) {
+    if (mpd_worker_state->coverprefetch_running == false) {
+        return;
+    }
+    LOG_INFO("Stopping cover prefetch at album %u of %u", mpd_worker_state->coverprefetch_pos, mpd_worker_state->coverprefetch_uris.length);
+    mpd_worker_state->coverprefetch_running = false;
+    if (mpd_worker_state->coverprefetch_node != NULL) {
+        mpd_worker_coverprefetch_state_write(config, mpd_worker_state->coverprefetch_node->key);
+    }
+    mpd_worker_coverprefetch_notify(mpd_worker_state);
+}
+
+//true if the next album should be fetched now
+bool mpd_worker_coverprefetch_pending(t_config *config, t_mpd_worker_state *mpd_worker_state) {
+    if (mpd_worker_state->coverprefetch_running == false || config->covercache == false) {
+        return false;
+    }
+    //pause while interactive requests are waiting, covers are fetched by the
+    //mpd_binary thread and browse requests are handled by the mpd_client pool
+    if (tiny_queue_length(mpd_client_queue, 0) > 0 ||
+        tiny_queue_length(mpd_binary_queue, 0) > 0 ||
+        tiny_queue_length(mpd_client_pool_queue, 0) > 0)
+    {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - mpd_worker_state->coverprefetch_last.tv_sec) * 1000 +
+        (now.tv_nsec - mpd_worker_state->coverprefetch_last.tv_nsec) / 1000000;
+    return elapsed >= COVERPREFETCH_INTERVAL;
+}
+
+void mpd_worker_coverprefetch_next(t_config *config, t_mpd_worker_state *mpd_worker_state) {
+    clock_gettime(CLOCK_MONOTONIC, &mpd_worker_state->coverprefetch_last);
+    struct list_node *node = mpd_worker_state->coverprefetch_node != NULL ?
+        mpd_worker_state->coverprefetch_node->next : mpd_worker_state->coverprefetch_uris.head;
+    if (node == NULL) {
+        LOG_INFO("Cover prefetch finished, fetched %u covers", mpd_worker_state->coverprefetch_fetched);
+        mpd_worker_state->coverprefetch_running = false;
+        mpd_worker_state->coverprefetch_node = NULL;
+        mpd_worker_state->coverprefetch_pos = 0;
+        mpd_worker_coverprefetch_state_write(config, "");
+        mpd_worker_coverprefetch_notify(mpd_worker_state);
+        send_jsonrpc_notify_info("Cover prefetch finished");
+        return;
+    }
+    if (mpd_worker_coverprefetch_fetch(config, mpd_worker_state, node->key) == true) {
+        mpd_worker_state->coverprefetch_fetched++;
+    }
+    mpd_worker_state->coverprefetch_node = node;
+    mpd_worker_state->coverprefetch_pos++;
+    if (mpd_worker_state->coverprefetch_pos % COVERPREFETCH_NOTIFY == 0) {
+        mpd_worker_coverprefetch_state_write(config, node->key);
+        mpd_worker_coverprefetch_notify(mpd_worker_state);
+    }
+}
+
+//private functions
+
+//fetches the cover like the web_server would: folder image (albumart) first, then embedded picture (readpicture),
+//the image is streamed into the covercache chunk by chunk
+static bool mpd_worker_coverprefetch_fetch(t_config *config, t_mpd_worker_state *mpd_worker_state, const char *uri) {
+    sds cached = find_covercache_file(config, uri, sdsempty());
+    if (sdslen(cached) > 0) {
+        sdsfree(cached);
+        return false;
+    }
+    sdsfree(cached);
+    struct mpd_connection *conn = mpd_worker_state->mpd_state->conn;
+    sds chunk = sdsempty();
+    unsigned size = 0;
+    bool readpicture = false;
+    int recv_len = mpd_shared_read_cover_chunk(conn, false, uri, 0, &chunk, &size);
+    if (recv_len <= 0) {
+        readpicture = true;
+        sdsclear(chunk);
+        recv_len = mpd_shared_read_cover_chunk(conn, true, uri, 0, &chunk, &size);
+    }
+    if (recv_len <= 0) {
+        sdsfree(chunk);
+        return false;
+    }
+    sds mime_type = get_mime_type_by_magic_stream(chunk);
+    struct t_covercache_writer *writer = covercache_writer_new(config, uri, mime_type);
+    sdsfree(mime_type);
+    if (writer == NULL) {
+        sdsfree(chunk);
+        return false;
+    }
+    unsigned offset = 0;
+    while (true) {
+        covercache_writer_append(writer, chunk, sdslen(chunk));
+        offset += (unsigned)recv_len;
+        if (offset >= size) {
+            break;
+        }
+        sdsclear(chunk);
+        recv_len = mpd_shared_read_cover_chunk(conn, readpicture, uri, offset, &chunk, &size);
+        if (recv_len <= 0) {
+            LOG_ERROR("Prefetching cover for \"%s\" failed at offset %u", uri, offset);
+            covercache_writer_abort(writer);
+            sdsfree(chunk);
+            return false;
+        }
+    }
+    sdsfree(chunk);
+    bool rc = covercache_writer_finish(config, writer);
+    if (rc == true) {
+        LOG_DEBUG("Prefetched cover for \"%s\" (%u bytes)", uri, offset);
+    }
+    return rc;
+}
+
+//sets the cursor to the album after uri, to the first album if uri is not found
+static void mpd_worker_coverprefetch_seek(t_mpd_worker_state *mpd_worker_state, const char *uri) {
+    mpd_worker_state->coverprefetch_node = NULL;
+    mpd_worker_state->coverprefetch_pos = 0;
+    if (uri == NULL || uri[0] == '\0') {
+        return;
+    }
+    unsigned i = 0;
+    for (struct list_node *current = mpd_worker_state->coverprefetch_uris.head; current != NULL; current = current->next, i++) {
+        if (strcmp(current->key, uri) == 0) {
+            mpd_worker_state->coverprefetch_node = current;
+            mpd_worker_state->coverprefetch_pos = i + 1;
+            return;
+        }
+    }
+}
+
+static void mpd_worker_coverprefetch_notify(t_mpd_worker_state *mpd_worker_state) {
+    sds buffer = jsonrpc_start_notify(sdsempty(), "update_coverprefetch");
+    buffer = tojson_bool(buffer, "running", mpd_worker_state->coverprefetch_running, true);
+    buffer = tojson_long(buffer, "pos", mpd_worker_state->coverprefetch_pos, true);
+    buffer = tojson_long(buffer, "total", mpd_worker_state->coverprefetch_uris.length, true);
+    buffer = tojson_long(buffer, "fetched", mpd_worker_state->coverprefetch_fetched, false);
+    buffer = jsonrpc_end_notify(buffer);
+    ws_notify(buffer);
+    sdsfree(buffer);
+}
+
+static sds mpd_worker_coverprefetch_state_read(t_config *config, sds uri) {
+    sds state_file = sdscatfmt(sdsempty(), "%s/state/coverprefetch", config->varlibdir);
+    FILE *fp = fopen(state_file, "r");
+    if (fp != NULL) {
+        char *line = NULL;
+        size_t n = 0;
+        if (getline(&line, &n, fp) > 0) {
+            uri = sdscat(uri, line);
+            sdstrim(uri, "\n");
+        }
+        FREE_PTR(line);
+        fclose(fp);
+    }
+    sdsfree(state_file);
+    return uri;
+}
+
+static void mpd_worker_coverprefetch_state_write(t_config *config, const char *uri) {
+    sds state_file = sdscatfmt(sdsempty(), "%s/state/coverprefetch", config->varlibdir);
+    FILE *fp = fopen(state_file, "w");
+    if (fp != NULL) {
+        fputs(uri, fp);
+        fclose(fp);
+    }
+    else {
+        LOG_ERROR("Can not open file \"%s\" for write: %s", state_file, strerror(errno));
+    }
+    sdsfree(state_file);
+}
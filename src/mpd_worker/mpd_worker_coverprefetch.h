@@ -0,0 +1,15 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __MPD_WORKER_COVERPREFETCH_H__
+#define __MPD_WORKER_COVERPREFETCH_H__
+#include "../../dist/src/rax/rax.h"
+void mpd_worker_coverprefetch_albums(t_mpd_worker_state *mpd_worker_state, rax *album_cache);
+bool mpd_worker_coverprefetch_start(t_config *config, t_mpd_worker_state *mpd_worker_state);
+void mpd_worker_coverprefetch_stop(t_config *config, t_mpd_worker_state *mpd_worker_state);
+bool mpd_worker_coverprefetch_pending(t_config *config, t_mpd_worker_state *mpd_worker_state);
+void mpd_worker_coverprefetch_next(t_config *config, t_mpd_worker_state *mpd_worker_state);
+#endif
@@ -4,6 +4,7 @@
  https://github.com/jcorporation/mympd
 */
 
+#include <assert.h>
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,6 +13,7 @@
 #include <dirent.h>
 #include <inttypes.h>
 #include <ctype.h>
+#include <time.h>
 #include <mpd/client.h>
 
 #include "../../dist/src/sds/sds.h"
@@ -27,28 +29,86 @@
 #include "../mpd_shared.h"
 #include "../mpd_shared/mpd_shared_search.h"
 #include "../mpd_shared/mpd_shared_playlists.h"
+#include "../mpd_shared/mpd_shared_sticker.h"
 #include "mpd_worker_utility.h"
 #include "mpd_worker_smartpls.h"
 
 //private definitions
+//inputs of a smart playlist
+#define SMARTPLS_DEP_DATABASE 1
+#define SMARTPLS_DEP_STICKER 2
+
+//build priorities, lower values are build first
+#define SMARTPLS_PRIO_DEFINITION 0
+#define SMARTPLS_PRIO_STICKER 1
+#define SMARTPLS_PRIO_DATABASE 2
+
+//a failed build is retried after failures * interval seconds
+#define SMARTPLS_RETRY_INTERVAL 60
+#define SMARTPLS_RETRY_MAX 3600
+
+//mpd rewrites the playlist file for each delete and move, a playlist with more
+//deletes and moves than this percentage of its length is replaced instead
+#define SMARTPLS_EDIT_RATIO 10
+
+struct t_smartpls_state {
+    unsigned deps;
+    bool dirty;
+    int priority;
+    unsigned long db_generation;
+    unsigned long sticker_generation;
+    unsigned long smartpls_mtime;
+    time_t last_build;
+    time_t retry_time;
+    unsigned failures;
+    long last_cost;
+    unsigned entries;
+};
+
+static bool mpd_worker_smartpls_build(t_config *config, t_mpd_worker_state *mpd_worker_state, const char *playlist, unsigned *deps, unsigned *entries);
+static unsigned mpd_worker_smartpls_deps(t_config *config, const char *playlist);
+static void mpd_worker_smartpls_mark_dirty(struct t_smartpls_state *state, int priority);
+static long mpd_worker_smartpls_elapsed_ms(struct timespec *start);
 static bool mpd_worker_smartpls_per_tag(t_config *mpd_config, t_mpd_worker_state *mpd_worker_state);
 static bool mpd_worker_smartpls_clear(t_mpd_worker_state *mpd_worker_state, const char *playlist);
-static bool mpd_worker_smartpls_update_search(t_mpd_worker_state *mpd_worker_state, const char *playlist, const char *tag, const char *searchstr);
-static bool mpd_worker_smartpls_update_sticker(t_mpd_worker_state *mpd_worker_state, const char *playlist, const char *sticker, const int maxentries, const int minvalue);
-static bool mpd_worker_smartpls_update_newest(t_mpd_worker_state *mpd_worker_state, const char *playlist, const int timerange);
+static bool mpd_worker_smartpls_update_search(t_mpd_worker_state *mpd_worker_state, const char *tag, const char *searchstr, struct list *uris);
+static bool mpd_worker_smartpls_update_sticker(t_mpd_worker_state *mpd_worker_state, const char *sticker, const int maxentries, const int minvalue, struct list *uris);
+static bool mpd_worker_smartpls_update_newest(t_mpd_worker_state *mpd_worker_state, const int timerange, struct list *uris);
+static bool mpd_worker_smartpls_search_uris(t_mpd_worker_state *mpd_worker_state, const char *expression, const char *tag, struct list *uris);
+static bool mpd_worker_smartpls_write(t_mpd_worker_state *mpd_worker_state, const char *playlist, struct list *uris, bool ignore_order, bool *changed);
+static bool mpd_worker_smartpls_command_list(t_mpd_worker_state *mpd_worker_state, bool *started);
+static bool mpd_worker_smartpls_sticker_from_cache(const char *sticker, int maxentries, struct list *add_list, int *value_max);
+static bool mpd_worker_smartpls_sticker_from_mpd(t_mpd_worker_state *mpd_worker_state, const char *sticker, struct list *add_list, int *value_max);
+static long mpd_worker_smartpls_sticker_value(const t_sticker *sticker, const char *name);
+
+//bounded min-heap for the top-k selection of sticker values
+struct t_heap_entry {
+    sds uri;
+    long value;
+};
+
+static void mpd_worker_smartpls_heap_push(struct t_heap_entry *heap, int *heap_len, int heap_size, const char *uri, size_t uri_len, long value);
+static void mpd_worker_smartpls_heap_down(struct t_heap_entry *heap, int heap_len, int i);
 
 //public functions
-bool mpd_worker_smartpls_update_all(t_config *config, t_mpd_worker_state *mpd_worker_state, bool force) {
+//marks the smart playlists with changed inputs dirty, check_mtime compares also the
+//database and the playlist mtimes for changes not seen by the generations
+bool mpd_worker_smartpls_update_all(t_config *config, t_mpd_worker_state *mpd_worker_state, bool force, bool check_mtime) {
     if (mpd_worker_state->feat_smartpls == false) {
         LOG_DEBUG("Smart playlists are disabled");
         return true;
     }
     
-    mpd_worker_smartpls_per_tag(config, mpd_worker_state);
+    //new tag values are only possible after a database change
+    if (force == true || mpd_worker_state->smartpls_per_tag_generation != mpd_worker_state->db_generation) {
+        if (mpd_worker_smartpls_per_tag(config, mpd_worker_state) == true) {
+            mpd_worker_state->smartpls_per_tag_generation = mpd_worker_state->db_generation;
+        }
+    }
 
-    unsigned long db_mtime = mpd_shared_get_db_mtime(mpd_worker_state->mpd_state);
-    LOG_DEBUG("Database mtime: %d", db_mtime);
-    
+    unsigned long db_mtime = 0;
+    long seen = ++mpd_worker_state->smartpls_seen;
+    unsigned dirty = 0;
     sds dirname = sdscatfmt(sdsempty(), "%s/smartpls", config->varlibdir);
     DIR *dir = opendir (dirname);
     if (dir != NULL) {
@@ -57,14 +117,66 @@ bool mpd_worker_smartpls_update_all(t_config *config, t_mpd_worker_state *mpd_wo
             if (strncmp(ent->d_name, ".", 1) == 0) {
                 continue;
             }
-            unsigned long playlist_mtime = mpd_shared_get_playlist_mtime(mpd_worker_state->mpd_state, ent->d_name);
             unsigned long smartpls_mtime = mpd_shared_get_smartpls_mtime(config, ent->d_name);
-            LOG_DEBUG("Playlist %s: playlist mtime %d, smartpls mtime %d", ent->d_name, playlist_mtime, smartpls_mtime);
-            if (force == true || db_mtime > playlist_mtime || smartpls_mtime > playlist_mtime) {
-                mpd_worker_smartpls_update(config, mpd_worker_state, ent->d_name);
+            struct list_node *node = list_get_node(&mpd_worker_state->smartpls_states, ent->d_name);
+            struct t_smartpls_state *state;
+            if (node == NULL) {
+                //unknown smart playlist, check the mtimes
+                state = (struct t_smartpls_state *)malloc(sizeof(struct t_smartpls_state));
+                assert(state);
+                state->deps = mpd_worker_smartpls_deps(config, ent->d_name);
+                state->dirty = false;
+                state->priority = SMARTPLS_PRIO_DEFINITION;
+                state->db_generation = mpd_worker_state->db_generation;
+                state->sticker_generation = mpd_worker_state->sticker_generation;
+                state->smartpls_mtime = smartpls_mtime;
+                state->last_build = 0;
+                state->retry_time = 0;
+                state->failures = 0;
+                state->last_cost = 0;
+                state->entries = 0;
+                list_push(&mpd_worker_state->smartpls_states, ent->d_name, seen, NULL, state);
+                if (db_mtime == 0) {
+                    db_mtime = mpd_shared_get_db_mtime(mpd_worker_state->mpd_state);
+                    LOG_DEBUG("Database mtime: %d", db_mtime);
+                }
+                unsigned long playlist_mtime = mpd_shared_get_playlist_mtime(mpd_worker_state->mpd_state, ent->d_name);
+                LOG_DEBUG("Playlist %s: playlist mtime %d, smartpls mtime %d", ent->d_name, playlist_mtime, smartpls_mtime);
+                if (force == true || db_mtime > playlist_mtime || smartpls_mtime > playlist_mtime) {
+                    mpd_worker_smartpls_mark_dirty(state, SMARTPLS_PRIO_DEFINITION);
+                }
+            }
+            else {
+                node->value_i = seen;
+                state = (struct t_smartpls_state *)node->user_data;
+                if (force == true || smartpls_mtime != state->smartpls_mtime) {
+                    state->deps = mpd_worker_smartpls_deps(config, ent->d_name);
+                    state->smartpls_mtime = smartpls_mtime;
+                    mpd_worker_smartpls_mark_dirty(state, SMARTPLS_PRIO_DEFINITION);
+                }
+                if ((state->deps & SMARTPLS_DEP_STICKER) && state->sticker_generation != mpd_worker_state->sticker_generation) {
+                    mpd_worker_smartpls_mark_dirty(state, SMARTPLS_PRIO_STICKER);
+                }
+                if ((state->deps & SMARTPLS_DEP_DATABASE) && state->db_generation != mpd_worker_state->db_generation) {
+                    mpd_worker_smartpls_mark_dirty(state, SMARTPLS_PRIO_DATABASE);
+                }
+                if (check_mtime == true && state->dirty == false) {
+                    if (db_mtime == 0) {
+                        db_mtime = mpd_shared_get_db_mtime(mpd_worker_state->mpd_state);
+                    }
+                    //an unchanged playlist is not rewritten by the build
+                    if (db_mtime > (unsigned long)state->last_build &&
+                        db_mtime > mpd_shared_get_playlist_mtime(mpd_worker_state->mpd_state, ent->d_name))
+                    {
+                        mpd_worker_smartpls_mark_dirty(state, SMARTPLS_PRIO_DATABASE);
+                    }
+                }
+            }
+            if (state->dirty == true) {
+                dirty++;
             }
             else {
-                LOG_VERBOSE("Update of smart playlist %s skipped, already up to date", ent->d_name);
+                LOG_DEBUG("Update of smart playlist %s skipped, already up to date", ent->d_name);
             }
         }
         closedir (dir);
@@ -75,18 +187,101 @@ bool mpd_worker_smartpls_update_all(t_config *config, t_mpd_worker_state *mpd_wo
         return false;
     }
     sdsfree(dirname);
+
+    //remove deleted smart playlists
+    unsigned i = 0;
+    struct list_node *current = mpd_worker_state->smartpls_states.head;
+    while (current != NULL) {
+        if (current->value_i != seen) {
+            current = current->next;
+            list_shift(&mpd_worker_state->smartpls_states, i);
+            continue;
+        }
+        i++;
+        current = current->next;
+    }
+    LOG_VERBOSE("%u smart playlists scheduled for update", dirty);
     return true;
 }
 
+bool mpd_worker_smartpls_dirty(t_mpd_worker_state *mpd_worker_state) {
+    if (mpd_worker_state->feat_smartpls == false) {
+        return false;
+    }
+    time_t now = time(NULL);
+    struct list_node *current = mpd_worker_state->smartpls_states.head;
+    while (current != NULL) {
+        struct t_smartpls_state *state = (struct t_smartpls_state *)current->user_data;
+        if (state->dirty == true && state->retry_time <= now) {
+            return true;
+        }
+        current = current->next;
+    }
+    return false;
+}
+
+bool mpd_worker_smartpls_update_next(t_config *config, t_mpd_worker_state *mpd_worker_state) {
+    //highest priority first, cheaper playlists first for same priority
+    struct list_node *next = NULL;
+    struct t_smartpls_state *next_state = NULL;
+    time_t now = time(NULL);
+    struct list_node *current = mpd_worker_state->smartpls_states.head;
+    while (current != NULL) {
+        struct t_smartpls_state *state = (struct t_smartpls_state *)current->user_data;
+        if (state->dirty == true && state->retry_time <= now && (next_state == NULL || state->priority < next_state->priority ||
+            (state->priority == next_state->priority && state->last_cost < next_state->last_cost)))
+        {
+            next = current;
+            next_state = state;
+        }
+        current = current->next;
+    }
+    if (next == NULL) {
+        return true;
+    }
+    sds playlist = sdsdup(next->key);
+    bool rc = mpd_worker_smartpls_update(config, mpd_worker_state, playlist);
+    if (rc == false && next_state->failures == 1) {
+        send_jsonrpc_notify_error("Smart playlists update failed");
+    }
+    sdsfree(playlist);
+    if (mpd_worker_state->smartpls_notify == true && mpd_worker_smartpls_dirty(mpd_worker_state) == false) {
+        mpd_worker_state->smartpls_notify = false;
+        send_jsonrpc_notify_info("Smart playlists updated");
+    }
+    return rc;
+}
+
+sds mpd_worker_smartpls_status(t_mpd_worker_state *mpd_worker_state, sds buffer, sds method, long request_id) {
+    buffer = jsonrpc_start_result(buffer, method, request_id);
+    buffer = sdscat(buffer, ",\"data\":[");
+    unsigned entity_count = 0;
+    struct list_node *current = mpd_worker_state->smartpls_states.head;
+    while (current != NULL) {
+        struct t_smartpls_state *state = (struct t_smartpls_state *)current->user_data;
+        if (entity_count++) {
+            buffer = sdscat(buffer, ",");
+        }
+        buffer = sdscat(buffer, "{");
+        buffer = tojson_char(buffer, "name", current->key, true);
+        buffer = tojson_bool(buffer, "dependsDatabase", (state->deps & SMARTPLS_DEP_DATABASE ? true : false), true);
+        buffer = tojson_bool(buffer, "dependsSticker", (state->deps & SMARTPLS_DEP_STICKER ? true : false), true);
+        buffer = tojson_bool(buffer, "dirty", state->dirty, true);
+        buffer = tojson_long(buffer, "priority", state->priority, true);
+        buffer = tojson_long(buffer, "lastBuild", state->last_build, true);
+        buffer = tojson_long(buffer, "lastCost", state->last_cost, true);
+        buffer = tojson_long(buffer, "entries", state->entries, false);
+        buffer = sdscat(buffer, "}");
+        current = current->next;
+    }
+    buffer = sdscat(buffer, "],");
+    buffer = tojson_long(buffer, "totalEntities", entity_count, true);
+    buffer = tojson_long(buffer, "returnedEntities", entity_count, false);
+    buffer = jsonrpc_end_result(buffer);
+    return buffer;
+}
+
 bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker_state, const char *playlist) {
-    char *smartpltype = NULL;
-    int je;
-    bool rc = true;
-    char *p_charbuf1 = NULL;
-    char *p_charbuf2 = NULL;
-    int int_buf1;
-    int int_buf2;
-    
     if (mpd_worker_state->feat_smartpls == false) {
         LOG_WARN("Smart playlists are disabled");
         return true;
@@ -95,6 +290,58 @@ bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker
         LOG_ERROR("Invalid smart playlist name");
         return false;
     }
+    //the inputs are captured before the build, changes while building marks the playlist dirty again
+    unsigned long db_generation = mpd_worker_state->db_generation;
+    unsigned long sticker_generation = mpd_worker_state->sticker_generation;
+    unsigned long smartpls_mtime = mpd_shared_get_smartpls_mtime(config, playlist);
+    unsigned deps = 0;
+    unsigned entries = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool rc = mpd_worker_smartpls_build(config, mpd_worker_state, playlist, &deps, &entries);
+    long cost = mpd_worker_smartpls_elapsed_ms(&start);
+    LOG_VERBOSE("Build of smart playlist %s took %ld ms", playlist, cost);
+
+    struct t_smartpls_state *state = (struct t_smartpls_state *)list_get_user_data(&mpd_worker_state->smartpls_states, playlist);
+    if (state == NULL) {
+        state = (struct t_smartpls_state *)malloc(sizeof(struct t_smartpls_state));
+        assert(state);
+        state->priority = SMARTPLS_PRIO_DEFINITION;
+        state->failures = 0;
+        list_push(&mpd_worker_state->smartpls_states, playlist, 0, NULL, state);
+    }
+    state->deps = deps;
+    if (rc == true) {
+        state->dirty = false;
+        state->failures = 0;
+        state->retry_time = 0;
+    }
+    else {
+        //the playlist stays dirty and is retried with a growing delay
+        state->dirty = true;
+        state->failures++;
+        time_t delay = (time_t)state->failures * SMARTPLS_RETRY_INTERVAL;
+        state->retry_time = time(NULL) + (delay < SMARTPLS_RETRY_MAX ? delay : SMARTPLS_RETRY_MAX);
+    }
+    state->db_generation = db_generation;
+    state->sticker_generation = sticker_generation;
+    state->smartpls_mtime = smartpls_mtime;
+    state->last_build = time(NULL);
+    state->last_cost = cost;
+    state->entries = entries;
+    return rc;
+}
+
+//private functions
+static bool mpd_worker_smartpls_build(t_config *config, t_mpd_worker_state *mpd_worker_state, const char *playlist, unsigned *deps, unsigned *entries) {
+    char *smartpltype = NULL;
+    int je;
+    bool rc = true;
+    char *p_charbuf1 = NULL;
+    char *p_charbuf2 = NULL;
+    int int_buf1;
+    int int_buf2;
+    struct list uris;
     
     sds filename = sdscatfmt(sdsempty(), "%s/smartpls/%s", config->varlibdir, playlist);
     char *content = json_fread(filename);
@@ -108,17 +355,20 @@ bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker
         LOG_ERROR("Cant read smart playlist type from %s", filename);
         return false;
     }
+    //the new content of the playlist
+    list_init(&uris);
     if (strcmp(smartpltype, "sticker") == 0) {
+        *deps = SMARTPLS_DEP_STICKER;
         je = json_scanf(content, (int)strlen(content), "{sticker: %Q, maxentries: %d, minvalue: %d}", &p_charbuf1, &int_buf1, &int_buf2);
         if (je == 3) {
-            if (mpd_worker_smartpls_update_sticker(mpd_worker_state, playlist, p_charbuf1, int_buf1, int_buf2) == false) {
+            if (mpd_worker_smartpls_update_sticker(mpd_worker_state, p_charbuf1, int_buf1, int_buf2, &uris) == false) {
                 LOG_ERROR("Update of smart playlist %s failed.", playlist);
                 rc = false;
             }
         }
         else if (je == 2) {
             //for backward compatibility
-            if (mpd_worker_smartpls_update_sticker(mpd_worker_state, playlist, p_charbuf1, int_buf1, 2) == false) {
+            if (mpd_worker_smartpls_update_sticker(mpd_worker_state, p_charbuf1, int_buf1, 2, &uris) == false) {
                 LOG_ERROR("Update of smart playlist %s failed.", playlist);
                 rc = false;
             }
@@ -130,9 +380,10 @@ bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker
         FREE_PTR(p_charbuf1);
     }
     else if (strcmp(smartpltype, "newest") == 0) {
+        *deps = SMARTPLS_DEP_DATABASE;
         je = json_scanf(content, (int)strlen(content), "{timerange: %d}", &int_buf1);
         if (je == 1) {
-            if (mpd_worker_smartpls_update_newest(mpd_worker_state, playlist, int_buf1) == false) {
+            if (mpd_worker_smartpls_update_newest(mpd_worker_state, int_buf1, &uris) == false) {
                 LOG_ERROR("Update of smart playlist %s failed", playlist);
                 rc = false;
             }
@@ -143,9 +394,10 @@ bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker
         }
     }
     else if (strcmp(smartpltype, "search") == 0) {
+        *deps = SMARTPLS_DEP_DATABASE;
         je = json_scanf(content, (int)strlen(content), "{tag: %Q, searchstr: %Q}", &p_charbuf1, &p_charbuf2);
         if (je == 2) {
-            if (mpd_worker_smartpls_update_search(mpd_worker_state, playlist, p_charbuf1, p_charbuf2) == false) {
+            if (mpd_worker_smartpls_update_search(mpd_worker_state, p_charbuf1, p_charbuf2, &uris) == false) {
                 LOG_ERROR("Update of smart playlist %s failed", playlist);
                 rc = false;
             }
@@ -158,19 +410,68 @@ bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker
         FREE_PTR(p_charbuf1);
         FREE_PTR(p_charbuf2);
     }
+    else {
+        LOG_ERROR("Unknown smart playlist type %s", smartpltype);
+        rc = false;
+    }
+    *entries = uris.length;
     if (rc == true) {
         je = json_scanf(content, (int)strlen(content), "{sort: %Q}", &p_charbuf1);
-        if (je == 1 && strlen(p_charbuf1) > 0) {
+        bool sort = je == 1 && strlen(p_charbuf1) > 0 ? true : false;
+        //sorted playlists are compared without order, the sort rewrites the playlist only if the content has changed
+        bool changed = false;
+        rc = mpd_worker_smartpls_write(mpd_worker_state, playlist, &uris, sort, &changed);
+        if (rc == true && changed == true && sort == true) {
             mpd_shared_playlist_shuffle_sort(mpd_worker_state->mpd_state, NULL, NULL, 0, playlist, p_charbuf1);
         }
         FREE_PTR(p_charbuf1);
     }
+    list_free(&uris);
     FREE_PTR(smartpltype);
     FREE_PTR(content);
     return rc;
 }
 
-//private functions
+static unsigned mpd_worker_smartpls_deps(t_config *config, const char *playlist) {
+    unsigned deps = 0;
+    sds filename = sdscatfmt(sdsempty(), "%s/smartpls/%s", config->varlibdir, playlist);
+    char *content = json_fread(filename);
+    sdsfree(filename);
+    if (content == NULL) {
+        return deps;
+    }
+    char *smartpltype = NULL;
+    int je = json_scanf(content, (int)strlen(content), "{type: %Q }", &smartpltype);
+    if (je == 1) {
+        if (strcmp(smartpltype, "sticker") == 0) {
+            deps = SMARTPLS_DEP_STICKER;
+        }
+        else if (strcmp(smartpltype, "newest") == 0 || strcmp(smartpltype, "search") == 0) {
+            deps = SMARTPLS_DEP_DATABASE;
+        }
+    }
+    FREE_PTR(smartpltype);
+    FREE_PTR(content);
+    return deps;
+}
+
+static void mpd_worker_smartpls_mark_dirty(struct t_smartpls_state *state, int priority) {
+    if (state->dirty == false || priority < state->priority) {
+        state->priority = priority;
+    }
+    state->dirty = true;
+    if (priority == SMARTPLS_PRIO_DEFINITION) {
+        //a changed definition could fix a failed build
+        state->retry_time = 0;
+    }
+}
+
+static long mpd_worker_smartpls_elapsed_ms(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000 + (end.tv_nsec - start->tv_nsec) / 1000000;
+}
+
 static bool mpd_worker_smartpls_per_tag(t_config *config, t_mpd_worker_state *mpd_worker_state) {
     for (size_t i = 0; i < mpd_worker_state->generate_pls_tag_types.len; i++) {
         enum mpd_tag_type tag = mpd_worker_state->generate_pls_tag_types.tags[i];
@@ -250,65 +551,33 @@ static bool mpd_worker_smartpls_clear(t_mpd_worker_state *mpd_worker_state, cons
     return true;
 }
 
-static bool mpd_worker_smartpls_update_search(t_mpd_worker_state *mpd_worker_state, const char *playlist, const char *tag, const char *searchstr) {
-    sds buffer = sdsempty();
-    sds method = sdsempty();
-    mpd_worker_smartpls_clear(mpd_worker_state, playlist);
+static bool mpd_worker_smartpls_update_search(t_mpd_worker_state *mpd_worker_state, const char *tag, const char *searchstr, struct list *uris) {
     if (mpd_worker_state->mpd_state->feat_advsearch == true && strcmp(tag, "expression") == 0) {
-        buffer = mpd_shared_search_adv(mpd_worker_state->mpd_state, buffer, method, 0, searchstr, NULL, true, NULL, playlist, 0, 0, NULL);
+        return mpd_worker_smartpls_search_uris(mpd_worker_state, searchstr, NULL, uris);
     }
-    else {
-        buffer = mpd_shared_search(mpd_worker_state->mpd_state, buffer, method, 0, searchstr, tag, playlist, 0, 0, NULL);
-    }
-    sdsfree(buffer);
-    sdsfree(method);
-    LOG_VERBOSE("Updated smart playlist %s", playlist);
-    return true;
+    return mpd_worker_smartpls_search_uris(mpd_worker_state, searchstr, tag, uris);
 }
 
-static bool mpd_worker_smartpls_update_sticker(t_mpd_worker_state *mpd_worker_state, const char *playlist, const char *sticker, const int maxentries, const int minvalue)
+static bool mpd_worker_smartpls_update_sticker(t_mpd_worker_state *mpd_worker_state, const char *sticker, const int maxentries, const int minvalue, struct list *uris)
 {
-    bool rc = mpd_send_sticker_find(mpd_worker_state->mpd_state->conn, "song", "", sticker);
-    if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_send_sticker_find") == false) {
-        return false;    
-    }
-
     struct list add_list;
     list_init(&add_list);
-
-    struct mpd_pair *pair;
-    char *uri = NULL;
     int value_max = 0;
 
-    while ((pair = mpd_recv_pair(mpd_worker_state->mpd_state->conn)) != NULL) {
-        if (strcmp(pair->name, "file") == 0) {
-            FREE_PTR(uri);
-            uri = strdup(pair->value);
-        } 
-        else if (strcmp(pair->name, "sticker") == 0) {
-            size_t j;
-            const char *p_value = mpd_parse_sticker(pair->value, &j);
-            if (p_value != NULL) {
-                char *crap;
-                int value = strtoimax(p_value, &crap, 10);
-                if (value >= 1) {
-                    list_push(&add_list, uri, value, NULL, NULL);
-                }
-                if (value > value_max) {
-                    value_max = value;
-                }
-            }
+    //use the sticker cache of the mpd_client thread if available, fallback to mpd
+    //the cache can not distinguish an explicit like sticker of 1 from a missing one,
+    //only mpd selects the songs with like 1
+    bool from_cache = strcmp(sticker, "like") != 0 || minvalue > 1;
+    if (from_cache == false ||
+        mpd_worker_smartpls_sticker_from_cache(sticker, maxentries, &add_list, &value_max) == false)
+    {
+        if (mpd_worker_smartpls_sticker_from_mpd(mpd_worker_state, sticker, &add_list, &value_max) == false) {
+            list_free(&add_list);
+            return false;
         }
-        mpd_return_pair(mpd_worker_state->mpd_state->conn, pair);
-    }
-    mpd_response_finish(mpd_worker_state->mpd_state->conn);
-    FREE_PTR(uri);
-    if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
-        return false;
+        list_sort_by_value_i(&add_list, false);
     }
 
-    mpd_worker_smartpls_clear(mpd_worker_state, playlist);
-     
     if (minvalue > 0) {
         value_max = minvalue;
     }
@@ -316,40 +585,24 @@ static bool mpd_worker_smartpls_update_sticker(t_mpd_worker_state *mpd_worker_st
         value_max = value_max / 2;
     }
 
-    list_sort_by_value_i(&add_list, false);
-
     int i = 0;
-    if (mpd_command_list_begin(mpd_worker_state->mpd_state->conn, false)) {
-        struct list_node *current = add_list.head;
-
-        while (current != NULL) {
-            if (current->value_i >= value_max) {
-                rc = mpd_send_playlist_add(mpd_worker_state->mpd_state->conn, playlist, current->key);
-                if (rc == false) {
-                    LOG_ERROR("Error adding command to command list mpd_send_playlist_add");
-                    break;
-                }
-                i++;
-                if (i >= maxentries) {
-                    break;
-                }
+    struct list_node *current = add_list.head;
+    while (current != NULL) {
+        if (current->value_i >= value_max) {
+            list_push(uris, current->key, 0, NULL, NULL);
+            i++;
+            if (i >= maxentries) {
+                break;
             }
-            current = current->next;
-        }
-        if (mpd_command_list_end(mpd_worker_state->mpd_state->conn)) {
-            mpd_response_finish(mpd_worker_state->mpd_state->conn);
-        }
-        if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
-            list_free(&add_list);
-            return false;
         }
+        current = current->next;
     }
     list_free(&add_list);
-    LOG_VERBOSE("Updated smart playlist %s with %d songs, minValue: %d", playlist, i, value_max);
+    LOG_DEBUG("Selected %d songs for sticker %s, minValue: %d", i, sticker, value_max);
     return true;
 }
 
-static bool mpd_worker_smartpls_update_newest(t_mpd_worker_state *mpd_worker_state, const char *playlist, const int timerange) {
+static bool mpd_worker_smartpls_update_newest(t_mpd_worker_state *mpd_worker_state, const int timerange, struct list *uris) {
     unsigned long value_max = 0;
     
     struct mpd_stats *stats = mpd_run_stats(mpd_worker_state->mpd_state->conn);
@@ -362,24 +615,409 @@ static bool mpd_worker_smartpls_update_newest(t_mpd_worker_state *mpd_worker_sta
         return false;
     }
 
-    mpd_worker_smartpls_clear(mpd_worker_state, playlist);
     value_max -= timerange;
-    sds buffer = sdsempty();
-    sds method = sdsempty();
+    bool rc = true;
     if (value_max > 0) {
         if (mpd_worker_state->mpd_state->feat_advsearch == true) {
             sds searchstr = sdscatprintf(sdsempty(), "(modified-since '%lu')", value_max);
-            buffer = mpd_shared_search_adv(mpd_worker_state->mpd_state, buffer, method, 0, searchstr, NULL, true, NULL, playlist, 0, 0, NULL);
+            rc = mpd_worker_smartpls_search_uris(mpd_worker_state, searchstr, NULL, uris);
             sdsfree(searchstr);
         }
         else {
             sds searchstr = sdscatprintf(sdsempty(), "%lu", value_max);
-            buffer = mpd_shared_search(mpd_worker_state->mpd_state, buffer, method, 0, searchstr, "modified-since", playlist, 0, 0, NULL);
+            rc = mpd_worker_smartpls_search_uris(mpd_worker_state, searchstr, "modified-since", uris);
             sdsfree(searchstr);
         }
-        LOG_VERBOSE("Updated smart playlist %s", playlist);
     }
-    sdsfree(buffer);
-    sdsfree(method);
+    return rc;
+}
+
+static bool mpd_worker_smartpls_search_uris(t_mpd_worker_state *mpd_worker_state, const char *expression, const char *tag, struct list *uris) {
+    if (strcmp(expression, "") == 0) {
+        LOG_ERROR("No search expression defined");
+        return false;
+    }
+    struct mpd_connection *conn = mpd_worker_state->mpd_state->conn;
+    bool rc = mpd_search_db_songs(conn, false);
+    if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_db_songs") == false) {
+        mpd_search_cancel(conn);
+        return false;
+    }
+    if (tag == NULL) {
+        rc = mpd_search_add_expression(conn, expression);
+    }
+    else if (strcmp(tag, "any") == 0) {
+        rc = mpd_search_add_any_tag_constraint(conn, MPD_OPERATOR_DEFAULT, expression);
+    }
+    else if (strcmp(tag, "modified-since") == 0) {
+        char *crap;
+        rc = mpd_search_add_modified_since_constraint(conn, MPD_OPERATOR_DEFAULT, (time_t)strtoimax(expression, &crap, 10));
+    }
+    else {
+        rc = mpd_search_add_tag_constraint(conn, MPD_OPERATOR_DEFAULT, mpd_tag_name_parse(tag), expression);
+    }
+    if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_add_constraint") == false) {
+        mpd_search_cancel(conn);
+        return false;
+    }
+    rc = mpd_search_commit(conn);
+    if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_search_commit") == false) {
+        return false;
+    }
+    //only the uris are needed
+    struct mpd_pair *pair;
+    while ((pair = mpd_recv_pair_named(conn, "file")) != NULL) {
+        list_push(uris, pair->value, 0, NULL, NULL);
+        mpd_return_pair(conn, pair);
+    }
+    mpd_response_finish(conn);
+    if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
+        return false;
+    }
+    return true;
+}
+
+static bool mpd_worker_smartpls_write(t_mpd_worker_state *mpd_worker_state, const char *playlist, struct list *uris, bool ignore_order, bool *changed) {
+    struct mpd_connection *conn = mpd_worker_state->mpd_state->conn;
+    *changed = false;
+
+    //get the current content of the playlist
+    struct list current_list;
+    list_init(&current_list);
+    unsigned long playlist_mtime = mpd_shared_get_playlist_mtime(mpd_worker_state->mpd_state, playlist);
+    if (playlist_mtime > 0) {
+        bool rc = mpd_send_list_playlist(conn, playlist);
+        if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_send_list_playlist") == false) {
+            return false;
+        }
+        struct mpd_pair *pair;
+        while ((pair = mpd_recv_pair_named(conn, "file")) != NULL) {
+            list_push(&current_list, pair->value, 0, NULL, NULL);
+            mpd_return_pair(conn, pair);
+        }
+        mpd_response_finish(conn);
+        if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
+            list_free(&current_list);
+            return false;
+        }
+    }
+
+    if (uris->length == 0) {
+        if (current_list.length > 0) {
+            *changed = true;
+            mpd_worker_smartpls_clear(mpd_worker_state, playlist);
+        }
+        list_free(&current_list);
+        LOG_VERBOSE("Updated smart playlist %s, playlist is empty", playlist);
+        return true;
+    }
+
+    //count the wanted uris
+    rax *wanted = raxNew();
+    struct list_node *current = uris->head;
+    while (current != NULL) {
+        void *count = raxFind(wanted, (unsigned char *)current->key, sdslen(current->key));
+        uintptr_t c = count == raxNotFound ? 1 : (uintptr_t)count + 1;
+        raxInsert(wanted, (unsigned char *)current->key, sdslen(current->key), (void *)c, NULL);
+        current = current->next;
+    }
+
+    //plan the edits, the working copy of the playlist has pointers to the keys of current_list and uris
+    const char **work = (const char **)malloc(sizeof(char *) * (current_list.length + uris->length));
+    assert(work);
+    unsigned work_len = 0;
+    bool rc = true;
+    unsigned max_edits = uris->length * SMARTPLS_EDIT_RATIO / 100;
+    bool replace = false;
+    unsigned deleted = 0;
+    unsigned moved = 0;
+    //moves as pairs of from and to positions
+    unsigned *moves = (unsigned *)malloc(sizeof(unsigned) * 2 * (max_edits + 1));
+    assert(moves);
+
+    //keep the first occurrences of wanted uris
+    bool *keep = (bool *)malloc(sizeof(bool) * (current_list.length + 1));
+    assert(keep);
+    unsigned i = 0;
+    current = current_list.head;
+    while (current != NULL) {
+        void *count = raxFind(wanted, (unsigned char *)current->key, sdslen(current->key));
+        if (count != raxNotFound && (uintptr_t)count > 0) {
+            raxInsert(wanted, (unsigned char *)current->key, sdslen(current->key), (void *)((uintptr_t)count - 1), NULL);
+            keep[i] = true;
+            work[work_len++] = current->key;
+        }
+        else {
+            keep[i] = false;
+            deleted++;
+        }
+        i++;
+        current = current->next;
+    }
+    //append the missing uris, the moves are reordering the working copy
+    const char **adds = (const char **)malloc(sizeof(char *) * (uris->length + 1));
+    assert(adds);
+    unsigned added = 0;
+    current = uris->head;
+    while (current != NULL) {
+        void *count = raxFind(wanted, (unsigned char *)current->key, sdslen(current->key));
+        if ((uintptr_t)count > 0) {
+            raxInsert(wanted, (unsigned char *)current->key, sdslen(current->key), (void *)((uintptr_t)count - 1), NULL);
+            work[work_len++] = current->key;
+            adds[added++] = current->key;
+        }
+        current = current->next;
+    }
+    raxFree(wanted);
+    if (deleted > max_edits) {
+        replace = true;
+    }
+    //move the entries to the wanted positions, the planning stops with the edit limit
+    if (ignore_order == false) {
+        i = 0;
+        current = uris->head;
+        while (current != NULL && replace == false) {
+            if (strcmp(work[i], current->key) != 0) {
+                if (deleted + moved == max_edits) {
+                    replace = true;
+                    break;
+                }
+                unsigned j = i + 1;
+                while (j < work_len && strcmp(work[j], current->key) != 0) {
+                    j++;
+                }
+                if (j == work_len) {
+                    LOG_ERROR("Smart playlist %s: uri \"%s\" not found in working copy", playlist, current->key);
+                    rc = false;
+                    break;
+                }
+                moves[moved * 2] = j;
+                moves[moved * 2 + 1] = i;
+                const char *tmp = work[j];
+                memmove(&work[i + 1], &work[i], sizeof(char *) * (j - i));
+                work[i] = tmp;
+                moved++;
+            }
+            i++;
+            current = current->next;
+        }
+    }
+
+    bool started = false;
+    if (rc == true && replace == true) {
+        //clear and add in one command list
+        rc = mpd_worker_smartpls_command_list(mpd_worker_state, &started) &&
+            mpd_send_playlist_clear(conn, playlist);
+        current = uris->head;
+        while (current != NULL && rc == true) {
+            rc = mpd_send_playlist_add(conn, playlist, current->key);
+            current = current->next;
+        }
+    }
+    else if (rc == true) {
+        //delete from the end to keep the positions valid
+        for (i = current_list.length; i > 0 && rc == true; i--) {
+            if (keep[i - 1] == false) {
+                rc = mpd_worker_smartpls_command_list(mpd_worker_state, &started) &&
+                    mpd_send_playlist_delete(conn, playlist, i - 1);
+            }
+        }
+        for (i = 0; i < added && rc == true; i++) {
+            rc = mpd_worker_smartpls_command_list(mpd_worker_state, &started) &&
+                mpd_send_playlist_add(conn, playlist, adds[i]);
+        }
+        for (i = 0; i < moved && rc == true; i++) {
+            rc = mpd_worker_smartpls_command_list(mpd_worker_state, &started) &&
+                mpd_send_playlist_move(conn, playlist, moves[i * 2], moves[i * 2 + 1]);
+        }
+    }
+    free(keep);
+    free(adds);
+    free(moves);
+    free(work);
+    list_free(&current_list);
+
+    if (rc == false) {
+        LOG_ERROR("Error adding command to command list");
+    }
+    if (started == true) {
+        if (mpd_command_list_end(conn)) {
+            mpd_response_finish(conn);
+        }
+        if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
+            return false;
+        }
+        *changed = true;
+        if (replace == true) {
+            LOG_VERBOSE("Replaced smart playlist %s with %u entries", playlist, uris->length);
+        }
+        else {
+            LOG_VERBOSE("Updated smart playlist %s: %u deleted, %u added, %u moved", playlist, deleted, added, moved);
+        }
+    }
+    else {
+        LOG_VERBOSE("Smart playlist %s is unchanged", playlist);
+    }
+    return rc;
+}
+
+static bool mpd_worker_smartpls_command_list(t_mpd_worker_state *mpd_worker_state, bool *started) {
+    //start the command list with the first change
+    if (*started == true) {
+        return true;
+    }
+    *started = mpd_command_list_begin(mpd_worker_state->mpd_state->conn, false);
+    return *started;
+}
+
+static bool mpd_worker_smartpls_sticker_from_cache(const char *sticker, int maxentries, struct list *add_list, int *value_max) {
+    if (mpd_worker_smartpls_sticker_value(NULL, sticker) == -1) {
+        //sticker is not cached
+        return false;
+    }
+    sticker_cache_lock();
+    rax *sticker_cache = sticker_cache_get_shared();
+    if (sticker_cache == NULL) {
+        sticker_cache_unlock();
+        return false;
+    }
+    //keep only the maxentries highest values, the minimum value is applied after the max value is known
+    int heap_size = maxentries > 0 ? maxentries : 1;
+    int heap_len = 0;
+    struct t_heap_entry *heap = (struct t_heap_entry *)malloc(sizeof(struct t_heap_entry) * (size_t)heap_size);
+    assert(heap);
+    raxIterator iter;
+    raxStart(&iter, sticker_cache);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        long value = mpd_worker_smartpls_sticker_value((t_sticker *)iter.data, sticker);
+        if (value >= 1) {
+            mpd_worker_smartpls_heap_push(heap, &heap_len, heap_size, (const char *)iter.key, iter.key_len, value);
+        }
+        if (value > *value_max) {
+            *value_max = (int)value;
+        }
+    }
+    raxStop(&iter);
+    sticker_cache_unlock();
+
+    //heap to list sorted by value descending
+    while (heap_len > 0) {
+        list_insert(add_list, heap[0].uri, heap[0].value, NULL, NULL);
+        sdsfree(heap[0].uri);
+        heap_len--;
+        heap[0] = heap[heap_len];
+        mpd_worker_smartpls_heap_down(heap, heap_len, 0);
+    }
+    free(heap);
+    LOG_DEBUG("Selected %u songs for sticker %s from sticker cache", add_list->length, sticker);
     return true;
 }
+
+static bool mpd_worker_smartpls_sticker_from_mpd(t_mpd_worker_state *mpd_worker_state, const char *sticker, struct list *add_list, int *value_max) {
+    bool rc = mpd_send_sticker_find(mpd_worker_state->mpd_state->conn, "song", "", sticker);
+    if (check_rc_error_and_recover(mpd_worker_state->mpd_state, NULL, NULL, 0, false, rc, "mpd_send_sticker_find") == false) {
+        return false;    
+    }
+
+    struct mpd_pair *pair;
+    char *uri = NULL;
+
+    while ((pair = mpd_recv_pair(mpd_worker_state->mpd_state->conn)) != NULL) {
+        if (strcmp(pair->name, "file") == 0) {
+            FREE_PTR(uri);
+            uri = strdup(pair->value);
+        } 
+        else if (strcmp(pair->name, "sticker") == 0) {
+            size_t j;
+            const char *p_value = mpd_parse_sticker(pair->value, &j);
+            if (p_value != NULL) {
+                char *crap;
+                int value = strtoimax(p_value, &crap, 10);
+                if (value >= 1) {
+                    list_push(add_list, uri, value, NULL, NULL);
+                }
+                if (value > *value_max) {
+                    *value_max = value;
+                }
+            }
+        }
+        mpd_return_pair(mpd_worker_state->mpd_state->conn, pair);
+    }
+    mpd_response_finish(mpd_worker_state->mpd_state->conn);
+    FREE_PTR(uri);
+    if (check_error_and_recover2(mpd_worker_state->mpd_state, NULL, NULL, 0, false) == false) {
+        return false;
+    }
+    return true;
+}
+
+static long mpd_worker_smartpls_sticker_value(const t_sticker *sticker, const char *name) {
+    //returns -1 for stickers that are not in the sticker cache
+    if (strcmp(name, "playCount") == 0) {
+        return sticker != NULL ? (long)sticker->playCount : 0;
+    }
+    if (strcmp(name, "skipCount") == 0) {
+        return sticker != NULL ? (long)sticker->skipCount : 0;
+    }
+    if (strcmp(name, "like") == 0) {
+        //the sticker cache defaults like to 1 for songs without like sticker,
+        //but sticker find does not return these songs, the cache is only used for minvalue > 1
+        return sticker != NULL && sticker->like != 1 ? (long)sticker->like : 0;
+    }
+    if (strcmp(name, "lastPlayed") == 0) {
+        return sticker != NULL ? (long)sticker->lastPlayed : 0;
+    }
+    if (strcmp(name, "lastSkipped") == 0) {
+        return sticker != NULL ? (long)sticker->lastSkipped : 0;
+    }
+    return -1;
+}
+
+static void mpd_worker_smartpls_heap_push(struct t_heap_entry *heap, int *heap_len, int heap_size, const char *uri, size_t uri_len, long value) {
+    if (*heap_len < heap_size) {
+        int i = *heap_len;
+        (*heap_len)++;
+        heap[i].uri = sdsnewlen(uri, uri_len);
+        heap[i].value = value;
+        //sift up
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (heap[parent].value <= heap[i].value) {
+                break;
+            }
+            struct t_heap_entry tmp = heap[i];
+            heap[i] = heap[parent];
+            heap[parent] = tmp;
+            i = parent;
+        }
+    }
+    else if (value > heap[0].value) {
+        //replace the smallest value
+        sdsfree(heap[0].uri);
+        heap[0].uri = sdsnewlen(uri, uri_len);
+        heap[0].value = value;
+        mpd_worker_smartpls_heap_down(heap, *heap_len, 0);
+    }
+}
+
+static void mpd_worker_smartpls_heap_down(struct t_heap_entry *heap, int heap_len, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < heap_len && heap[left].value < heap[smallest].value) {
+            smallest = left;
+        }
+        if (right < heap_len && heap[right].value < heap[smallest].value) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        struct t_heap_entry tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
@@ -6,6 +6,9 @@
 
 #ifndef __MPD_WORKER_SMARTPLS_H__
 #define __MPD_WORKER_SMARTPLS_H__
-bool mpd_worker_smartpls_update_all(t_config *config, t_mpd_worker_state *mpd_worker_state, bool force);
+bool mpd_worker_smartpls_update_all(t_config *config, t_mpd_worker_state *mpd_worker_state, bool force, bool check_mtime);
 bool mpd_worker_smartpls_update(t_config *config, t_mpd_worker_state *mpd_worker_state, const char *playlist);
+bool mpd_worker_smartpls_dirty(t_mpd_worker_state *mpd_worker_state);
+bool mpd_worker_smartpls_update_next(t_config *config, t_mpd_worker_state *mpd_worker_state);
+sds mpd_worker_smartpls_status(t_mpd_worker_state *mpd_worker_state, sds buffer, sds method, long request_id);
 #endif
@@ -40,6 +40,19 @@ void default_mpd_worker_state(t_mpd_worker_state *mpd_worker_state) {
     mpd_worker_state->smartpls_prefix = sdsempty();
     mpd_worker_state->generate_pls_tags = sdsempty();
     reset_t_tags(&mpd_worker_state->generate_pls_tag_types);
+    list_init(&mpd_worker_state->smartpls_states);
+    mpd_worker_state->db_generation = 1;
+    mpd_worker_state->sticker_generation = 1;
+    mpd_worker_state->smartpls_per_tag_generation = 0;
+    mpd_worker_state->smartpls_seen = 0;
+    mpd_worker_state->smartpls_notify = false;
+    list_init(&mpd_worker_state->coverprefetch_uris);
+    mpd_worker_state->coverprefetch_node = NULL;
+    mpd_worker_state->coverprefetch_pos = 0;
+    mpd_worker_state->coverprefetch_fetched = 0;
+    mpd_worker_state->coverprefetch_running = false;
+    mpd_worker_state->coverprefetch_last.tv_sec = 0;
+    mpd_worker_state->coverprefetch_last.tv_nsec = 0;
     //mpd state
     mpd_worker_state->mpd_state = (t_mpd_state *)malloc(sizeof(t_mpd_state));
     assert(mpd_worker_state->mpd_state);
@@ -50,6 +63,8 @@ void free_mpd_worker_state(t_mpd_worker_state *mpd_worker_state) {
     sdsfree(mpd_worker_state->smartpls_sort);
     sdsfree(mpd_worker_state->smartpls_prefix);
     sdsfree(mpd_worker_state->generate_pls_tags);
+    list_free(&mpd_worker_state->smartpls_states);
+    list_free(&mpd_worker_state->coverprefetch_uris);
     //mpd state
     mpd_shared_free_mpd_state(mpd_worker_state->mpd_state);
     free(mpd_worker_state);
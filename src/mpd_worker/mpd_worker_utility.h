@@ -15,6 +15,20 @@ typedef struct t_mpd_worker_state {
     sds smartpls_prefix;
     sds generate_pls_tags;
     t_tags generate_pls_tag_types;
+    //smart playlist scheduler
+    struct list smartpls_states;
+    unsigned long db_generation;
+    unsigned long sticker_generation;
+    unsigned long smartpls_per_tag_generation;
+    long smartpls_seen; //marks the smart playlists found by the last scan
+    bool smartpls_notify;
+    //cover prefetch job
+    struct list coverprefetch_uris;
+    struct list_node *coverprefetch_node; //last fetched album, NULL before the first
+    unsigned coverprefetch_pos;
+    unsigned coverprefetch_fetched;
+    bool coverprefetch_running;
+    struct timespec coverprefetch_last;
     //mpd state
     struct t_mpd_state *mpd_state;
 } t_mpd_worker_state;
@@ -30,6 +30,7 @@
 #include "config_defs.h"
 #include "utility.h"
 #include "global.h"
+#include "api_params.h"
 #include "lua_mympd_state.h"
 #include "mpd_client.h"
 #include "maintenance.h"
@@ -366,11 +367,12 @@ static void mympd_api(t_config *config, t_mympd_state *mympd_state, t_work_reque
             response->data = jsonrpc_respond_ok(response->data, request->method, request->id);
             break;
         case MYMPD_API_SETTINGS_SET: {
-            void *h = NULL;
+            t_api_params *params = request_params(request);
+            unsigned pos = 0;
             struct json_token key;
             struct json_token val;
             rc = true;
-            while ((h = json_next_key(request->data, sdslen(request->data), h, ".params", &key, &val)) != NULL) {
+            while (api_params_next(params, &pos, &key, &val) == true) {
                 rc = mympd_api_settings_set(config, mympd_state, &key, &val);
                 if (rc == false) {
                     break;
@@ -397,11 +399,12 @@ static void mympd_api(t_config *config, t_mympd_state *mympd_state, t_work_reque
             response->data = mympd_api_settings_put(config, mympd_state, response->data, request->method, request->id);
             break;
         case MYMPD_API_CONNECTION_SAVE: {
-            void *h = NULL;
+            t_api_params *params = request_params(request);
+            unsigned pos = 0;
             struct json_token key;
             struct json_token val;
             rc = true;
-            while ((h = json_next_key(request->data, sdslen(request->data), h, ".params", &key, &val)) != NULL) {
+            while (api_params_next(params, &pos, &key, &val) == true) {
                 rc = mympd_api_connection_save(config, mympd_state, &key, &val);
                 if (rc == false) {
                     break;
@@ -536,6 +539,13 @@ static void mympd_api(t_config *config, t_mympd_state *mympd_state, t_work_reque
     FREE_PTR(p_charbuf4);
     FREE_PTR(p_charbuf5);
 
+    //cached settings responses are outdated
+    if (request->cmd_id == MYMPD_API_SETTINGS_SET || request->cmd_id == MYMPD_API_SETTINGS_RESET ||
+        request->cmd_id == MYMPD_API_CONNECTION_SAVE || request->cmd_id == MYMPD_API_COLS_SAVE)
+    {
+        api_generation_bump(GENERATION_SETTINGS);
+    }
+
     if (sdslen(response->data) == 0) {
         response->data = jsonrpc_start_phrase(response->data, request->method, request->id, "No response for method %{method}", true);
         response->data = tojson_char(response->data, "method", request->method, false);
@@ -571,6 +571,12 @@ static int _mympd_api(lua_State *lua_vm, bool raw) {
     else if (strncmp(method, "MPDWORKER_API_", 14) == 0) {
         tiny_queue_push(mpd_worker_queue, request, tid);
     }
+    else if (is_mpd_binary_api_method(request->cmd_id) == true) {
+        tiny_queue_push(mpd_binary_queue, request, tid);
+    }
+    else if (mpd_client_pool_queue != NULL && is_mpd_client_pool_api_method(request->cmd_id) == true) {
+        tiny_queue_push(mpd_client_pool_queue, request, tid);
+    }
     else {
         tiny_queue_push(mpd_client_queue, request, tid);
     }
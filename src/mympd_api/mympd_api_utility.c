@@ -68,6 +68,14 @@ void mympd_api_push_to_mpd_client(t_mympd_state *mympd_state) {
     request2->data = tojson_long(request2->data, "mpdPort", mympd_state->mpd_port, false);
     request2->data = sdscat(request2->data, "}}");
     tiny_queue_push(mpd_worker_queue, request2, 0);
+
+    t_work_request *request3 = create_request(-1, 0, MYMPD_API_SETTINGS_SET, "MYMPD_API_SETTINGS_SET", "");
+    request3->data = sdscat(request3->data, "{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"MYMPD_API_SETTINGS_SET\",\"params\":{");
+    request3->data = tojson_char(request3->data, "mpdHost", mympd_state->mpd_host, true);
+    request3->data = tojson_char(request3->data, "mpdPass", mympd_state->mpd_pass, true);
+    request3->data = tojson_long(request3->data, "mpdPort", mympd_state->mpd_port, false);
+    request3->data = sdscat(request3->data, "}}");
+    tiny_queue_push(mpd_binary_queue, request3, 0);
 }
 
 void free_mympd_state(t_mympd_state *mympd_state) {
@@ -8,58 +8,40 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "../dist/src/sds/sds.h"
 #include "sds_extras.h"
 
-static int json_get_utf8_char_len(unsigned char ch) {
-    if ((ch & 0x80) == 0) {
-        return 1;
-    }
+//private definitions
+static size_t json_escape_run(const unsigned char *p, size_t len);
+static sds json_escape_char(sds s, unsigned char c);
 
-    switch (ch & 0xf0) {
-        case 0xf0:
-            return 4;
-        case 0xe0:
-            return 3;
-        default:
-            return 2;
-    }
-}
+//public functions
 
+//runs of bytes that need no escaping are copied in bulk,
+//the runs are found with sse2 or neon if available
 sds sdscatjson(sds s, const char *p, size_t len) {
-    const char *hex_digits = "0123456789abcdef";
+    const unsigned char *src = (const unsigned char *)p;
+    //most strings need no escaping at all
+    s = sdsMakeRoomFor(s, len + 2);
     s = sdscatlen(s, "\"", 1);
-    while (len--) {
-        switch(*p) {
-        case '\\':
-        case '"':
-            s = sdscatprintf(s, "\\%c", *p);
-            break;
-        case '\n': s = sdscatlen(s, "\\n", 2);     break;
-        case '\r': s = sdscatlen(s, "\\r", 2);     break;
-        case '\t': s = sdscatlen(s, "\\t", 2);     break;
-        case '\b': s = sdscatlen(s, "\\b", 2);     break;
-        case '\f': s = sdscatlen(s, "\\f", 2);     break;
-        // Escape < to prevent script execution
-        case '<' : s = sdscatlen(s, "\\u003C", 6); break;
-        //ignore vertical tabulator and alert
-        case '\v': 
-        case '\a': 
-            break;
-        default:
-            if (isprint(*p)) {
-                s = sdscatprintf(s, "%c", *p);
-            }
-            else if (json_get_utf8_char_len(*p) == 1) {
-                s = sdscatprintf(s, "\\u00%s%s", &hex_digits[(*p >> 4) % 0xf], &hex_digits[*p % 0xf]);
-            } 
-            else {
-                s = sdscatprintf(s, "%c", *p);
-            }
-            break;
+    while (len > 0) {
+        size_t run = json_escape_run(src, len);
+        if (run > 0) {
+            s = sdscatlen(s, src, run);
+            src += run;
+            len -= run;
+        }
+        if (len > 0) {
+            s = json_escape_char(s, *src);
+            src++;
+            len--;
         }
-        p++;
     }
     return sdscatlen(s, "\"", 1);
 }
@@ -122,3 +104,83 @@ sds sdscrop(sds s) {
     sdsclear(s);
     return s;
 }
+
+//private functions
+
+//true for control characters, quote, backslash, < and delete,
+//bytes of multibyte utf8 characters are copied as they are
+static inline bool json_needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\' || c == '<' || c == 0x7f;
+}
+
+//length of the leading run of bytes that need no escaping
+static size_t json_escape_run(const unsigned char *p, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i ctrl = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        //unsigned v <= 0x1f
+        __m128i mask = _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl);
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, quote));
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, backslash));
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, lt));
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, del));
+        int bits = _mm_movemask_epi8(mask);
+        if (bits != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)bits);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t lt = vdupq_n_u8('<');
+    const uint8x16_t del = vdupq_n_u8(0x7f);
+    const uint8x16_t ctrl = vdupq_n_u8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t mask = vcltq_u8(v, ctrl);
+        mask = vorrq_u8(mask, vceqq_u8(v, quote));
+        mask = vorrq_u8(mask, vceqq_u8(v, backslash));
+        mask = vorrq_u8(mask, vceqq_u8(v, lt));
+        mask = vorrq_u8(mask, vceqq_u8(v, del));
+        if (vmaxvq_u8(mask) != 0) {
+            //the position is found by the scalar loop
+            break;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (json_needs_escape(p[i]) == true) {
+            break;
+        }
+    }
+    return i;
+}
+
+static sds json_escape_char(sds s, unsigned char c) {
+    const char *hex_digits = "0123456789abcdef";
+    switch(c) {
+        case '\\': return sdscatlen(s, "\\\\", 2);
+        case '"':  return sdscatlen(s, "\\\"", 2);
+        case '\n': return sdscatlen(s, "\\n", 2);
+        case '\r': return sdscatlen(s, "\\r", 2);
+        case '\t': return sdscatlen(s, "\\t", 2);
+        case '\b': return sdscatlen(s, "\\b", 2);
+        case '\f': return sdscatlen(s, "\\f", 2);
+        // Escape < to prevent script execution
+        case '<':  return sdscatlen(s, "\\u003C", 6);
+        //ignore vertical tabulator and alert
+        case '\v':
+        case '\a':
+            return s;
+        default: {
+            char escaped[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf]};
+            return sdscatlen(s, escaped, 6);
+        }
+    }
+}
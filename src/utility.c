@@ -21,6 +21,7 @@
 #include <libgen.h>
 
 #include "../dist/src/sds/sds.h"
+#include "../dist/src/mongoose/mongoose.h"
 #include "sds_extras.h"
 #include "list.h"
 #include "config_defs.h"
@@ -449,7 +450,7 @@ sds get_mime_type_by_magic_stream(sds stream) {
     sds hex_buffer = sdsempty();
     size_t len = sdslen(stream) < 8 ? sdslen(stream) : 8;
     for (size_t i = 0; i < len; i++) {
-        hex_buffer = sdscatprintf(hex_buffer, "%02X", stream[i]);
+        hex_buffer = sdscatprintf(hex_buffer, "%02X", (unsigned char)stream[i]);
     }
     const struct magic_byte_entry *p = NULL;
     for (p = magic_bytes; p->magic_bytes != NULL; p++) {
@@ -470,35 +471,17 @@ bool is_streamuri(const char *uri) {
     return false;
 }
 
-bool write_covercache_file(t_config *config, const char *uri, const char *mime_type, sds binary) {
-    bool rc = false;
-    sds filename = sdsnew(uri);
-    uri_to_filename(filename);
-    sds tmp_file = sdscatfmt(sdsempty(), "%s/covercache/%s.XXXXXX", config->varlibdir, filename);
-    int fd = mkstemp(tmp_file);
-    if (fd < 0) {
-        LOG_ERROR("Can not open file \"%s\" for write: %s", tmp_file, strerror(errno));
-    }
-    else {
-        FILE *fp = fdopen(fd, "w");
-        fwrite(binary, 1, sdslen(binary), fp);
-        fclose(fp);
-        sds ext = get_ext_by_mime_type(mime_type);
-        sds cover_file = sdscatfmt(sdsempty(), "%s/covercache/%s.%s", config->varlibdir, filename, ext);
-        if (rename(tmp_file, cover_file) == -1) {
-            LOG_ERROR("Rename file from \"%s\" to \"%s\" failed: %s", tmp_file, cover_file, strerror(errno));
-            if (unlink(tmp_file) != 0) {
-                LOG_ERROR("Error removing file \"%s\": %s", tmp_file, strerror(errno));
-            }
-        }
-        LOG_DEBUG("Write covercache file \"%s\" for uri \"%s\"", cover_file, uri);
-        sdsfree(ext);
-        sdsfree(cover_file);
-        rc = true;
-    }
-    sdsfree(tmp_file);
-    sdsfree(filename);
-    return rc;
+//hex encoded sha1 of data
+sds calc_sha1(sds buffer, const char *data, size_t len) {
+    unsigned char digest[20];
+    char hex[41];
+    cs_sha1_ctx ctx;
+    cs_sha1_init(&ctx);
+    cs_sha1_update(&ctx, (const unsigned char *)data, (uint32_t)len);
+    cs_sha1_final(digest, &ctx);
+    cs_to_hex(hex, digest, sizeof(digest));
+    buffer = sdscatlen(buffer, hex, 40);
+    return buffer;
 }
 
 void my_usleep(time_t usec) {
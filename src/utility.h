@@ -39,7 +39,7 @@ sds get_mime_type_by_ext(const char *filename);
 sds get_ext_by_mime_type(const char *mime_type);
 sds get_mime_type_by_magic(const char *filename);
 sds get_mime_type_by_magic_stream(sds stream);
-bool write_covercache_file(t_config *config, const char *uri, const char *mime_type, sds binary);
+sds calc_sha1(sds buffer, const char *data, size_t len);
 bool strtobool(const char *value);
 int strip_extension(char *s);
 void strip_slash(sds s);
@@ -61,6 +61,8 @@ struct mime_type_entry {
     const char *mime_type;
 };
 
+extern const struct mime_type_entry image_files[];
+
 struct magic_byte_entry {
     const char *magic_bytes;
     const char *mime_type;
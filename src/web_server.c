@@ -12,12 +12,15 @@
 #include <inttypes.h>
 #include <libgen.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <mpd/client.h>
 
 #include "../dist/src/sds/sds.h"
 #include "../dist/src/mongoose/mongoose.h"
 #include "../dist/src/frozen/frozen.h"
+#include "../dist/src/rax/rax.h"
 
 #include "sds_extras.h"
 #include "api.h"
@@ -25,11 +28,24 @@
 #include "list.h"
 #include "config_defs.h"
 #include "utility.h"
+#include "api_params.h"
+#include "covercache.h"
 #include "tiny_queue.h"
 #include "global.h"
 #include "web_server/web_server_utility.h"
+#include "web_server/web_server_albumart_cache.h"
+#include "web_server/web_server_coverlookup.h"
+#include "web_server/web_server_connections.h"
+#include "web_server/web_server_coalesce.h"
+#include "web_server/web_server_etag.h"
+#include "web_server/web_server_compress.h"
+#include "web_server/web_server_chunked.h"
 #include "web_server/web_server_albumart.h"
+#include "web_server/web_server_albumart_batch.h"
 #include "web_server/web_server_tagpics.h"
+#include "mpd_shared/mpd_shared_typedefs.h"
+#include "mpd_client/mpd_client_utility.h"
+#include "mpd_client/mpd_client_pool.h"
 #include "web_server.h"
 
 //private definitions
@@ -39,9 +55,12 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data);
 #ifdef ENABLE_SSL
   static void ev_handler_redirect(struct mg_connection *nc_http, int ev, void *ev_data);
 #endif
-static void send_ws_notify(struct mg_mgr *mgr, t_work_result *response);
-static void send_api_response(struct mg_mgr *mgr, t_work_result *response);
-static bool handle_api(int conn_id, struct http_message *hm);
+static void send_ws_notify(t_mg_user_data *mg_user_data, t_work_result *response);
+static void send_api_response(t_mg_user_data *mg_user_data, t_work_result *response);
+static bool handle_api(t_mg_user_data *mg_user_data, int conn_id, struct http_message *hm);
+static bool handle_api_batch(t_mg_user_data *mg_user_data, int conn_id, struct http_message *hm);
+static void send_api_batch_invalid(t_mg_user_data *mg_user_data, int conn_id);
+static t_work_request *api_request_new(int conn_id, const char *data, size_t len);
 static bool handle_script_api(int conn_id, struct http_message *hm);
 
 //public functions
@@ -58,6 +77,12 @@ bool web_server_init(void *arg_mgr, t_config *config, t_mg_user_data *mg_user_da
     mg_user_data->conn_id = 1;
     mg_user_data->feat_library = false;
     mg_user_data->feat_mpd_albumart = false;
+    mg_user_data->albumart_cache = albumart_cache_new((size_t)config->covermemcache * 1024);
+    mg_user_data->coverlookup_cache = coverlookup_cache_new();
+    mg_user_data->connection_index = connection_index_new();
+    mg_user_data->request_coalesce = request_coalesce_new();
+    mg_user_data->etag_index = etag_index_new();
+    mg_user_data->chunked_index = chunked_index_new();
     
     //init monogoose mgr with mg_user_data
     mg_mgr_init(mgr, mg_user_data);
@@ -124,6 +149,7 @@ void *web_server_loop(void *arg_mgr) {
     t_mg_user_data *mg_user_data = (t_mg_user_data *) mgr->user_data;
     sds last_notify = sdsempty();
     time_t last_time = 0;
+    albumart_batch_start();
     while (s_signal_received == 0) {
         unsigned web_server_queue_length = tiny_queue_length(web_server_queue, 50);
         if (web_server_queue_length > 0) {
@@ -136,10 +162,15 @@ void *web_server_loop(void *arg_mgr) {
                 else if (response->conn_id == 0) {
                     //websocket notify from mpd idle
                     time_t now = time(NULL);
+                    if (strstr(response->data, "\"update_database\"") != NULL) {
+                        //coverimages could be changed
+                        albumart_cache_clear(mg_user_data->albumart_cache);
+                        coverlookup_cache_clear(mg_user_data->coverlookup_cache);
+                    }
                     if (strcmp(response->data, last_notify) != 0 || last_time < now - 1) {
                         last_notify = sdsreplace(last_notify, response->data);
                         last_time = now;
-                        send_ws_notify(mgr, response);
+                        send_ws_notify(mg_user_data, response);
                     } 
                     else {
                         free_result(response);                    
@@ -147,13 +178,20 @@ void *web_server_loop(void *arg_mgr) {
                 } 
                 else {
                     //api response
-                    send_api_response(mgr, response);
+                    send_api_response(mg_user_data, response);
                 }
             }
         }
+        //send coalesced websocket notifications
+        connection_index_flush(mg_user_data->connection_index);
+        //release sent response chunks
+        chunked_index_flush(mg_user_data->chunked_index, mg_user_data->connection_index);
+        //send resolved albumart batches
+        albumart_batch_flush(mg_user_data);
         //webserver polling
         mg_mgr_poll(mgr, 50);
     }
+    albumart_batch_stop();
     sdsfree(thread_logname);
     sdsfree(last_notify);
     return NULL;
@@ -176,6 +214,9 @@ static bool parse_internal_message(t_work_result *response, t_mg_user_data *mg_u
         mg_user_data->playlist_directory = sdsreplace(mg_user_data->playlist_directory, p_charbuf3);
         sdsfreesplitres(mg_user_data->coverimage_names, mg_user_data->coverimage_names_len);
         mg_user_data->coverimage_names = split_coverimage_names(p_charbuf2, mg_user_data->coverimage_names, &mg_user_data->coverimage_names_len);
+        //cached lookups depend on the coverimage names and the music directory
+        coverlookup_cache_clear(mg_user_data->coverlookup_cache);
+        albumart_cache_clear(mg_user_data->albumart_cache);
         mg_user_data->feat_library = feat_library;
         mg_user_data->feat_mpd_albumart = feat_mpd_albumart;
         
@@ -215,51 +256,66 @@ static unsigned long is_websocket(const struct mg_connection *nc) {
     return nc->flags & MG_F_IS_WEBSOCKET;
 }
 
-static void send_ws_notify(struct mg_mgr *mgr, t_work_result *response) {
-    struct mg_connection *nc;
-    int i = 0;
-    for (nc = mg_next(mgr, NULL); nc != NULL; nc = mg_next(mgr, nc)) {
-        if (!is_websocket(nc)) {
-            continue;
+static void send_ws_notify(t_mg_user_data *mg_user_data, t_work_result *response) {
+    connection_index_notify(mg_user_data->connection_index, response->data);
+    free_result(response);
+}
+
+static void send_api_response(t_mg_user_data *mg_user_data, t_work_result *response) {
+    sds headers = sdsnew("Content-Type: application/json");
+    sds etag = etag_pending_remove(mg_user_data->etag_index, response->conn_id);
+    if (etag != NULL) {
+        //errors are not cacheable
+        if (strstr(response->data, "\"error\":") == NULL) {
+            headers = sdscatfmt(headers, "\r\nETag: %s", etag);
+        }
+        sdsfree(etag);
+    }
+    if (response->chunk != RESPONSE_COMPLETE) {
+        //coalesced requests get all chunks, later requests do not join the stream
+        struct list waiters;
+        list_init(&waiters);
+        if (chunked_index_started(mg_user_data->chunked_index, response->conn_id) == false) {
+            request_coalesce_detach(mg_user_data->request_coalesce, response->conn_id, &waiters);
         }
-        i++;
-        if (nc->user_data != NULL) {
-            LOG_DEBUG("Sending notify to conn_id %d: %s", (intptr_t)nc->user_data, response->data);
+        chunked_index_send(mg_user_data->chunked_index, mg_user_data->connection_index, response, headers, &waiters);
+        list_free(&waiters);
+        sdsfree(headers);
+        free_result(response);
+        return;
+    }
+    struct mg_connection *nc = connection_index_get(mg_user_data->connection_index, response->conn_id);
+    if (nc != NULL && !is_websocket(nc)) {
+        LOG_DEBUG("Sending response to conn_id %d: %s", (intptr_t)nc->user_data, response->data);
+        if (response->cmd_id == MPD_API_ALBUMART) {
+            send_albumart(nc, response->data, response->binary);
         }
         else {
-            LOG_WARN("Sending notify to unknown connection: %s", response->data);
+            api_send_response(nc, headers, response->data, sdslen(response->data));
         }
-        mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, response->data, sdslen(response->data));
     }
-    if (i == 0) {
-        LOG_DEBUG("No websocket client connected, discarding message: %s", response->data);
+    else {
+        LOG_WARN("Unknown connection %d", response->conn_id);
     }
-    free_result(response);
-}
-
-static void send_api_response(struct mg_mgr *mgr, t_work_result *response) {
-    struct mg_connection *nc;
-    for (nc = mg_next(mgr, NULL); nc != NULL; nc = mg_next(mgr, nc)) {
-        if (is_websocket(nc)) {
-            continue;
-        }
-        if (nc->user_data != NULL) {
-            if ((intptr_t)nc->user_data == response->conn_id) {
-                LOG_DEBUG("Sending response to conn_id %d: %s", (intptr_t)nc->user_data, response->data);
-                if (response->cmd_id == MPD_API_ALBUMART) {
-                    send_albumart(nc, response->data, response->binary);
-                }
-                else {
-                    mg_send_head(nc, 200, sdslen(response->data), "Content-Type: application/json");
-                    mg_send(nc, response->data, sdslen(response->data));
-                }
-                break;
+    //send a copy to the connections waiting for the same request
+    struct list waiters;
+    if (request_coalesce_detach(mg_user_data->request_coalesce, response->conn_id, &waiters) == true) {
+        sds data = sdsempty();
+        struct list_node *current = waiters.head;
+        while (current != NULL) {
+            nc = connection_index_get(mg_user_data->connection_index, current->value_i);
+            if (nc != NULL && !is_websocket(nc)) {
+                sdsclear(data);
+                data = request_coalesce_response(data, response->data, sdslen(response->data), strtol(current->key, NULL, 10));
+                LOG_DEBUG("Sending coalesced response to conn_id %d", current->value_i);
+                api_send_response(nc, headers, data, sdslen(data));
             }
+            current = current->next;
         }
-        else {
-            LOG_WARN("Unknown connection");
-        }
+        sdsfree(data);
+        list_free(&waiters);
     }
+    sdsfree(headers);
     free_result(response);
 }
 
@@ -291,6 +347,7 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
             }
             //set conn_id
             nc->user_data = (void *)(intptr_t)mg_user_data->conn_id;
+            connection_index_add(mg_user_data->connection_index, nc);
             LOG_DEBUG("New connection id %d", (intptr_t)nc->user_data);
             break;
         }
@@ -305,6 +362,7 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
         }
         case MG_EV_WEBSOCKET_HANDSHAKE_DONE: {
              LOG_VERBOSE("New Websocket connection established (%d)", (intptr_t)nc->user_data);
+             connection_index_add_websocket(mg_user_data->connection_index, nc);
              sds response = jsonrpc_start_notify(sdsempty(), "welcome");
              response = tojson_char(response, "mympdVersion", MYMPD_VERSION, false);
              response = jsonrpc_end_notify(response);
@@ -318,6 +376,8 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
             static const struct mg_str albumart_prefix = MG_MK_STR("/albumart");
             static const struct mg_str tagpics_prefix = MG_MK_STR("/tagpics");
             LOG_VERBOSE("HTTP request (%d): %.*s", (intptr_t)nc->user_data, (int)hm->uri.len, hm->uri.p);
+            //gzip is negotiated per request, keep-alive connections reuse the flags
+            nc->flags &= ~MG_F_API_GZIP;
             if (mg_vcmp(&hm->uri, "/api/script") == 0) {
                 if (config->remotescripting == false) {
                     nc->flags |= MG_F_SEND_AND_CLOSE;
@@ -355,7 +415,24 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
                     sds response = jsonrpc_start_result(sdsempty(), method, 0);
                     response = sdscat(response, ",");
                     response = tojson_char(response, "version", MG_VERSION, true);
-                    response = tojson_char(response, "ip", inet_ntoa(localip.sin_addr), false);
+                    response = tojson_char(response, "ip", inet_ntoa(localip.sin_addr), true);
+                    response = albumart_cache_stats(response, mg_user_data->albumart_cache);
+                    response = sdscat(response, ",");
+                    response = coverlookup_cache_stats(response, mg_user_data->coverlookup_cache);
+                    response = sdscat(response, ",");
+                    response = covercache_stats(response);
+                    response = sdscat(response, ",");
+                    response = connection_index_stats(response, mg_user_data->connection_index);
+                    response = sdscat(response, ",");
+                    response = request_coalesce_stats(response, mg_user_data->request_coalesce);
+                    response = sdscat(response, ",");
+                    response = etag_stats(response, mg_user_data->etag_index);
+                    response = sdscat(response, ",");
+                    response = api_gzip_stats(response);
+                    response = sdscat(response, ",");
+                    response = chunked_index_stats(response, mg_user_data->chunked_index);
+                    response = sdscat(response, ",");
+                    response = mpd_client_pool_stats(response);
                     response = jsonrpc_end_result(response);
                     mg_send_head(nc, 200, sdslen(response), "Content-Type: application/json");
                     mg_send(nc, response, sdslen(response));
@@ -365,7 +442,10 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
             }
             else if (mg_vcmp(&hm->uri, "/api") == 0) {
                 //api request
-                bool rc = handle_api((intptr_t)nc->user_data, hm);
+                if (api_gzip_accepted(hm) == true) {
+                    nc->flags |= MG_F_API_GZIP;
+                }
+                bool rc = handle_api(mg_user_data, (intptr_t)nc->user_data, hm);
                 if (rc == false) {
                     LOG_ERROR("Invalid API request");
                     sds method = sdsempty();
@@ -389,6 +469,9 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
                 }
             }
             #endif
+            else if (mg_vcmp(&hm->uri, "/albumart-batch") == 0) {
+                handle_albumart_batch(nc, hm, mg_user_data, config);
+            }
             else if (mg_str_starts_with(hm->uri, albumart_prefix) == 1) {
                 handle_albumart(nc, hm, mg_user_data, config, (intptr_t)nc->user_data);
             }
@@ -446,6 +529,8 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data) {
         case MG_EV_CLOSE: {
             if (nc->user_data != NULL) {
                 LOG_VERBOSE("HTTP connection %ld closed", (intptr_t)nc->user_data);
+                connection_index_remove(mg_user_data->connection_index, nc);
+                sdsfree(etag_pending_remove(mg_user_data->etag_index, (intptr_t)nc->user_data));
                 nc->user_data = NULL;
             }
             break;
@@ -508,58 +593,171 @@ static void ev_handler_redirect(struct mg_connection *nc, int ev, void *ev_data)
 }
 #endif
 
-static bool handle_api(int conn_id, struct http_message *hm) {
+static bool handle_api(t_mg_user_data *mg_user_data, int conn_id, struct http_message *hm) {
+    //json-rpc batch
+    for (size_t i = 0; i < hm->body.len; i++) {
+        if (hm->body.p[i] == '[') {
+            return handle_api_batch(mg_user_data, conn_id, hm);
+        }
+        if (isspace((unsigned char)hm->body.p[i]) == 0) {
+            break;
+        }
+    }
     if (hm->body.len > 2048) {
         LOG_ERROR("Request length of %d exceeds max request size, discarding request)", hm->body.len);
         return false;
     }
     
     LOG_DEBUG("API request (%d): %.*s", conn_id, hm->body.len, hm->body.p);
-    char *cmd = NULL;
-    char *jsonrpc = NULL;
-    int id = 0;
-    const int je = json_scanf(hm->body.p, hm->body.len, "{jsonrpc: %Q, method: %Q, id: %d}", &jsonrpc, &cmd, &id);
-    if (je < 3) {
-        FREE_PTR(cmd);
-        FREE_PTR(jsonrpc);
+    t_work_request *request = api_request_new(conn_id, hm->body.p, hm->body.len);
+    if (request == NULL) {
         return false;
     }
-    LOG_VERBOSE("API request (%d): %s", conn_id, cmd);
+    enum mympd_cmd_ids cmd_id = request->cmd_id;
+    long id = request->id;
 
-    enum mympd_cmd_ids cmd_id = get_cmd_id(cmd);
-    if (cmd_id == 0 || strncmp(jsonrpc, "2.0", 3) != 0) {
-        FREE_PTR(cmd);
-        FREE_PTR(jsonrpc);
-        return false;
+    //etag of an expired response
+    sds etag = etag_pending_remove(mg_user_data->etag_index, conn_id);
+    sdsfree(etag);
+    //the client has the current version of a cacheable response
+    etag = etag_create(mg_user_data->etag_index, sdsempty(), cmd_id);
+    if (sdslen(etag) > 0 && etag_match(hm, etag) == true) {
+        struct mg_connection *nc = connection_index_get(mg_user_data->connection_index, conn_id);
+        if (nc != NULL) {
+            sds response = etag_not_modified(mg_user_data->etag_index, sdsempty(), request->method, id);
+            sds headers = sdscatfmt(sdsempty(), "Content-Type: application/json\r\nETag: %s", etag);
+            mg_send_head(nc, 200, sdslen(response), headers);
+            mg_send(nc, response, sdslen(response));
+            sdsfree(headers);
+            sdsfree(response);
+        }
+        sdsfree(etag);
+        free_request(request);
+        return true;
     }
-    
-    if (is_public_api_method(cmd_id) == false) {
-        LOG_ERROR("API method %s is privat", cmd);
-        FREE_PTR(cmd);
-        FREE_PTR(jsonrpc);
-        return false;
+
+    //identical read request is already queued or executed
+    const struct json_token *params = api_params_member(request->params, "params");
+    if (request_coalesce_attach(mg_user_data->request_coalesce, conn_id, id, cmd_id, params) == true) {
+        sdsfree(etag);
+        free_request(request);
+        return true;
     }
-    
-    sds data = sdscatlen(sdsempty(), hm->body.p, hm->body.len);
-    t_work_request *request = create_request(conn_id, id, cmd_id, cmd, data);
-    sdsfree(data);
-    
-    if (strncmp(cmd, "MYMPD_API_", 10) == 0) {
+    if (sdslen(etag) > 0) {
+        etag_pending_add(mg_user_data->etag_index, conn_id, etag);
+    }
+    else {
+        sdsfree(etag);
+    }
+
+    if (strncmp(request->method, "MYMPD_API_", 10) == 0) {
         tiny_queue_push(mympd_api_queue, request, 0);
     }
-    else if (strncmp(cmd, "MPDWORKER_API_", 14) == 0) {
+    else if (strncmp(request->method, "MPDWORKER_API_", 14) == 0) {
         tiny_queue_push(mpd_worker_queue, request, 0);
         
     }
+    else if (is_mpd_binary_api_method(cmd_id) == true) {
+        tiny_queue_push(mpd_binary_queue, request, 0);
+    }
+    else if (mpd_client_pool_queue != NULL && is_mpd_client_pool_api_method(cmd_id) == true) {
+        tiny_queue_push(mpd_client_pool_queue, request, 0);
+    }
     else {
         tiny_queue_push(mpd_client_queue, request, 0);
     }
+    return true;
+}
 
-    FREE_PTR(cmd);
-    FREE_PTR(jsonrpc);
+//the elements of a batch are executed by the mpd_client thread,
+//it responds with one array
+static bool handle_api_batch(t_mg_user_data *mg_user_data, int conn_id, struct http_message *hm) {
+    if (hm->body.len > API_BATCH_MAX_SIZE) {
+        LOG_ERROR("Batch length of %d exceeds max batch size, discarding request)", hm->body.len);
+        send_api_batch_invalid(mg_user_data, conn_id);
+        return true;
+    }
+    LOG_DEBUG("API batch request (%d): %.*s", conn_id, hm->body.len, hm->body.p);
+    struct json_token elements[API_BATCH_MAX_REQUESTS];
+    int count = api_params_batch(hm->body.p, hm->body.len, elements, API_BATCH_MAX_REQUESTS);
+    if (count <= 0) {
+        LOG_ERROR("Invalid API batch request");
+        send_api_batch_invalid(mg_user_data, conn_id);
+        return true;
+    }
+    struct list *batch = (struct list *)malloc(sizeof(struct list));
+    assert(batch);
+    list_init(batch);
+    for (int i = 0; i < count; i++) {
+        t_work_request *request = api_request_new(conn_id, elements[i].ptr, elements[i].len);
+        if (request == NULL) {
+            sds error = jsonrpc_respond_message(sdsempty(), "", 0, "Invalid API request", true);
+            list_push(batch, "", 0, error, NULL);
+            sdsfree(error);
+        }
+        else if (is_batch_api_method(request->cmd_id) == false) {
+            sds error = jsonrpc_respond_message(sdsempty(), request->method, request->id, "Method not allowed in a batch", true);
+            list_push(batch, "", 0, error, NULL);
+            sdsfree(error);
+            free_request(request);
+        }
+        else {
+            //the response is part of the batch response
+            request->conn_id = -1;
+            list_push(batch, "", 0, NULL, request);
+        }
+    }
+    t_work_request *request = create_request(conn_id, 0, MPD_API_BATCH, "MPD_API_BATCH", "");
+    request->extra = batch;
+    tiny_queue_push(mpd_client_queue, request, 0);
     return true;
 }
 
+//an empty, too large or malformed batch gets a single error object, json-rpc 2.0 section 6
+static void send_api_batch_invalid(t_mg_user_data *mg_user_data, int conn_id) {
+    struct mg_connection *nc = connection_index_get(mg_user_data->connection_index, conn_id);
+    if (nc == NULL) {
+        return;
+    }
+    const char *response = "{\"jsonrpc\":\"2.0\",\"id\":null,\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"}}";
+    mg_send_head(nc, 200, strlen(response), "Content-Type: application/json");
+    mg_send(nc, response, strlen(response));
+}
+
+//returns NULL if the body is not a valid request for a public method
+static t_work_request *api_request_new(int conn_id, const char *data, size_t len) {
+    sds body = sdscatlen(sdsempty(), data, len);
+    t_work_request *request = create_request(conn_id, 0, 0, "", body);
+    sdsfree(body);
+    //the body is parsed once, the handlers use the params table
+    request->params = api_params_parse(request->data, sdslen(request->data));
+    const struct json_token *jsonrpc = api_params_member(request->params, "jsonrpc");
+    const struct json_token *method = api_params_member(request->params, "method");
+    long id = 0;
+    if (jsonrpc == NULL || jsonrpc->type != JSON_TYPE_STRING || method == NULL || method->type != JSON_TYPE_STRING ||
+        api_params_member_long(request->params, "id", &id) == false)
+    {
+        free_request(request);
+        return NULL;
+    }
+    request->method = sdscpylen(request->method, method->ptr, method->len);
+    request->id = id;
+    request->cmd_id = get_cmd_id(request->method);
+    LOG_VERBOSE("API request (%d): %s", conn_id, request->method);
+
+    if (request->cmd_id == 0 || jsonrpc->len != 3 || strncmp(jsonrpc->ptr, "2.0", 3) != 0) {
+        free_request(request);
+        return NULL;
+    }
+    
+    if (is_public_api_method(request->cmd_id) == false) {
+        LOG_ERROR("API method %s is privat", request->method);
+        free_request(request);
+        return NULL;
+    }
+    return request;
+}
+
 static bool handle_script_api(int conn_id, struct http_message *hm) {
     if (hm->body.len > 4096) {
         LOG_ERROR("Request length of %d exceeds max request size, discarding request)", hm->body.len);
@@ -7,50 +7,82 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <string.h>
 #include <libgen.h>
 
 #include "../../dist/src/sds/sds.h"
 #include "../../dist/src/mongoose/mongoose.h"
 #include "../../dist/src/frozen/frozen.h"
+#include "../../dist/src/rax/rax.h"
 #include "../sds_extras.h"
 #include "../api.h"
 #include "../list.h"
 #include "config_defs.h"
 #include "../utility.h"
+#include "../covercache.h"
 #include "../log.h"
 #include "../tiny_queue.h"
 #include "../global.h"
 #include "web_server_utility.h"
+#include "web_server_albumart_cache.h"
+#include "web_server_coverlookup.h"
+#include "web_server_coverextract.h"
 #include "web_server_albumart.h"
 
-//optional includes
-#ifdef ENABLE_LIBID3TAG
-    #include <id3tag.h>
-#endif
-
-#ifdef ENABLE_FLAC
-    #include <FLAC/metadata.h>
-#endif
-
 //privat definitions
-static bool handle_coverextract(struct mg_connection *nc, t_config *config, const char *uri, const char *media_file);
+static struct t_albumart_cache_entry *lookup_albumart(t_mg_user_data *mg_user_data, t_config *config, const char *uri,
+                                                      const char *media_file, sds *coverfile, sds *binary);
+static bool handle_coverextract(t_config *config, const char *uri, const char *media_file, sds *binary);
 static bool handle_coverextract_id3(t_config *config, const char *uri, const char *media_file, sds *binary);
 static bool handle_coverextract_flac(t_config *config, const char *uri, const char *media_file, sds *binary, bool is_ogg);
 
 //public functions
 void send_albumart(struct mg_connection *nc, sds data, sds binary) {
     char *p_charbuf1 = NULL;
+    char *p_charbuf2 = NULL;
+    unsigned offset = 0;
+    unsigned size = 0;
+    t_mg_user_data *mg_user_data = (t_mg_user_data *) nc->mgr->user_data;
 
-    int je = json_scanf(data, sdslen(data), "{result: {mime_type:%Q}}", &p_charbuf1);
-    if (je == 1) {
-        LOG_DEBUG("Serving file from memory (%s - %u bytes)", p_charbuf1, sdslen(binary));
+    int je = json_scanf(data, sdslen(data), "{result: {mime_type:%Q, uri:%Q, offset:%u, size:%u}}", &p_charbuf1, &p_charbuf2, &offset, &size);
+    if (je == 4 && offset > 0) {
+        //next chunk of a streamed image
+        mg_send(nc, binary, sdslen(binary));
+        if (offset + sdslen(binary) >= size) {
+            nc->flags &= ~MG_F_ALBUMART_STREAMING;
+        }
+    }
+    else if (je == 4 && sdslen(binary) < size) {
+        //first chunk of a streamed image, only complete images are put in the memory cache
+        LOG_DEBUG("Streaming file from mpd (%s - %u bytes)", p_charbuf1, size);
         sds header = sdscatfmt(sdsempty(), "Content-Type: %s\r\n", p_charbuf1);
         header = sdscat(header, EXTRA_HEADERS_CACHE);
-        mg_send_head(nc, 200, sdslen(binary), header);
+        mg_send_head(nc, 200, size, header);
         mg_send(nc, binary, sdslen(binary));
+        nc->flags |= MG_F_ALBUMART_STREAMING;
         sdsfree(header);
     }
+    else if (je == 4) {
+        struct t_albumart_cache_entry *entry = albumart_cache_put(mg_user_data->albumart_cache, p_charbuf2, p_charbuf1, binary);
+        if (entry != NULL) {
+            albumart_cache_send(mg_user_data->albumart_cache, nc, NULL, entry);
+        }
+        else {
+            LOG_DEBUG("Serving file from memory (%s - %u bytes)", p_charbuf1, sdslen(binary));
+            sds header = sdscatfmt(sdsempty(), "Content-Type: %s\r\n", p_charbuf1);
+            header = sdscat(header, EXTRA_HEADERS_CACHE);
+            mg_send_head(nc, 200, sdslen(binary), header);
+            mg_send(nc, binary, sdslen(binary));
+            sdsfree(header);
+        }
+    }
+    else if ((nc->flags & MG_F_ALBUMART_STREAMING) != 0) {
+        //the header is already sent, the response can not be completed
+        LOG_ERROR("Streaming of albumart failed, closing connection");
+        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+    }
     else {
         //create dummy http message and serve not available image
         struct http_message hm;
@@ -58,6 +90,7 @@ void send_albumart(struct mg_connection *nc, sds data, sds binary) {
         serve_na_image(nc, &hm);
     }
     FREE_PTR(p_charbuf1);
+    FREE_PTR(p_charbuf2);
 }
 
 //returns true if an image is served
@@ -111,197 +144,202 @@ bool handle_albumart(struct mg_connection *nc, struct http_message *hm, t_mg_use
     //create absolute file
     sds mediafile = sdscatfmt(sdsempty(), "%s/%s", mg_user_data->music_directory, uri_decoded);
     LOG_DEBUG("Absolut media_file: %s", mediafile);
+    sds coverfile = sdsempty();
+    sds binary = sdsempty();
+    bool rc = true;
+    struct t_albumart_cache_entry *entry = lookup_albumart(mg_user_data, config, uri_decoded, mediafile, &coverfile, &binary);
+    if (entry != NULL) {
+        albumart_cache_send(mg_user_data->albumart_cache, nc, hm, entry);
+    }
+    else if (sdslen(coverfile) > 0) {
+        sds mime_type = get_mime_type_by_ext(coverfile);
+        LOG_DEBUG("Serving file %s (%s)", coverfile, mime_type);
+        mg_http_serve_file(nc, hm, coverfile, mg_mk_str(mime_type), mg_mk_str(EXTRA_HEADERS_CACHE));
+        sdsfree(mime_type);
+    }
+    else if (sdslen(binary) > 0) {
+        sds mime_type = get_mime_type_by_magic_stream(binary);
+        sds header = sdscatfmt(sdsempty(), "Content-Type: %s\r\n", mime_type);
+        header = sdscat(header, EXTRA_HEADERS_CACHE);
+        mg_send_head(nc, 200, sdslen(binary), header);
+        mg_send(nc, binary, sdslen(binary));
+        sdsfree(header);
+        sdsfree(mime_type);
+    }
+    //ask mpd
+    else if (mg_user_data->feat_library == false && mg_user_data->feat_mpd_albumart == true) {
+        LOG_DEBUG("Sending getalbumart to mpd_binary_queue");
+        t_work_request *request = create_request(conn_id, 0, MPD_API_ALBUMART, "MPD_API_ALBUMART", "");
+        request->data = sdscat(request->data, "{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"MPD_API_ALBUMART\",\"params\":{");
+        request->data = tojson_char(request->data, "uri", uri_decoded, false);
+        request->data = sdscat(request->data, "}}");
+
+        tiny_queue_push(mpd_binary_queue, request, 0);
+        rc = false;
+    }
+    else {
+        LOG_VERBOSE("No coverimage found for %s", mediafile);
+        serve_na_image(nc, hm);
+    }
+    sdsfree(coverfile);
+    sdsfree(binary);
+    sdsfree(mediafile);
+    sdsfree(uri_decoded);
+    return rc;
+}
+
+//looks up the cover of the song and the folder cover of its directory in the memory cache
+struct t_albumart_cache_entry *albumart_lookup_memory(t_albumart_cache *albumart_cache, const char *uri) {
+    struct t_albumart_cache_entry *entry = albumart_cache_get(albumart_cache, uri);
+    if (entry == NULL) {
+        //folder covers are cached per directory, all other covers per song
+        sds dir = sdsnew(uri);
+        sds dir_key = sdscatfmt(sdsempty(), "%s/", dirname(dir));
+        entry = albumart_cache_get(albumart_cache, dir_key);
+        sdsfree(dir_key);
+        sdsfree(dir);
+    }
+    if (entry != NULL) {
+        albumart_cache->hits++;
+    }
+    else {
+        albumart_cache->misses++;
+    }
+    return entry;
+}
+
+//looks up the cover in the covercache, the folder of the song and the media file itself
+//sets the memory cache key and the image file in coverfile or the extracted image in binary
+//does not use the memory cache and is called by the web_server thread and the albumart batch threads
+bool albumart_find(t_config *config, t_coverlookup_cache *coverlookup_cache, const char *music_directory,
+                   sds *coverimage_names, int coverimage_names_len, bool feat_library,
+                   const char *uri, const char *media_file, sds *key, sds *coverfile, sds *binary)
+{
     //check covercache
     if (config->covercache == true) {
-        sds filename = sdsdup(uri_decoded);
-        uri_to_filename(filename);
-        sds covercachefile = sdscatfmt(sdsempty(), "%s/covercache/%s", config->varlibdir, filename);
-        sdsfree(filename);
-        covercachefile = find_image_file(covercachefile);
+        sds covercachefile = find_covercache_file(config, uri, sdsempty());
         if (sdslen(covercachefile) > 0) {
-            sds mime_type = get_mime_type_by_ext(covercachefile);
-            LOG_DEBUG("Serving file %s (%s)", covercachefile, mime_type);
-            mg_http_serve_file(nc, hm, covercachefile, mg_mk_str(mime_type), mg_mk_str(EXTRA_HEADERS_CACHE));
-            sdsfree(uri_decoded);
+            *key = sdscat(*key, uri);
+            *coverfile = sdscatsds(*coverfile, covercachefile);
             sdsfree(covercachefile);
-            sdsfree(mediafile);
-            sdsfree(mime_type);
             return true;
         }
-
         LOG_DEBUG("No covercache file found");
         sdsfree(covercachefile);
     }
     //check music_directory folder
-    if (mg_user_data->feat_library == true && mg_user_data->coverimage_names_len > 0 &&
-        access(mediafile, F_OK) == 0) /* Flawfinder: ignore */
+    if (feat_library == false || coverimage_names_len == 0 ||
+        access(media_file, F_OK) != 0) /* Flawfinder: ignore */
     {
-        //try image in folder under music_directory
-        sds path = sdsdup(uri_decoded);
-        dirname(path);
-        for (int j = 0; j < mg_user_data->coverimage_names_len; j++) {
-            sds coverfile = sdscatfmt(sdsempty(), "%s/%s/%s", mg_user_data->music_directory, path, mg_user_data->coverimage_names[j]);
-            if (strchr(mg_user_data->coverimage_names[j], '.') == NULL) {
-                //basename, try extensions
-                coverfile = find_image_file(coverfile);
-            }
-            if (sdslen(coverfile) > 0 && access(coverfile, F_OK ) == 0) { /* Flawfinder: ignore */
-                LOG_DEBUG("Check for cover %s", coverfile);
-                sds mime_type = get_mime_type_by_ext(coverfile);
-                LOG_DEBUG("Serving file %s (%s)", coverfile, mime_type);
-                mg_http_serve_file(nc, hm, coverfile, mg_mk_str(mime_type), mg_mk_str(EXTRA_HEADERS_CACHE));
-                sdsfree(uri_decoded);
-                sdsfree(coverfile);
-                sdsfree(mediafile);
-                sdsfree(mime_type);
-                sdsfree(path); 
-                return true;
-            }
-            sdsfree(coverfile);
-        }
+        return false;
+    }
+    bool rc = false;
+    sds dir = sdsnew(uri);
+    const char *dir_path = dirname(dir);
+    //try image in folder under music_directory
+    sds folder_cover = coverlookup_find(coverlookup_cache, sdsempty(), music_directory, dir_path,
+        coverimage_names, coverimage_names_len);
+    if (sdslen(folder_cover) > 0) {
+        *key = sdscatfmt(*key, "%s/", dir_path);
+        *coverfile = sdscatsds(*coverfile, folder_cover);
+        rc = true;
+    }
+    else {
         LOG_DEBUG("No cover file found in music directory");
-        sdsfree(path);
         //try to extract cover from media file
-        bool rc = handle_coverextract(nc, config, uri_decoded, mediafile);
-        if (rc == true) {
-            sdsfree(uri_decoded);
-            sdsfree(mediafile);
-            return true;
+        if (handle_coverextract(config, uri, media_file, binary) == true) {
+            *key = sdscat(*key, uri);
+            rc = true;
         }
     }
-    //ask mpd
-    else if (mg_user_data->feat_library == false && mg_user_data->feat_mpd_albumart == true) {
-        LOG_DEBUG("Sending getalbumart to mpd_client_queue");
-        t_work_request *request = create_request(conn_id, 0, MPD_API_ALBUMART, "MPD_API_ALBUMART", "");
-        request->data = sdscat(request->data, "{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"MPD_API_ALBUMART\",\"params\":{");
-        request->data = tojson_char(request->data, "uri", uri_decoded, false);
-        request->data = sdscat(request->data, "}}");
+    sdsfree(folder_cover);
+    sdsfree(dir);
+    return rc;
+}
 
-        tiny_queue_push(mpd_client_queue, request, 0);
-        sdsfree(mediafile);
-        sdsfree(uri_decoded);
-        return false;
-    }
+//privat functions
 
-    LOG_VERBOSE("No coverimage found for %s", mediafile);
-    sdsfree(mediafile);
-    sdsfree(uri_decoded);
-    serve_na_image(nc, hm);
-    return true;
+//looks up the cover in the memory cache, the covercache, the folder of the song and the media file itself
+//returns the memory cache entry, or NULL and sets coverfile or binary if the image does not fit in the memory cache
+static struct t_albumart_cache_entry *lookup_albumart(t_mg_user_data *mg_user_data, t_config *config, const char *uri,
+                                                      const char *media_file, sds *coverfile, sds *binary)
+{
+    struct t_albumart_cache_entry *entry = albumart_lookup_memory(mg_user_data->albumart_cache, uri);
+    if (entry != NULL) {
+        return entry;
+    }
+    sds key = sdsempty();
+    if (albumart_find(config, mg_user_data->coverlookup_cache, mg_user_data->music_directory, mg_user_data->coverimage_names,
+            mg_user_data->coverimage_names_len, mg_user_data->feat_library, uri, media_file, &key, coverfile, binary) == true)
+    {
+        if (sdslen(*coverfile) > 0) {
+            entry = albumart_cache_put_file(mg_user_data->albumart_cache, key, *coverfile);
+            if (entry != NULL) {
+                sdsclear(*coverfile);
+            }
+        }
+        else {
+            sds mime_type = get_mime_type_by_magic_stream(*binary);
+            entry = albumart_cache_put(mg_user_data->albumart_cache, key, mime_type, *binary);
+            if (entry != NULL) {
+                sdsclear(*binary);
+            }
+            sdsfree(mime_type);
+        }
+    }
+    sdsfree(key);
+    return entry;
 }
 
-//privat functions
-static bool handle_coverextract(struct mg_connection *nc, t_config *config, const char *uri, const char *media_file) {
+static bool handle_coverextract(t_config *config, const char *uri, const char *media_file, sds *binary) {
     bool rc = false;
     sds mime_type_media_file = get_mime_type_by_ext(media_file);
     LOG_DEBUG("Handle coverextract for uri \"%s\"", uri);
     LOG_DEBUG("Mimetype of %s is %s", media_file, mime_type_media_file);
-    sds binary = sdsempty();
+    sds mime_type_embedded = sdsempty();
+    //try the lightweight parsers first, fall back to the libraries
     if (strcmp(mime_type_media_file, "audio/mpeg") == 0) {
-        rc = handle_coverextract_id3(config, uri, media_file, &binary);
-    }
-    else if (strcmp(mime_type_media_file, "audio/ogg") == 0) {
-        rc = handle_coverextract_flac(config, uri, media_file, &binary, true);
+        rc = coverextract_id3(media_file, binary, &mime_type_embedded);
+        if (rc == false) {
+            sdsclear(*binary);
+            rc = handle_coverextract_id3(config, uri, media_file, binary);
+        }
+        else if (config->covercache == true) {
+            write_covercache_file(config, uri, mime_type_embedded, *binary);
+        }
     }
-    else if (strcmp(mime_type_media_file, "audio/flac") == 0) {
-        rc = handle_coverextract_flac(config, uri, media_file, &binary, false);
+    else if (strcmp(mime_type_media_file, "audio/ogg") == 0 || strcmp(mime_type_media_file, "audio/flac") == 0) {
+        bool is_ogg = strcmp(mime_type_media_file, "audio/ogg") == 0 ? true : false;
+        rc = coverextract_flac(media_file, binary, &mime_type_embedded, is_ogg);
+        if (rc == false) {
+            sdsclear(*binary);
+            rc = handle_coverextract_flac(config, uri, media_file, binary, is_ogg);
+        }
+        else if (config->covercache == true) {
+            write_covercache_file(config, uri, mime_type_embedded, *binary);
+        }
     }
+    sdsfree(mime_type_embedded);
     sdsfree(mime_type_media_file);
-    if (rc == true) {
-        sds mime_type = get_mime_type_by_magic_stream(binary);
-        sds header = sdscatfmt(sdsempty(), "Content-Type: %s", mime_type);
-        header = sdscat(header, EXTRA_HEADERS_CACHE);
-        mg_send_head(nc, 200, sdslen(binary), header);
-        mg_send(nc, binary, sdslen(binary));
-        sdsfree(header);
-        sdsfree(mime_type);
-    }
-    sdsfree(binary);
     return rc;
 }
 
 static bool handle_coverextract_id3(t_config *config, const char *uri, const char *media_file, sds *binary) {
-    bool rc = false;
-    #ifdef ENABLE_LIBID3TAG
-    LOG_DEBUG("Exctracting coverimage from %s", media_file);
-    struct id3_file *file_struct = id3_file_open(media_file, ID3_FILE_MODE_READONLY);
-    if (file_struct == NULL) {
-        LOG_ERROR("Can't parse id3_file: %s", media_file);
-        return false;
-    }
-    struct id3_tag *tags = id3_file_tag(file_struct);
-    if (tags == NULL) {
-        LOG_ERROR("Can't read id3 tags from file: %s", media_file);
-        return false;
+    sds mime_type = sdsempty();
+    bool rc = coverextract_id3_lib(media_file, binary, &mime_type);
+    if (rc == true && config->covercache == true) {
+        write_covercache_file(config, uri, mime_type, *binary);
     }
-    struct id3_frame *frame = id3_tag_findframe(tags, "APIC", 0);
-    if (frame != NULL) {
-        id3_length_t length;
-        const id3_byte_t *pic = id3_field_getbinarydata(id3_frame_field(frame, 4), &length);
-        *binary = sdscatlen(*binary, pic, length);
-        if (config->covercache == true) {
-            write_covercache_file(config, uri, (char *)id3_field_getlatin1(id3_frame_field(frame, 1)), *binary);
-        }
-        LOG_DEBUG("Coverimage successfully extracted");
-        rc = true;        
-    }
-    else {
-        LOG_DEBUG("No embedded picture detected");
-    }
-    id3_file_close(file_struct);
-    #else
-    (void) config;
-    (void) uri;
-    (void) media_file;
-    (void) binary;
-    #endif
+    sdsfree(mime_type);
     return rc;
 }
 
 static bool handle_coverextract_flac(t_config *config, const char *uri, const char *media_file, sds *binary, bool is_ogg) {
-    bool rc = false;
-    #ifdef ENABLE_FLAC
-    LOG_DEBUG("Exctracting coverimage from %s", media_file);
-    FLAC__StreamMetadata *metadata = NULL;
-
-    FLAC__Metadata_Chain *chain = FLAC__metadata_chain_new();
-    
-    if(! (is_ogg? FLAC__metadata_chain_read_ogg(chain, media_file) : FLAC__metadata_chain_read(chain, media_file)) ) {
-        LOG_DEBUG("%s: ERROR: reading metadata", media_file);
-        FLAC__metadata_chain_delete(chain);
-        return false;
-    }
-
-    FLAC__Metadata_Iterator *iterator = FLAC__metadata_iterator_new();
-    FLAC__metadata_iterator_init(iterator, chain);
-    assert(iterator);
-    
-    do {
-        FLAC__StreamMetadata *block = FLAC__metadata_iterator_get_block(iterator);
-        if (block->type == FLAC__METADATA_TYPE_PICTURE) {
-            metadata = block;
-        }
-    } while (FLAC__metadata_iterator_next(iterator) && metadata == NULL);
-    
-    if (metadata == NULL) {
-        LOG_DEBUG("No embedded picture detected");
-    }
-    else {
-        *binary = sdscatlen(*binary, metadata->data.picture.data, metadata->data.picture.data_length);
-        if (config->covercache == true) {
-            write_covercache_file(config, uri, metadata->data.picture.mime_type, *binary);
-        }
-        LOG_DEBUG("Coverimage successfully extracted");
-        rc = true;
+    sds mime_type = sdsempty();
+    bool rc = coverextract_flac_lib(media_file, binary, &mime_type, is_ogg);
+    if (rc == true && config->covercache == true) {
+        write_covercache_file(config, uri, mime_type, *binary);
     }
-    FLAC__metadata_iterator_delete(iterator);
-    FLAC__metadata_chain_delete(chain);
-    #else
-    (void) config;
-    (void) uri;
-    (void) media_file;
-    (void) binary;
-    (void) is_ogg;
-    #endif
+    sdsfree(mime_type);
     return rc;
 }
@@ -8,4 +8,8 @@
 #define __WEB_SERVER_ALBUMART_H__
 void send_albumart(struct mg_connection *nc, sds data, sds binary);
 bool handle_albumart(struct mg_connection *nc, struct http_message *hm, t_mg_user_data *mg_user_data, t_config *config, int conn_id);
+struct t_albumart_cache_entry *albumart_lookup_memory(t_albumart_cache *albumart_cache, const char *uri);
+bool albumart_find(t_config *config, t_coverlookup_cache *coverlookup_cache, const char *music_directory,
+                   sds *coverimage_names, int coverimage_names_len, bool feat_library,
+                   const char *uri, const char *media_file, sds *key, sds *coverfile, sds *binary);
 #endif
@@ -0,0 +1,365 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/mongoose/mongoose.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../../dist/src/rax/rax.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "web_server_utility.h"
+#include "web_server_albumart_cache.h"
+#include "web_server_coverlookup.h"
+#include "web_server_connections.h"
+#include "web_server_albumart.h"
+#include "web_server_albumart_batch.h"
+
+//The covers of a batch request are resolved in parallel by a small pool of
+//threads. The web_server thread answers memory cache hits itself and queues
+//the misses. The thread that resolves the last missing cover of a batch
+//queues the batch as done, it is sent and its covers are put in the memory
+//cache by the web_server thread. The memory cache is only accessed by the
+//web_server thread, the covercache and the cover lookup cache are locked.
+
+#define ALBUMART_BATCH_THREADS 4
+//max covers and response size for a batch request
+#define ALBUMART_BATCH_MAX 100
+#define ALBUMART_BATCH_MAX_SIZE (8 * 1024 * 1024)
+//length prefixes of an entry
+#define ALBUMART_BATCH_ENTRY_OVERHEAD 8
+
+//privat definitions
+struct t_albumart_batch;
+
+struct t_albumart_batch_item {
+    struct t_albumart_batch *batch;
+    sds uri;
+    sds key; //memory cache key of a resolved cover
+    sds mime_type;
+    sds binary;
+    bool resolve;
+};
+
+struct t_albumart_batch {
+    int conn_id;
+    t_config *config;
+    t_coverlookup_cache *coverlookup_cache;
+    //copies of the web_server settings, they could change while the batch is resolved
+    sds music_directory;
+    sds *coverimage_names;
+    int coverimage_names_len;
+    bool feat_library;
+    unsigned count;
+    unsigned pending;
+    size_t size;
+    pthread_mutex_t mutex;
+    struct t_albumart_batch_item items[ALBUMART_BATCH_MAX];
+};
+
+static struct t_albumart_batch_pool {
+    pthread_t threads[ALBUMART_BATCH_THREADS];
+    bool started[ALBUMART_BATCH_THREADS];
+    tiny_queue_t *queue; //items to resolve
+    tiny_queue_t *done; //resolved batches
+} pool;
+
+static void *albumart_batch_loop(void *arg);
+static void albumart_batch_resolve(struct t_albumart_batch_item *item);
+static bool albumart_batch_reserve(struct t_albumart_batch *batch, size_t len);
+static bool albumart_batch_read_file(const char *filename, size_t len, sds *binary);
+static void albumart_batch_send(t_mg_user_data *mg_user_data, struct t_albumart_batch *batch);
+static sds albumart_batch_append(sds body, const char *mime_type, const char *binary, size_t len);
+static struct t_albumart_batch *albumart_batch_new(t_mg_user_data *mg_user_data, t_config *config, int conn_id);
+static void albumart_batch_free(struct t_albumart_batch *batch);
+
+//public functions
+void albumart_batch_start(void) {
+    pool.queue = tiny_queue_create();
+    pool.done = tiny_queue_create();
+    for (unsigned i = 0; i < ALBUMART_BATCH_THREADS; i++) {
+        pool.started[i] = pthread_create(&pool.threads[i], NULL, albumart_batch_loop, (void *)(intptr_t)i) == 0 ? true : false;
+        if (pool.started[i] == true) {
+            sds name = sdscatfmt(sdsempty(), "mympd_albumart%u", i);
+            pthread_setname_np(pool.threads[i], name);
+            sdsfree(name);
+        }
+        else {
+            LOG_ERROR("Can't create albumart batch thread %u", i);
+        }
+    }
+}
+
+void albumart_batch_stop(void) {
+    for (unsigned i = 0; i < ALBUMART_BATCH_THREADS; i++) {
+        if (pool.started[i] == true) {
+            pthread_join(pool.threads[i], NULL);
+        }
+    }
+    //items of unfinished batches reference their batch, free each batch once
+    struct t_albumart_batch_item *item;
+    while ((item = tiny_queue_expire(pool.queue, 0)) != NULL) {
+        if (--item->batch->pending == 0) {
+            albumart_batch_free(item->batch);
+        }
+    }
+    tiny_queue_free(pool.queue);
+    struct t_albumart_batch *batch;
+    while ((batch = tiny_queue_expire(pool.done, 0)) != NULL) {
+        albumart_batch_free(batch);
+    }
+    tiny_queue_free(pool.done);
+}
+
+//sends the resolved batches, called by the web_server thread
+void albumart_batch_flush(t_mg_user_data *mg_user_data) {
+    while (tiny_queue_length(pool.done, 0) > 0) {
+        struct t_albumart_batch *batch = tiny_queue_shift(pool.done, 50, 0);
+        if (batch == NULL) {
+            break;
+        }
+        albumart_batch_send(mg_user_data, batch);
+    }
+}
+
+//serves the covers for a list of song uris with one response
+//each cover is sent as mime type length (4 bytes, big endian), mime type, image length (4 bytes, big endian), image
+//covers that can not be resolved locally have a length of zero, they must be requested through /albumart
+void handle_albumart_batch(struct mg_connection *nc, struct http_message *hm, t_mg_user_data *mg_user_data, t_config *config) {
+    if (mg_vcmp(&hm->method, "POST") != 0) {
+        send_error(nc, 405, "Method not allowed");
+        return;
+    }
+    struct t_albumart_batch *batch = albumart_batch_new(mg_user_data, config, (int)(intptr_t)nc->user_data);
+    struct json_token t;
+    for (int i = 0; i < ALBUMART_BATCH_MAX && json_scanf_array_elem(hm->body.p, (int)hm->body.len, ".uris", i, &t) > 0; i++) {
+        struct t_albumart_batch_item *item = &batch->items[batch->count++];
+        item->batch = batch;
+        item->uri = sdsMakeRoomFor(sdsempty(), (size_t)t.len);
+        int len = json_unescape(t.ptr, t.len, item->uri, t.len);
+        if (len > 0) {
+            sdsIncrLen(item->uri, len);
+        }
+        item->key = sdsempty();
+        item->mime_type = sdsempty();
+        item->binary = sdsempty();
+        item->resolve = false;
+        if (sdslen(item->uri) == 0 || validate_uri(item->uri) == false || is_streamuri(item->uri) == true) {
+            continue;
+        }
+        struct t_albumart_cache_entry *entry = albumart_lookup_memory(mg_user_data->albumart_cache, item->uri);
+        if (entry != NULL) {
+            if (albumart_batch_reserve(batch, sdslen(entry->mime_type) + sdslen(entry->binary)) == true) {
+                item->mime_type = sdscatsds(item->mime_type, entry->mime_type);
+                item->binary = sdscatsds(item->binary, entry->binary);
+            }
+            continue;
+        }
+        item->resolve = true;
+        batch->pending++;
+    }
+    if (batch->pending == 0) {
+        albumart_batch_send(mg_user_data, batch);
+        return;
+    }
+    //pending is set before the first item is queued, the last resolved item completes the batch
+    for (unsigned i = 0; i < batch->count; i++) {
+        if (batch->items[i].resolve == true) {
+            tiny_queue_push(pool.queue, &batch->items[i], 0);
+        }
+    }
+}
+
+//privat functions
+static void *albumart_batch_loop(void *arg) {
+    unsigned idx = (unsigned)(intptr_t)arg;
+    thread_logname = sdscatfmt(sdsempty(), "albumart%u", idx);
+    while (s_signal_received == 0) {
+        struct t_albumart_batch_item *item = tiny_queue_shift(pool.queue, 50, 0);
+        if (item != NULL) {
+            albumart_batch_resolve(item);
+        }
+    }
+    sdsfree(thread_logname);
+    return NULL;
+}
+
+static void albumart_batch_resolve(struct t_albumart_batch_item *item) {
+    struct t_albumart_batch *batch = item->batch;
+    sds mediafile = sdscatfmt(sdsempty(), "%s/%s", batch->music_directory, item->uri);
+    sds coverfile = sdsempty();
+    if (albumart_find(batch->config, batch->coverlookup_cache, batch->music_directory, batch->coverimage_names,
+            batch->coverimage_names_len, batch->feat_library, item->uri, mediafile, &item->key, &coverfile, &item->binary) == true)
+    {
+        sdsfree(item->mime_type);
+        if (sdslen(coverfile) > 0) {
+            item->mime_type = get_mime_type_by_ext(coverfile);
+            struct stat st;
+            if (stat(coverfile, &st) != 0 || st.st_size <= 0 ||
+                albumart_batch_reserve(batch, sdslen(item->mime_type) + (size_t)st.st_size) == false ||
+                albumart_batch_read_file(coverfile, (size_t)st.st_size, &item->binary) == false)
+            {
+                sdsclear(item->binary);
+            }
+        }
+        else {
+            item->mime_type = get_mime_type_by_magic_stream(item->binary);
+            if (albumart_batch_reserve(batch, sdslen(item->mime_type) + sdslen(item->binary)) == false) {
+                sdsclear(item->binary);
+            }
+        }
+    }
+    sdsfree(coverfile);
+    sdsfree(mediafile);
+    pthread_mutex_lock(&batch->mutex);
+    bool done = --batch->pending == 0 ? true : false;
+    pthread_mutex_unlock(&batch->mutex);
+    if (done == true) {
+        tiny_queue_push(pool.done, batch, 0);
+    }
+}
+
+//reserves space for a cover in the response, returns false if the response would exceed its size limit
+static bool albumart_batch_reserve(struct t_albumart_batch *batch, size_t len) {
+    pthread_mutex_lock(&batch->mutex);
+    bool rc = batch->size + len <= ALBUMART_BATCH_MAX_SIZE ? true : false;
+    if (rc == true) {
+        batch->size += len;
+    }
+    pthread_mutex_unlock(&batch->mutex);
+    return rc;
+}
+
+static bool albumart_batch_read_file(const char *filename, size_t len, sds *binary) {
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        LOG_ERROR("Can not open file \"%s\": %s", filename, strerror(errno));
+        return false;
+    }
+    *binary = sdsMakeRoomFor(*binary, len);
+    size_t bytes_read = fread(*binary, 1, len, fp);
+    fclose(fp);
+    if (bytes_read != len) {
+        LOG_ERROR("Error reading file \"%s\"", filename);
+        return false;
+    }
+    sdsIncrLen(*binary, (ssize_t)len);
+    return true;
+}
+
+static void albumart_batch_send(t_mg_user_data *mg_user_data, struct t_albumart_batch *batch) {
+    //the resolved covers are served from memory on the next request
+    for (unsigned i = 0; i < batch->count; i++) {
+        struct t_albumart_batch_item *item = &batch->items[i];
+        if (item->resolve == true && sdslen(item->binary) > 0) {
+            albumart_cache_put(mg_user_data->albumart_cache, item->key, item->mime_type, item->binary);
+        }
+    }
+    struct mg_connection *nc = connection_index_get(mg_user_data->connection_index, batch->conn_id);
+    if (nc == NULL) {
+        LOG_WARN("Unknown connection %d", batch->conn_id);
+        albumart_batch_free(batch);
+        return;
+    }
+    sds body = sdsempty();
+    unsigned found = 0;
+    for (unsigned i = 0; i < batch->count; i++) {
+        struct t_albumart_batch_item *item = &batch->items[i];
+        size_t len = sdslen(item->binary);
+        //the reserved space does not include the prefixes, the limit is checked including the image and the remaining entries
+        size_t remaining = (size_t)(batch->count - i) * ALBUMART_BATCH_ENTRY_OVERHEAD;
+        if (len > 0 && sdslen(body) + remaining + sdslen(item->mime_type) + len <= ALBUMART_BATCH_MAX_SIZE) {
+            body = albumart_batch_append(body, item->mime_type, item->binary, len);
+            found++;
+        }
+        else {
+            //not found, not cacheable, served by mpd or over the size limit
+            body = albumart_batch_append(body, "", NULL, 0);
+        }
+    }
+    LOG_DEBUG("Serving %u of %u covers in one response (%u bytes)", found, batch->count, sdslen(body));
+    mg_send_head(nc, 200, sdslen(body), "Content-Type: application/octet-stream\r\nCache-Control: no-cache");
+    mg_send(nc, body, sdslen(body));
+    sdsfree(body);
+    albumart_batch_free(batch);
+}
+
+static sds albumart_batch_append(sds body, const char *mime_type, const char *binary, size_t len) {
+    size_t mime_len = strlen(mime_type);
+    unsigned char prefix[4];
+    prefix[0] = (unsigned char)(mime_len >> 24);
+    prefix[1] = (unsigned char)(mime_len >> 16);
+    prefix[2] = (unsigned char)(mime_len >> 8);
+    prefix[3] = (unsigned char)mime_len;
+    body = sdscatlen(body, prefix, 4);
+    body = sdscatlen(body, mime_type, mime_len);
+    prefix[0] = (unsigned char)(len >> 24);
+    prefix[1] = (unsigned char)(len >> 16);
+    prefix[2] = (unsigned char)(len >> 8);
+    prefix[3] = (unsigned char)len;
+    body = sdscatlen(body, prefix, 4);
+    if (len > 0) {
+        body = sdscatlen(body, binary, len);
+    }
+    return body;
+}
+
+static struct t_albumart_batch *albumart_batch_new(t_mg_user_data *mg_user_data, t_config *config, int conn_id) {
+    struct t_albumart_batch *batch = (struct t_albumart_batch *)malloc(sizeof(struct t_albumart_batch));
+    assert(batch);
+    batch->conn_id = conn_id;
+    batch->config = config;
+    batch->coverlookup_cache = mg_user_data->coverlookup_cache;
+    batch->music_directory = sdsdup(mg_user_data->music_directory);
+    batch->coverimage_names_len = mg_user_data->coverimage_names_len;
+    batch->coverimage_names = NULL;
+    if (batch->coverimage_names_len > 0) {
+        batch->coverimage_names = (sds *)malloc(sizeof(sds) * (size_t)batch->coverimage_names_len);
+        assert(batch->coverimage_names);
+        for (int i = 0; i < batch->coverimage_names_len; i++) {
+            batch->coverimage_names[i] = sdsdup(mg_user_data->coverimage_names[i]);
+        }
+    }
+    batch->feat_library = mg_user_data->feat_library;
+    batch->count = 0;
+    batch->pending = 0;
+    batch->size = 0;
+    pthread_mutex_init(&batch->mutex, NULL);
+    return batch;
+}
+
+static void albumart_batch_free(struct t_albumart_batch *batch) {
+    for (unsigned i = 0; i < batch->count; i++) {
+        sdsfree(batch->items[i].uri);
+        sdsfree(batch->items[i].key);
+        sdsfree(batch->items[i].mime_type);
+        sdsfree(batch->items[i].binary);
+    }
+    sdsfree(batch->music_directory);
+    if (batch->coverimage_names != NULL) {
+        sdsfreesplitres(batch->coverimage_names, batch->coverimage_names_len);
+    }
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch);
+}
@@ -0,0 +1,13 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_ALBUMART_BATCH_H__
+#define __WEB_SERVER_ALBUMART_BATCH_H__
+void albumart_batch_start(void);
+void albumart_batch_stop(void);
+void albumart_batch_flush(t_mg_user_data *mg_user_data);
+void handle_albumart_batch(struct mg_connection *nc, struct http_message *hm, t_mg_user_data *mg_user_data, t_config *config);
+#endif
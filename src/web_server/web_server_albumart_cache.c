@@ -0,0 +1,245 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/mongoose/mongoose.h"
+#include "../../dist/src/rax/rax.h"
+#include "../sds_extras.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "web_server_utility.h"
+#include "web_server_albumart_cache.h"
+
+//privat definitions
+static void albumart_cache_unlink(t_albumart_cache *cache, struct t_albumart_cache_entry *entry);
+static void albumart_cache_link_head(t_albumart_cache *cache, struct t_albumart_cache_entry *entry);
+static void albumart_cache_remove(t_albumart_cache *cache, struct t_albumart_cache_entry *entry);
+static void albumart_cache_free_entry(struct t_albumart_cache_entry *entry);
+static size_t albumart_cache_entry_size(struct t_albumart_cache_entry *entry);
+static sds albumart_cache_etag(sds etag, sds binary);
+
+//public functions
+t_albumart_cache *albumart_cache_new(size_t max_size) {
+    t_albumart_cache *cache = (t_albumart_cache *)malloc(sizeof(t_albumart_cache));
+    assert(cache);
+    cache->index = raxNew();
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->size = 0;
+    cache->max_size = max_size;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->not_modified = 0;
+    cache->evictions = 0;
+    return cache;
+}
+
+void albumart_cache_free(t_albumart_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    albumart_cache_clear(cache);
+    raxFree(cache->index);
+    free(cache);
+}
+
+void albumart_cache_clear(t_albumart_cache *cache) {
+    if (cache == NULL || cache->head == NULL) {
+        return;
+    }
+    LOG_DEBUG("Clearing albumart memory cache (%llu entries)", (unsigned long long)raxSize(cache->index));
+    struct t_albumart_cache_entry *current = cache->head;
+    while (current != NULL) {
+        struct t_albumart_cache_entry *next = current->next;
+        albumart_cache_free_entry(current);
+        current = next;
+    }
+    raxFree(cache->index);
+    cache->index = raxNew();
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->size = 0;
+}
+
+struct t_albumart_cache_entry *albumart_cache_get(t_albumart_cache *cache, const char *key) {
+    if (cache == NULL || cache->max_size == 0) {
+        return NULL;
+    }
+    void *data = raxFind(cache->index, (unsigned char *)key, strlen(key));
+    if (data == raxNotFound) {
+        return NULL;
+    }
+    struct t_albumart_cache_entry *entry = (struct t_albumart_cache_entry *)data;
+    if (cache->head != entry) {
+        albumart_cache_unlink(cache, entry);
+        albumart_cache_link_head(cache, entry);
+    }
+    return entry;
+}
+
+//takes a copy of binary, returns NULL if the image is not cacheable
+struct t_albumart_cache_entry *albumart_cache_put(t_albumart_cache *cache, const char *key, const char *mime_type, sds binary) {
+    if (cache == NULL || cache->max_size == 0 || sdslen(binary) == 0) {
+        return NULL;
+    }
+    //do not let one big image flush the whole cache
+    if (sdslen(binary) > cache->max_size / 4) {
+        LOG_DEBUG("Image for \"%s\" is too big for the albumart memory cache", key);
+        return NULL;
+    }
+    void *old = NULL;
+    if (raxRemove(cache->index, (unsigned char *)key, strlen(key), &old) == 1) {
+        struct t_albumart_cache_entry *old_entry = (struct t_albumart_cache_entry *)old;
+        albumart_cache_unlink(cache, old_entry);
+        cache->size -= albumart_cache_entry_size(old_entry);
+        albumart_cache_free_entry(old_entry);
+    }
+    struct t_albumart_cache_entry *entry = (struct t_albumart_cache_entry *)malloc(sizeof(struct t_albumart_cache_entry));
+    assert(entry);
+    entry->key = sdsnew(key);
+    entry->mime_type = sdsnew(mime_type);
+    entry->binary = sdsdup(binary);
+    entry->etag = albumart_cache_etag(sdsempty(), binary);
+    entry->prev = NULL;
+    entry->next = NULL;
+    size_t entry_size = albumart_cache_entry_size(entry);
+    while (cache->tail != NULL && cache->size + entry_size > cache->max_size) {
+        cache->evictions++;
+        albumart_cache_remove(cache, cache->tail);
+    }
+    raxInsert(cache->index, (unsigned char *)entry->key, sdslen(entry->key), entry, NULL);
+    albumart_cache_link_head(cache, entry);
+    cache->size += entry_size;
+    return entry;
+}
+
+//reads an image file into the cache, returns NULL on error or if the image is not cacheable
+struct t_albumart_cache_entry *albumart_cache_put_file(t_albumart_cache *cache, const char *key, const char *filename) {
+    if (cache == NULL || cache->max_size == 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (stat(filename, &st) != 0 || st.st_size <= 0 || (size_t)st.st_size > cache->max_size / 4) {
+        return NULL;
+    }
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        LOG_ERROR("Can not open file \"%s\": %s", filename, strerror(errno));
+        return NULL;
+    }
+    sds binary = sdsnewlen(NULL, (size_t)st.st_size);
+    size_t bytes_read = fread(binary, 1, (size_t)st.st_size, fp);
+    fclose(fp);
+    if (bytes_read != (size_t)st.st_size) {
+        LOG_ERROR("Error reading file \"%s\"", filename);
+        sdsfree(binary);
+        return NULL;
+    }
+    sds mime_type = get_mime_type_by_ext(filename);
+    struct t_albumart_cache_entry *entry = albumart_cache_put(cache, key, mime_type, binary);
+    sdsfree(mime_type);
+    sdsfree(binary);
+    return entry;
+}
+
+//sends the cached image or a 304 response if the client already has it
+void albumart_cache_send(t_albumart_cache *cache, struct mg_connection *nc, struct http_message *hm, struct t_albumart_cache_entry *entry) {
+    sds header = sdscatfmt(sdsempty(), "ETag: %s\r\n", entry->etag);
+    header = sdscat(header, EXTRA_HEADERS_CACHE);
+    struct mg_str *if_none_match = hm != NULL ? mg_get_http_header(hm, "If-None-Match") : NULL;
+    if (if_none_match != NULL && mg_vcmp(if_none_match, entry->etag) == 0) {
+        LOG_DEBUG("Image for \"%s\" not modified", entry->key);
+        cache->not_modified++;
+        mg_send_head(nc, 304, 0, header);
+    }
+    else {
+        LOG_DEBUG("Serving file from memory (%s - %u bytes)", entry->mime_type, sdslen(entry->binary));
+        header = sdscatfmt(header, "\r\nContent-Type: %s", entry->mime_type);
+        mg_send_head(nc, 200, sdslen(entry->binary), header);
+        mg_send(nc, entry->binary, sdslen(entry->binary));
+    }
+    sdsfree(header);
+}
+
+sds albumart_cache_stats(sds buffer, t_albumart_cache *cache) {
+    buffer = sdscat(buffer, "\"albumartCache\":{");
+    buffer = tojson_long(buffer, "entries", (cache != NULL ? (long long)raxSize(cache->index) : 0), true);
+    buffer = tojson_long(buffer, "size", (cache != NULL ? (long long)cache->size : 0), true);
+    buffer = tojson_long(buffer, "maxSize", (cache != NULL ? (long long)cache->max_size : 0), true);
+    buffer = tojson_long(buffer, "hits", (cache != NULL ? (long long)cache->hits : 0), true);
+    buffer = tojson_long(buffer, "misses", (cache != NULL ? (long long)cache->misses : 0), true);
+    buffer = tojson_long(buffer, "notModified", (cache != NULL ? (long long)cache->not_modified : 0), true);
+    buffer = tojson_long(buffer, "evictions", (cache != NULL ? (long long)cache->evictions : 0), false);
+    buffer = sdscat(buffer, "}");
+    return buffer;
+}
+
+//privat functions
+static void albumart_cache_unlink(t_albumart_cache *cache, struct t_albumart_cache_entry *entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    }
+    else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    }
+    else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void albumart_cache_link_head(t_albumart_cache *cache, struct t_albumart_cache_entry *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    }
+    cache->head = entry;
+    if (cache->tail == NULL) {
+        cache->tail = entry;
+    }
+}
+
+static void albumart_cache_remove(t_albumart_cache *cache, struct t_albumart_cache_entry *entry) {
+    raxRemove(cache->index, (unsigned char *)entry->key, sdslen(entry->key), NULL);
+    albumart_cache_unlink(cache, entry);
+    cache->size -= albumart_cache_entry_size(entry);
+    albumart_cache_free_entry(entry);
+}
+
+static void albumart_cache_free_entry(struct t_albumart_cache_entry *entry) {
+    sdsfree(entry->key);
+    sdsfree(entry->mime_type);
+    sdsfree(entry->etag);
+    sdsfree(entry->binary);
+    free(entry);
+}
+
+static size_t albumart_cache_entry_size(struct t_albumart_cache_entry *entry) {
+    return sdslen(entry->binary) + sdslen(entry->key) + sizeof(struct t_albumart_cache_entry);
+}
+
+//strong etag: quoted sha1 of the image data
+static sds albumart_cache_etag(sds etag, sds binary) {
+    etag = sdscatlen(etag, "\"", 1);
+    etag = calc_sha1(etag, binary, sdslen(binary));
+    etag = sdscatlen(etag, "\"", 1);
+    return etag;
+}
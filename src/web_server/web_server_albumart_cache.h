@@ -0,0 +1,40 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_ALBUMART_CACHE_H__
+#define __WEB_SERVER_ALBUMART_CACHE_H__
+
+//in memory lru cache for served coverimages, only accessed by the web_server thread
+struct t_albumart_cache_entry {
+    sds key;
+    sds mime_type;
+    sds etag;
+    sds binary;
+    struct t_albumart_cache_entry *prev;
+    struct t_albumart_cache_entry *next;
+};
+
+typedef struct t_albumart_cache {
+    rax *index;
+    struct t_albumart_cache_entry *head; //most recently used
+    struct t_albumart_cache_entry *tail; //least recently used
+    size_t size;
+    size_t max_size;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long not_modified;
+    unsigned long evictions;
+} t_albumart_cache;
+
+t_albumart_cache *albumart_cache_new(size_t max_size);
+void albumart_cache_free(t_albumart_cache *cache);
+void albumart_cache_clear(t_albumart_cache *cache);
+struct t_albumart_cache_entry *albumart_cache_get(t_albumart_cache *cache, const char *key);
+struct t_albumart_cache_entry *albumart_cache_put(t_albumart_cache *cache, const char *key, const char *mime_type, sds binary);
+struct t_albumart_cache_entry *albumart_cache_put_file(t_albumart_cache *cache, const char *key, const char *filename);
+void albumart_cache_send(t_albumart_cache *cache, struct mg_connection *nc, struct http_message *hm, struct t_albumart_cache_entry *entry);
+sds albumart_cache_stats(sds buffer, t_albumart_cache *cache);
+#endif
@@ -0,0 +1,238 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/rax/rax.h"
+#include "../../dist/src/mongoose/mongoose.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "web_server_connections.h"
+#include "web_server_coalesce.h"
+#include "web_server_compress.h"
+#include "web_server_chunked.h"
+
+//Large api responses are pushed in chunks by the api handlers and sent
+//with chunked transfer encoding. A chunk is released to the handlers after
+//the send buffers of all receiving connections are drained below the
+//low water mark. The handlers abort a response with too many unreleased
+//chunks, an aborted stream closes its connections.
+
+//send buffer size below which chunks are released
+#define CHUNKED_LOW_WATER 65536
+
+struct t_chunked_stream {
+    struct list targets; //key: jsonrpc id of a coalesced request or empty, value_i: conn_id, user_data: gzip stream
+    unsigned held; //chunks not released
+};
+
+//private definitions
+static void chunked_stream_send(t_connection_index *connections, struct t_chunked_stream *stream,
+                                t_work_result *response, bool first);
+static void chunked_stream_free(struct t_chunked_stream *stream);
+static void chunked_close(t_connection_index *connections, int conn_id);
+
+//public functions
+t_chunked_index *chunked_index_new(void) {
+    t_chunked_index *index = (t_chunked_index *)malloc(sizeof(t_chunked_index));
+    assert(index);
+    index->streams = raxNew();
+    index->responses = 0;
+    index->chunks = 0;
+    return index;
+}
+
+void chunked_index_free(t_chunked_index *index) {
+    if (index == NULL) {
+        return;
+    }
+    raxIterator iter;
+    raxStart(&iter, index->streams);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        chunked_stream_free((struct t_chunked_stream *)iter.data);
+    }
+    raxStop(&iter);
+    raxFree(index->streams);
+    free(index);
+}
+
+bool chunked_index_started(t_chunked_index *index, int conn_id) {
+    return raxFind(index->streams, (unsigned char *)&conn_id, sizeof(conn_id)) != raxNotFound;
+}
+
+//headers and waiters are only used for the first chunk
+void chunked_index_send(t_chunked_index *index, t_connection_index *connections, t_work_result *response,
+                        const char *headers, struct list *waiters)
+{
+    int conn_id = response->conn_id;
+    struct t_chunked_stream *stream = NULL;
+    bool first = false;
+    void *data = raxFind(index->streams, (unsigned char *)&conn_id, sizeof(conn_id));
+    if (response->chunk == RESPONSE_ABORT) {
+        //the headers are already sent, the response can not be completed
+        LOG_ERROR("Chunked response for connection %d aborted, closing connection", conn_id);
+        if (data == raxNotFound) {
+            chunked_close(connections, conn_id);
+            for (struct list_node *current = waiters->head; current != NULL; current = current->next) {
+                chunked_close(connections, (int)current->value_i);
+            }
+            return;
+        }
+        stream = (struct t_chunked_stream *)data;
+        for (struct list_node *current = stream->targets.head; current != NULL; current = current->next) {
+            chunked_close(connections, (int)current->value_i);
+        }
+        raxRemove(index->streams, (unsigned char *)&conn_id, sizeof(conn_id), NULL);
+        response_chunk_release(conn_id, stream->held);
+        chunked_stream_free(stream);
+        return;
+    }
+    if (data == raxNotFound) {
+        first = true;
+        stream = (struct t_chunked_stream *)malloc(sizeof(struct t_chunked_stream));
+        assert(stream);
+        list_init(&stream->targets);
+        stream->held = 0;
+        raxInsert(index->streams, (unsigned char *)&conn_id, sizeof(conn_id), stream, NULL);
+        index->responses++;
+        list_push(&stream->targets, "", conn_id, NULL, NULL);
+        for (struct list_node *current = waiters->head; current != NULL; current = current->next) {
+            list_push(&stream->targets, current->key, current->value_i, NULL, NULL);
+        }
+        for (struct list_node *current = stream->targets.head; current != NULL; current = current->next) {
+            struct mg_connection *nc = connection_index_get(connections, current->value_i);
+            if (nc == NULL) {
+                continue;
+            }
+            current->user_data = api_gzip_stream_new(nc);
+            sds chunk_headers = sdsnew(headers);
+            if (current->user_data != NULL) {
+                chunk_headers = sdscat(chunk_headers, "\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding");
+            }
+            //negative length sends the Transfer-Encoding: chunked header
+            mg_send_head(nc, 200, -1, chunk_headers);
+            sdsfree(chunk_headers);
+        }
+    }
+    else {
+        stream = (struct t_chunked_stream *)data;
+    }
+    index->chunks++;
+    chunked_stream_send(connections, stream, response, first);
+    if (response->chunk == RESPONSE_LAST_CHUNK) {
+        raxRemove(index->streams, (unsigned char *)&conn_id, sizeof(conn_id), NULL);
+        response_chunk_release(conn_id, stream->held);
+        chunked_stream_free(stream);
+    }
+    else {
+        stream->held++;
+    }
+}
+
+//releases the chunks of streams with drained send buffers
+void chunked_index_flush(t_chunked_index *index, t_connection_index *connections) {
+    raxIterator iter;
+    raxStart(&iter, index->streams);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        struct t_chunked_stream *stream = (struct t_chunked_stream *)iter.data;
+        if (stream->held == 0) {
+            continue;
+        }
+        bool drained = true;
+        for (struct list_node *current = stream->targets.head; current != NULL; current = current->next) {
+            struct mg_connection *nc = connection_index_get(connections, current->value_i);
+            if (nc != NULL && nc->send_mbuf.len >= CHUNKED_LOW_WATER) {
+                drained = false;
+                break;
+            }
+        }
+        if (drained == true) {
+            int conn_id;
+            memcpy(&conn_id, iter.key, sizeof(conn_id));
+            response_chunk_release(conn_id, stream->held);
+            stream->held = 0;
+        }
+    }
+    raxStop(&iter);
+}
+
+sds chunked_index_stats(sds buffer, t_chunked_index *index) {
+    buffer = sdscat(buffer, "\"chunked\":{");
+    buffer = tojson_long(buffer, "streams", raxSize(index->streams), true);
+    buffer = tojson_long(buffer, "responses", index->responses, true);
+    buffer = tojson_long(buffer, "chunks", index->chunks, false);
+    buffer = sdscat(buffer, "}");
+    return buffer;
+}
+
+//private functions
+static void chunked_stream_send(t_connection_index *connections, struct t_chunked_stream *stream,
+                                t_work_result *response, bool first)
+{
+    bool finish = response->chunk == RESPONSE_LAST_CHUNK ? true : false;
+    sds data = sdsempty();
+    for (struct list_node *current = stream->targets.head; current != NULL; current = current->next) {
+        struct mg_connection *nc = connection_index_get(connections, current->value_i);
+        if (nc == NULL) {
+            continue;
+        }
+        const char *p = response->data;
+        size_t len = sdslen(response->data);
+        sdsclear(data);
+        if (first == true && sdslen(current->key) > 0) {
+            //replace the jsonrpc id for a coalesced request
+            data = request_coalesce_response(data, response->data, len, strtol(current->key, NULL, 10));
+            p = data;
+            len = sdslen(data);
+        }
+        if (current->user_data != NULL) {
+            sds compressed = api_gzip_stream_write((struct t_gzip_stream *)current->user_data, sdsempty(), p, len, finish);
+            if (sdslen(compressed) > 0) {
+                mg_send_http_chunk(nc, compressed, sdslen(compressed));
+            }
+            sdsfree(compressed);
+        }
+        else if (len > 0) {
+            mg_send_http_chunk(nc, p, len);
+        }
+        if (finish == true) {
+            mg_send_http_chunk(nc, "", 0);
+        }
+    }
+    sdsfree(data);
+}
+
+static void chunked_stream_free(struct t_chunked_stream *stream) {
+    for (struct list_node *current = stream->targets.head; current != NULL; current = current->next) {
+        api_gzip_stream_free((struct t_gzip_stream *)current->user_data);
+        current->user_data = NULL;
+    }
+    list_free(&stream->targets);
+    free(stream);
+}
+
+static void chunked_close(t_connection_index *connections, int conn_id) {
+    struct mg_connection *nc = connection_index_get(connections, conn_id);
+    if (nc != NULL) {
+        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+    }
+}
@@ -0,0 +1,24 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_CHUNKED_H__
+#define __WEB_SERVER_CHUNKED_H__
+
+//chunked api responses, only accessed by the web_server thread
+typedef struct t_chunked_index {
+    rax *streams; //key: conn_id of the executed request
+    unsigned long responses;
+    unsigned long chunks;
+} t_chunked_index;
+
+t_chunked_index *chunked_index_new(void);
+void chunked_index_free(t_chunked_index *index);
+bool chunked_index_started(t_chunked_index *index, int conn_id);
+void chunked_index_send(t_chunked_index *index, t_connection_index *connections, t_work_result *response,
+                        const char *headers, struct list *waiters);
+void chunked_index_flush(t_chunked_index *index, t_connection_index *connections);
+sds chunked_index_stats(sds buffer, t_chunked_index *index);
+#endif
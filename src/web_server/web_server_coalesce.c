@@ -0,0 +1,171 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/rax/rax.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "web_server_coalesce.h"
+
+//A read request with the same method and params as a request that is
+//queued or executed is not queued again. The connection waits for the
+//result of the first request, it gets a copy with its own jsonrpc id.
+
+//requests older than this are not joined anymore, in seconds
+#define REQUEST_COALESCE_TIMEOUT 10
+
+//private definitions
+static sds request_coalesce_key(sds key, enum mympd_cmd_ids cmd_id, const struct json_token *params);
+static void request_coalesce_free_entry(struct t_coalesce_entry *entry);
+
+//public functions
+t_request_coalesce *request_coalesce_new(void) {
+    t_request_coalesce *coalesce = (t_request_coalesce *)malloc(sizeof(t_request_coalesce));
+    assert(coalesce);
+    coalesce->requests = raxNew();
+    coalesce->leaders = raxNew();
+    coalesce->coalesced = 0;
+    return coalesce;
+}
+
+void request_coalesce_free(t_request_coalesce *coalesce) {
+    if (coalesce == NULL) {
+        return;
+    }
+    raxIterator iter;
+    raxStart(&iter, coalesce->leaders);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        request_coalesce_free_entry((struct t_coalesce_entry *)iter.data);
+    }
+    raxStop(&iter);
+    raxFree(coalesce->requests);
+    raxFree(coalesce->leaders);
+    free(coalesce);
+}
+
+//returns true if the request was attached to an identical request,
+//false if the request must be queued
+bool request_coalesce_attach(t_request_coalesce *coalesce, int conn_id, long id, enum mympd_cmd_ids cmd_id,
+                             const struct json_token *params)
+{
+    if (is_coalesce_api_method(cmd_id) == false) {
+        return false;
+    }
+    sds key = request_coalesce_key(sdsempty(), cmd_id, params);
+    time_t now = time(NULL);
+    void *data = raxFind(coalesce->requests, (unsigned char *)key, sdslen(key));
+    if (data != raxNotFound && ((struct t_coalesce_entry *)data)->started > now - REQUEST_COALESCE_TIMEOUT) {
+        struct t_coalesce_entry *entry = (struct t_coalesce_entry *)data;
+        sds id_str = sdsfromlonglong(id);
+        list_push(&entry->waiters, id_str, conn_id, NULL, NULL);
+        sdsfree(id_str);
+        coalesce->coalesced++;
+        LOG_DEBUG("Attached request of connection %d to connection %d", conn_id, entry->conn_id);
+        sdsfree(key);
+        return true;
+    }
+    struct t_coalesce_entry *entry = (struct t_coalesce_entry *)malloc(sizeof(struct t_coalesce_entry));
+    assert(entry);
+    entry->key = key;
+    entry->conn_id = conn_id;
+    entry->started = now;
+    list_init(&entry->waiters);
+    raxInsert(coalesce->requests, (unsigned char *)entry->key, sdslen(entry->key), entry, NULL);
+    raxInsert(coalesce->leaders, (unsigned char *)&conn_id, sizeof(conn_id), entry, NULL);
+    return false;
+}
+
+//moves the waiting connections for the result of conn_id to waiters
+bool request_coalesce_detach(t_request_coalesce *coalesce, int conn_id, struct list *waiters) {
+    void *data = NULL;
+    if (raxRemove(coalesce->leaders, (unsigned char *)&conn_id, sizeof(conn_id), &data) == 0) {
+        return false;
+    }
+    struct t_coalesce_entry *entry = (struct t_coalesce_entry *)data;
+    //a timed out request could be replaced by a newer one
+    if (raxFind(coalesce->requests, (unsigned char *)entry->key, sdslen(entry->key)) == entry) {
+        raxRemove(coalesce->requests, (unsigned char *)entry->key, sdslen(entry->key), NULL);
+    }
+    *waiters = entry->waiters;
+    list_init(&entry->waiters);
+    request_coalesce_free_entry(entry);
+    return true;
+}
+
+//copies the response and replaces the jsonrpc id
+sds request_coalesce_response(sds buffer, const char *data, size_t len, long id) {
+    static const char *prefix = "{\"jsonrpc\":\"2.0\",\"id\":";
+    size_t prefix_len = strlen(prefix);
+    if (len <= prefix_len || strncmp(data, prefix, prefix_len) != 0) {
+        return sdscatlen(buffer, data, len);
+    }
+    size_t i = prefix_len;
+    while (i < len && data[i] != ',') {
+        i++;
+    }
+    buffer = sdscatlen(buffer, prefix, prefix_len);
+    buffer = sdscatfmt(buffer, "%I", (long long)id);
+    buffer = sdscatlen(buffer, data + i, len - i);
+    return buffer;
+}
+
+sds request_coalesce_stats(sds buffer, t_request_coalesce *coalesce) {
+    buffer = sdscat(buffer, "\"requestCoalesce\":{");
+    buffer = tojson_long(buffer, "inflight", raxSize(coalesce->leaders), true);
+    buffer = tojson_long(buffer, "coalesced", coalesce->coalesced, false);
+    buffer = sdscat(buffer, "}");
+    return buffer;
+}
+
+//private functions
+
+//method and params without whitespace outside of strings
+static sds request_coalesce_key(sds key, enum mympd_cmd_ids cmd_id, const struct json_token *params) {
+    key = sdscatfmt(key, "%i:", cmd_id);
+    if (params == NULL) {
+        return key;
+    }
+    bool in_string = false;
+    for (int i = 0; i < params->len; i++) {
+        char c = params->ptr[i];
+        if (in_string == true) {
+            if (c == '\\' && i + 1 < params->len) {
+                key = sdscatlen(key, params->ptr + i, 2);
+                i++;
+                continue;
+            }
+            if (c == '"') {
+                in_string = false;
+            }
+        }
+        else if (c == '"') {
+            in_string = true;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            continue;
+        }
+        key = sdscatlen(key, &c, 1);
+    }
+    return key;
+}
+
+static void request_coalesce_free_entry(struct t_coalesce_entry *entry) {
+    sdsfree(entry->key);
+    list_free(&entry->waiters);
+    free(entry);
+}
@@ -0,0 +1,31 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_COALESCE_H__
+#define __WEB_SERVER_COALESCE_H__
+
+//identical read requests in flight, only accessed by the web_server thread
+struct t_coalesce_entry {
+    sds key;
+    int conn_id; //connection of the executed request
+    time_t started;
+    struct list waiters; //key: jsonrpc id, value_i: conn_id
+};
+
+typedef struct t_request_coalesce {
+    rax *requests; //key: cmd_id and params
+    rax *leaders; //key: conn_id of the executed request
+    unsigned long coalesced;
+} t_request_coalesce;
+
+t_request_coalesce *request_coalesce_new(void);
+void request_coalesce_free(t_request_coalesce *coalesce);
+bool request_coalesce_attach(t_request_coalesce *coalesce, int conn_id, long id, enum mympd_cmd_ids cmd_id,
+                             const struct json_token *params);
+bool request_coalesce_detach(t_request_coalesce *coalesce, int conn_id, struct list *waiters);
+sds request_coalesce_response(sds buffer, const char *data, size_t len, long id);
+sds request_coalesce_stats(sds buffer, t_request_coalesce *coalesce);
+#endif
@@ -0,0 +1,194 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/mongoose/mongoose.h"
+#include "../sds_extras.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "web_server_utility.h"
+#include "web_server_compress.h"
+
+#ifdef ENABLE_ZLIB
+  #include <zlib.h>
+#endif
+
+//Api responses are gzip compressed if the client accepts it and the response
+//is not too small. The web server thread compresses with the fastest level
+//to bound the cpu time, this costs about 5 ms per MB of json.
+
+//do not compress responses smaller than this
+#define API_GZIP_MIN_SIZE 1024
+
+//statistics, only accessed by the web_server thread
+static unsigned long gzip_responses;
+static unsigned long long gzip_bytes_in;
+static unsigned long long gzip_bytes_out;
+static unsigned long long gzip_usec;
+
+#ifdef ENABLE_ZLIB
+//compression state of a chunked response
+struct t_gzip_stream {
+    z_stream strm;
+};
+#endif
+
+//private definitions
+#ifdef ENABLE_ZLIB
+static sds api_gzip(sds buffer, const char *data, size_t len);
+#endif
+
+//public functions
+bool api_gzip_accepted(struct http_message *hm) {
+    #ifdef ENABLE_ZLIB
+    struct mg_str *header_encoding = mg_get_http_header(hm, "Accept-Encoding");
+    if (header_encoding != NULL && mg_strstr(*header_encoding, mg_mk_str("gzip")) != NULL) {
+        return true;
+    }
+    #else
+    (void) hm;
+    #endif
+    return false;
+}
+
+void api_send_response(struct mg_connection *nc, const char *headers, const char *data, size_t len) {
+    #ifdef ENABLE_ZLIB
+    if ((nc->flags & MG_F_API_GZIP) && len >= API_GZIP_MIN_SIZE) {
+        sds compressed = api_gzip(sdsempty(), data, len);
+        if (sdslen(compressed) > 0) {
+            sds gzip_headers = sdscatfmt(sdsempty(), "%s\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding", headers);
+            mg_send_head(nc, 200, sdslen(compressed), gzip_headers);
+            mg_send(nc, compressed, sdslen(compressed));
+            sdsfree(gzip_headers);
+            sdsfree(compressed);
+            return;
+        }
+        sdsfree(compressed);
+    }
+    #endif
+    mg_send_head(nc, 200, len, headers);
+    mg_send(nc, data, len);
+}
+
+//returns NULL if the response should not be compressed
+struct t_gzip_stream *api_gzip_stream_new(struct mg_connection *nc) {
+    #ifdef ENABLE_ZLIB
+    if (nc->flags & MG_F_API_GZIP) {
+        struct t_gzip_stream *stream = (struct t_gzip_stream *)malloc(sizeof(struct t_gzip_stream));
+        assert(stream);
+        memset(&stream->strm, 0, sizeof(stream->strm));
+        if (deflateInit2(&stream->strm, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+            return stream;
+        }
+        LOG_ERROR("Can not initialize gzip compression");
+        free(stream);
+    }
+    #else
+    (void) nc;
+    #endif
+    return NULL;
+}
+
+//compresses the data and flushes the output, so that each chunk can be decompressed at once
+sds api_gzip_stream_write(struct t_gzip_stream *stream, sds buffer, const char *data, size_t len, bool finish) {
+    #ifdef ENABLE_ZLIB
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uLong total_out = stream->strm.total_out;
+    stream->strm.next_in = (Bytef *)data;
+    stream->strm.avail_in = len;
+    int rc;
+    do {
+        buffer = sdsMakeRoomFor(buffer, 16384);
+        stream->strm.next_out = (Bytef *)(buffer + sdslen(buffer));
+        stream->strm.avail_out = sdsavail(buffer);
+        size_t avail = stream->strm.avail_out;
+        rc = deflate(&stream->strm, finish == true ? Z_FINISH : Z_SYNC_FLUSH);
+        sdsIncrLen(buffer, avail - stream->strm.avail_out);
+    } while (rc == Z_OK && stream->strm.avail_out == 0);
+    if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+        LOG_ERROR("Gzip compression failed: %d", rc);
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (finish == true) {
+        gzip_responses++;
+    }
+    gzip_bytes_in += len;
+    gzip_bytes_out += stream->strm.total_out - total_out;
+    gzip_usec += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    #else
+    (void) stream;
+    (void) finish;
+    buffer = sdscatlen(buffer, data, len);
+    #endif
+    return buffer;
+}
+
+void api_gzip_stream_free(struct t_gzip_stream *stream) {
+    if (stream == NULL) {
+        return;
+    }
+    #ifdef ENABLE_ZLIB
+    deflateEnd(&stream->strm);
+    #endif
+    free(stream);
+}
+
+sds api_gzip_stats(sds buffer) {
+    buffer = sdscat(buffer, "\"gzip\":{");
+    buffer = tojson_long(buffer, "responses", gzip_responses, true);
+    buffer = tojson_long(buffer, "bytesIn", gzip_bytes_in, true);
+    buffer = tojson_long(buffer, "bytesOut", gzip_bytes_out, true);
+    buffer = tojson_long(buffer, "usec", gzip_usec, false);
+    buffer = sdscat(buffer, "}");
+    return buffer;
+}
+
+//private functions
+#ifdef ENABLE_ZLIB
+//returns an empty string on error
+static sds api_gzip(sds buffer, const char *data, size_t len) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    //windowBits 15 + 16 writes a gzip header
+    if (deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        LOG_ERROR("Can not initialize gzip compression");
+        return buffer;
+    }
+    uLong bound = deflateBound(&strm, len);
+    buffer = sdsMakeRoomFor(buffer, bound);
+    strm.next_in = (Bytef *)data;
+    strm.avail_in = len;
+    strm.next_out = (Bytef *)buffer;
+    strm.avail_out = bound;
+    int rc = deflate(&strm, Z_FINISH);
+    if (rc == Z_STREAM_END) {
+        sdsIncrLen(buffer, strm.total_out);
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        gzip_responses++;
+        gzip_bytes_in += len;
+        gzip_bytes_out += strm.total_out;
+        gzip_usec += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    }
+    else {
+        LOG_ERROR("Gzip compression failed: %d", rc);
+    }
+    deflateEnd(&strm);
+    return buffer;
+}
+#endif
@@ -0,0 +1,16 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_COMPRESS_H__
+#define __WEB_SERVER_COMPRESS_H__
+
+bool api_gzip_accepted(struct http_message *hm);
+void api_send_response(struct mg_connection *nc, const char *headers, const char *data, size_t len);
+struct t_gzip_stream *api_gzip_stream_new(struct mg_connection *nc);
+sds api_gzip_stream_write(struct t_gzip_stream *stream, sds buffer, const char *data, size_t len, bool finish);
+void api_gzip_stream_free(struct t_gzip_stream *stream);
+sds api_gzip_stats(sds buffer);
+#endif
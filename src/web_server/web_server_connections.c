@@ -0,0 +1,238 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/rax/rax.h"
+#include "../../dist/src/mongoose/mongoose.h"
+#include "../../dist/src/frozen/frozen.h"
+#include "../sds_extras.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "web_server_utility.h"
+#include "web_server_connections.h"
+
+//The conn_id is stored in the user_data of the mongoose connection. The
+//index is updated on accept, websocket handshake and close, responses and
+//notifications do not need to walk the mongoose connection list.
+//
+//Websocket notifications are collected for WS_NOTIFY_WINDOW ms. A newer
+//notify replaces a pending one with the same method, only messages (info,
+//warn, error) are never merged. Merged update_queue notifies keep the
+//lowest changedFrom. A client with more than WS_SEND_HIGHWATER
+//bytes in its send buffer gets no notifications until the buffer is
+//drained, then it gets a single resync notify.
+
+#define WS_NOTIFY_WINDOW 100
+#define WS_SEND_HIGHWATER 262144
+
+//privat definitions
+static bool connection_index_coalesce(const char *method);
+static sds connection_index_merge_queue(const char *old_data, sds data);
+static void connection_index_send(struct mg_connection *nc, const char *data, size_t len);
+
+//public functions
+t_connection_index *connection_index_new(void) {
+    t_connection_index *index = (t_connection_index *)malloc(sizeof(t_connection_index));
+    assert(index);
+    index->connections = raxNew();
+    index->websockets = raxNew();
+    list_init(&index->notify_pending);
+    index->resync_waiting = 0;
+    index->coalesced = 0;
+    index->dropped = 0;
+    index->resyncs = 0;
+    return index;
+}
+
+void connection_index_free(t_connection_index *index) {
+    if (index == NULL) {
+        return;
+    }
+    raxFree(index->connections);
+    raxFree(index->websockets);
+    list_free(&index->notify_pending);
+    free(index);
+}
+
+void connection_index_add(t_connection_index *index, struct mg_connection *nc) {
+    intptr_t conn_id = (intptr_t)nc->user_data;
+    raxInsert(index->connections, (unsigned char *)&conn_id, sizeof(conn_id), nc, NULL);
+}
+
+void connection_index_add_websocket(t_connection_index *index, struct mg_connection *nc) {
+    intptr_t conn_id = (intptr_t)nc->user_data;
+    raxInsert(index->websockets, (unsigned char *)&conn_id, sizeof(conn_id), nc, NULL);
+}
+
+void connection_index_remove(t_connection_index *index, struct mg_connection *nc) {
+    intptr_t conn_id = (intptr_t)nc->user_data;
+    //the conn_id could be reused after a wrap around, remove only the own entry
+    if (connection_index_get(index, conn_id) == nc) {
+        raxRemove(index->connections, (unsigned char *)&conn_id, sizeof(conn_id), NULL);
+    }
+    void *ws = raxFind(index->websockets, (unsigned char *)&conn_id, sizeof(conn_id));
+    if (ws == nc) {
+        raxRemove(index->websockets, (unsigned char *)&conn_id, sizeof(conn_id), NULL);
+        if (nc->flags & MG_F_WS_RESYNC) {
+            index->resync_waiting--;
+        }
+    }
+}
+
+struct mg_connection *connection_index_get(t_connection_index *index, intptr_t conn_id) {
+    void *nc = raxFind(index->connections, (unsigned char *)&conn_id, sizeof(conn_id));
+    if (nc == raxNotFound) {
+        return NULL;
+    }
+    return (struct mg_connection *)nc;
+}
+
+//adds a notify to the pending list, a pending notify with the same method is replaced
+void connection_index_notify(t_connection_index *index, sds data) {
+    char *method = NULL;
+    json_scanf(data, sdslen(data), "{method: %Q}", &method);
+    if (method == NULL) {
+        method = strdup("");
+    }
+    sds merged = NULL;
+    if (connection_index_coalesce(method) == true) {
+        unsigned i = 0;
+        for (struct list_node *current = index->notify_pending.head; current != NULL; current = current->next, i++) {
+            if (strcmp(current->key, method) == 0) {
+                if (strcmp(method, "update_queue") == 0) {
+                    merged = connection_index_merge_queue(current->value_p, data);
+                    data = merged;
+                }
+                //remove it and append the new notify to keep the order of the last events
+                list_shift(&index->notify_pending, i);
+                index->coalesced++;
+                break;
+            }
+        }
+    }
+    if (index->notify_pending.length == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &index->notify_first);
+    }
+    list_push_len(&index->notify_pending, method, (int)strlen(method), 0, data, (int)sdslen(data), NULL);
+    FREE_PTR(method);
+    if (merged != NULL) {
+        sdsfree(merged);
+    }
+}
+
+//sends the pending notifications after the coalescing window
+void connection_index_flush(t_connection_index *index) {
+    if (index->notify_pending.length == 0 && index->resync_waiting == 0) {
+        return;
+    }
+    bool send_pending = false;
+    if (index->notify_pending.length > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - index->notify_first.tv_sec) * 1000 +
+            (now.tv_nsec - index->notify_first.tv_nsec) / 1000000;
+        send_pending = elapsed >= WS_NOTIFY_WINDOW;
+    }
+    if (send_pending == false && index->resync_waiting == 0) {
+        return;
+    }
+    if (send_pending == true && raxSize(index->websockets) == 0) {
+        LOG_DEBUG("No websocket client connected, discarding %u messages", index->notify_pending.length);
+    }
+    raxIterator iter;
+    raxStart(&iter, index->websockets);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        struct mg_connection *nc = (struct mg_connection *)iter.data;
+        if (nc->send_mbuf.len > WS_SEND_HIGHWATER) {
+            //slow client, drop the notifications
+            if (send_pending == true) {
+                index->dropped += index->notify_pending.length;
+            }
+            if (!(nc->flags & MG_F_WS_RESYNC)) {
+                LOG_WARN("Send buffer of websocket %d is full, dropping notifications", (intptr_t)nc->user_data);
+                nc->flags |= MG_F_WS_RESYNC;
+                index->resync_waiting++;
+            }
+        }
+        else if (nc->flags & MG_F_WS_RESYNC) {
+            //the client reloads all, the pending notifications are obsolete
+            sds buffer = jsonrpc_notify(sdsempty(), "resync");
+            connection_index_send(nc, buffer, sdslen(buffer));
+            sdsfree(buffer);
+            nc->flags &= ~MG_F_WS_RESYNC;
+            index->resync_waiting--;
+            index->resyncs++;
+        }
+        else if (send_pending == true) {
+            for (struct list_node *current = index->notify_pending.head; current != NULL; current = current->next) {
+                connection_index_send(nc, current->value_p, sdslen(current->value_p));
+            }
+        }
+    }
+    raxStop(&iter);
+    if (send_pending == true) {
+        list_free(&index->notify_pending);
+    }
+}
+
+sds connection_index_stats(sds buffer, t_connection_index *index) {
+    buffer = sdscat(buffer, "\"connections\":{");
+    buffer = tojson_long(buffer, "total", raxSize(index->connections), true);
+    buffer = tojson_long(buffer, "websockets", raxSize(index->websockets), true);
+    buffer = tojson_long(buffer, "notifyCoalesced", index->coalesced, true);
+    buffer = tojson_long(buffer, "notifyDropped", index->dropped, true);
+    buffer = tojson_long(buffer, "resyncs", index->resyncs, false);
+    buffer = sdscat(buffer, "}");
+    return buffer;
+}
+
+//privat functions
+static bool connection_index_coalesce(const char *method) {
+    if (strcmp(method, "info") == 0 || strcmp(method, "warn") == 0 || strcmp(method, "error") == 0) {
+        return false;
+    }
+    return true;
+}
+
+//changedFrom of update_queue is relative to the previous notify, the merged
+//notify must start at the first change of both, -1 (unknown) wins
+static sds connection_index_merge_queue(const char *old_data, sds data) {
+    long old_from = -1;
+    long new_from = -1;
+    if (json_scanf(old_data, (int)strlen(old_data), "{params: {changedFrom: %ld}}", &old_from) != 1 ||
+        json_scanf(data, (int)sdslen(data), "{params: {changedFrom: %ld}}", &new_from) != 1)
+    {
+        old_from = -1;
+    }
+    long changed_from = old_from == -1 || new_from == -1 ? -1 :
+        old_from < new_from ? old_from : new_from;
+    const char *key = "\"changedFrom\":";
+    const char *p = strstr(data, key);
+    if (p == NULL) {
+        return sdsdup(data);
+    }
+    p += strlen(key);
+    size_t value_len = strspn(p, "-0123456789");
+    sds merged = sdscatlen(sdsempty(), data, (size_t)(p - data));
+    merged = sdscatprintf(merged, "%ld", changed_from);
+    merged = sdscat(merged, p + value_len);
+    return merged;
+}
+
+static void connection_index_send(struct mg_connection *nc, const char *data, size_t len) {
+    LOG_DEBUG("Sending notify to conn_id %d: %.*s", (intptr_t)nc->user_data, (int)len, data);
+    mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, data, len);
+}
@@ -0,0 +1,31 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_CONNECTIONS_H__
+#define __WEB_SERVER_CONNECTIONS_H__
+
+//conn_id to mongoose connection index, only accessed by the web_server thread
+typedef struct t_connection_index {
+    rax *connections; //all connections with a conn_id
+    rax *websockets; //websocket connections for broadcasts
+    struct list notify_pending; //key: method, value_p: notify
+    struct timespec notify_first; //time of the oldest pending notify
+    unsigned resync_waiting; //websockets that are waiting for a resync
+    unsigned long coalesced;
+    unsigned long dropped;
+    unsigned long resyncs;
+} t_connection_index;
+
+t_connection_index *connection_index_new(void);
+void connection_index_free(t_connection_index *index);
+void connection_index_add(t_connection_index *index, struct mg_connection *nc);
+void connection_index_add_websocket(t_connection_index *index, struct mg_connection *nc);
+void connection_index_remove(t_connection_index *index, struct mg_connection *nc);
+struct mg_connection *connection_index_get(t_connection_index *index, intptr_t conn_id);
+void connection_index_notify(t_connection_index *index, sds data);
+void connection_index_flush(t_connection_index *index);
+sds connection_index_stats(sds buffer, t_connection_index *index);
+#endif
@@ -0,0 +1,440 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../sds_extras.h"
+#include "../log.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "web_server_coverextract.h"
+
+//optional includes
+#ifdef ENABLE_LIBID3TAG
+    #include <id3tag.h>
+#endif
+
+#ifdef ENABLE_FLAC
+    #include <FLAC/metadata.h>
+#endif
+
+//Minimal parsers for embedded pictures. They only read the frame and block
+//headers and the first picture payload with pread, instead of parsing all
+//tags like libid3tag and libFLAC. Unsupported variants return false, the
+//caller falls back to the libraries.
+
+//sanity limit for embedded pictures
+#define COVEREXTRACT_MAX_SIZE (32 * 1024 * 1024)
+
+//privat definitions
+static bool read_exact(int fd, void *buf, size_t len, off_t offset);
+static uint32_t get_be32(const unsigned char *p);
+static uint32_t get_be24(const unsigned char *p);
+static uint32_t get_syncsafe32(const unsigned char *p);
+static bool parse_apic(const unsigned char *frame, size_t len, bool v22, sds *binary, sds *mime_type);
+static bool parse_flac_picture(const unsigned char *block, size_t len, sds *binary, sds *mime_type);
+static bool coverextract_flac_native(int fd, off_t offset, sds *binary, sds *mime_type);
+static bool coverextract_flac_ogg(int fd, sds *binary, sds *mime_type);
+
+//public functions
+bool coverextract_id3(const char *media_file, sds *binary, sds *mime_type) {
+    int fd = open(media_file, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Can not open file \"%s\": %s", media_file, strerror(errno));
+        return false;
+    }
+    bool rc = false;
+    unsigned char header[10];
+    if (read_exact(fd, header, 10, 0) == false || memcmp(header, "ID3", 3) != 0) {
+        LOG_DEBUG("No id3v2 tag found in \"%s\"", media_file);
+        close(fd);
+        return false;
+    }
+    unsigned version = header[3];
+    unsigned flags = header[5];
+    off_t tag_end = 10 + (off_t)get_syncsafe32(header + 6);
+    if (version < 2 || version > 4 || (flags & 0x80) != 0) {
+        //unsynchronisation of the whole tag is not supported
+        LOG_DEBUG("Unsupported id3v2 tag in \"%s\"", media_file);
+        close(fd);
+        return false;
+    }
+    off_t pos = 10;
+    if (version > 2 && (flags & 0x40) != 0) {
+        //skip extended header
+        unsigned char ext[4];
+        if (read_exact(fd, ext, 4, pos) == false) {
+            close(fd);
+            return false;
+        }
+        pos += version == 3 ? 4 + (off_t)get_be32(ext) : (off_t)get_syncsafe32(ext);
+    }
+    size_t header_len = version == 2 ? 6 : 10;
+    while (pos + (off_t)header_len <= tag_end) {
+        unsigned char frame_header[10];
+        if (read_exact(fd, frame_header, header_len, pos) == false || frame_header[0] == '\0') {
+            //padding reached
+            break;
+        }
+        uint32_t frame_len;
+        unsigned frame_flags = 0;
+        bool is_picture;
+        if (version == 2) {
+            frame_len = get_be24(frame_header + 3);
+            is_picture = memcmp(frame_header, "PIC", 3) == 0;
+        }
+        else {
+            frame_len = version == 4 ? get_syncsafe32(frame_header + 4) : get_be32(frame_header + 4);
+            frame_flags = frame_header[9];
+            is_picture = memcmp(frame_header, "APIC", 4) == 0;
+        }
+        pos += (off_t)header_len;
+        if (frame_len == 0 || pos + (off_t)frame_len > tag_end) {
+            break;
+        }
+        if (is_picture == true) {
+            //grouped, compressed, encrypted or unsynchronised frames are not supported
+            unsigned unsupported = version == 4 ? 0x4e : 0xe0;
+            if ((frame_flags & unsupported) != 0 || frame_len > COVEREXTRACT_MAX_SIZE) {
+                LOG_DEBUG("Unsupported picture frame in \"%s\"", media_file);
+                break;
+            }
+            size_t skip = version == 4 && (frame_flags & 0x01) != 0 ? 4 : 0;
+            if (frame_len <= skip) {
+                break;
+            }
+            sds frame = sdsnewlen(NULL, frame_len - skip);
+            if (read_exact(fd, frame, frame_len - skip, pos + (off_t)skip) == true) {
+                rc = parse_apic((unsigned char *)frame, frame_len - skip, version == 2, binary, mime_type);
+            }
+            sdsfree(frame);
+            break;
+        }
+        pos += (off_t)frame_len;
+    }
+    close(fd);
+    return rc;
+}
+
+bool coverextract_flac(const char *media_file, sds *binary, sds *mime_type, bool is_ogg) {
+    int fd = open(media_file, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Can not open file \"%s\": %s", media_file, strerror(errno));
+        return false;
+    }
+    bool rc = false;
+    if (is_ogg == true) {
+        rc = coverextract_flac_ogg(fd, binary, mime_type);
+    }
+    else {
+        unsigned char magic[4];
+        off_t offset = 0;
+        if (read_exact(fd, magic, 4, 0) == true && memcmp(magic, "ID3", 3) == 0) {
+            //skip id3v2 tag in front of the flac stream
+            unsigned char header[10];
+            if (read_exact(fd, header, 10, 0) == true) {
+                offset = 10 + (off_t)get_syncsafe32(header + 6);
+                if (read_exact(fd, magic, 4, offset) == false) {
+                    magic[0] = '\0';
+                }
+            }
+        }
+        if (memcmp(magic, "fLaC", 4) == 0) {
+            rc = coverextract_flac_native(fd, offset + 4, binary, mime_type);
+        }
+    }
+    close(fd);
+    return rc;
+}
+
+//full tag parsing with libid3tag
+bool coverextract_id3_lib(const char *media_file, sds *binary, sds *mime_type) {
+    bool rc = false;
+    #ifdef ENABLE_LIBID3TAG
+    LOG_DEBUG("Exctracting coverimage from %s", media_file);
+    struct id3_file *file_struct = id3_file_open(media_file, ID3_FILE_MODE_READONLY);
+    if (file_struct == NULL) {
+        LOG_ERROR("Can't parse id3_file: %s", media_file);
+        return false;
+    }
+    struct id3_tag *tags = id3_file_tag(file_struct);
+    if (tags == NULL) {
+        LOG_ERROR("Can't read id3 tags from file: %s", media_file);
+        id3_file_close(file_struct);
+        return false;
+    }
+    struct id3_frame *frame = id3_tag_findframe(tags, "APIC", 0);
+    if (frame != NULL) {
+        id3_length_t length;
+        const id3_byte_t *pic = id3_field_getbinarydata(id3_frame_field(frame, 4), &length);
+        *binary = sdscatlen(*binary, pic, length);
+        *mime_type = sdscat(*mime_type, (const char *)id3_field_getlatin1(id3_frame_field(frame, 1)));
+        LOG_DEBUG("Coverimage successfully extracted");
+        rc = true;
+    }
+    else {
+        LOG_DEBUG("No embedded picture detected");
+    }
+    id3_file_close(file_struct);
+    #else
+    (void) media_file;
+    (void) binary;
+    (void) mime_type;
+    #endif
+    return rc;
+}
+
+//full metadata parsing with libFLAC
+bool coverextract_flac_lib(const char *media_file, sds *binary, sds *mime_type, bool is_ogg) {
+    bool rc = false;
+    #ifdef ENABLE_FLAC
+    LOG_DEBUG("Exctracting coverimage from %s", media_file);
+    FLAC__StreamMetadata *metadata = NULL;
+
+    FLAC__Metadata_Chain *chain = FLAC__metadata_chain_new();
+    
+    if(! (is_ogg? FLAC__metadata_chain_read_ogg(chain, media_file) : FLAC__metadata_chain_read(chain, media_file)) ) {
+        LOG_DEBUG("%s: ERROR: reading metadata", media_file);
+        FLAC__metadata_chain_delete(chain);
+        return false;
+    }
+
+    FLAC__Metadata_Iterator *iterator = FLAC__metadata_iterator_new();
+    if (iterator == NULL) {
+        LOG_ERROR("Can't create metadata iterator");
+        FLAC__metadata_chain_delete(chain);
+        return false;
+    }
+    FLAC__metadata_iterator_init(iterator, chain);
+    
+    do {
+        FLAC__StreamMetadata *block = FLAC__metadata_iterator_get_block(iterator);
+        if (block->type == FLAC__METADATA_TYPE_PICTURE) {
+            metadata = block;
+        }
+    } while (FLAC__metadata_iterator_next(iterator) && metadata == NULL);
+    
+    if (metadata == NULL) {
+        LOG_DEBUG("No embedded picture detected");
+    }
+    else {
+        *binary = sdscatlen(*binary, metadata->data.picture.data, metadata->data.picture.data_length);
+        *mime_type = sdscat(*mime_type, metadata->data.picture.mime_type);
+        LOG_DEBUG("Coverimage successfully extracted");
+        rc = true;
+    }
+    FLAC__metadata_iterator_delete(iterator);
+    FLAC__metadata_chain_delete(chain);
+    #else
+    (void) media_file;
+    (void) binary;
+    (void) mime_type;
+    (void) is_ogg;
+    #endif
+    return rc;
+}
+
+//privat functions
+static bool read_exact(int fd, void *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static uint32_t get_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint32_t get_be24(const unsigned char *p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+}
+
+static uint32_t get_syncsafe32(const unsigned char *p) {
+    return ((uint32_t)(p[0] & 0x7f) << 21) | ((uint32_t)(p[1] & 0x7f) << 14) | ((uint32_t)(p[2] & 0x7f) << 7) | (uint32_t)(p[3] & 0x7f);
+}
+
+//APIC: encoding, mime type, picture type, description, data
+//PIC (id3v2.2): encoding, image format (3 chars), picture type, description, data
+static bool parse_apic(const unsigned char *frame, size_t len, bool v22, sds *binary, sds *mime_type) {
+    size_t pos = 1;
+    unsigned encoding = frame[0];
+    if (v22 == true) {
+        if (len < 5) {
+            return false;
+        }
+        *mime_type = sdscrop(*mime_type);
+        *mime_type = sdscat(*mime_type, strncasecmp((const char *)frame + 1, "PNG", 3) == 0 ? "image/png" : "image/jpeg");
+        pos = 4;
+    }
+    else {
+        const unsigned char *end = memchr(frame + pos, '\0', len - pos);
+        if (end == NULL) {
+            return false;
+        }
+        *mime_type = sdscrop(*mime_type);
+        *mime_type = sdscatlen(*mime_type, frame + pos, (size_t)(end - frame) - pos);
+        pos = (size_t)(end - frame) + 1;
+    }
+    //picture type
+    pos++;
+    //description, utf-16 strings are terminated by two zero bytes
+    if (encoding == 1 || encoding == 2) {
+        while (pos + 1 < len && (frame[pos] != '\0' || frame[pos + 1] != '\0')) {
+            pos += 2;
+        }
+        pos += 2;
+    }
+    else {
+        while (pos < len && frame[pos] != '\0') {
+            pos++;
+        }
+        pos++;
+    }
+    if (pos >= len) {
+        return false;
+    }
+    *binary = sdscatlen(*binary, frame + pos, len - pos);
+    return true;
+}
+
+//PICTURE block: type, mime type, description, width, height, depth, colors, data
+static bool parse_flac_picture(const unsigned char *block, size_t len, sds *binary, sds *mime_type) {
+    if (len < 8) {
+        return false;
+    }
+    size_t pos = 4;
+    uint32_t mime_len = get_be32(block + pos);
+    pos += 4;
+    if (mime_len > len - pos) {
+        return false;
+    }
+    *mime_type = sdscrop(*mime_type);
+    *mime_type = sdscatlen(*mime_type, block + pos, mime_len);
+    pos += mime_len;
+    if (len - pos < 4) {
+        return false;
+    }
+    uint32_t desc_len = get_be32(block + pos);
+    pos += 4;
+    if (desc_len > len - pos || len - pos - desc_len < 20) {
+        return false;
+    }
+    pos += desc_len + 16;
+    uint32_t data_len = get_be32(block + pos);
+    pos += 4;
+    if (data_len == 0 || data_len > len - pos) {
+        return false;
+    }
+    *binary = sdscatlen(*binary, block + pos, data_len);
+    return true;
+}
+
+static bool coverextract_flac_native(int fd, off_t offset, sds *binary, sds *mime_type) {
+    bool last = false;
+    while (last == false) {
+        unsigned char header[4];
+        if (read_exact(fd, header, 4, offset) == false) {
+            return false;
+        }
+        last = (header[0] & 0x80) != 0;
+        unsigned type = header[0] & 0x7f;
+        uint32_t len = get_be24(header + 1);
+        offset += 4;
+        if (type == 6) {
+            if (len > COVEREXTRACT_MAX_SIZE) {
+                return false;
+            }
+            sds block = sdsnewlen(NULL, len);
+            bool rc = read_exact(fd, block, len, offset) &&
+                parse_flac_picture((unsigned char *)block, len, binary, mime_type);
+            sdsfree(block);
+            return rc;
+        }
+        offset += (off_t)len;
+    }
+    LOG_DEBUG("No embedded picture detected");
+    return false;
+}
+
+//Ogg FLAC: the first packet is the mapping header, each following header packet one metadata block
+static bool coverextract_flac_ogg(int fd, sds *binary, sds *mime_type) {
+    off_t offset = 0;
+    sds packet = sdsempty();
+    unsigned packet_no = 0;
+    bool rc = false;
+    bool done = false;
+    while (done == false) {
+        unsigned char page_header[27];
+        unsigned char segments[255];
+        if (read_exact(fd, page_header, 27, offset) == false || memcmp(page_header, "OggS", 4) != 0) {
+            break;
+        }
+        unsigned segment_count = page_header[26];
+        if (read_exact(fd, segments, segment_count, offset + 27) == false) {
+            break;
+        }
+        offset += 27 + (off_t)segment_count;
+        for (unsigned i = 0; i < segment_count && done == false; i++) {
+            size_t old_len = sdslen(packet);
+            if (old_len + segments[i] > COVEREXTRACT_MAX_SIZE) {
+                done = true;
+                break;
+            }
+            packet = sdsMakeRoomFor(packet, segments[i]);
+            if (read_exact(fd, packet + old_len, segments[i], offset) == false) {
+                done = true;
+                break;
+            }
+            sdsIncrLen(packet, segments[i]);
+            offset += segments[i];
+            if (segments[i] == 255) {
+                //packet continues
+                continue;
+            }
+            const unsigned char *p = (const unsigned char *)packet;
+            size_t len = sdslen(packet);
+            if (packet_no == 0) {
+                if (len < 13 || memcmp(p, "\x7f" "FLAC", 5) != 0) {
+                    //no flac stream
+                    done = true;
+                }
+            }
+            else if (len >= 4) {
+                unsigned type = p[0] & 0x7f;
+                if (type == 6) {
+                    rc = parse_flac_picture(p + 4, len - 4, binary, mime_type);
+                    done = true;
+                }
+                else if ((p[0] & 0x80) != 0) {
+                    //last metadata block
+                    done = true;
+                }
+            }
+            packet_no++;
+            sdsclear(packet);
+        }
+    }
+    sdsfree(packet);
+    return rc;
+}
@@ -0,0 +1,13 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_COVEREXTRACT_H__
+#define __WEB_SERVER_COVEREXTRACT_H__
+bool coverextract_id3(const char *media_file, sds *binary, sds *mime_type);
+bool coverextract_flac(const char *media_file, sds *binary, sds *mime_type, bool is_ogg);
+bool coverextract_id3_lib(const char *media_file, sds *binary, sds *mime_type);
+bool coverextract_flac_lib(const char *media_file, sds *binary, sds *mime_type, bool is_ogg);
+#endif
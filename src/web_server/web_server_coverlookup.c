@@ -0,0 +1,202 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/rax/rax.h"
+#include "../sds_extras.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "web_server_coverlookup.h"
+
+//seconds a cached directory is trusted before its mtime is checked again
+#define COVERLOOKUP_RECHECK 10
+
+//privat definitions
+static void coverlookup_read_dir(struct t_coverlookup_dir *dir, const char *dir_path, sds *coverimage_names,
+                                 int coverimage_names_len, time_t now);
+static void coverlookup_free_dir(struct t_coverlookup_dir *dir);
+
+//public functions
+t_coverlookup_cache *coverlookup_cache_new(void) {
+    t_coverlookup_cache *cache = (t_coverlookup_cache *)malloc(sizeof(t_coverlookup_cache));
+    assert(cache);
+    cache->dirs = raxNew();
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->hits = 0;
+    cache->misses = 0;
+    return cache;
+}
+
+void coverlookup_cache_free(t_coverlookup_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    coverlookup_cache_clear(cache);
+    raxFree(cache->dirs);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+void coverlookup_cache_clear(t_coverlookup_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache->mutex);
+    if (raxSize(cache->dirs) == 0) {
+        pthread_mutex_unlock(&cache->mutex);
+        return;
+    }
+    LOG_DEBUG("Clearing cover lookup cache (%llu directories)", (unsigned long long)raxSize(cache->dirs));
+    raxIterator iter;
+    raxStart(&iter, cache->dirs);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        coverlookup_free_dir((struct t_coverlookup_dir *)iter.data);
+    }
+    raxStop(&iter);
+    raxFree(cache->dirs);
+    cache->dirs = raxNew();
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+//returns the absolute path of the folder cover for path in coverfile, coverfile is empty if there is none
+//the directory is read without holding the lock, concurrent lookups of other directories are not blocked
+sds coverlookup_find(t_coverlookup_cache *cache, sds coverfile, const char *music_directory, const char *path,
+                     sds *coverimage_names, int coverimage_names_len)
+{
+    time_t now = time(NULL);
+    sds dir_path = sdscatfmt(sdsempty(), "%s/%s", music_directory, path);
+    bool valid = false;
+    pthread_mutex_lock(&cache->mutex);
+    void *data = raxFind(cache->dirs, (unsigned char *)dir_path, sdslen(dir_path));
+    if (data != raxNotFound) {
+        struct t_coverlookup_dir *dir = (struct t_coverlookup_dir *)data;
+        if (now - dir->checked < COVERLOOKUP_RECHECK) {
+            valid = true;
+        }
+        else {
+            struct stat st;
+            if (stat(dir_path, &st) == 0 && st.st_mtime == dir->mtime) {
+                dir->checked = now;
+                valid = true;
+            }
+        }
+        if (valid == true) {
+            cache->hits++;
+            coverfile = sdscatsds(sdscrop(coverfile), dir->coverfile);
+        }
+    }
+    if (valid == false) {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    if (valid == true) {
+        sdsfree(dir_path);
+        return coverfile;
+    }
+    struct t_coverlookup_dir read_dir;
+    read_dir.coverfile = sdsempty();
+    coverlookup_read_dir(&read_dir, dir_path, coverimage_names, coverimage_names_len, now);
+    coverfile = sdscatsds(sdscrop(coverfile), read_dir.coverfile);
+    pthread_mutex_lock(&cache->mutex);
+    data = raxFind(cache->dirs, (unsigned char *)dir_path, sdslen(dir_path));
+    if (data != raxNotFound) {
+        //replace the outdated result
+        struct t_coverlookup_dir *dir = (struct t_coverlookup_dir *)data;
+        sdsfree(dir->coverfile);
+        *dir = read_dir;
+    }
+    else {
+        struct t_coverlookup_dir *dir = (struct t_coverlookup_dir *)malloc(sizeof(struct t_coverlookup_dir));
+        assert(dir);
+        *dir = read_dir;
+        raxInsert(cache->dirs, (unsigned char *)dir_path, sdslen(dir_path), dir, NULL);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    sdsfree(dir_path);
+    return coverfile;
+}
+
+sds coverlookup_cache_stats(sds buffer, t_coverlookup_cache *cache) {
+    if (cache != NULL) {
+        pthread_mutex_lock(&cache->mutex);
+    }
+    buffer = sdscat(buffer, "\"coverLookupCache\":{");
+    buffer = tojson_long(buffer, "directories", (cache != NULL ? (long long)raxSize(cache->dirs) : 0), true);
+    buffer = tojson_long(buffer, "hits", (cache != NULL ? (long long)cache->hits : 0), true);
+    buffer = tojson_long(buffer, "misses", (cache != NULL ? (long long)cache->misses : 0), false);
+    buffer = sdscat(buffer, "}");
+    if (cache != NULL) {
+        pthread_mutex_unlock(&cache->mutex);
+    }
+    return buffer;
+}
+
+//privat functions
+
+//lists the directory once and resolves the coverimage names against the listing
+static void coverlookup_read_dir(struct t_coverlookup_dir *dir, const char *dir_path, sds *coverimage_names,
+                                 int coverimage_names_len, time_t now)
+{
+    dir->coverfile = sdscrop(dir->coverfile);
+    dir->checked = now;
+    dir->mtime = 0;
+    struct stat st;
+    if (stat(dir_path, &st) == 0) {
+        dir->mtime = st.st_mtime;
+    }
+    DIR *dir_handle = opendir(dir_path);
+    if (dir_handle == NULL) {
+        LOG_ERROR("Can not open directory \"%s\": %s", dir_path, strerror(errno));
+        return;
+    }
+    rax *files = raxNew();
+    struct dirent *next_file;
+    while ((next_file = readdir(dir_handle)) != NULL) {
+        if (next_file->d_name[0] != '.') {
+            raxInsert(files, (unsigned char *)next_file->d_name, strlen(next_file->d_name), NULL, NULL);
+        }
+    }
+    closedir(dir_handle);
+
+    sds name = sdsempty();
+    for (int j = 0; j < coverimage_names_len && sdslen(dir->coverfile) == 0; j++) {
+        if (strchr(coverimage_names[j], '.') != NULL) {
+            if (raxFind(files, (unsigned char *)coverimage_names[j], sdslen(coverimage_names[j])) != raxNotFound) {
+                dir->coverfile = sdscatfmt(dir->coverfile, "%s/%s", dir_path, coverimage_names[j]);
+            }
+            continue;
+        }
+        //basename, try extensions
+        for (const struct mime_type_entry *p = image_files; p->extension != NULL; p++) {
+            name = sdscatfmt(sdscrop(name), "%s.%s", coverimage_names[j], p->extension);
+            if (raxFind(files, (unsigned char *)name, sdslen(name)) != raxNotFound) {
+                dir->coverfile = sdscatfmt(dir->coverfile, "%s/%s", dir_path, name);
+                break;
+            }
+        }
+    }
+    sdsfree(name);
+    raxFree(files);
+    LOG_DEBUG("Cover lookup for directory \"%s\": \"%s\"", dir_path, dir->coverfile);
+}
+
+static void coverlookup_free_dir(struct t_coverlookup_dir *dir) {
+    sdsfree(dir->coverfile);
+    free(dir);
+}
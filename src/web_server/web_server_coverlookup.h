@@ -0,0 +1,30 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_COVERLOOKUP_H__
+#define __WEB_SERVER_COVERLOOKUP_H__
+
+//per directory results of the folder cover lookup, shared by the web_server thread and the albumart batch threads
+struct t_coverlookup_dir {
+    sds coverfile; //empty if the directory has no cover
+    time_t mtime;
+    time_t checked;
+};
+
+typedef struct t_coverlookup_cache {
+    rax *dirs;
+    pthread_mutex_t mutex;
+    unsigned long hits;
+    unsigned long misses;
+} t_coverlookup_cache;
+
+t_coverlookup_cache *coverlookup_cache_new(void);
+void coverlookup_cache_free(t_coverlookup_cache *cache);
+void coverlookup_cache_clear(t_coverlookup_cache *cache);
+sds coverlookup_find(t_coverlookup_cache *cache, sds coverfile, const char *music_directory, const char *path,
+                     sds *coverimage_names, int coverimage_names_len);
+sds coverlookup_cache_stats(sds buffer, t_coverlookup_cache *cache);
+#endif
@@ -0,0 +1,108 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "../../dist/src/sds/sds.h"
+#include "../../dist/src/rax/rax.h"
+#include "../../dist/src/mongoose/mongoose.h"
+#include "../sds_extras.h"
+#include "../api.h"
+#include "../list.h"
+#include "config_defs.h"
+#include "../utility.h"
+#include "../log.h"
+#include "../tiny_queue.h"
+#include "../global.h"
+#include "web_server_etag.h"
+
+//Responses of cacheable api requests get an etag derived from the generation
+//counters of the data they depend on. A request with a matching If-None-Match
+//header gets a notModified result without calling the handler.
+//The etag is created before the request is queued, a change while the request
+//is executed only results in a needless full response next time.
+
+//public functions
+t_etag_index *etag_index_new(void) {
+    t_etag_index *index = (t_etag_index *)malloc(sizeof(t_etag_index));
+    assert(index);
+    index->pending = raxNew();
+    index->started = time(NULL);
+    index->not_modified = 0;
+    return index;
+}
+
+void etag_index_free(t_etag_index *index) {
+    if (index == NULL) {
+        return;
+    }
+    raxIterator iter;
+    raxStart(&iter, index->pending);
+    raxSeek(&iter, "^", NULL, 0);
+    while (raxNext(&iter)) {
+        sdsfree((sds)iter.data);
+    }
+    raxStop(&iter);
+    raxFree(index->pending);
+    free(index);
+}
+
+//returns an empty string if the response can not be cached
+sds etag_create(t_etag_index *index, sds buffer, enum mympd_cmd_ids cmd_id) {
+    unsigned generations = get_api_generations(cmd_id);
+    if (generations == 0) {
+        return buffer;
+    }
+    buffer = sdscatfmt(buffer, "\"%I-%i-%U\"", (long long)index->started, cmd_id,
+        (unsigned long long)api_generation_get(generations));
+    return buffer;
+}
+
+bool etag_match(struct http_message *hm, sds etag) {
+    struct mg_str *if_none_match = mg_get_http_header(hm, "If-None-Match");
+    if (if_none_match == NULL) {
+        return false;
+    }
+    return mg_vcmp(if_none_match, etag) == 0 ? true : false;
+}
+
+sds etag_not_modified(t_etag_index *index, sds buffer, const char *method, long id) {
+    index->not_modified++;
+    buffer = jsonrpc_start_result(buffer, method, id);
+    buffer = sdscat(buffer, ",");
+    buffer = tojson_bool(buffer, "notModified", true, false);
+    buffer = jsonrpc_end_result(buffer);
+    return buffer;
+}
+
+//takes ownership of etag
+void etag_pending_add(t_etag_index *index, int conn_id, sds etag) {
+    void *old = NULL;
+    if (raxInsert(index->pending, (unsigned char *)&conn_id, sizeof(conn_id), etag, &old) == 0) {
+        sdsfree((sds)old);
+    }
+}
+
+//returns NULL if there is no etag for this connection
+sds etag_pending_remove(t_etag_index *index, int conn_id) {
+    void *data = NULL;
+    if (raxRemove(index->pending, (unsigned char *)&conn_id, sizeof(conn_id), &data) == 0) {
+        return NULL;
+    }
+    return (sds)data;
+}
+
+sds etag_stats(sds buffer, t_etag_index *index) {
+    buffer = sdscat(buffer, "\"etag\":{");
+    buffer = tojson_long(buffer, "pending", raxSize(index->pending), true);
+    buffer = tojson_long(buffer, "notModified", index->not_modified, false);
+    buffer = sdscat(buffer, "}");
+    return buffer;
+}
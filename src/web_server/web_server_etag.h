@@ -0,0 +1,25 @@
+/*
+ SPDX-License-Identifier: GPL-2.0-or-later
+ myMPD (c) 2018-2021 Juergen Mang <mail@jcgames.de>
+ https://github.com/jcorporation/mympd
+*/
+
+#ifndef __WEB_SERVER_ETAG_H__
+#define __WEB_SERVER_ETAG_H__
+
+//etags of cacheable api requests, only accessed by the web_server thread
+typedef struct t_etag_index {
+    rax *pending; //key: conn_id, data: etag of the queued request
+    time_t started; //invalidates all etags after a restart
+    unsigned long not_modified;
+} t_etag_index;
+
+t_etag_index *etag_index_new(void);
+void etag_index_free(t_etag_index *index);
+sds etag_create(t_etag_index *index, sds buffer, enum mympd_cmd_ids cmd_id);
+bool etag_match(struct http_message *hm, sds etag);
+sds etag_not_modified(t_etag_index *index, sds buffer, const char *method, long id);
+void etag_pending_add(t_etag_index *index, int conn_id, sds etag);
+sds etag_pending_remove(t_etag_index *index, int conn_id);
+sds etag_stats(sds buffer, t_etag_index *index);
+#endif
@@ -25,6 +25,14 @@
 
 #define EXTRA_HEADERS_CACHE "Cache-Control: max-age=604800"
 
+//mongoose user flags, each feature needs its own flag
+//websocket that has missed notifications
+#define MG_F_WS_RESYNC MG_F_USER_1
+//the client of the current api request accepts gzip
+#define MG_F_API_GZIP MG_F_USER_2
+//albumart that is streamed from mpd
+#define MG_F_ALBUMART_STREAMING MG_F_USER_3
+
 #define CUSTOM_MIME_TYPES ".html=text/html; charset=utf-8,.manifest=application/manifest+json,.woff2=application/font-woff,.tiff=image/tiff"
 
 typedef struct t_mg_user_data {
@@ -38,6 +46,12 @@ typedef struct t_mg_user_data {
     bool feat_library;
     bool feat_mpd_albumart;
     int conn_id;
+    struct t_albumart_cache *albumart_cache;
+    struct t_coverlookup_cache *coverlookup_cache;
+    struct t_connection_index *connection_index;
+    struct t_request_coalesce *request_coalesce;
+    struct t_etag_index *etag_index;
+    struct t_chunked_index *chunked_index;
 } t_mg_user_data;
 
 #ifndef DEBUG
@@ -13,14 +13,272 @@
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <mpd/client.h>
+#include <mpd/async.h>
 
 #include "../dist/src/sds/sds.h"
 #include "../src/sds_extras.h"
 #include "../src/tiny_queue.h"
 #include "../src/list.h"
+#include "../dist/src/frozen/frozen.h"
+#include "../src/api_params.h"
+#include "../src/web_server/web_server_coverextract.h"
+#include "config_defs.h"
+#include "../src/api.h"
+#include "../src/global.h"
+#include "../src/utility.h"
+#include "../src/mpd_shared/mpd_shared_typedefs.h"
+#include "../src/mpd_shared.h"
+#include "../src/mpd_client/mpd_client_utility.h"
+#include "../src/mpd_client/mpd_client_api.h"
+#include "../src/mpd_client/mpd_client_batch.h"
 
 _Thread_local sds thread_logname;
 
+//byte by byte json escaping to check sdscatjson
+static sds json_escape_reference(sds s, const char *p, size_t len) {
+    s = sdscatlen(s, "\"", 1);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)p[i];
+        switch(c) {
+            case '\\': s = sdscat(s, "\\\\"); break;
+            case '"':  s = sdscat(s, "\\\""); break;
+            case '\n': s = sdscat(s, "\\n"); break;
+            case '\r': s = sdscat(s, "\\r"); break;
+            case '\t': s = sdscat(s, "\\t"); break;
+            case '\b': s = sdscat(s, "\\b"); break;
+            case '\f': s = sdscat(s, "\\f"); break;
+            case '<':  s = sdscat(s, "\\u003C"); break;
+            case '\v':
+            case '\a':
+                break;
+            default:
+                if (c < 0x20 || c == 0x7f) {
+                    s = sdscatprintf(s, "\\u%04x", c);
+                }
+                else {
+                    s = sdscatlen(s, &p[i], 1);
+                }
+        }
+    }
+    return sdscatlen(s, "\"", 1);
+}
+
+//synthetic media files for the cover extraction parsers
+static sds put_be32(sds s, uint32_t v) {
+    unsigned char b[4] = {(unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v};
+    return sdscatlen(s, b, 4);
+}
+
+static sds put_id3_frame(sds s, unsigned version, const char *id, unsigned flags, const char *data, size_t len) {
+    s = sdscatlen(s, id, 4);
+    if (version == 4) {
+        unsigned char b[4] = {(unsigned char)((len >> 21) & 0x7f), (unsigned char)((len >> 14) & 0x7f),
+            (unsigned char)((len >> 7) & 0x7f), (unsigned char)(len & 0x7f)};
+        s = sdscatlen(s, b, 4);
+    }
+    else {
+        s = put_be32(s, (uint32_t)len);
+    }
+    unsigned char f[2] = {0, (unsigned char)flags};
+    s = sdscatlen(s, f, 2);
+    return sdscatlen(s, data, len);
+}
+
+//id3v2.3 or 2.4 tag with text frames, a large frame and the picture frame
+static sds test_id3_file(unsigned version, unsigned apic_flags, unsigned text_frames, size_t skip_len, const char *picture, size_t picture_len) {
+    sds frames = sdsempty();
+    for (unsigned i = 0; i < text_frames; i++) {
+        frames = put_id3_frame(frames, version, "TXXX", 0, "\x00" "key\x00" "some value", 15);
+    }
+    if (skip_len > 0) {
+        sds skip = sdsnewlen(NULL, skip_len);
+        memset(skip, 'x', skip_len);
+        frames = put_id3_frame(frames, version, "PRIV", 0, skip, skip_len);
+        sdsfree(skip);
+    }
+    sds apic = sdsnewlen("\x00" "image/png\x00" "\x03" "desc\x00", 17);
+    apic = sdscatlen(apic, picture, picture_len);
+    frames = put_id3_frame(frames, version, "APIC", apic_flags, apic, sdslen(apic));
+    sdsfree(apic);
+    size_t len = sdslen(frames);
+    unsigned char header[10] = {'I', 'D', '3', (unsigned char)version, 0, 0, (unsigned char)((len >> 21) & 0x7f),
+        (unsigned char)((len >> 14) & 0x7f), (unsigned char)((len >> 7) & 0x7f), (unsigned char)(len & 0x7f)};
+    sds file = sdsnewlen(header, 10);
+    file = sdscatsds(file, frames);
+    sdsfree(frames);
+    return file;
+}
+
+static sds test_flac_picture_block(const char *picture, size_t picture_len, bool last) {
+    sds block = sdsempty();
+    block = put_be32(block, 3);
+    block = put_be32(block, 9);
+    block = sdscat(block, "image/png");
+    block = put_be32(block, 0);
+    for (int i = 0; i < 4; i++) {
+        block = put_be32(block, 0);
+    }
+    block = put_be32(block, (uint32_t)picture_len);
+    block = sdscatlen(block, picture, picture_len);
+    size_t len = sdslen(block);
+    unsigned char header[4] = {(unsigned char)(6 | (last == true ? 0x80 : 0)), (unsigned char)(len >> 16),
+        (unsigned char)(len >> 8), (unsigned char)len};
+    sds result = sdsnewlen(header, 4);
+    result = sdscatsds(result, block);
+    sdsfree(block);
+    return result;
+}
+
+//streaminfo, a vorbis comment of comment_len bytes and the picture
+static sds test_flac_file(size_t comment_len, const char *picture, size_t picture_len) {
+    sds file = sdsnewlen("fLaC" "\x00\x00\x00\x22", 8);
+    file = sdsgrowzero(file, sdslen(file) + 34);
+    unsigned char header[4] = {4, (unsigned char)(comment_len >> 16), (unsigned char)(comment_len >> 8), (unsigned char)comment_len};
+    file = sdscatlen(file, header, 4);
+    file = sdsgrowzero(file, sdslen(file) + comment_len);
+    sds block = test_flac_picture_block(picture, picture_len, true);
+    file = sdscatsds(file, block);
+    sdsfree(block);
+    return file;
+}
+
+static sds put_ogg_page(sds s, const char *packet, size_t len) {
+    unsigned char segments[255];
+    unsigned count = 0;
+    size_t rest = len;
+    while (rest >= 255 && count < 254) {
+        segments[count++] = 255;
+        rest -= 255;
+    }
+    assert(rest < 255);
+    segments[count++] = (unsigned char)rest;
+    s = sdscatlen(s, "OggS", 4);
+    s = sdsgrowzero(s, sdslen(s) + 22);
+    unsigned char c = (unsigned char)count;
+    s = sdscatlen(s, &c, 1);
+    s = sdscatlen(s, segments, count);
+    return sdscatlen(s, packet, len);
+}
+
+//mapping header with streaminfo and the picture, each in its own page
+static sds test_ogg_file(const char *picture, size_t picture_len) {
+    sds packet = sdsnewlen("\x7f" "FLAC" "\x01\x00\x00\x01" "fLaC" "\x00\x00\x00\x22", 17);
+    packet = sdsgrowzero(packet, sdslen(packet) + 34);
+    sds file = put_ogg_page(sdsempty(), packet, sdslen(packet));
+    sdsfree(packet);
+    packet = test_flac_picture_block(picture, picture_len, true);
+    file = put_ogg_page(file, packet, sdslen(packet));
+    sdsfree(packet);
+    return file;
+}
+
+static void test_write_file(const char *path, const char *data, size_t len) {
+    FILE *fp = fopen(path, "w");
+    assert(fp);
+    if (len > 0) {
+        assert(fwrite(data, 1, len, fp) == len);
+    }
+    fclose(fp);
+}
+
+//type 0 = id3, 1 = flac, 2 = ogg flac
+static bool test_coverextract(const char *path, int type, sds *binary, sds *mime_type) {
+    sdsclear(*binary);
+    sdsclear(*mime_type);
+    return type == 0 ? coverextract_id3(path, binary, mime_type) : coverextract_flac(path, binary, mime_type, type == 2);
+}
+
+//the libid3tag and libFLAC fallbacks, type as above
+static bool test_coverextract_lib(const char *path, int type, sds *binary, sds *mime_type) {
+    sdsclear(*binary);
+    sdsclear(*mime_type);
+    return type == 0 ? coverextract_id3_lib(path, binary, mime_type) : coverextract_flac_lib(path, binary, mime_type, type == 2);
+}
+
+static long elapsed_us(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000 + (end.tv_nsec - start->tv_nsec) / 1000;
+}
+
+//the batch test sends only requests that fit in command lists
+t_work_result *mpd_client_api_response(t_config *config, t_mpd_client_state *mpd_client_state, t_work_request *request) {
+    (void) config;
+    (void) mpd_client_state;
+    t_work_result *response = create_result(request);
+    response->data = jsonrpc_respond_message(response->data, request->method, request->id, "Not a command list request", true);
+    return response;
+}
+
+//fake mpd: answers all commands with OK, in a command_list_ok_begin
+//list the playid command fails and the rest of the list is discarded
+static void *test_fake_mpd(void *arg) {
+    int fd = *(int *)arg;
+    FILE *fp = fdopen(dup(fd), "r");
+    assert(fp);
+    char line[256];
+    int list = 0;
+    bool failed = false;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strcmp(line, "command_list_begin\n") == 0 || strcmp(line, "command_list_ok_begin\n") == 0) {
+            list = strcmp(line, "command_list_begin\n") == 0 ? 1 : 2;
+            failed = false;
+        }
+        else if (strcmp(line, "command_list_end\n") == 0) {
+            if (failed == false) {
+                assert(write(fd, "OK\n", 3) == 3);
+            }
+            list = 0;
+        }
+        else if (list == 0) {
+            assert(write(fd, "OK\n", 3) == 3);
+        }
+        else if (failed == true) {
+            //mpd discards the commands after the failed one
+        }
+        else if (strncmp(line, "playid ", 7) == 0) {
+            const char *ack = "ACK [50@1] {playid} No such song\n";
+            assert(write(fd, ack, strlen(ack)) == (ssize_t)strlen(ack));
+            failed = true;
+        }
+        else if (list == 2) {
+            assert(write(fd, "list_OK\n", 8) == 8);
+        }
+    }
+    fclose(fp);
+    close(fd);
+    return NULL;
+}
+
+//runs the methods as one batch, returns the json-rpc response
+static sds test_mpd_client_batch(t_mpd_client_state *mpd_client_state, const char *methods[][2], int count) {
+    struct list *batch = (struct list *)malloc(sizeof(struct list));
+    assert(batch);
+    list_init(batch);
+    for (int i = 0; i < count; i++) {
+        sds data = sdscatprintf(sdsempty(), "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":%s}",
+            i, methods[i][0], methods[i][1]);
+        t_work_request *request = create_request(-1, i, get_cmd_id(methods[i][0]), methods[i][0], data);
+        sdsfree(data);
+        list_push(batch, "", 0, NULL, request);
+    }
+    t_work_request *request = create_request(-1, 0, MPD_API_BATCH, "MPD_API_BATCH", "");
+    request->extra = batch;
+    t_work_result *response = mpd_client_batch(NULL, mpd_client_state, request);
+    sds data = sdsdup(response->data);
+    free_result(response);
+    free_request(request);
+    return data;
+}
+
+static bool test_batch_element(struct json_token *element, const char *needle) {
+    return element->type == JSON_TYPE_OBJECT_END && memmem(element->ptr, (size_t)element->len, needle, strlen(needle)) != NULL;
+}
+
 int main(void) {
 //tests tiny queue
     thread_logname = sdsempty();
@@ -137,4 +395,340 @@ int main(void) {
     printf("Tail is: %s\n", test_list->tail->key);
     list_free(test_list);
     free(test_list);
+
+//test api params
+    const char *body = "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"MPD_API_QUEUE_LIST\","
+        "\"params\":{\"offset\":100,\"limit\":-1,\"searchstr\":\"a\\\"b\",\"cols\":[\"Pos\",\"Title\"],\"sortdesc\":true,\"sub\":{\"offset\":5}}}";
+    t_api_params *params = api_params_parse(body, (int)strlen(body));
+    long long_buf = 0;
+    unsigned uint_buf = 0;
+    bool bool_buf = false;
+    char *char_buf = NULL;
+    printf(params->valid == true ? "OK\n" : "ERROR\n");
+    printf(api_params_member_long(params, "id", &long_buf) == true && long_buf == 3 ? "OK\n" : "ERROR\n");
+    printf(api_param_uint(params, "offset", &uint_buf) == true && uint_buf == 100 ? "OK\n" : "ERROR\n");
+    printf(api_param_uint(params, "limit", &uint_buf) == false ? "OK\n" : "ERROR\n");
+    printf(api_param_bool(params, "sortdesc", &bool_buf) == true && bool_buf == true ? "OK\n" : "ERROR\n");
+    printf(api_param_string(params, "searchstr", &char_buf) == true && strcmp(char_buf, "a\"b") == 0 ? "OK\n" : "ERROR\n");
+    printf(api_param_string(params, "offset", &char_buf) == false ? "OK\n" : "ERROR\n");
+    const struct json_token *token = api_param_token(params, "cols");
+    printf(token != NULL && token->type == JSON_TYPE_ARRAY_END && strncmp(token->ptr, "[\"Pos\",\"Title\"]", token->len) == 0 ? "OK\n" : "ERROR\n");
+    //members of nested objects are not params
+    printf(api_param_token(params, "id") == NULL && api_params_member(params, "offset") == NULL ? "OK\n" : "ERROR\n");
+    unsigned pos = 0;
+    i = 0;
+    struct json_token key;
+    struct json_token val;
+    while (api_params_next(params, &pos, &key, &val) == true) {
+        i++;
+    }
+    printf(i == 6 ? "OK\n" : "ERROR\n");
+    api_params_free(params);
+    free(char_buf);
+    char_buf = NULL;
+    //invalid bodies
+    const char *invalid[] = {"", "[]", "{\"id\":", "{\"id\":}", "{\"a\":\"\\", "\"string\"", NULL};
+    for (i = 0; invalid[i] != NULL; i++) {
+        printf(api_params_validate(invalid[i], (int)strlen(invalid[i])) == false ? "OK\n" : "ERROR\n");
+    }
+    sds deep = sdsnew("{\"params\":");
+    for (i = 0; i < 10000; i++) {
+        deep = sdscatlen(deep, "[", 1);
+    }
+    printf(api_params_validate(deep, (int)sdslen(deep)) == false ? "OK\n" : "ERROR\n");
+    sdsfree(deep);
+    //json-rpc batches
+    struct json_token elements[API_BATCH_MAX_REQUESTS];
+    const char *batch = " [{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"MPD_API_QUEUE_CLEAR\",\"params\":{}}, 5, {\"a\":[1,2]}]";
+    int count = api_params_batch(batch, (int)strlen(batch), elements, API_BATCH_MAX_REQUESTS);
+    printf(count == 3 && elements[1].type == JSON_TYPE_NUMBER && elements[2].type == JSON_TYPE_OBJECT_END &&
+        strncmp(elements[2].ptr, "{\"a\":[1,2]}", elements[2].len) == 0 ? "OK\n" : "ERROR\n");
+    printf(api_params_batch("{}", 2, elements, API_BATCH_MAX_REQUESTS) == -1 &&
+        api_params_batch("[1,2,3]", 7, elements, 2) == -1 ? "OK\n" : "ERROR\n");
+    //fuzz the parser with truncated and mutated bodies
+    srand(1);
+    size_t body_len = strlen(body);
+    char *fuzz = malloc(body_len);
+    assert(fuzz);
+    int valid = 0;
+    for (i = 0; i < 100000; i++) {
+        memcpy(fuzz, body, body_len);
+        int fuzz_len = i % 2 == 0 ? (int)body_len : rand() % (int)body_len;
+        for (int j = rand() % 4; j >= 0; j--) {
+            fuzz[rand() % body_len] = (char)(rand() % 256);
+        }
+        params = api_params_parse(fuzz, fuzz_len);
+        if (params->valid == true) {
+            valid++;
+            api_params_member(params, "method");
+            api_param_string(params, "searchstr", &char_buf);
+            api_param_long(params, "offset", &long_buf);
+        }
+        api_params_free(params);
+    }
+    free(char_buf);
+    char_buf = NULL;
+    free(fuzz);
+    printf("Fuzzed parser, %d of %d bodies valid\nOK\n", valid, i);
+    //parse cost per method: one walk for all params vs. json_scanf
+    const char *bench[][2] = {
+        {"MPD_API_PLAYER_STATE", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"MPD_API_PLAYER_STATE\",\"params\":{}}"},
+        {"MPD_API_QUEUE_LIST", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"MPD_API_QUEUE_LIST\",\"params\":{\"offset\":0,\"limit\":100,"
+            "\"cols\":[\"Pos\",\"Title\",\"Artist\",\"Album\",\"Duration\"]}}"},
+        {"MPD_API_DATABASE_TAG_LIST", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"MPD_API_DATABASE_TAG_LIST\",\"params\":{\"offset\":0,"
+            "\"limit\":100,\"searchstr\":\"\",\"filter\":\"any\",\"sort\":\"AlbumArtist\",\"sortdesc\":false,\"tag\":\"AlbumArtist\"}}"},
+        {NULL, NULL}
+    };
+    for (i = 0; bench[i][0] != NULL; i++) {
+        int len = (int)strlen(bench[i][1]);
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < 10000; j++) {
+            params = api_params_parse(bench[i][1], len);
+            api_params_free(params);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long table_ns = ((end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec)) / 10000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < 10000; j++) {
+            //the web server scan and one handler scan
+            char *jsonrpc = NULL;
+            char *method = NULL;
+            json_scanf(bench[i][1], len, "{jsonrpc: %Q, method: %Q, id: %ld}", &jsonrpc, &method, &long_buf);
+            json_scanf(bench[i][1], len, "{params: {offset: %u, limit: %u, searchstr: %Q}}", &uint_buf, &uint_buf, &char_buf);
+            free(jsonrpc);
+            free(method);
+            free(char_buf);
+            char_buf = NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long scanf_ns = ((end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec)) / 10000;
+        printf("%s: params table %ld ns, json_scanf %ld ns\n", bench[i][0], table_ns, scanf_ns);
+    }
+
+//test json escaping
+    sds escaped = sdscatjson(sdsempty(), "a\"b\\c\nd<e\vf\x01g\x7fh\xc3\xa4", 17);
+    printf(strcmp(escaped, "\"a\\\"b\\\\c\\nd\\u003Cef\\u0001g\\u007fh\xc3\xa4\"") == 0 ? "OK\n" : "ERROR\n");
+    sdsfree(escaped);
+    //output of the vectorized and the scalar path must be the same for all lengths and positions
+    char escape_in[256];
+    bool escape_ok = true;
+    for (i = 0; i < 20000; i++) {
+        size_t escape_len = (size_t)(rand() % 80);
+        for (size_t j = 0; j < escape_len; j++) {
+            //mostly plain text with some special and multibyte characters
+            int r = rand() % 100;
+            escape_in[j] = r < 90 ? (char)(0x20 + rand() % 0x5f) : (char)(rand() % 256);
+        }
+        size_t offset = (size_t)(rand() % 16);
+        memmove(escape_in + offset, escape_in, escape_len);
+        escaped = sdscatjson(sdsempty(), escape_in + offset, escape_len);
+        sds reference = json_escape_reference(sdsempty(), escape_in + offset, escape_len);
+        if (sdslen(escaped) != sdslen(reference) || memcmp(escaped, reference, sdslen(escaped)) != 0) {
+            escape_ok = false;
+        }
+        sdsfree(escaped);
+        sdsfree(reference);
+    }
+    printf(escape_ok == true ? "OK\n" : "ERROR\n");
+    //throughput for typical tag values
+    const char *tags[] = {"Some Title Here", "The Artist Name feat. Another Artist", "Mötley Crüe",
+        "music/Artist/Album (2021) [FLAC]/01 - Some Title Here.flac", "Rock; Hard \"Rock\"", NULL};
+    size_t tags_len = 0;
+    for (i = 0; tags[i] != NULL; i++) {
+        tags_len += strlen(tags[i]);
+    }
+    for (int k = 0; k < 2; k++) {
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        escaped = sdsempty();
+        for (int j = 0; j < 100000; j++) {
+            sdsclear(escaped);
+            for (i = 0; tags[i] != NULL; i++) {
+                escaped = k == 0 ? sdscatjson(escaped, tags[i], strlen(tags[i])) :
+                    json_escape_reference(escaped, tags[i], strlen(tags[i]));
+            }
+        }
+        sdsfree(escaped);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double secs = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%s: %.0f MB/s\n", k == 0 ? "sdscatjson" : "byte by byte", (double)tags_len * 100000 / secs / 1e6);
+    }
+//test chunked responses
+    web_server_queue = tiny_queue_create();
+    for (i = 0; i < 3; i++) {
+        t_work_request *chunk_req = create_request(1, 0, MPD_API_QUEUE_LIST, "MPD_API_QUEUE_LIST", "");
+        response_chunk_begin(chunk_req);
+        sds chunk_buffer = sdsempty();
+        if (i < 2) {
+            chunk_buffer = sdsgrowzero(chunk_buffer, 70000);
+            chunk_buffer = response_chunk(chunk_buffer);
+        }
+        if (i > 0) {
+            response_chunk_abort();
+        }
+        t_work_result *chunk_res = create_result(chunk_req);
+        chunk_res->data = sdscat(chunk_res->data, "{\"jsonrpc\":\"2.0\",\"id\":0,\"error\":{}}");
+        response_chunk_end(chunk_res);
+        //the error object can only replace a response that is not already partly sent
+        enum response_chunk_types expected[] = {RESPONSE_LAST_CHUNK, RESPONSE_ABORT, RESPONSE_COMPLETE};
+        printf(chunk_res->chunk == expected[i] && tiny_queue_length(web_server_queue, 0) == (i < 2 ? 1U : 0U) ? "OK\n" : "ERROR\n");
+        t_work_result *chunk;
+        while ((chunk = tiny_queue_shift(web_server_queue, 50, 0)) != NULL) {
+            response_chunk_release(chunk->conn_id, 1);
+            free_result(chunk);
+        }
+        free_result(chunk_res);
+        free_request(chunk_req);
+        sdsfree(chunk_buffer);
+    }
+    tiny_queue_free(web_server_queue);
+
+//test cover extraction
+    char cover_path[] = "/tmp/mympd_test_coverXXXXXX";
+    int cover_fd = mkstemp(cover_path);
+    assert(cover_fd >= 0);
+    close(cover_fd);
+    const char picture[] = "\x89PNG\r\n\x1a\n-picture-data-";
+    size_t picture_len = sizeof(picture) - 1;
+    sds cover_binary = sdsempty();
+    sds cover_mime = sdsempty();
+    sds cover_files[4];
+    cover_files[0] = test_id3_file(3, 0, 3, 100, picture, picture_len);
+    cover_files[1] = test_id3_file(4, 0, 3, 200, picture, picture_len);
+    cover_files[2] = test_flac_file(100, picture, picture_len);
+    cover_files[3] = test_ogg_file(picture, picture_len);
+    int cover_types[4] = {0, 0, 1, 2};
+    for (i = 0; i < 4; i++) {
+        test_write_file(cover_path, cover_files[i], sdslen(cover_files[i]));
+        bool rc = test_coverextract(cover_path, cover_types[i], &cover_binary, &cover_mime);
+        printf(rc == true && sdslen(cover_binary) == picture_len && memcmp(cover_binary, picture, picture_len) == 0 &&
+            strcmp(cover_mime, "image/png") == 0 ? "OK\n" : "ERROR\n");
+    }
+    //grouped (2.3: 0x20, 2.4: 0x40), compressed and encrypted picture frames are not parsed
+    unsigned unsupported_flags[][2] = {{3, 0x20}, {3, 0x80}, {3, 0x40}, {4, 0x40}, {4, 0x08}, {4, 0x04}, {4, 0x02}};
+    for (i = 0; i < 7; i++) {
+        sds file = test_id3_file(unsupported_flags[i][0], unsupported_flags[i][1], 0, 0, picture, picture_len);
+        test_write_file(cover_path, file, sdslen(file));
+        printf(test_coverextract(cover_path, 0, &cover_binary, &cover_mime) == false ? "OK\n" : "ERROR\n");
+        sdsfree(file);
+    }
+    //truncated files, the picture is at the end of each file
+    bool truncated_ok = true;
+    for (i = 0; i < 4; i++) {
+        for (size_t len = 0; len < sdslen(cover_files[i]); len++) {
+            test_write_file(cover_path, cover_files[i], len);
+            if (test_coverextract(cover_path, cover_types[i], &cover_binary, &cover_mime) == true) {
+                truncated_ok = false;
+            }
+        }
+    }
+    printf(truncated_ok == true ? "OK\n" : "ERROR\n");
+    //malformed files: random bytes in the headers and the picture payload
+    srand(2);
+    int extracted = 0;
+    int mutations = 0;
+    for (i = 0; i < 4; i++) {
+        size_t len = sdslen(cover_files[i]);
+        sds file = sdsnewlen(NULL, len);
+        for (int j = 0; j < 3000; j++) {
+            memcpy(file, cover_files[i], len);
+            for (int k = rand() % 4; k >= 0; k--) {
+                file[rand() % len] = (char)(rand() % 256);
+            }
+            test_write_file(cover_path, file, len);
+            if (test_coverextract(cover_path, cover_types[i], &cover_binary, &cover_mime) == true) {
+                extracted++;
+            }
+            mutations++;
+        }
+        sdsfree(file);
+    }
+    printf("Fuzzed cover extraction, %d of %d files extracted\nOK\n", extracted, mutations);
+    for (i = 0; i < 4; i++) {
+        sdsfree(cover_files[i]);
+    }
+    //extraction from a tag with 500 text frames and a 2 MiB frame in front of a 256 KiB picture,
+    //compared to the library fallbacks if they are built
+    sds big_picture = sdsnewlen(NULL, 256 * 1024);
+    memset(big_picture, 'p', sdslen(big_picture));
+    const char *bench_names[] = {"id3v2.4", "flac"};
+    bool lib_built[] = {false, false};
+    #ifdef ENABLE_LIBID3TAG
+    lib_built[0] = true;
+    #endif
+    #ifdef ENABLE_FLAC
+    lib_built[1] = true;
+    #endif
+    for (i = 0; i < 2; i++) {
+        if (lib_built[i] == false) {
+            printf("%s: library not built, skipping benchmark\n", bench_names[i]);
+            continue;
+        }
+        sds file = i == 0 ? test_id3_file(4, 0, 500, 2 * 1024 * 1024, big_picture, sdslen(big_picture)) :
+            test_flac_file(2 * 1024 * 1024, big_picture, sdslen(big_picture));
+        test_write_file(cover_path, file, sdslen(file));
+        sds lib_binary = sdsempty();
+        sds lib_mime = sdsempty();
+        bool rc = test_coverextract(cover_path, i, &cover_binary, &cover_mime) == true &&
+            test_coverextract_lib(cover_path, i, &lib_binary, &lib_mime) == true;
+        printf(rc == true && sdscmp(cover_binary, lib_binary) == 0 && sdscmp(cover_mime, lib_mime) == 0 ? "OK\n" : "ERROR\n");
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < 200; j++) {
+            test_coverextract(cover_path, i, &cover_binary, &cover_mime);
+        }
+        long parser_us = elapsed_us(&start) / 200;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < 200; j++) {
+            test_coverextract_lib(cover_path, i, &lib_binary, &lib_mime);
+        }
+        long lib_us = elapsed_us(&start) / 200;
+        printf("%s: parser %ld us, library %ld us\n", bench_names[i], parser_us, lib_us);
+        sdsfree(lib_binary);
+        sdsfree(lib_mime);
+        sdsfree(file);
+    }
+    sdsfree(big_picture);
+    sdsfree(cover_binary);
+    sdsfree(cover_mime);
+    unlink(cover_path);
+
+//test command lists of json-rpc batches against a fake mpd
+    int mpd_fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, mpd_fds) == 0);
+    pthread_t fake_mpd_thread;
+    assert(pthread_create(&fake_mpd_thread, NULL, test_fake_mpd, &mpd_fds[1]) == 0);
+    t_mpd_client_state *mpd_client_state = (t_mpd_client_state *)calloc(1, sizeof(t_mpd_client_state));
+    assert(mpd_client_state);
+    mpd_client_state->mpd_state = (t_mpd_state *)calloc(1, sizeof(t_mpd_state));
+    assert(mpd_client_state->mpd_state);
+    mpd_shared_default_mpd_state(mpd_client_state->mpd_state);
+    mpd_client_state->mpd_state->conn = mpd_connection_new_async(mpd_async_new(mpd_fds[0]), "OK MPD 0.22.0");
+    assert(mpd_client_state->mpd_state->conn);
+    mpd_client_state->mpd_state->conn_state = MPD_CONNECTED;
+    //the second command fails, the commands after it are not executed
+    const char *failing[][2] = {{"MPD_API_QUEUE_CLEAR", "{}"}, {"MPD_API_PLAYER_PLAY_TRACK", "{\"track\":5}"},
+        {"MPD_API_PLAYER_STOP", "{}"}, {"MPD_API_PLAYER_NEXT", "{}"}};
+    sds batch_response = test_mpd_client_batch(mpd_client_state, failing, 4);
+    count = api_params_batch(batch_response, (int)sdslen(batch_response), elements, API_BATCH_MAX_REQUESTS);
+    printf(count == 4 && test_batch_element(&elements[0], "\"result\"") == true &&
+        test_batch_element(&elements[1], "No such song") == true &&
+        test_batch_element(&elements[2], "Not executed, a previous command failed") == true &&
+        test_batch_element(&elements[3], "Not executed, a previous command failed") == true ? "OK\n" : "ERROR\n");
+    sdsfree(batch_response);
+    //the connection is in sync after the failed list
+    const char *succeeding[][2] = {{"MPD_API_QUEUE_CLEAR", "{}"}, {"MPD_API_PLAYER_STOP", "{}"}};
+    batch_response = test_mpd_client_batch(mpd_client_state, succeeding, 2);
+    count = api_params_batch(batch_response, (int)sdslen(batch_response), elements, API_BATCH_MAX_REQUESTS);
+    printf(count == 2 && test_batch_element(&elements[0], "\"result\"") == true &&
+        test_batch_element(&elements[1], "\"result\"") == true &&
+        mpd_connection_get_error(mpd_client_state->mpd_state->conn) == MPD_ERROR_SUCCESS ? "OK\n" : "ERROR\n");
+    sdsfree(batch_response);
+    mpd_connection_free(mpd_client_state->mpd_state->conn);
+    pthread_join(fake_mpd_thread, NULL);
+    mpd_shared_free_mpd_state(mpd_client_state->mpd_state);
+    free(mpd_client_state);
 }